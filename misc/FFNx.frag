@@ -34,9 +34,24 @@ uniform vec4 FSAlphaFlags;
 uniform vec4 FSMiscFlags;
 uniform vec4 FSTexFlags;
 
+#ifdef FFNX_PERMUTATION
+// Specialized variant, the flags below are known at build time. See Renderer::getPermutation
+#ifdef FFNX_PERMUTATION_TLVERTEX
+#define isTLVertex true
+#else
+#define isTLVertex false
+#endif
+#define isFBTexture false
+#ifdef FFNX_PERMUTATION_TEXTURE
+#define isTexture true
+#else
+#define isTexture false
+#endif
+#else
 #define isTLVertex VSFlags.x > 0.0
 #define isFBTexture VSFlags.z > 0.0
 #define isTexture VSFlags.w > 0.0
+#endif
 // ---
 #define inAlphaRef FSAlphaFlags.x
 
@@ -48,12 +63,27 @@ uniform vec4 FSTexFlags;
 #define isAlphaNotEqual abs(FSAlphaFlags.y - 5.0) < 0.00001
 #define isAlphaGEqual abs(FSAlphaFlags.y - 6.0) < 0.00001
 
+#ifdef FFNX_PERMUTATION
+#ifdef FFNX_PERMUTATION_ALPHATEST
+#define doAlphaTest true
+#else
+#define doAlphaTest false
+#endif
+#else
 #define doAlphaTest FSAlphaFlags.z > 0.0
+#endif
 // ---
 #define isFullRange FSMiscFlags.x > 0.0
-#define isYUV FSMiscFlags.y > 0.0
 #define modulateAlpha FSMiscFlags.z > 0.0
+#ifdef FFNX_PERMUTATION
+#define isYUV false
+#define isMovie false
+#else
+#define isYUV FSMiscFlags.y > 0.0
 #define isMovie FSMiscFlags.w > 0.0
+#endif
+// ---
+#define isInterleavedUV FSTexFlags.w > 0.0
 
 void main()
 {
@@ -81,6 +111,9 @@ void main()
                 texture2D(tex_2, v_texcoord0.xy).r - 0.5
             );
 
+            // NV12 and P010 store U and V interleaved in a single two channel texture
+            if (isInterleavedUV) yuv.z = texture2D(tex_1, v_texcoord0.xy).g - 0.5;
+
             if (isFullRange) color.rgb = instMul(jpeg_rgb_transform, yuv);
             else color.rgb = instMul(mpeg_rgb_transform, yuv);
 
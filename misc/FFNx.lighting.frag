@@ -77,6 +77,7 @@ uniform vec4 iblData;
 #define isNmlTextureLoaded FSTexFlags.x > 0.0
 #define isPbrTextureLoaded FSTexFlags.y > 0.0
 #define isIblTextureLoaded FSTexFlags.z > 0.0
+#define isInterleavedUV FSTexFlags.w > 0.0
 
 void main()
 {
@@ -106,6 +107,9 @@ void main()
                 texture2D(tex_2, v_texcoord0.xy).r - 0.5
             );
 
+            // NV12 and P010 store U and V interleaved in a single two channel texture
+            if (isInterleavedUV) yuv.z = texture2D(tex_1, v_texcoord0.xy).g - 0.5;
+
             if (isFullRange) color.rgb = instMul(jpeg_rgb_transform, yuv);
             else color.rgb = instMul(mpeg_rgb_transform, yuv);
 
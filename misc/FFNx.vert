@@ -29,9 +29,19 @@ uniform mat4 d3dProjection;
 uniform mat4 worldView;
 
 uniform vec4 VSFlags;
-#define isTLVertex VSFlags.x > 0.0
 #define blendMode VSFlags.y
+#ifdef FFNX_PERMUTATION
+// Specialized variant, the flags below are known at build time. See Renderer::getPermutation
+#ifdef FFNX_PERMUTATION_TLVERTEX
+#define isTLVertex true
+#else
+#define isTLVertex false
+#endif
+#define isFBTexture false
+#else
+#define isTLVertex VSFlags.x > 0.0
 #define isFBTexture VSFlags.z > 0.0
+#endif
 
 void main()
 {
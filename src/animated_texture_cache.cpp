@@ -0,0 +1,156 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include "animated_texture_cache.h"
+#include "renderer.h"
+#include "cfg.h"
+#include "log.h"
+
+AnimatedTextureCache animatedTextureCache;
+
+// PRIVATE
+
+void AnimatedTextureCache::trim()
+{
+	auto it = lru.end();
+
+	while (bytes > budget && it != lru.begin())
+	{
+		--it;
+
+		Entry& entry = entries[*it];
+
+		if (entry.refs > 0) continue;
+
+		if (trace_all || trace_loaders) ffnx_trace("AnimatedTextureCache: evicting %s\n", it->c_str());
+
+		newRenderer.deleteTexture(entry.handle);
+		bytes -= entry.bytes;
+		evictions++;
+
+		entries.erase(*it);
+		it = lru.erase(it);
+	}
+}
+
+// PUBLIC
+
+std::string AnimatedTextureCache::getKey(const char* name, uint32_t palette_index, uint64_t hash)
+{
+	char key[1024]{ 0 };
+
+	_snprintf(key, sizeof(key), "%s_%02i_%llx", name, palette_index, hash);
+
+	return key;
+}
+
+void AnimatedTextureCache::setBudget(size_t maxBytes)
+{
+	budget = maxBytes;
+
+	trim();
+}
+
+uint32_t AnimatedTextureCache::acquire(const std::string& key)
+{
+	auto it = entries.find(key);
+
+	if (it == entries.end())
+	{
+		misses++;
+
+		return 0;
+	}
+
+	Entry& entry = it->second;
+
+	entry.refs++;
+	lru.splice(lru.begin(), lru, entry.lru);
+	hits++;
+
+	return entry.handle;
+}
+
+uint32_t AnimatedTextureCache::insert(const std::string& key, uint32_t handle, size_t size)
+{
+	auto it = entries.find(key);
+
+	// The same frame is already known, keep only one copy of it
+	if (it != entries.end())
+	{
+		newRenderer.deleteTexture(handle);
+
+		it->second.refs++;
+
+		return it->second.handle;
+	}
+
+	Entry& entry = entries[key];
+
+	lru.push_front(key);
+
+	entry.handle = handle;
+	entry.bytes = size;
+	entry.refs = 1;
+	entry.lru = lru.begin();
+
+	bytes += size;
+
+	trim();
+
+	return handle;
+}
+
+void AnimatedTextureCache::release(const std::string& key)
+{
+	auto it = entries.find(key);
+
+	if (it == entries.end()) return;
+
+	if (it->second.refs > 0) it->second.refs--;
+
+	trim();
+}
+
+size_t AnimatedTextureCache::getSize()
+{
+	return bytes;
+}
+
+size_t AnimatedTextureCache::getEntryCount()
+{
+	return entries.size();
+}
+
+uint32_t AnimatedTextureCache::getHits()
+{
+	return hits;
+}
+
+uint32_t AnimatedTextureCache::getMisses()
+{
+	return misses;
+}
+
+uint32_t AnimatedTextureCache::getEvictions()
+{
+	return evictions;
+}
@@ -0,0 +1,75 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+/*
+ * Keeps the external textures loaded for animated palettes alive across texture set unloads.
+ *
+ * Entries are keyed by texture name, palette index and hash of the converted image data,
+ * so the same animation frame is shared by every texture set showing it.
+ * Entries still referenced by a texture set are never evicted, the others are evicted
+ * least recently used first when the cache grows past its budget.
+ */
+class AnimatedTextureCache
+{
+private:
+	struct Entry
+	{
+		uint32_t handle = 0;
+		size_t bytes = 0;
+		uint32_t refs = 0;
+		std::list<std::string>::iterator lru;
+	};
+
+	std::unordered_map<std::string, Entry> entries;
+	std::list<std::string> lru;
+
+	size_t budget = 0;
+	size_t bytes = 0;
+
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t evictions = 0;
+
+	void trim();
+
+public:
+	static std::string getKey(const char* name, uint32_t palette_index, uint64_t hash);
+
+	void setBudget(size_t maxBytes);
+
+	uint32_t acquire(const std::string& key);
+	uint32_t insert(const std::string& key, uint32_t handle, size_t size);
+	void release(const std::string& key);
+
+	size_t getSize();
+	size_t getEntryCount();
+	uint32_t getHits();
+	uint32_t getMisses();
+	uint32_t getEvictions();
+};
+
+extern AnimatedTextureCache animatedTextureCache;
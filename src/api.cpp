@@ -20,6 +20,7 @@
 /****************************************************************************/
 
 #include "api.h"
+#include "video/movies.h"
 
 FFNX_API void __stdcall nxRegisterMouseListener(MouseListener* listener)
 {
@@ -30,3 +31,9 @@ FFNX_API void __stdcall nxRegisterKeyListener(KeyListener* listener)
 {
     keyListeners.push_back(listener);
 }
+
+// Decode a movie to raw frames without a window, for testing the movie decoder on its own
+FFNX_API uint32_t __stdcall nxDumpMovie(char* name, char* filename)
+{
+    return ffmpeg_dump_movie(name, filename);
+}
@@ -26,3 +26,4 @@
 
 FFNX_API void __stdcall nxRegisterMouseListener(MouseListener* listener);
 FFNX_API void __stdcall nxRegisterKeyListener(KeyListener* listener);
+FFNX_API uint32_t __stdcall nxDumpMovie(char* name, char* filename);
@@ -19,10 +19,13 @@
 //    GNU General Public License for more details.                          //
 /****************************************************************************/
 
+#include <charconv>
+
 #include "audio.h"
 
 #include "log.h"
 #include "gamehacks.h"
+#include "profiler.h"
 
 #if defined(__cplusplus)
 extern "C" {
@@ -38,9 +41,42 @@ NxAudioEngine nxAudioEngine;
 
 // PRIVATE
 
+static std::vector<std::string> get_rule_names(toml::array* array)
+{
+	std::vector<std::string> ret;
+
+	if (array && !array->empty() && array->is_homogeneous(toml::node_type::string))
+	{
+		for (auto&& item : *array) ret.push_back(std::string(item.value_or("")));
+	}
+
+	return ret;
+}
+
+static std::vector<int> get_rule_ids(toml::array* array)
+{
+	std::vector<int> ret;
+
+	if (array && !array->empty() && array->is_homogeneous(toml::node_type::integer))
+	{
+		for (auto&& item : *array) ret.push_back(int(item.value_or(0)));
+	}
+
+	return ret;
+}
+
+template <class T>
+const T* NxAudioEngine::findRule(const NxAudioEngineRuleMap<T>& rules, const char* name)
+{
+	auto it = rules.find(std::string_view(name));
+
+	return it == rules.end() ? nullptr : &it->second;
+}
+
 void NxAudioEngine::loadConfig()
 {
 	char _fullpath[MAX_PATH];
+	std::unique_ptr<NxAudioEngineRules> rules = std::make_unique<NxAudioEngineRules>();
 
 	for (int idx = NxAudioEngineLayer::NXAUDIOENGINE_SFX; idx <= NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT; idx++)
 	{
@@ -66,15 +102,114 @@ void NxAudioEngine::loadConfig()
 			break;
 		}
 
-		try
+		toml::table config;
+		struct stat dummy;
+
+		if (stat(_fullpath, &dummy) == 0)
 		{
-			nxAudioEngineConfig[type] = toml::parse_file(_fullpath);
+			try
+			{
+				config = toml::parse_file(_fullpath);
+			}
+			catch (const toml::parse_error &err)
+			{
+				ffnx_error("NxAudioEngine::%s: %s ( line %u ): %s, keeping the previous rules\n", __func__, _fullpath, err.source().begin.line, std::string(err.description()).c_str());
+
+				switch (type)
+				{
+				case NxAudioEngineLayer::NXAUDIOENGINE_SFX:
+					rules->sfx = _rules->sfx;
+					rules->sfxById = _rules->sfxById;
+					break;
+				case NxAudioEngineLayer::NXAUDIOENGINE_MUSIC:
+					rules->music = _rules->music;
+					break;
+				case NxAudioEngineLayer::NXAUDIOENGINE_VOICE:
+					rules->voice = _rules->voice;
+					break;
+				case NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT:
+					rules->ambient = _rules->ambient;
+					break;
+				}
+
+				continue;
+			}
 		}
-		catch (const toml::parse_error &err)
+
+		for (auto&& [key, value] : config)
 		{
-			nxAudioEngineConfig[type] = toml::parse("");
+			toml::table* node = value.as_table();
+			std::string name(key);
+
+			if (node == nullptr) continue;
+
+			switch (type)
+			{
+			case NxAudioEngineLayer::NXAUDIOENGINE_SFX:
+				{
+					NxAudioEngineSFXRule rule;
+
+					rule.shuffle = get_rule_ids((*node)["shuffle"].as_array());
+					rule.sequential = get_rule_ids((*node)["sequential"].as_array());
+					if (toml::value<bool>* loop = (*node)["loop"].as_boolean()) rule.loop = loop->get();
+					else rule.loop = (*node)["loop"].value_or(-1);
+					rule.preload = (*node)["preload"].value_or(false);
+
+					// Loop and preload flags are looked up by the id of the file itself
+					if (!name.empty() && name.find_first_not_of("0123456789") == std::string::npos)
+					{
+						int id = 0;
+						auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), id);
+
+						if (ec == std::errc() && end == name.data() + name.size()) rules->sfxById[id] = rule;
+						else ffnx_warning("NxAudioEngine::%s: SFX id %s is out of range, its loop and preload flags are ignored\n", __func__, name.c_str());
+					}
+
+					rules->sfx[name] = rule;
+				}
+				break;
+			case NxAudioEngineLayer::NXAUDIOENGINE_MUSIC:
+				{
+					NxAudioEngineMusicRule rule;
+
+					rule.offsetSeconds = (*node)["offset_seconds"].value<SoLoud::time>();
+					if (!rule.offsetSeconds.has_value()) rule.offsetSync = (*node)["offset_seconds"].value<std::string>() == "sync";
+					rule.noIntroTrack = (*node)["no_intro_track"].value<std::string>();
+					rule.introSeconds = (*node)["intro_seconds"].value<SoLoud::time>();
+					rule.shuffle = get_rule_names((*node)["shuffle"].as_array());
+					rule.disabled = (*node)["disabled"].value_or(false);
+					std::vector<std::string> prefetch = get_rule_names((*node)["prefetch"].as_array());
+					if (!prefetch.empty()) rule.prefetch = prefetch;
+
+					rules->music[name] = rule;
+				}
+				break;
+			case NxAudioEngineLayer::NXAUDIOENGINE_VOICE:
+				{
+					NxAudioEngineVoiceRule rule;
+
+					if (toml::value<int64_t>* volume = (*node)["volume"].as_integer()) rule.volume = volume->get() / 100.0f;
+
+					rules->voice[name] = rule;
+				}
+				break;
+			case NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT:
+				{
+					NxAudioEngineAmbientRule rule;
+
+					rule.shuffle = get_rule_names((*node)["shuffle"].as_array());
+					rule.sequential = get_rule_names((*node)["sequential"].as_array());
+					if (toml::value<double>* fadeIn = (*node)["fade_in"].as_floating_point()) rule.fadeIn = fadeIn->get();
+					if (toml::value<double>* fadeOut = (*node)["fade_out"].as_floating_point()) rule.fadeOut = fadeOut->get();
+
+					rules->ambient[name] = rule;
+				}
+				break;
+			}
 		}
 	}
+
+	_rules = std::move(rules);
 }
 
 template <class T>
@@ -131,9 +266,27 @@ bool NxAudioEngine::getFilenameFullPath(char *_out, T _key, NxAudioEngineLayer _
 
 bool NxAudioEngine::fileExists(const char* filename)
 {
-	struct stat dummy;
+	bool ret = false, indexed = false;
+
+	for (FileIndex& index : _fileIndex)
+	{
+		const std::string& root = index.getRoot();
+
+		if (!root.empty() && strncmp(filename, root.c_str(), root.length()) == 0 && filename[root.length()] == '/')
+		{
+			ret = index.exists(filename + root.length() + 1);
+			indexed = true;
+			break;
+		}
+	}
 
-	bool ret = (stat(filename, &dummy) == 0);
+	// Outside of any external path, e.g. music played by full path
+	if (!indexed)
+	{
+		struct stat dummy;
+
+		ret = (stat(filename, &dummy) == 0);
+	}
 
 	if (!ret && (trace_all || trace_music || trace_sfx || trace_voice || trace_ambient))
 		ffnx_warning("NxAudioEngine::%s: Could not find file %s\n", __func__, filename);
@@ -149,6 +302,11 @@ bool NxAudioEngine::init()
 	{
 		_engineInitialized = true;
 
+		_fileIndex[NxAudioEngineLayer::NXAUDIOENGINE_SFX].setRoot(std::string(basedir) + "/" + external_sfx_path);
+		_fileIndex[NxAudioEngineLayer::NXAUDIOENGINE_MUSIC].setRoot(std::string(basedir) + "/" + external_music_path);
+		_fileIndex[NxAudioEngineLayer::NXAUDIOENGINE_VOICE].setRoot(std::string(basedir) + "/" + external_voice_path);
+		_fileIndex[NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT].setRoot(std::string(basedir) + "/" + external_ambient_path);
+
 		// 100 -> LOG_LEVEL_ALL: https://github.com/vgmstream/vgmstream/blob/4cda04d02595b381dc8cf98ec39e771c80987d18/src/util/log.c#L20
 		if (trace_all || trace_ambient || trace_sfx || trace_music || trace_voice) vgm_log_set_callback(NULL, 100, 0, NxAudioEngineVgmstreamCallback);
 
@@ -169,6 +327,14 @@ bool NxAudioEngine::init()
 
 		for (int channel = 0; channel < _sfxTotalChannels; channel++) _sfxChannels[channel] = NxAudioEngineSFX();
 
+		if (use_external_sfx) preloadSFX();
+
+		if (use_external_music)
+		{
+			_musicLoaderRunning = true;
+			_musicLoaderThread = std::thread(&NxAudioEngine::musicLoaderWork, this);
+		}
+
 		return true;
 	}
 
@@ -205,6 +371,22 @@ void NxAudioEngine::flush()
 
 void NxAudioEngine::cleanup()
 {
+	if (_musicLoaderThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(_musicLoaderMutex);
+
+			_musicLoaderRunning = false;
+		}
+
+		_musicLoaderCondition.notify_all();
+		_musicLoaderThread.join();
+
+		for (NxAudioEngineMusicPrefetch& prefetch : _musicPrefetches) delete prefetch.stream;
+
+		_musicPrefetches.clear();
+	}
+
 	_engine.deinit();
 }
 
@@ -216,31 +398,35 @@ bool NxAudioEngine::canPlaySFX(int id)
 	return getFilenameFullPath<int>(filename, id, NxAudioEngineLayer::NXAUDIOENGINE_SFX);
 }
 
-SoLoud::VGMStream* NxAudioEngine::loadSFX(int id, bool loop)
+SoLoud::AudioSource* NxAudioEngine::loadSFX(int id, bool loop)
 {
-	int _curId = id - 1;
+	PROFILE_ZONE("NxAudioEngine::loadSFX");
 
 	if (_engineInitialized)
 	{
-		char filename[MAX_PATH];
+		auto rule = _rules->sfxById.find(id);
 
-		bool exists = getFilenameFullPath<int>(filename, id, NxAudioEngineLayer::NXAUDIOENGINE_SFX);
+		// Force loop if requested in the config
+		if (rule != _rules->sfxById.end() && rule->second.loop != -1) loop = rule->second.loop;
 
-		if (exists)
+		std::shared_ptr<const SoLoud::PcmBuffer> cached = getCachedSFX(id);
+
+		if (cached != nullptr)
 		{
-			std::string _id = std::to_string(id);
-			auto node = nxAudioEngineConfig[NxAudioEngineLayer::NXAUDIOENGINE_SFX][_id];
+			if (trace_all || trace_sfx) ffnx_trace("NxAudioEngine::%s: id=%d,loop=%d (cached)\n", __func__, id, loop);
 
-			if (node)
-			{
-				int shouldLoop = node["loop"].value_or(-1);
+			return new SoLoud::Pcm(cached, loop);
+		}
 
-				// Force loop if requested in the config
-				if (shouldLoop != -1) loop = shouldLoop;
-			}
+		char filename[MAX_PATH];
+
+		bool exists = getFilenameFullPath<int>(filename, id, NxAudioEngineLayer::NXAUDIOENGINE_SFX);
 
+		if (exists)
+		{
 			if (trace_all || trace_sfx) ffnx_trace("NxAudioEngine::%s: filename=%s,loop=%d\n", __func__, filename, loop);
 
+			auto start = std::chrono::steady_clock::now();
 			SoLoud::VGMStream* sfx = new SoLoud::VGMStream();
 
 			sfx->setLooping(loop);
@@ -252,6 +438,24 @@ SoLoud::VGMStream* NxAudioEngine::loadSFX(int id, bool loop)
 				return nullptr;
 			}
 
+			// Short enough to be kept in memory: decode it once, next plays will not touch the disk anymore
+			if (sfx_cache_max_seconds > 0.0 && sfx_cache_mb > 0 && sfx->getLength() <= sfx_cache_max_seconds)
+			{
+				std::shared_ptr<SoLoud::PcmBuffer> buffer = std::make_shared<SoLoud::PcmBuffer>();
+
+				if (buffer->decode(sfx->mStream))
+				{
+					delete sfx;
+
+					cacheSFX(id, buffer, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+
+					return new SoLoud::Pcm(buffer, loop);
+				}
+
+				// Could not be decoded in one go, stream it from the start as usual
+				reset_vgmstream(sfx->mStream);
+			}
+
 			return sfx;
 		}
 	}
@@ -259,6 +463,81 @@ SoLoud::VGMStream* NxAudioEngine::loadSFX(int id, bool loop)
 	return nullptr;
 }
 
+std::shared_ptr<const SoLoud::PcmBuffer> NxAudioEngine::getCachedSFX(int id)
+{
+	auto it = _sfxCache.find(id);
+
+	if (it == _sfxCache.end())
+	{
+		_sfxCacheMisses++;
+
+		return nullptr;
+	}
+
+	_sfxCacheHits++;
+	_sfxCacheTimeSaved += it->second.loadTime;
+
+	// Most recently used first
+	_sfxCacheLru.splice(_sfxCacheLru.begin(), _sfxCacheLru, it->second.lru);
+
+	return it->second.buffer;
+}
+
+void NxAudioEngine::cacheSFX(int id, std::shared_ptr<const SoLoud::PcmBuffer> buffer, std::chrono::microseconds loadTime)
+{
+	size_t budget = size_t(sfx_cache_mb) * 1024 * 1024;
+	size_t size = buffer->getSize();
+
+	if (size > budget || _sfxCache.count(id) > 0) return;
+
+	// Evict the least recently used sounds, channels still playing them keep their own reference to the samples
+	while (_sfxCacheSize + size > budget && !_sfxCacheLru.empty())
+	{
+		auto it = _sfxCache.find(_sfxCacheLru.back());
+
+		_sfxCacheSize -= it->second.buffer->getSize();
+		_sfxCache.erase(it);
+		_sfxCacheLru.pop_back();
+	}
+
+	_sfxCacheLru.push_front(id);
+	_sfxCache[id] = NxAudioEngineSFXCacheEntry{ buffer, _sfxCacheLru.begin(), loadTime };
+	_sfxCacheSize += size;
+
+	if (trace_all || trace_sfx) ffnx_trace("NxAudioEngine::%s: id=%d,size=%zu,load_time=%lldus,cache_size=%zu\n", __func__, id, size, loadTime.count(), _sfxCacheSize);
+}
+
+void NxAudioEngine::preloadSFX()
+{
+	if (sfx_cache_max_seconds <= 0.0 || sfx_cache_mb <= 0) return;
+
+	std::vector<int> ids;
+
+	for (const auto& [id, rule] : _rules->sfxById)
+	{
+		if (!rule.preload) continue;
+
+		if (id > 0) ids.push_back(id);
+
+		// Whatever may replace this id at playback time has to be warm as well
+		for (int alternativeId : rule.shuffle) if (alternativeId > 0) ids.push_back(alternativeId);
+		for (int alternativeId : rule.sequential) if (alternativeId > 0) ids.push_back(alternativeId);
+	}
+
+	for (int id : ids)
+	{
+		if (_sfxCache.count(id) > 0) continue;
+
+		// Decoding fills the cache, the source itself is not needed
+		delete loadSFX(id);
+	}
+
+	// Preloading does not count as a miss
+	_sfxCacheMisses = 0;
+
+	if (!ids.empty()) ffnx_info("NxAudioEngine::%s: %zu SFX preloaded (%zu KB)\n", __func__, _sfxCache.size(), _sfxCacheSize / 1024);
+}
+
 void NxAudioEngine::unloadSFX(int id)
 {
 	if (_sfxEffectsHandler.count(id) > 0)
@@ -288,6 +567,8 @@ void NxAudioEngine::unloadSFXChannel(int channel)
 
 bool NxAudioEngine::playSFX(const char* name, int id, int channel, float panning, bool loop)
 {
+	PROFILE_ZONE("NxAudioEngine::playSFX");
+
 	NxAudioEngineSFX *options = &_sfxChannels[channel - 1];
 	int _curId = id - 1;
 
@@ -315,30 +596,24 @@ bool NxAudioEngine::playSFX(const char* name, int id, int channel, float panning
 		unloadSFXChannel(channel);
 	}
 
-	auto node = nxAudioEngineConfig[NxAudioEngineLayer::NXAUDIOENGINE_SFX][name];
-	if (node)
+	const NxAudioEngineSFXRule* rule = findRule(_rules->sfx, name);
+	if (rule)
 	{
 		// Shuffle SFX playback, if any entry found for the current id
-		toml::array *shuffleIds = node["shuffle"].as_array();
-		if (shuffleIds && !shuffleIds->empty() && shuffleIds->is_homogeneous(toml::node_type::integer))
+		if (!rule->shuffle.empty())
 		{
-			auto _newId = shuffleIds->get(getRandomInt(0, shuffleIds->size() - 1));
-
-			_curId = _newId->value_or(id) - 1;
+			_curId = rule->shuffle[getRandomInt(0, rule->shuffle.size() - 1)] - 1;
 		}
 
 		// Sequentially playback new SFX ids, if any entry found for the current id
-		toml::array *sequentialIds = node["sequential"].as_array();
-		if (sequentialIds && !sequentialIds->empty() && sequentialIds->is_homogeneous(toml::node_type::integer))
+		if (!rule->sequential.empty())
 		{
-			if (_sfxSequentialIndexes.find(name) == _sfxSequentialIndexes.end() || _sfxSequentialIndexes[name] >= sequentialIds->size())
-				_sfxSequentialIndexes[name] = 0;
+			auto index = _sfxSequentialIndexes.find(name);
 
-			auto _newId = sequentialIds->get(_sfxSequentialIndexes[name]);
+			if (index == _sfxSequentialIndexes.end()) index = _sfxSequentialIndexes.emplace(name, 0).first;
+			if (index->second >= rule->sequential.size()) index->second = 0;
 
-			_sfxSequentialIndexes[name]++;
-
-			_curId = _newId->value_or(id) - 1;
+			_curId = rule->sequential[index->second++] - 1;
 		}
 	}
 
@@ -481,6 +756,31 @@ void NxAudioEngine::addSFXLazyUnloadChannel(int channel)
 	_sfxLazyUnloadChannels.push_back(channel);
 }
 
+size_t NxAudioEngine::getSFXCacheCount()
+{
+	return _sfxCache.size();
+}
+
+size_t NxAudioEngine::getSFXCacheSize()
+{
+	return _sfxCacheSize;
+}
+
+uint32_t NxAudioEngine::getSFXCacheHits()
+{
+	return _sfxCacheHits;
+}
+
+uint32_t NxAudioEngine::getSFXCacheMisses()
+{
+	return _sfxCacheMisses;
+}
+
+double NxAudioEngine::getSFXCacheTimeSaved()
+{
+	return _sfxCacheTimeSaved.count() / 1000.0;
+}
+
 // Music
 bool NxAudioEngine::canPlayMusic(const char* name)
 {
@@ -492,16 +792,146 @@ bool NxAudioEngine::canPlayMusic(const char* name)
 bool NxAudioEngine::isMusicDisabled(const char* name)
 {
 	char lowercaseName[MAX_PATH];
+	int i = 0;
 
 	// Name to lower case
-	for (int i = 0; name[i]; i++) {
+	for (; name[i] && i < MAX_PATH - 1; i++) {
 		lowercaseName[i] = tolower(name[i]);
 	}
+	lowercaseName[i] = '\0';
+
+	const NxAudioEngineMusicRule* rule = findRule(_rules->music, lowercaseName);
+
+	return rule && rule->disabled;
+}
+
+void NxAudioEngine::musicLoaderWork()
+{
+	profiler.setThreadName("Music loader");
+
+	std::unique_lock<std::mutex> lock(_musicLoaderMutex);
+
+	while (_musicLoaderRunning)
+	{
+		auto it = std::find_if(_musicPrefetches.begin(), _musicPrefetches.end(), [](const NxAudioEngineMusicPrefetch& prefetch) { return prefetch.state == NxAudioEngineMusicPrefetch::QUEUED; });
+
+		if (it == _musicPrefetches.end())
+		{
+			_musicLoaderCondition.wait(lock);
+			continue;
+		}
+
+		// Entries being loaded are never removed by the game thread, the iterator stays valid while unlocked
+		it->state = NxAudioEngineMusicPrefetch::LOADING;
+		std::string filename = it->filename, format = it->format;
+
+		lock.unlock();
+
+		PROFILE_ZONE("NxAudioEngine::musicLoaderWork");
+
+		auto start = std::chrono::steady_clock::now();
+		SoLoud::VGMStream* stream = new SoLoud::VGMStream();
+
+		if (stream->load(filename.c_str(), format.c_str()) == SoLoud::SO_NO_ERROR)
+		{
+			stream->preroll((unsigned int)(stream->mBaseSamplerate * NXAUDIOENGINE_MUSIC_PREROLL_MS / 1000));
+		}
+		else
+		{
+			// The game thread will try again and report the error
+			delete stream;
+			stream = nullptr;
+		}
+
+		auto openTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+		lock.lock();
+
+		it->stream = stream;
+		it->openTime = openTime;
+		it->state = NxAudioEngineMusicPrefetch::READY;
+
+		if (trace_all || trace_music) ffnx_trace("NxAudioEngine::%s: %s prefetched in %.1f ms\n", __func__, filename.c_str(), openTime.count() / 1000.0);
+
+		_musicLoaderCondition.notify_all();
+	}
+}
+
+void NxAudioEngine::prefetchMusic(const char* name)
+{
+	if (!_musicLoaderRunning) return;
+
+	char filename[MAX_PATH];
+
+	if (!getFilenameFullPath<const char*>(filename, name, NxAudioEngineLayer::NXAUDIOENGINE_MUSIC)) return;
+
+	// The PSX core is shared, PSF files are still opened on the game thread only
+	if (_openpsf_loaded && SoLoud::OpenPsf::is_our_path(filename)) return;
+
+	std::lock_guard<std::mutex> lock(_musicLoaderMutex);
+
+	for (const NxAudioEngineMusicPrefetch& prefetch : _musicPrefetches)
+	{
+		if (prefetch.filename == filename && prefetch.format.empty()) return;
+	}
+
+	// Make room by dropping the oldest prefetches, except the one being loaded
+	while (_musicPrefetches.size() >= NXAUDIOENGINE_MUSIC_PREFETCH_MAX)
+	{
+		auto it = std::find_if(_musicPrefetches.begin(), _musicPrefetches.end(), [](const NxAudioEngineMusicPrefetch& prefetch) { return prefetch.state != NxAudioEngineMusicPrefetch::LOADING; });
+
+		if (it == _musicPrefetches.end()) return;
+
+		delete it->stream;
+		_musicPrefetches.erase(it);
+	}
+
+	NxAudioEngineMusicPrefetch prefetch;
+	prefetch.filename = filename;
+	_musicPrefetches.push_back(prefetch);
+
+	if (trace_all || trace_music) ffnx_trace("NxAudioEngine::%s: %s\n", __func__, filename);
+
+	_musicLoaderCondition.notify_all();
+}
+
+void NxAudioEngine::prefetchMusicHints(const char* name)
+{
+	const NxAudioEngineMusicRule* rule = findRule(_rules->music, name);
 
-	toml::table config = nxAudioEngineConfig[NXAUDIOENGINE_MUSIC];
-	std::optional<bool> disabled = config[lowercaseName]["disabled"].value<bool>();
+	// Tracks without hints keep the previous ones, so battle music stays warm after a battle
+	if (rule && rule->prefetch.has_value()) _musicPrefetchHints = *rule->prefetch;
 
-	return disabled.has_value() && disabled;
+	for (const std::string& hint : _musicPrefetchHints) prefetchMusic(hint.c_str());
+}
+
+SoLoud::VGMStream* NxAudioEngine::takePrefetchedMusic(const char* filename, const char* format)
+{
+	std::unique_lock<std::mutex> lock(_musicLoaderMutex);
+
+	auto it = std::find_if(_musicPrefetches.begin(), _musicPrefetches.end(), [&](const NxAudioEngineMusicPrefetch& prefetch) {
+		return prefetch.filename == filename && prefetch.format == (format ? format : "");
+	});
+
+	if (it == _musicPrefetches.end()) return nullptr;
+
+	// Not started yet, opening it right now is faster than waiting for it
+	if (it->state == NxAudioEngineMusicPrefetch::QUEUED)
+	{
+		_musicPrefetches.erase(it);
+
+		return nullptr;
+	}
+
+	_musicLoaderCondition.wait(lock, [&] { return it->state == NxAudioEngineMusicPrefetch::READY; });
+
+	SoLoud::VGMStream* stream = it->stream;
+
+	if (trace_all || trace_music) ffnx_trace("NxAudioEngine::%s: %s was opened in %.1f ms by the loader thread\n", __func__, filename, it->openTime.count() / 1000.0);
+
+	_musicPrefetches.erase(it);
+
+	return stream;
 }
 
 void NxAudioEngine::cleanOldAudioSources()
@@ -524,6 +954,8 @@ void NxAudioEngine::cleanOldAudioSources()
 
 SoLoud::AudioSource* NxAudioEngine::loadMusic(const char* name, bool isFullPath, const char* format)
 {
+	PROFILE_ZONE("NxAudioEngine::loadMusic");
+
 	SoLoud::AudioSource* music = nullptr;
 	char filename[MAX_PATH];
 	bool exists = false;
@@ -545,7 +977,11 @@ SoLoud::AudioSource* NxAudioEngine::loadMusic(const char* name, bool isFullPath,
 
 		cleanOldAudioSources();
 
-		if (_openpsf_loaded && SoLoud::OpenPsf::is_our_path(filename)) {
+		auto start = std::chrono::steady_clock::now();
+
+		music = takePrefetchedMusic(filename, format);
+
+		if (music == nullptr && _openpsf_loaded && SoLoud::OpenPsf::is_our_path(filename)) {
 			SoLoud::OpenPsf* openpsf = new SoLoud::OpenPsf();
 			music = openpsf;
 
@@ -568,6 +1004,13 @@ SoLoud::AudioSource* NxAudioEngine::loadMusic(const char* name, bool isFullPath,
 				music = nullptr;
 			}
 		}
+
+		if (music != nullptr) {
+			double openTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			if (openTime >= NXAUDIOENGINE_MUSIC_SLOW_OPEN_MS) ffnx_warning("NxAudioEngine::%s: opening %s blocked the game for %.1f ms\n", __func__, filename, openTime);
+			else if (trace_all || trace_music) ffnx_trace("NxAudioEngine::%s: %s ready in %.1f ms\n", __func__, filename, openTime);
+		}
 	}
 
 	return music;
@@ -580,33 +1023,33 @@ void NxAudioEngine::overloadPlayArgumentsFromConfig(char* name, uint32_t* id, Mu
 		name[i] = tolower(name[i]);
 	}
 
-	toml::table config = nxAudioEngineConfig[NXAUDIOENGINE_MUSIC];
-	std::optional<SoLoud::time> offset_seconds_opt = config[name]["offset_seconds"].value<SoLoud::time>();
-	std::optional<std::string> no_intro_track_opt = config[name]["no_intro_track"].value<std::string>();
-	std::optional<SoLoud::time> intro_seconds_opt = config[name]["intro_seconds"].value<SoLoud::time>();
+	static const NxAudioEngineMusicRule noRule;
+	const NxAudioEngineMusicRule* rule = findRule(_rules->music, name);
 
-	if (offset_seconds_opt.has_value()) {
-		musicOptions->offsetSeconds = *offset_seconds_opt;
-	} else {
-		std::optional<std::string> offset_special_opt = config[name]["offset_seconds"].value<std::string>();
+	if (rule == nullptr) rule = &noRule;
 
-		if (offset_special_opt.has_value() && offset_special_opt->compare("sync") == 0) {
-			musicOptions->sync = true;
-		}
+	if (rule->offsetSeconds.has_value()) {
+		musicOptions->offsetSeconds = *rule->offsetSeconds;
+	} else if (rule->offsetSync) {
+		musicOptions->sync = true;
 	}
 
 	if (musicOptions->noIntro) {
-		if (no_intro_track_opt.has_value()) {
-			std::string no_intro_track = *no_intro_track_opt;
+		if (rule->noIntroTrack.has_value()) {
+			const std::string& no_intro_track = *rule->noIntroTrack;
 			if (trace_all || trace_music) ffnx_info("%s: replaced by no intro track %s\n", __func__, no_intro_track.c_str());
 
 			if (!no_intro_track.empty()) {
 				memcpy(name, no_intro_track.c_str(), no_intro_track.size());
 				name[no_intro_track.size()] = '\0';
+
+				// Further flags apply to the replacement track
+				rule = findRule(_rules->music, name);
+				if (rule == nullptr) rule = &noRule;
 			}
 		}
-		else if (intro_seconds_opt.has_value()) {
-			musicOptions->offsetSeconds = *intro_seconds_opt;
+		else if (rule->introSeconds.has_value()) {
+			musicOptions->offsetSeconds = *rule->introSeconds;
 		}
 		else {
 			ffnx_info("%s: cannot play no intro track, please configure it in %s/config.toml\n", __func__, external_music_path.c_str());
@@ -614,20 +1057,20 @@ void NxAudioEngine::overloadPlayArgumentsFromConfig(char* name, uint32_t* id, Mu
 	}
 
 	// Shuffle Music playback, if any entry found for the current music name
-	toml::array* shuffleNames = config[name]["shuffle"].as_array();
-	if (shuffleNames && !shuffleNames->empty() && shuffleNames->is_homogeneous(toml::node_type::string)) {
-		std::optional<std::string> _newName = shuffleNames->get(getRandomInt(0, shuffleNames->size() - 1))->value<std::string>();
-		if (_newName.has_value()) {
-			memcpy(name, (*_newName).c_str(), (*_newName).size());
-			name[(*_newName).size()] = '\0';
-
-			if (trace_all || trace_music) ffnx_info("%s: replaced by shuffle with %s\n", __func__, (*_newName).c_str());
-		}
+	if (!rule->shuffle.empty()) {
+		const std::string& _newName = rule->shuffle[getRandomInt(0, rule->shuffle.size() - 1)];
+
+		memcpy(name, _newName.c_str(), _newName.size());
+		name[_newName.size()] = '\0';
+
+		if (trace_all || trace_music) ffnx_info("%s: replaced by shuffle with %s\n", __func__, _newName.c_str());
 	}
 }
 
 bool NxAudioEngine::playMusic(const char* name, uint32_t id, int channel, MusicOptions options)
 {
+	PROFILE_ZONE("NxAudioEngine::playMusic");
+
 	if (trace_all || trace_music) ffnx_trace("NxAudioEngine::%s: %s (%d) on channel #%d\n", __func__, name, id, channel);
 
 	char overloadedName[MAX_PATH];
@@ -648,6 +1091,8 @@ bool NxAudioEngine::playMusic(const char* name, uint32_t id, int channel, MusicO
 	if ((isChannelValid(channel) && currentMusicId(channel) == id) || restore) {
 		resumeMusic(channel, options.fadetime == 0.0 ? 1.0 : options.fadetime, restore); // Slight fade
 
+		prefetchMusicHints(overloadedName);
+
 		return true;
 	}
 
@@ -682,6 +1127,8 @@ bool NxAudioEngine::playMusic(const char* name, uint32_t id, int channel, MusicO
 			setMusicVolume(music.wantedMusicVolume, channel, options.fadetime);
 		}
 
+		prefetchMusicHints(overloadedName);
+
 		return true;
 	}
 
@@ -991,21 +1438,19 @@ bool NxAudioEngine::canPlayVoice(const char* name)
 
 bool NxAudioEngine::playVoice(const char* name, int slot, float volume)
 {
+	PROFILE_ZONE("NxAudioEngine::playVoice");
+
 	char filename[MAX_PATH];
 
 	bool exists = getFilenameFullPath<const char *>(filename, name, NxAudioEngineLayer::NXAUDIOENGINE_VOICE);
 
 	_currentVoice[slot].volume = volume;
 
-	auto node = nxAudioEngineConfig[NxAudioEngineLayer::NXAUDIOENGINE_VOICE][name];
-	if (node)
+	// Set volume for the current track
+	const NxAudioEngineVoiceRule* rule = findRule(_rules->voice, name);
+	if (rule && rule->volume.has_value())
 	{
-		// Set volume for the current track
-		toml::node *trackVolume = node["volume"].as_integer();
-		if (trackVolume)
-		{
-			_currentVoice[slot].volume = trackVolume->value_or(100) / 100.0f;
-		}
+		_currentVoice[slot].volume = *rule->volume;
 	}
 
 	if (trace_all || trace_voice) ffnx_trace("NxAudioEngine::%s: %s\n", __func__, filename);
@@ -1099,6 +1544,8 @@ bool NxAudioEngine::canPlayAmbient(const char* name)
 
 bool NxAudioEngine::playAmbient(const char* name, float volume, double time)
 {
+	PROFILE_ZONE("NxAudioEngine::playAmbient");
+
 	char filename[MAX_PATH];
 	bool exists = false;
 
@@ -1107,49 +1554,42 @@ bool NxAudioEngine::playAmbient(const char* name, float volume, double time)
 	_currentAmbient.fade_out = 0.0f;
 	_currentAmbient.volume = 1.0f;
 
-	auto node = nxAudioEngineConfig[NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT][name];
-	if (node)
+	const NxAudioEngineAmbientRule* rule = findRule(_rules->ambient, name);
+	if (rule)
 	{
 		// Shuffle Ambient playback, if any entry found for the current id
-		toml::array *shuffleIds = node["shuffle"].as_array();
-		if (shuffleIds && !shuffleIds->empty() && shuffleIds->is_homogeneous(toml::node_type::string))
+		if (!rule->shuffle.empty())
 		{
-			auto _newName = shuffleIds->get(getRandomInt(0, shuffleIds->size() - 1));
+			const std::string& _newName = rule->shuffle[getRandomInt(0, rule->shuffle.size() - 1)];
 
-			exists = getFilenameFullPath<const char *>(filename, _newName->value_or(""), NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT);
+			exists = getFilenameFullPath<const char *>(filename, _newName.c_str(), NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT);
 		}
 
 		// Sequentially playback new Ambient ids, if any entry found for the current id
-		toml::array *sequentialIds = node["sequential"].as_array();
-		if (sequentialIds && !sequentialIds->empty() && sequentialIds->is_homogeneous(toml::node_type::string))
+		if (!rule->sequential.empty())
 		{
-			// If the key doesn't exist already, add it
-			if (_ambientSequentialIndexes.count(name) == 0) _ambientSequentialIndexes[name] = NULL;
+			auto index = _ambientSequentialIndexes.find(name);
 
-			if (_ambientSequentialIndexes.find(name) == _ambientSequentialIndexes.end() || _ambientSequentialIndexes[name] >= sequentialIds->size())
-				_ambientSequentialIndexes[name] = 0;
+			if (index == _ambientSequentialIndexes.end()) index = _ambientSequentialIndexes.emplace(name, 0).first;
+			if (index->second >= rule->sequential.size()) index->second = 0;
 
-			auto _newName = sequentialIds->get(_ambientSequentialIndexes[name]);
+			const std::string& _newName = rule->sequential[index->second++];
 
-			_ambientSequentialIndexes[name]++;
-
-			exists = getFilenameFullPath<const char *>(filename, _newName->value_or(""), NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT);
+			exists = getFilenameFullPath<const char *>(filename, _newName.c_str(), NxAudioEngineLayer::NXAUDIOENGINE_AMBIENT);
 		}
 
 		// Fade In time for this track, if configured
-		toml::node *fadeInTime = node["fade_in"].as_floating_point();
-		if (fadeInTime)
+		if (rule->fadeIn.has_value())
 		{
-			_currentAmbient.fade_in = fadeInTime->value_or(0.0f);
+			_currentAmbient.fade_in = *rule->fadeIn;
 
 			time = _currentAmbient.fade_in;
 		}
 
 		// Fade Out time for this track, if configured
-		toml::node *fadeOutTime = node["fade_out"].as_floating_point();
-		if (fadeOutTime)
+		if (rule->fadeOut.has_value())
 		{
-			_currentAmbient.fade_out = fadeOutTime->value_or(0.0f);
+			_currentAmbient.fade_out = *rule->fadeOut;
 		}
 	}
 	else
@@ -1316,4 +1756,33 @@ bool NxAudioEngine::isMovieAudioPlaying(int slot)
 void NxAudioEngine::setMovieAudioMaxSlots(int slot)
 {
 	_movieAudioMaxSlots = slot;
-}
\ No newline at end of file
+}
+
+// Misc
+void NxAudioEngine::reloadConfig()
+{
+	loadConfig();
+
+	// Sequences may have changed length or disappeared
+	_sfxSequentialIndexes.clear();
+	_ambientSequentialIndexes.clear();
+
+	// New preload rules take effect right away, entries already cached are skipped
+	if (use_external_sfx) preloadSFX();
+
+	ffnx_info("NxAudioEngine::%s: %zu SFX, %zu music, %zu voice and %zu ambient rules loaded\n", __func__, _rules->sfx.size(), _rules->music.size(), _rules->voice.size(), _rules->ambient.size());
+}
+
+size_t NxAudioEngine::getFileIndexCount()
+{
+	size_t ret = 0;
+
+	for (FileIndex& index : _fileIndex) ret += index.getFileCount();
+
+	return ret;
+}
+
+void NxAudioEngine::invalidateFileIndex()
+{
+	for (FileIndex& index : _fileIndex) index.invalidate();
+}
@@ -21,17 +21,33 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 #include <soloud.h>
 #include <soloud_wav.h>
 #include <soloud_wavstream.h>
 #include "audio/vgmstream/vgmstream.h"
+#include "audio/pcm/pcm.h"
+#include "file_index.h"
 #include "audio/openpsf/openpsf.h"
 
 #define NXAUDIOENGINE_INVALID_HANDLE 0xfffff000
+// Amount of music decoded ahead of time by the loader thread
+#define NXAUDIOENGINE_MUSIC_PREROLL_MS 300
+// Music prefetched but not played yet, the oldest are dropped first
+#define NXAUDIOENGINE_MUSIC_PREFETCH_MAX 4
+// Opening a music on the game thread for longer than this is reported
+#define NXAUDIOENGINE_MUSIC_SLOW_OPEN_MS 50
 
 static void NxAudioEngineVgmstreamCallback(int level, const char* str)
 {
@@ -72,7 +88,7 @@ public:
 		{}
 		int game_id;
 		int id;
-		SoLoud::VGMStream *stream;
+		SoLoud::AudioSource *stream;
 		SoLoud::handle handle;
 		float volume;
 		bool loop;
@@ -106,6 +122,30 @@ public:
 		SoLoud::AudioSource* audioSource;
 	};
 
+	struct NxAudioEngineMusicPrefetch
+	{
+		enum State
+		{
+			QUEUED,
+			LOADING,
+			READY
+		};
+
+		std::string filename;
+		std::string format;
+		State state = QUEUED;
+		SoLoud::VGMStream* stream = nullptr;
+		std::chrono::microseconds openTime = std::chrono::microseconds::zero();
+	};
+
+	struct NxAudioEngineSFXCacheEntry
+	{
+		std::shared_ptr<const SoLoud::PcmBuffer> buffer;
+		std::list<int>::iterator lru;
+		// What it cost to open, parse and decode the file the first time
+		std::chrono::microseconds loadTime;
+	};
+
 	struct NxAudioEngineVoice
 	{
 		NxAudioEngineVoice() :
@@ -151,6 +191,58 @@ private:
 		NXAUDIOENGINE_MOVIE_AUDIO,
 	};
 
+	// Lets rule tables be searched with a plain const char* without building a std::string
+	struct NxAudioEngineStringHash
+	{
+		using is_transparent = void;
+		size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+	};
+
+	template <class T>
+	using NxAudioEngineRuleMap = std::unordered_map<std::string, T, NxAudioEngineStringHash, std::equal_to<>>;
+
+	// Flags of each config.toml entry, validated once when the config is loaded
+	struct NxAudioEngineSFXRule
+	{
+		std::vector<int> shuffle;
+		std::vector<int> sequential;
+		int loop = -1; // -1 follows the file
+		bool preload = false;
+	};
+
+	struct NxAudioEngineMusicRule
+	{
+		std::optional<SoLoud::time> offsetSeconds;
+		bool offsetSync = false;
+		std::optional<std::string> noIntroTrack;
+		std::optional<SoLoud::time> introSeconds;
+		std::vector<std::string> shuffle;
+		bool disabled = false;
+		std::optional<std::vector<std::string>> prefetch;
+	};
+
+	struct NxAudioEngineVoiceRule
+	{
+		std::optional<float> volume;
+	};
+
+	struct NxAudioEngineAmbientRule
+	{
+		std::vector<std::string> shuffle;
+		std::vector<std::string> sequential;
+		std::optional<double> fadeIn;
+		std::optional<double> fadeOut;
+	};
+
+	struct NxAudioEngineRules
+	{
+		NxAudioEngineRuleMap<NxAudioEngineSFXRule> sfx;
+		std::unordered_map<int, NxAudioEngineSFXRule> sfxById; // Entries named after a plain SFX id
+		NxAudioEngineRuleMap<NxAudioEngineMusicRule> music;
+		NxAudioEngineRuleMap<NxAudioEngineVoiceRule> voice;
+		NxAudioEngineRuleMap<NxAudioEngineAmbientRule> ambient;
+	};
+
 	bool _engineInitialized = false;
 	SoLoud::Soloud _engine;
 	bool _openpsf_loaded = false;
@@ -160,11 +252,22 @@ private:
 	short _sfxTotalChannels = 0;
 	float _sfxMasterVolume = -1.0f;
 	std::map<int, NxAudioEngineSFX> _sfxChannels;
-	std::map<std::string, int> _sfxSequentialIndexes;
-	std::map<int, SoLoud::VGMStream*> _sfxEffectsHandler;
+	std::map<std::string, int, std::less<>> _sfxSequentialIndexes;
+	std::map<int, SoLoud::AudioSource*> _sfxEffectsHandler;
 	std::vector<short> _sfxLazyUnloadChannels;
 
-	SoLoud::VGMStream* loadSFX(int id, bool loop = false);
+	// Short SFX are decoded once and kept in memory, most recently used first
+	std::unordered_map<int, NxAudioEngineSFXCacheEntry> _sfxCache;
+	std::list<int> _sfxCacheLru;
+	size_t _sfxCacheSize = 0;
+	uint32_t _sfxCacheHits = 0;
+	uint32_t _sfxCacheMisses = 0;
+	std::chrono::microseconds _sfxCacheTimeSaved = std::chrono::microseconds::zero();
+
+	SoLoud::AudioSource* loadSFX(int id, bool loop = false);
+	std::shared_ptr<const SoLoud::PcmBuffer> getCachedSFX(int id);
+	void cacheSFX(int id, std::shared_ptr<const SoLoud::PcmBuffer> buffer, std::chrono::microseconds loadTime);
+	void preloadSFX();
 	void unloadSFXChannel(int channel);
 
 	// MUSIC
@@ -176,6 +279,18 @@ private:
 	float _musicMasterVolume = -1.0f;
 	SoLoud::time _lastVolumeFadeEndTime = 0.0;
 
+	// Music is opened and pre-rolled on the loader thread when it can be guessed ahead of time
+	std::thread _musicLoaderThread;
+	std::mutex _musicLoaderMutex;
+	std::condition_variable _musicLoaderCondition;
+	bool _musicLoaderRunning = false;
+	std::list<NxAudioEngineMusicPrefetch> _musicPrefetches;
+	std::vector<std::string> _musicPrefetchHints;
+
+	void musicLoaderWork();
+	void prefetchMusic(const char* name);
+	void prefetchMusicHints(const char* name);
+	SoLoud::VGMStream* takePrefetchedMusic(const char* filename, const char* format);
 	void cleanOldAudioSources();
 	SoLoud::AudioSource* loadMusic(const char* name, bool isFullPath = false, const char* format = nullptr);
 	void overloadPlayArgumentsFromConfig(char* name, uint32_t *id, MusicOptions *MusicOptions);
@@ -189,7 +304,7 @@ private:
 	std::map<int, NxAudioEngineVoice> _currentVoice;
 
 	// AMBIENT
-	std::map<std::string, int> _ambientSequentialIndexes;
+	std::map<std::string, int, std::less<>> _ambientSequentialIndexes;
 	NxAudioEngineAmbient _currentAmbient;
 
 	// MOVIE AUDIO
@@ -197,6 +312,9 @@ private:
 	std::map<int, NxAudioEngineMovieAudio> _currentMovieAudio;
 
 	// MISC
+	// In-memory view of each layer external path, so probing every candidate name and extension does not hit the disk
+	FileIndex _fileIndex[NXAUDIOENGINE_MOVIE_AUDIO];
+
 	// Returns false if the file does not exist
 	template <class T>
 	bool getFilenameFullPath(char *_out, T _key, NxAudioEngineLayer _type);
@@ -204,8 +322,11 @@ private:
 	bool fileExists(const char* filename);
 
 	// CFG
-	std::unordered_map<NxAudioEngineLayer,toml::parse_result> nxAudioEngineConfig;
+	// Rebuilt aside and swapped in at once by loadConfig, never modified in place
+	std::unique_ptr<const NxAudioEngineRules> _rules = std::make_unique<NxAudioEngineRules>();
 
+	template <class T>
+	static const T* findRule(const NxAudioEngineRuleMap<T>& rules, const char* name);
 	void loadConfig();
 
 public:
@@ -230,6 +351,11 @@ public:
 	void setSFXReusableChannels(short num);
 	void setSFXTotalChannels(short num);
 	void addSFXLazyUnloadChannel(int channel);
+	size_t getSFXCacheCount();
+	size_t getSFXCacheSize();
+	uint32_t getSFXCacheHits();
+	uint32_t getSFXCacheMisses();
+	double getSFXCacheTimeSaved();
 
 	// Music
 	bool canPlayMusic(const char* name);
@@ -278,6 +404,11 @@ public:
 	void stopMovieAudio(int slot = 0);
 	bool isMovieAudioPlaying(int slot = 0);
 	void setMovieAudioMaxSlots(int slot);
+
+	// Misc
+	void reloadConfig();
+	size_t getFileIndexCount();
+	void invalidateFileIndex();
 };
 
 extern NxAudioEngine nxAudioEngine;
@@ -0,0 +1,162 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include "pcm.h"
+
+#include <math.h>
+
+#define SOLOUD_PCM_DECODE_SAMPLES 4096
+
+namespace SoLoud
+{
+	bool PcmBuffer::decode(VGMSTREAM* aStream)
+	{
+		mChannels = aStream->channels;
+		mSamplerate = (float)aStream->sample_rate;
+		mLoopFlag = aStream->loop_flag;
+		// Anything after the loop end is never heard when the file loops by itself
+		mSampleCount = mLoopFlag ? aStream->loop_end_sample : aStream->num_samples;
+		mLoopStart = mLoopFlag ? aStream->loop_start_sample : 0;
+		mLoopEnd = mSampleCount;
+
+		if (mChannels == 0 || mSampleCount == 0 || mLoopStart >= mLoopEnd) return false;
+
+		mData.resize(size_t(mSampleCount) * mChannels);
+
+		reset_vgmstream(aStream);
+
+		for (unsigned int offset = 0; offset < mSampleCount; offset += SOLOUD_PCM_DECODE_SAMPLES)
+		{
+			unsigned int count = (mSampleCount - offset) > SOLOUD_PCM_DECODE_SAMPLES ? SOLOUD_PCM_DECODE_SAMPLES : mSampleCount - offset;
+
+			render_vgmstream(mData.data() + size_t(offset) * mChannels, count, aStream);
+		}
+
+		return true;
+	}
+
+	size_t PcmBuffer::getSize() const
+	{
+		return mData.size() * sizeof(sample_t);
+	}
+
+	PcmInstance::PcmInstance(Pcm* aParent)
+	{
+		mBuffer = aParent->mBuffer;
+
+		rewind();
+	}
+
+	unsigned int PcmInstance::getAudio(float* aBuffer, unsigned int aSamplesToRead, unsigned int aBufferSize)
+	{
+		const PcmBuffer& buffer = *mBuffer;
+		const sample_t* data = buffer.mData.data();
+		bool looping = mFlags & AudioSourceInstance::LOOPING;
+		unsigned int written = 0;
+
+		while (written < aSamplesToRead)
+		{
+			if (mOffset >= buffer.mLoopEnd)
+			{
+				if (!looping) break;
+
+				mOffset = buffer.mLoopStart;
+			}
+
+			unsigned int copylen = buffer.mLoopEnd - mOffset;
+			if (copylen > aSamplesToRead - written) copylen = aSamplesToRead - written;
+
+			for (unsigned int j = 0; j < copylen; j++)
+			{
+				for (unsigned int k = 0; k < mChannels; k++)
+				{
+					aBuffer[k * aSamplesToRead + written + j] = data[size_t(mOffset + j) * mChannels + k] / (float)INT16_MAX;
+				}
+			}
+
+			mOffset += copylen;
+			written += copylen;
+		}
+
+		// Silence whatever is left once a non looping sound reached its end
+		for (unsigned int k = 0; k < mChannels; k++)
+		{
+			for (unsigned int j = written; j < aSamplesToRead; j++) aBuffer[k * aSamplesToRead + j] = 0.0f;
+		}
+
+		return written;
+	}
+
+	result PcmInstance::rewind()
+	{
+		mOffset = 0;
+		mStreamPosition = 0.0f;
+		return SO_NO_ERROR;
+	}
+
+	result PcmInstance::seek(double aSeconds, float* mScratch, unsigned int mScratchSize)
+	{
+		unsigned int seek_samples = (unsigned int)floor(mBuffer->mSamplerate * aSeconds);
+
+		// Seeking past the end of a loop wraps around the loop, like vgmstream does
+		if (seek_samples >= mBuffer->mLoopEnd && (mFlags & AudioSourceInstance::LOOPING))
+		{
+			seek_samples = mBuffer->mLoopStart + (seek_samples - mBuffer->mLoopStart) % (mBuffer->mLoopEnd - mBuffer->mLoopStart);
+		}
+
+		mOffset = seek_samples < mBuffer->mLoopEnd ? seek_samples : mBuffer->mLoopEnd;
+		mStreamPosition = aSeconds;
+		return SO_NO_ERROR;
+	}
+
+	bool PcmInstance::hasEnded()
+	{
+		return !(mFlags & AudioSourceInstance::LOOPING) && mOffset >= mBuffer->mLoopEnd;
+	}
+
+	Pcm::Pcm(std::shared_ptr<const PcmBuffer> aBuffer, bool aLoop)
+	{
+		mBuffer = aBuffer;
+		mBaseSamplerate = aBuffer->mSamplerate;
+		mChannels = aBuffer->mChannels;
+
+		// Same rules as VGMStream: loop tags in the file always win, otherwise loop the whole sound if requested
+		if (aBuffer->mLoopFlag || aLoop) setLooping(true);
+	}
+
+	Pcm::~Pcm()
+	{
+		stop();
+	}
+
+	AudioSourceInstance* Pcm::createInstance()
+	{
+		return new PcmInstance(this);
+	}
+
+	double Pcm::getLength()
+	{
+		if (mBaseSamplerate == 0)
+			return 0;
+
+		return mBuffer->mSampleCount / mBaseSamplerate;
+	}
+};
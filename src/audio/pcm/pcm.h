@@ -0,0 +1,79 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <soloud.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <libvgmstream/vgmstream.h>
+
+#if defined(__cplusplus)
+}
+#endif
+
+namespace SoLoud
+{
+	// Fully decoded audio kept in memory, shared between every Pcm source playing it
+	struct PcmBuffer
+	{
+		std::vector<sample_t> mData; // Interleaved
+		unsigned int mChannels = 0;
+		float mSamplerate = 0.0f;
+		unsigned int mSampleCount = 0;
+		bool mLoopFlag = false;
+		unsigned int mLoopStart = 0;
+		unsigned int mLoopEnd = 0;
+
+		// Decodes the whole stream, up to the loop end when the file has loop tags. The stream is left at an undefined position.
+		bool decode(VGMSTREAM* aStream);
+		size_t getSize() const;
+	};
+
+	class Pcm : public AudioSource
+	{
+	public:
+		std::shared_ptr<const PcmBuffer> mBuffer;
+
+		Pcm(std::shared_ptr<const PcmBuffer> aBuffer, bool aLoop = false);
+		virtual ~Pcm();
+
+		virtual AudioSourceInstance* createInstance();
+		time getLength();
+	};
+
+	class PcmInstance : public AudioSourceInstance
+	{
+		std::shared_ptr<const PcmBuffer> mBuffer;
+		unsigned int mOffset;
+	public:
+		PcmInstance(Pcm* aParent);
+		virtual unsigned int getAudio(float* aBuffer, unsigned int aSamplesToRead, unsigned int aBufferSize);
+		virtual result rewind();
+		virtual result seek(double aSeconds, float* mScratch, unsigned int mScratchSize);
+		virtual bool hasEnded();
+	};
+};
@@ -0,0 +1,88 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOLOUD_VGMSTREAM_SSE2
+#endif
+
+namespace SoLoud
+{
+	// Scalar reference, converts the samples from aStart onwards, for any channel layout
+	inline void deinterleave_samples_scalar(float* aDst, unsigned int aPitch, const int16_t* aSrc, unsigned int aCount, unsigned int aChannels, unsigned int aStart = 0)
+	{
+		for (unsigned int k = 0; k < aChannels; k++)
+		{
+			float* dst = aDst + k * aPitch;
+			const int16_t* src = aSrc + k;
+
+			for (unsigned int s = aStart; s < aCount; s++)
+			{
+				dst[s] = src[s * aChannels] / (float)INT16_MAX;
+			}
+		}
+	}
+
+	// Converts interleaved int16 samples to one float plane per channel, planes being aPitch floats apart.
+	// The SIMD paths divide like the scalar one does, so the output is bit-exact whatever path is taken.
+	inline void deinterleave_samples(float* aDst, unsigned int aPitch, const int16_t* aSrc, unsigned int aCount, unsigned int aChannels)
+	{
+		unsigned int j = 0;
+
+#ifdef SOLOUD_VGMSTREAM_SSE2
+		const __m128 scale = _mm_set1_ps((float)INT16_MAX);
+
+		if (aChannels == 1)
+		{
+			for (; j + 8 <= aCount; j += 8)
+			{
+				__m128i in = _mm_loadu_si128((const __m128i*)(aSrc + j));
+				// Sign extend each int16 into the high half of an int32, then shift it back down
+				__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+				__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16));
+
+				_mm_storeu_ps(aDst + j, _mm_div_ps(lo, scale));
+				_mm_storeu_ps(aDst + j + 4, _mm_div_ps(hi, scale));
+			}
+		}
+		else if (aChannels == 2)
+		{
+			for (; j + 4 <= aCount; j += 4)
+			{
+				__m128i in = _mm_loadu_si128((const __m128i*)(aSrc + j * 2));
+				// L0 R0 L1 R1 and L2 R2 L3 R3
+				__m128 lo = _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16)), scale);
+				__m128 hi = _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16)), scale);
+
+				_mm_storeu_ps(aDst + j, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(aDst + aPitch + j, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+			}
+		}
+#endif
+
+		// Also takes care of the remaining samples
+		deinterleave_samples_scalar(aDst, aPitch, aSrc, aCount, aChannels, j);
+	}
+}
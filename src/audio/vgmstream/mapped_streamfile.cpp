@@ -0,0 +1,253 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_PATH PATH_MAX
+#define _stricmp strcmp
+#endif
+
+#include <atomic>
+#include <string.h>
+
+#include "mapped_streamfile.h"
+
+namespace SoLoud
+{
+#ifdef _WIN32
+	// Same layout as WIN32_MEMORY_RANGE_ENTRY, which is only declared when targeting Windows 8 and later
+	struct MappedMemoryRange
+	{
+		PVOID VirtualAddress;
+		SIZE_T NumberOfBytes;
+	};
+
+	typedef BOOL (WINAPI *PrefetchVirtualMemoryProc)(HANDLE, ULONG_PTR, MappedMemoryRange*, ULONG);
+#endif
+
+	static MappedBudget mapped_budget(MAPPED_STREAMFILE_MAX_TOTAL);
+
+	struct MappedFile
+	{
+		std::atomic<uint32_t> refs = 1;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int file = -1;
+#endif
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (data != nullptr) UnmapViewOfFile(data);
+			if (size > 0) mapped_budget.release(size);
+			if (mapping != nullptr) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+			if (data != nullptr) munmap((void*)data, size);
+			if (size > 0) mapped_budget.release(size);
+			if (file != -1) close(file);
+#endif
+		}
+	};
+
+	struct MappedStreamFile
+	{
+		STREAMFILE sf; // Must stay first, this is all vgmstream knows about
+		MappedFile* file;
+		char name[MAX_PATH];
+		MappedReadAhead readAhead;
+	};
+
+	static void mapped_read_ahead(MappedStreamFile* msf, size_t offset, size_t length)
+	{
+		if (offset >= msf->file->size) return;
+		if (length > msf->file->size - offset) length = msf->file->size - offset;
+
+#ifdef _WIN32
+		// Not available before Windows 8, pages are then faulted in by the reads themselves
+		static PrefetchVirtualMemoryProc prefetchVirtualMemory = (PrefetchVirtualMemoryProc)GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+
+		if (prefetchVirtualMemory != nullptr)
+		{
+			MappedMemoryRange range = { (PVOID)(msf->file->data + offset), length };
+
+			prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+		}
+#else
+		// The advised range has to start on a page
+		static size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+		size_t misalignment = offset % pageSize;
+
+		posix_madvise((void*)(msf->file->data + offset - misalignment), length + misalignment, POSIX_MADV_WILLNEED);
+#endif
+	}
+
+	// Offset types changed across vgmstream versions, let the compiler pick them from the STREAMFILE declaration
+	template <class Offset>
+	static size_t mapped_read(STREAMFILE* sf, uint8_t* dst, Offset offset, size_t length)
+	{
+		MappedStreamFile* msf = (MappedStreamFile*)sf;
+		size_t size = msf->file->size;
+
+		if (offset < 0 || size_t(offset) >= size || dst == nullptr) return 0;
+
+		size_t start = size_t(offset);
+
+		if (length > size - start) length = size - start;
+
+		msf->readAhead.read(start, start + length, [msf](size_t aOffset, size_t aLength) { mapped_read_ahead(msf, aOffset, aLength); });
+
+		memcpy(dst, msf->file->data + start, length);
+
+		return length;
+	}
+
+	static size_t mapped_get_size(STREAMFILE* sf)
+	{
+		return ((MappedStreamFile*)sf)->file->size;
+	}
+
+	template <class Offset>
+	static Offset mapped_get_offset(STREAMFILE* sf)
+	{
+		return 0;
+	}
+
+	static void mapped_get_name(STREAMFILE* sf, char* name, size_t length)
+	{
+		if (length == 0) return;
+
+		strncpy(name, ((MappedStreamFile*)sf)->name, length - 1);
+		name[length - 1] = '\0';
+	}
+
+	static STREAMFILE* mapped_create(MappedFile* file, const char* filename);
+
+	static STREAMFILE* mapped_open(STREAMFILE* sf, const char* const filename, size_t buffer_size)
+	{
+		MappedStreamFile* msf = (MappedStreamFile*)sf;
+
+		if (filename == nullptr) return nullptr;
+
+		// Decoders often reopen the file they are reading, the mapping can be shared
+		if (_stricmp(filename, msf->name) == 0)
+		{
+			msf->file->refs++;
+
+			return mapped_create(msf->file, filename);
+		}
+
+		return open_mapped_streamfile(filename);
+	}
+
+	static void mapped_close(STREAMFILE* sf)
+	{
+		MappedStreamFile* msf = (MappedStreamFile*)sf;
+
+		if (--msf->file->refs == 0) delete msf->file;
+
+		delete msf;
+	}
+
+	static STREAMFILE* mapped_create(MappedFile* file, const char* filename)
+	{
+		MappedStreamFile* msf = new MappedStreamFile{};
+
+		msf->sf.read = &mapped_read;
+		msf->sf.get_size = &mapped_get_size;
+		msf->sf.get_offset = &mapped_get_offset;
+		msf->sf.get_name = &mapped_get_name;
+		msf->sf.open = &mapped_open;
+		msf->sf.close = &mapped_close;
+		msf->file = file;
+		strncpy(msf->name, filename, MAX_PATH - 1);
+
+		msf->readAhead.open([msf](size_t aOffset, size_t aLength) { mapped_read_ahead(msf, aOffset, aLength); });
+
+		return &msf->sf;
+	}
+
+	// Maps the whole file and reserves its size in the budget, returns false when the file should be read through stdio instead
+	static bool mapped_map(MappedFile* file, const char* aFilename)
+	{
+#ifdef _WIN32
+		LARGE_INTEGER size;
+
+		file->file = CreateFileA(aFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (file->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->file, &size) || size.QuadPart == 0 || size.QuadPart > MAPPED_STREAMFILE_MAX_SIZE
+			|| !mapped_budget.reserve(size_t(size.QuadPart)))
+		{
+			return false;
+		}
+
+		// Reserved, given back by the destructor from now on
+		file->size = size_t(size.QuadPart);
+
+		file->mapping = CreateFileMappingA(file->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (file->mapping != nullptr) file->data = (const uint8_t*)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		struct stat st;
+
+		file->file = open(aFilename, O_RDONLY | O_CLOEXEC);
+
+		if (file->file == -1 || fstat(file->file, &st) != 0 || st.st_size == 0 || st.st_size > MAPPED_STREAMFILE_MAX_SIZE
+			|| !mapped_budget.reserve(size_t(st.st_size)))
+		{
+			return false;
+		}
+
+		// Reserved, given back by the destructor from now on
+		file->size = size_t(st.st_size);
+
+		void* data = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, file->file, 0);
+		if (data != MAP_FAILED) file->data = (const uint8_t*)data;
+#endif
+
+		return file->data != nullptr;
+	}
+
+	STREAMFILE* open_mapped_streamfile(const char* aFilename)
+	{
+		MappedFile* file = new MappedFile();
+
+		if (!mapped_map(file, aFilename))
+		{
+			delete file;
+
+			return open_stdio_streamfile(aFilename);
+		}
+
+		return mapped_create(file, aFilename);
+	}
+};
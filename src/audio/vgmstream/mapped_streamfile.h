@@ -0,0 +1,48 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <libvgmstream/vgmstream.h>
+
+#if defined(__cplusplus)
+}
+#endif
+
+#include "mapped_window.h"
+
+namespace SoLoud
+{
+	/*
+	 * Opens a file for vgmstream through a read-only memory mapping instead of buffered fread calls.
+	 *
+	 * Reads done by the decoder on the mixer thread are plain memcpy calls. A window of MAPPED_STREAMFILE_READ_AHEAD
+	 * bytes ahead of the last read is prefetched asynchronously by the OS, so the mixer does not wait on the disk
+	 * while the game is loading its own data. Companion files opened by vgmstream share the mapping when they are the same file.
+	 *
+	 * Falls back to the stdio streamfile when the file cannot be mapped.
+	 */
+	STREAMFILE* open_mapped_streamfile(const char* aFilename);
+};
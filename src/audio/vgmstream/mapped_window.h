@@ -0,0 +1,107 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+// Largest file mapped as a whole, bigger ones are read through stdio
+#define MAPPED_STREAMFILE_MAX_SIZE (128 * 1024 * 1024)
+// Address space all mapped files may use at once, this is a 32-bit process
+#define MAPPED_STREAMFILE_MAX_TOTAL (512 * 1024 * 1024)
+// How far ahead of the decoder the OS is asked to bring the file in memory
+#define MAPPED_STREAMFILE_READ_AHEAD (1024 * 1024)
+
+namespace SoLoud
+{
+	// Address space shared by all mapped files. Files are opened from the game thread and the music loader at the same time,
+	// reservations are made atomically so that they can never exceed the limit together
+	class MappedBudget
+	{
+	private:
+		std::atomic<size_t> mUsed = 0;
+		size_t mLimit;
+
+	public:
+		MappedBudget(size_t aLimit) : mLimit(aLimit) {}
+
+		bool reserve(size_t aSize)
+		{
+			size_t used = mUsed.load();
+
+			do
+			{
+				if (aSize > mLimit || used > mLimit - aSize) return false;
+			} while (!mUsed.compare_exchange_weak(used, used + aSize));
+
+			return true;
+		}
+
+		void release(size_t aSize)
+		{
+			mUsed -= aSize;
+		}
+
+		size_t getUsed()
+		{
+			return mUsed;
+		}
+	};
+
+	// Window of the file the OS was asked to prefetch, kept ahead of the reads of one decoder
+	struct MappedReadAhead
+	{
+		size_t mStart = 0;
+		size_t mEnd = 0;
+
+		// Headers are parsed right away, get the beginning of the file coming
+		template <class Prefetch>
+		void open(Prefetch aPrefetch)
+		{
+			mStart = 0;
+			mEnd = 2 * MAPPED_STREAMFILE_READ_AHEAD;
+
+			aPrefetch(size_t(0), mEnd);
+		}
+
+		// Called before reading [aStart, aEnd), aPrefetch(offset, length) is given what should be brought in memory next
+		template <class Prefetch>
+		void read(size_t aStart, size_t aEnd, Prefetch aPrefetch)
+		{
+			// The decoder jumped (loop, seek), start a new window from there
+			if (aStart < mStart || aStart > mEnd)
+			{
+				mStart = aStart;
+				mEnd = aStart + 2 * MAPPED_STREAMFILE_READ_AHEAD;
+
+				aPrefetch(aStart, size_t(2 * MAPPED_STREAMFILE_READ_AHEAD));
+			}
+			// Keep at least one window ahead of the decoder
+			else if (aEnd + MAPPED_STREAMFILE_READ_AHEAD > mEnd)
+			{
+				aPrefetch(mEnd, size_t(MAPPED_STREAMFILE_READ_AHEAD));
+
+				mEnd += MAPPED_STREAMFILE_READ_AHEAD;
+			}
+		}
+	};
+};
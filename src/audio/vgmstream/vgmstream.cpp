@@ -20,19 +20,38 @@
 /****************************************************************************/
 
 #include "vgmstream.h"
+#include "mapped_streamfile.h"
+#include "deinterleave.h"
+#include "../../profiler.h"
 
 #include <sys/stat.h>
+#include <string.h>
 
+// Samples per channel rendered by vgmstream in one go, bigger chunks mean less calls but a bigger scratch buffer
+#ifndef SOLOUD_VGMSTREAM_NUM_SAMPLES
 #define SOLOUD_VGMSTREAM_NUM_SAMPLES 512
+#endif
 
 namespace SoLoud
 {
+	static_assert(sizeof(sample_t) == sizeof(int16_t), "deinterleave_samples expects int16 samples");
+
 	VGMStreamInstance::VGMStreamInstance(VGMStream* aParent)
 	{
 		mParent = aParent;
 		mStreamBuffer = new sample_t[SOLOUD_VGMSTREAM_NUM_SAMPLES * aParent->mChannels];
 
-		rewind();
+		// The stream is already positioned right after the pre-rolled samples
+		if (!aParent->mPreroll.empty() && !aParent->mPrerollClaimed)
+		{
+			aParent->mPrerollClaimed = true;
+
+			mOffset = 0;
+			mStreamPosition = 0.0f;
+			mPrerollOffset = 0;
+			mPrerollCount = (unsigned int)aParent->mPreroll.size() / aParent->mChannels;
+		}
+		else rewind();
 	}
 
 	VGMStreamInstance::~VGMStreamInstance()
@@ -42,22 +61,30 @@ namespace SoLoud
 
 	unsigned int VGMStreamInstance::getAudio(float* aBuffer, unsigned int aSamplesToRead, unsigned int aBufferSize)
 	{
+		PROFILE_ZONE("VGMStream::getAudio");
+
 		unsigned int offset = mOffset;
-		unsigned int i, j, k;
 
-		for (i = 0; i < aSamplesToRead; i += SOLOUD_VGMSTREAM_NUM_SAMPLES)
+		for (unsigned int i = 0; i < aSamplesToRead; i += SOLOUD_VGMSTREAM_NUM_SAMPLES)
 		{
-			memset(mStreamBuffer, 0, sizeof(sample_t) * SOLOUD_VGMSTREAM_NUM_SAMPLES * mChannels);
 			unsigned int copylen = (aSamplesToRead - i) > SOLOUD_VGMSTREAM_NUM_SAMPLES ? SOLOUD_VGMSTREAM_NUM_SAMPLES : aSamplesToRead - i;
-			offset += (unsigned int)render_vgmstream(mStreamBuffer, copylen, mParent->mStream);
+			unsigned int rendered = 0;
 
-			for (j = 0; j < copylen; j++)
+			if (mPrerollOffset < mPrerollCount)
 			{
-				for (k = 0; k < mChannels; k++)
-				{
-					aBuffer[k * aSamplesToRead + i + j] = mStreamBuffer[(j * mChannels) + k] / (float)INT16_MAX;
-				}
+				rendered = (mPrerollCount - mPrerollOffset) > copylen ? copylen : mPrerollCount - mPrerollOffset;
+				memcpy(mStreamBuffer, mParent->mPreroll.data() + mPrerollOffset * mChannels, sizeof(sample_t) * rendered * mChannels);
+				mPrerollOffset += rendered;
 			}
+
+			if (rendered < copylen) rendered += (unsigned int)render_vgmstream(mStreamBuffer + rendered * mChannels, copylen - rendered, mParent->mStream);
+
+			// Only what vgmstream did not write needs to be silenced
+			if (rendered < copylen) memset(mStreamBuffer + rendered * mChannels, 0, sizeof(sample_t) * (copylen - rendered) * mChannels);
+
+			offset += rendered;
+
+			deinterleave_samples(aBuffer + i, aSamplesToRead, mStreamBuffer, copylen, mChannels);
 		}
 
 		mOffset = offset;
@@ -70,6 +97,7 @@ namespace SoLoud
 
 		mOffset = 0;
 		mStreamPosition = 0.0f;
+		mPrerollOffset = mPrerollCount = 0;
 		return SO_NO_ERROR;
 	}
 
@@ -79,6 +107,7 @@ namespace SoLoud
 
 		seek_vgmstream(mParent->mStream, seek_samples);
 
+		mPrerollOffset = mPrerollCount = 0;
 		mStreamPosition = aSeconds;
 		return SO_NO_ERROR;
 	}
@@ -95,6 +124,7 @@ namespace SoLoud
 	VGMStream::VGMStream()
 	{
 		mSampleCount = 0;
+		mPrerollClaimed = false;
 	}
 
 	VGMStream::~VGMStream()
@@ -104,16 +134,18 @@ namespace SoLoud
 		close_vgmstream(mStream);
 	}
 
-	VGMSTREAM* VGMStream::init_vgmstream_with_extension(const char* aFilename, const char* ext)
+	VGMSTREAM* VGMStream::init_vgmstream_from_file(const char* aFilename, const char* ext)
 	{
-		STREAMFILE* streamFile = open_stdio_streamfile(aFilename);
+		STREAMFILE* streamFile = open_mapped_streamfile(aFilename);
 		if (streamFile == nullptr) {
 			return nullptr;
 		}
 		// Force extension
-		streamFile = open_fakename_streamfile_f(streamFile, nullptr, ext);
-		if (streamFile == nullptr) {
-			return nullptr;
+		if (ext && ext[0] != '\0') {
+			streamFile = open_fakename_streamfile_f(streamFile, nullptr, ext);
+			if (streamFile == nullptr) {
+				return nullptr;
+			}
 		}
 		VGMSTREAM* stream = init_vgmstream_from_STREAMFILE(streamFile);
 		close_streamfile(streamFile);
@@ -133,12 +165,7 @@ namespace SoLoud
 
 		stop();
 
-		if (ext && ext[0] != '\0') {
-			mStream = init_vgmstream_with_extension(aFilename, ext);
-		}
-		else {
-			mStream = init_vgmstream(aFilename);
-		}
+		mStream = init_vgmstream_from_file(aFilename, ext);
 
 		if (mStream == nullptr) {
 			return FILE_LOAD_FAILED;
@@ -156,6 +183,17 @@ namespace SoLoud
 		return SO_NO_ERROR;
 	}
 
+	void VGMStream::preroll(unsigned int aSamples)
+	{
+		if (mStream == nullptr || mChannels == 0) return;
+
+		if (!(mFlags & AudioSourceInstance::LOOPING) && aSamples > mSampleCount) aSamples = mSampleCount;
+
+		mPreroll.resize(size_t(aSamples) * mChannels);
+		mPreroll.resize(size_t(render_vgmstream(mPreroll.data(), aSamples, mStream)) * mChannels);
+		mPrerollClaimed = false;
+	}
+
 	AudioSourceInstance* VGMStream::createInstance()
 	{
 		return new VGMStreamInstance(this);
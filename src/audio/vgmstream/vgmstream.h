@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <vector>
 #include <soloud.h>
 
 #if defined(__cplusplus)
@@ -37,16 +38,21 @@ namespace SoLoud
 {
 	class VGMStream : public AudioSource
 	{
-		static VGMSTREAM* init_vgmstream_with_extension(const char* aFilename, const char* ext);
+		static VGMSTREAM* init_vgmstream_from_file(const char* aFilename, const char* ext);
 	public:
 		VGMSTREAM* mStream;
 		unsigned int mSampleCount;
 
 		sample_t* mData;
 
+		// First samples decoded ahead of time, served by the first instance before it renders anything
+		std::vector<sample_t> mPreroll;
+		bool mPrerollClaimed;
+
 		VGMStream();
 		virtual ~VGMStream();
 		result load(const char* aFilename, const char* ext = nullptr);
+		void preroll(unsigned int aSamples);
 
 		virtual AudioSourceInstance* createInstance();
 		time getLength();
@@ -57,6 +63,8 @@ namespace SoLoud
 		sample_t* mStreamBuffer;
 		VGMStream* mParent;
 		unsigned int mOffset;
+		unsigned int mPrerollOffset;
+		unsigned int mPrerollCount;
 	public:
 		VGMStreamInstance(VGMStream* aParent);
 		virtual ~VGMStreamInstance();
@@ -33,6 +33,8 @@ std::vector<std::string> external_movie_audio_ext;
 bool use_external_sfx;
 std::string external_sfx_path;
 std::vector<std::string> external_sfx_ext;
+double sfx_cache_max_seconds;
+long sfx_cache_mb;
 bool use_external_music;
 bool external_music_resume;
 bool external_music_sync;
@@ -81,6 +83,9 @@ bool enable_vsync;
 bool mdef_fix;
 long enable_antialiasing;
 bool enable_anisotropic;
+bool enable_shader_permutations;
+bool enable_draw_batching;
+bool enable_texture_atlas;
 bool enable_lighting;
 bool prefer_lighting_cpu_calculations;
 bool ff7_external_opening_music;
@@ -88,6 +93,7 @@ bool skip_frames;
 bool ff7_more_debug;
 bool ff8_ssigpu_debug;
 bool show_applog;
+long log_max_lines_per_second;
 bool show_missing_textures;
 bool show_error_popup;
 bool movie_sync_debug;
@@ -101,12 +107,20 @@ std::string direct_mode_path;
 std::string save_path;
 bool enable_devtools;
 long devtools_hotkey;
+bool enable_profiler;
 double speedhack_step;
 double speedhack_max;
 double speedhack_min;
 bool enable_animated_textures;
 std::vector<std::string> disable_animated_textures_on_field;
 bool use_animated_textures_v2;
+long animated_textures_cache_mb;
+bool enable_texture_streaming;
+long texture_streaming_threads;
+long texture_streaming_max_inflight_mb;
+bool enable_texture_cache;
+std::string texture_cache_path;
+long texture_cache_threads;
 long ff7_fps_limiter;
 bool ff7_footsteps;
 bool enable_analogue_controls;
@@ -163,6 +177,8 @@ void read_cfg()
 	use_external_sfx = config["use_external_sfx"].value_or(false);
 	external_sfx_path = config["external_sfx_path"].value_or("");
 	external_sfx_ext = get_string_or_array_of_strings(config["external_sfx_ext"]);
+	sfx_cache_max_seconds = config["sfx_cache_max_seconds"].value_or(5.0);
+	sfx_cache_mb = config["sfx_cache_mb"].value_or(32);
 	use_external_music = config["use_external_music"].value_or(false);
 	external_music_resume = config["external_music_resume"].value_or(true);
 	external_music_sync = config["external_music_sync"].value_or(false);
@@ -211,6 +227,9 @@ void read_cfg()
 	mdef_fix = config["mdef_fix"].value_or(true);
 	enable_antialiasing = config["enable_antialiasing"].value_or(0);
 	enable_anisotropic = config["enable_anisotropic"].value_or(true);
+	enable_shader_permutations = config["enable_shader_permutations"].value_or(true);
+	enable_draw_batching = config["enable_draw_batching"].value_or(true);
+	enable_texture_atlas = config["enable_texture_atlas"].value_or(true);
 	enable_lighting = config["enable_lighting"].value_or(false);
 	prefer_lighting_cpu_calculations = config["prefer_lighting_cpu_calculations"].value_or(true);
 	ff7_external_opening_music = config["ff7_external_opening_music"].value_or(false);
@@ -218,6 +237,7 @@ void read_cfg()
 	ff7_more_debug = config["ff7_more_debug"].value_or(false);
 	ff8_ssigpu_debug = config["ff8_ssigpu_debug"].value_or(false);
 	show_applog = config["show_applog"].value_or(true);
+	log_max_lines_per_second = config["log_max_lines_per_second"].value_or(0);
 	show_missing_textures = config["show_missing_textures"].value_or(false);
 	show_error_popup = config["show_error_popup"].value_or(false);
 	movie_sync_debug = config["movie_sync_debug"].value_or(false);
@@ -231,12 +251,20 @@ void read_cfg()
 	save_path = config["save_path"].value_or("");
 	enable_devtools = config["enable_devtools"].value_or(false);
 	devtools_hotkey = config["devtools_hotkey"].value_or(VK_F12);
+	enable_profiler = config["enable_profiler"].value_or(false);
 	speedhack_step = config["speedhack_step"].value_or(0.5);
 	speedhack_max = config["speedhack_max"].value_or(8.0);
 	speedhack_min = config["speedhack_min"].value_or(1.0);
 	enable_animated_textures = config["enable_animated_textures"].value_or(false);
 	disable_animated_textures_on_field = get_string_or_array_of_strings(config["disable_animated_textures_on_field"]);
 	use_animated_textures_v2 = config["use_animated_textures_v2"].value_or(false);
+	animated_textures_cache_mb = config["animated_textures_cache_mb"].value_or(256);
+	enable_texture_streaming = config["enable_texture_streaming"].value_or(false);
+	texture_streaming_threads = config["texture_streaming_threads"].value_or(2);
+	texture_streaming_max_inflight_mb = config["texture_streaming_max_inflight_mb"].value_or(256);
+	enable_texture_cache = config["enable_texture_cache"].value_or(false);
+	texture_cache_path = config["texture_cache_path"].value_or("");
+	texture_cache_threads = config["texture_cache_threads"].value_or(1);
 	ff7_fps_limiter = config["ff7_fps_limiter"].value_or(FF7_LIMITER_DEFAULT);
 	ff7_footsteps = config["ff7_footsteps"].value_or(false);
 	enable_analogue_controls = config["enable_analogue_controls"].value_or(false);
@@ -255,6 +283,13 @@ void read_cfg()
 	if (external_voice_music_fade_volume < 0) external_voice_music_fade_volume = 0;
 	if (external_voice_music_fade_volume > 100) external_voice_music_fade_volume = 100;
 
+	if (animated_textures_cache_mb < 0) animated_textures_cache_mb = 0;
+
+	// Texture streaming needs at least one worker and some room to decode
+	if (texture_streaming_threads < 1) texture_streaming_threads = 1;
+	if (texture_streaming_max_inflight_mb < 16) texture_streaming_max_inflight_mb = 16;
+	if (texture_cache_threads < 1) texture_cache_threads = 1;
+
 
 	// #############
 	// SAFE DEFAULTS
@@ -394,4 +429,8 @@ void read_cfg()
 	// MOD EXTENSION
 	if (mod_ext.empty() || mod_ext.front().empty())
 		mod_ext = {"dds", "png"};
+
+	// TEXTURE CACHE PATH
+	if (texture_cache_path.empty())
+		texture_cache_path = "cache/textures";
 }
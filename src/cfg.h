@@ -32,6 +32,8 @@
 #define RENDERER_BACKEND_DIRECT3D11 3
 #define RENDERER_BACKEND_DIRECT3D12 4
 #define RENDERER_BACKEND_VULKAN 5
+// Renders nothing, used by the replay tool
+#define RENDERER_BACKEND_NOOP 6
 
 #define FF7_LIMITER_ORIGINAL 0
 #define FF7_LIMITER_DEFAULT 1
@@ -46,6 +48,8 @@ extern std::vector<std::string> external_movie_audio_ext;
 extern bool use_external_sfx;
 extern std::string external_sfx_path;
 extern std::vector<std::string> external_sfx_ext;
+extern double sfx_cache_max_seconds;
+extern long sfx_cache_mb;
 extern bool use_external_music;
 extern bool external_music_resume;
 extern bool external_music_sync;
@@ -94,6 +98,9 @@ extern bool enable_vsync;
 extern bool mdef_fix;
 extern long enable_antialiasing;
 extern bool enable_anisotropic;
+extern bool enable_shader_permutations;
+extern bool enable_draw_batching;
+extern bool enable_texture_atlas;
 extern bool enable_lighting;
 extern bool prefer_lighting_cpu_calculations;
 extern bool ff7_external_opening_music;
@@ -101,6 +108,7 @@ extern bool skip_frames;
 extern bool ff7_more_debug;
 extern bool ff8_ssigpu_debug;
 extern bool show_applog;
+extern long log_max_lines_per_second;
 extern bool show_missing_textures;
 extern bool show_error_popup;
 extern bool movie_sync_debug;
@@ -114,12 +122,20 @@ extern std::string direct_mode_path;
 extern std::string save_path;
 extern bool enable_devtools;
 extern long devtools_hotkey;
+extern bool enable_profiler;
 extern double speedhack_step;
 extern double speedhack_max;
 extern double speedhack_min;
 extern bool enable_animated_textures;
 extern std::vector<std::string> disable_animated_textures_on_field;
 extern bool use_animated_textures_v2;
+extern long animated_textures_cache_mb;
+extern bool enable_texture_streaming;
+extern long texture_streaming_threads;
+extern long texture_streaming_max_inflight_mb;
+extern bool enable_texture_cache;
+extern std::string texture_cache_path;
+extern long texture_cache_threads;
 extern long ff7_fps_limiter;
 extern bool ff7_footsteps;
 extern bool enable_analogue_controls;
@@ -39,6 +39,12 @@
 #include "music.h"
 #include "sfx.h"
 #include "saveload.h"
+#include "texture_streamer.h"
+#include "texture_cache.h"
+#include "animated_texture_cache.h"
+#include "frame_limiter.h"
+#include "profiler.h"
+#include "draw_capture.h"
 #include "gamepad.h"
 #include "joystick.h"
 #include "input.h"
@@ -431,6 +437,13 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 			gl_cleanup_deferred();
 
+			textureStreamer.shutdown();
+			textureCache.shutdown();
+
+			hextPatcher.shutdown();
+
+			frameLimiter.shutdown();
+
 			newRenderer.shutdown();
 
 			SetWindowLongA(gameHwnd, GWL_WNDPROC, (LONG)common_externals.engine_wndproc);
@@ -637,6 +650,9 @@ int common_create_window(HINSTANCE hInstance, struct game_obj* game_object)
 				replace_function((uint32_t)common_externals.assert_calloc, ext_calloc);
 #endif
 
+				// Init profiler, before the renderer which reports its own zones
+				profiler.init(enable_profiler);
+
 				// Init renderer
 				newRenderer.init();
 
@@ -649,6 +665,12 @@ int common_create_window(HINSTANCE hInstance, struct game_obj* game_object)
 				newRenderer.prepareEnvBrdf();
 
 				// perform any additional initialization that requires the rendering environment to be set up
+				saveload_init();
+				animatedTextureCache.setBudget(animated_textures_cache_mb * 1024 * 1024);
+				if (enable_texture_streaming)
+					textureStreamer.init(texture_streaming_threads, texture_streaming_max_inflight_mb * 1024 * 1024);
+				if (enable_texture_cache)
+					textureCache.init(std::string(basedir) + "/" + texture_cache_path, texture_cache_threads);
 				field_init();
 				world_init();
 				music_init();
@@ -728,6 +750,8 @@ void common_cleanup(struct game_obj *game_object)
 	}
 
 	nxAudioEngine.cleanup();
+
+	close_applog();
 }
 
 // unused and unnecessary
@@ -750,6 +774,12 @@ uint32_t common_unlock(uint32_t surface)
 // buffers
 void common_flip(struct game_obj *game_object)
 {
+	// close the previous frame before timing this one
+	profiler.frame();
+	drawCapture.frame();
+
+	PROFILE_ZONE("common_flip");
+
 	if (trace_all) ffnx_trace("dll_gfx: flip (%i)\n", frame_counter);
 
 	VOBJ(game_obj, game_object, game_object);
@@ -803,12 +833,24 @@ void common_flip(struct game_obj *game_object)
 			gl_draw_text(col, row++, color, 255, "RAM usage: %llu MB / %llu MB", (last_ram_state.ullTotalVirtual - last_ram_state.ullAvailVirtual) / (1024 * 1024), last_ram_state.ullTotalVirtual / ( 1024 * 1024 ));
 			gl_draw_text(col, row++, color, 255, "Textures: %u", stats.texture_count);
 			gl_draw_text(col, row++, color, 255, "External textures: %u", stats.external_textures);
+			if (textureStreamer.isEnabled()) gl_draw_text(col, row++, color, 255, "Streaming textures: %u (%zu MB)", textureStreamer.getPendingCount(), textureStreamer.getInFlightBytes() / (1024 * 1024));
+			if (textureCache.isEnabled()) gl_draw_text(col, row++, color, 255, "Texture cache: %u hits, %u transcoded (%u pending)", textureCache.getHitCount(), textureCache.getTranscodedCount(), textureCache.getPendingCount());
+			if (enable_animated_textures) gl_draw_text(col, row++, color, 255, "Animated texture cache: %zu MB, %u hits, %u misses, %u evictions", animatedTextureCache.getSize() / (1024 * 1024), animatedTextureCache.getHits(), animatedTextureCache.getMisses(), animatedTextureCache.getEvictions());
+			if (use_external_sfx && sfx_cache_max_seconds > 0.0) gl_draw_text(col, row++, color, 255, "SFX cache: %zu sounds (%zu KB), %u hits, %u misses, %.1f ms saved", nxAudioEngine.getSFXCacheCount(), nxAudioEngine.getSFXCacheSize() / 1024, nxAudioEngine.getSFXCacheHits(), nxAudioEngine.getSFXCacheMisses(), nxAudioEngine.getSFXCacheTimeSaved());
 			gl_draw_text(col, row++, color, 255, "Texture reloads: %u", stats.texture_reloads);
 			gl_draw_text(col, row++, color, 255, "Palette writes: %u", stats.palette_writes);
 			gl_draw_text(col, row++, color, 255, "Palette changes: %u", stats.palette_changes);
 			gl_draw_text(col, row++, color, 255, "Zsort layers: %u", stats.deferred);
 			gl_draw_text(col, row++, color, 255, "Vertices: %u", stats.vertex_count);
+			gl_draw_text(col, row++, color, 255, "Uniforms: %u KB submitted, %u KB skipped", newRenderer.getUniformBytesSubmitted() / 1024, newRenderer.getUniformBytesSkipped() / 1024);
+			gl_draw_text(col, row++, color, 255, "Submits: %u ( %u before batching )", newRenderer.getSubmitCount(), newRenderer.getSubmitCount() + newRenderer.getMergedDrawCount());
 			gl_draw_text(col, row++, color, 255, "Timer: %I64u", stats.timer);
+			if (frameLimiter.getFrameCount() > 0)
+			{
+				const uint32_t* histogram = frameLimiter.getHistogram();
+
+				gl_draw_text(col, row++, color, 255, "Frame pacing: %.0f%% asleep, late <0.1/0.25/0.5/1/2/4/4+ ms: %u %u %u %u %u %u %u", frameLimiter.getSleepRatio() * 100.0, histogram[0], histogram[1], histogram[2], histogram[3], histogram[4], histogram[5], histogram[6]);
+			}
 		}
 	}
 	else
@@ -879,6 +921,9 @@ void common_flip(struct game_obj *game_object)
 		}
 	}
 
+	// everything deferred has been drawn by now, reuse its storage for the next frame
+	gl_reset_deferred();
+
 	// reset per-frame stats
 	stats.texture_reloads = 0;
 	stats.palette_writes = 0;
@@ -888,6 +933,9 @@ void common_flip(struct game_obj *game_object)
 
 	newRenderer.show();
 
+	// swap in the external textures loaded in background, they will be used starting from the next frame
+	textureStreamer.update();
+
 	current_state.texture_filter = true;
 	current_state.fb_texture = false;
 
@@ -1021,6 +1069,8 @@ void common_setviewport(uint32_t _x, uint32_t _y, uint32_t _w, uint32_t _h, stru
 	else d3dviewport_matrix._22 = (float)_h / (float)game_height;
 	d3dviewport_matrix._41 = (((float)_x + (float)_w / 2.0f) - (float)game_width / 2.0f) / ((float)game_width / 2.0f);
 	d3dviewport_matrix._42 = -(((float)_y + (float)_h / 2.0f) - (float)game_height / 2.0f) / ((float)game_height / 2.0f);
+
+	if (drawCapture.isRecording()) drawCapture.viewport(_x, _y, _w, _h, &d3dviewport_matrix);
 }
 
 // called by the game to set the background color which the back buffer will be
@@ -1086,6 +1136,17 @@ void common_light_polygon_set(struct polygon_set *polygon_set, struct light *lig
 }
 
 // called by the game to unload a texture
+// animated textures are owned by the animated texture cache and may be shared with other texture sets
+bool is_animated_texture(struct gl_texture_set *gl_set, uint32_t texture)
+{
+	for (const auto& it : gl_set->animated_textures)
+	{
+		if (it.second == texture) return true;
+	}
+
+	return false;
+}
+
 void common_unload_texture(struct texture_set *texture_set)
 {
 	uint32_t i;
@@ -1099,20 +1160,20 @@ void common_unload_texture(struct texture_set *texture_set)
 
 	struct gl_texture_set *gl_set = VREF(texture_set, ogl.gl_set);
 
+	// Drop any external texture still being loaded for this set
+	textureStreamer.cancel(texture_set);
+
 	// Destroy original static textures
 	for (uint32_t idx = 0; idx < VREF(texture_set, ogl.gl_set->textures); idx++)
 	{
-		newRenderer.deleteTexture(VREF(texture_set, texturehandle[idx]));
+		if (!is_animated_texture(gl_set, VREF(texture_set, texturehandle[idx]))) newRenderer.deleteTexture(VREF(texture_set, texturehandle[idx]));
 	}
 
-	// Destroy animated textures
-	if (gl_set->is_animated)
-	{
-		for(std::map<std::string,uint32_t>::iterator it = gl_set->animated_textures.begin(); it != gl_set->animated_textures.end(); ++it) {
-			newRenderer.deleteTexture(it->second);
-		}
-		gl_set->animated_textures.clear();
+	// Release animated textures, the cache decides when to destroy them
+	for(std::map<std::string,uint32_t>::iterator it = gl_set->animated_textures.begin(); it != gl_set->animated_textures.end(); ++it) {
+		animatedTextureCache.release(it->first);
 	}
+	gl_set->animated_textures.clear();
 
 	// Destroy additional textures
 	for (short slot = RendererTextureSlot::TEX_NML; slot < RendererTextureSlot::COUNT; slot++)
@@ -1181,7 +1242,7 @@ uint32_t load_external_texture(void* image_data, uint32_t dataSize, struct textu
 	{
 		if(trace_all || trace_loaders) ffnx_trace("texture file name: %s\n", VREF(tex_header, file.pc_name));
 
-		texture = load_texture(image_data, dataSize, VREF(tex_header, file.pc_name), VREF(tex_header, palette_index), VREFP(texture_set, ogl.width), VREFP(texture_set, ogl.height), gl_set);
+		texture = load_texture(image_data, dataSize, VREF(tex_header, file.pc_name), VREF(tex_header, palette_index), VREFP(texture_set, ogl.width), VREFP(texture_set, ogl.height), gl_set, texture_set, VREF(tex_header, palette_index));
 
 		if (enable_lighting)
 		{
@@ -1207,6 +1268,21 @@ uint32_t load_external_texture(void* image_data, uint32_t dataSize, struct textu
 		if(!_strnicmp(VREF(tex_header, file.pc_name), "flevel/hand_1", strlen("flevel/hand_1") - 1)) gl_set->force_filter = true;
 	}
 
+	if(texture == TEXTURE_STREAMER_QUEUED)
+	{
+		// this palette already got its external texture on a previous load, keep it
+		if(gl_set->streamed_palettes.count(VREF(tex_header, palette_index))) return true;
+
+		// use the texture converted from the game data until the external one is ready
+		uint32_t placeholder = newRenderer.createTexture((uint8_t*)image_data, originalWidth, originalHeight);
+
+		if (drawCapture.isRecording()) drawCapture.texture(placeholder, image_data, originalWidth, originalHeight, RendererTextureType::BGRA);
+
+		gl_replace_texture(texture_set, VREF(tex_header, palette_index), placeholder);
+
+		return true;
+	}
+
 	if(texture)
 	{
 		gl_replace_texture(texture_set, VREF(tex_header, palette_index), texture);
@@ -1329,6 +1405,8 @@ void convert_image_data(unsigned char *image_data, uint32_t *converted_image_dat
 // can be called under a wide variety of circumstances, we must figure out what the game wants
 struct texture_set *common_load_texture(struct texture_set *_texture_set, struct tex_header *_tex_header, struct texture_format *texture_format)
 {
+	PROFILE_ZONE("common_load_texture");
+
 	VOBJ(game_obj, game_object, common_externals.get_game_object());
 	VOBJ(texture_set, texture_set, _texture_set);
 	VOBJ(tex_header, tex_header, _tex_header);
@@ -1425,7 +1503,9 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 			if(memcmp(VREF(tex_header, old_palette_data), tex_format->palette_data, 4 * tex_format->palette_size))
 			{
 				for (uint32_t idx = 0; idx < VREF(texture_set, ogl.gl_set->textures); idx++)
-					newRenderer.deleteTexture(VREF(texture_set, texturehandle[idx]));
+				{
+					if (!is_animated_texture(VREF(texture_set, ogl.gl_set), VREF(texture_set, texturehandle[idx]))) newRenderer.deleteTexture(VREF(texture_set, texturehandle[idx]));
+				}
 
 				memset(VREF(texture_set, texturehandle), 0, VREF(texture_set, ogl.gl_set->textures) * sizeof(uint32_t));
 
@@ -1661,6 +1741,8 @@ void internal_set_renderstate(uint32_t state, uint32_t option, struct game_obj *
 {
 	VOBJ(game_obj, game_object, game_object);
 
+	if (drawCapture.isRecording()) drawCapture.renderState(state, option);
+
 	switch(state)
 	{
 		// wireframe rendering, not used?
@@ -60,6 +60,7 @@ LONG WINAPI ExceptionHandler(EXCEPTION_POINTERS *ep)
 	if(had_exception)
 	{
 		ffnx_unexpected("ExceptionHandler: crash while running another ExceptionHandler. Exiting.");
+		flush_applog();
 		SetUnhandledExceptionFilter(0);
 		return EXCEPTION_CONTINUE_EXECUTION;
 	}
@@ -156,6 +157,9 @@ LONG WINAPI ExceptionHandler(EXCEPTION_POINTERS *ep)
 
 	ffnx_error("Unhandled Exception. See dumped information above.\n");
 
+	// Make sure everything queued so far reaches the disk, the process may not survive the message box
+	flush_applog();
+
 	MessageBoxA(gameHwnd, "Feel free to visit this link for further next steps: https://github.com/julianxhokaxhiu/FFNx/wiki/FAQ", "Unhandled Exception", MB_ICONERROR | MB_OK);
 
 	// Cleanup the audio device
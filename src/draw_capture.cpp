@@ -0,0 +1,163 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include "draw_capture.h"
+#include "common.h"
+#include "log.h"
+#include "renderer.h"
+
+DrawCapture drawCapture;
+
+extern uint32_t nodefer;
+
+static_assert(sizeof(struct nvertex) == DRAW_CAPTURE_VERTEX_SIZE);
+static_assert(sizeof(vector3<float>) == DRAW_CAPTURE_NORMAL_SIZE);
+static_assert(sizeof(struct matrix) == sizeof(DrawCaptureStream::Event::matrix));
+static_assert(RendererTextureType::YUV16_UV == 4, "DrawCaptureStream::textureSize lists the texture types in order");
+
+// PUBLIC
+
+void DrawCapture::capture(uint32_t frameCount)
+{
+	char filename[64];
+
+	if (isCapturing() || frameCount == 0) return;
+
+	sprintf(filename, "drawcapture_%u.bin", frame_counter);
+
+	if (!writer.open(filename, ff8))
+	{
+		ffnx_error("DrawCapture: could not open %s for writing\n", filename);
+		return;
+	}
+
+	captureFrames = frameCount;
+	draws = 0;
+
+	ffnx_info("DrawCapture: capturing %u frames to %s\n", frameCount, filename);
+}
+
+bool DrawCapture::isCapturing()
+{
+	return captureFrames > 0;
+}
+
+bool DrawCapture::isRecording()
+{
+	return captureFrames > 0 && !nodefer;
+}
+
+void DrawCapture::frame()
+{
+	if (!isCapturing()) return;
+
+	writer.writeRecord(DrawCaptureStream::FRAME);
+	writer.writeUInt32(frame_counter);
+
+	captureFrames--;
+
+	if (captureFrames == 0)
+	{
+		ffnx_info("DrawCapture: done, %u draws, %zu unique blobs ( %zu KB )\n", draws, writer.getBlobCount(), writer.getBlobBytes() / 1024);
+
+		writer.close();
+	}
+}
+
+void DrawCapture::draw(uint32_t primitiveType, uint32_t vertexType, const struct nvertex* vertices, const void* normals, uint32_t vertexCount, const uint16_t* indices, uint32_t count, uint32_t clip, uint32_t mipmap)
+{
+	uint64_t verticesHash = writer.writeBlob(vertices, vertexCount * DRAW_CAPTURE_VERTEX_SIZE);
+	uint64_t normalsHash = writer.writeBlob(normals, normals ? vertexCount * DRAW_CAPTURE_NORMAL_SIZE : 0);
+	uint64_t indicesHash = writer.writeBlob(indices, count * sizeof(uint16_t));
+
+	writer.writeRecord(DrawCaptureStream::DRAW);
+	writer.writeUInt32(primitiveType);
+	writer.writeUInt32(vertexType);
+	writer.writeUInt32(vertexCount);
+	writer.writeUInt32(count);
+	writer.writeUInt32(clip);
+	writer.writeUInt32(mipmap);
+	writer.write(&verticesHash, sizeof(verticesHash));
+	writer.write(&normalsHash, sizeof(normalsHash));
+	writer.write(&indicesHash, sizeof(indicesHash));
+
+	draws++;
+}
+
+void DrawCapture::textureSet(uint32_t texture, bool fbTexture)
+{
+	writer.writeRecord(DrawCaptureStream::TEXTURE_SET);
+	writer.writeUInt32(texture);
+	writer.writeUInt32(fbTexture);
+}
+
+void DrawCapture::renderState(uint32_t state, uint32_t option)
+{
+	writer.writeRecord(DrawCaptureStream::RENDERSTATE);
+	writer.writeUInt32(state);
+	writer.writeUInt32(option);
+}
+
+void DrawCapture::blendMode(uint32_t mode)
+{
+	writer.writeRecord(DrawCaptureStream::BLEND_MODE);
+	writer.writeUInt32(mode);
+}
+
+void DrawCapture::worldViewMatrix(const struct matrix* matrix)
+{
+	writer.writeRecord(DrawCaptureStream::WORLDVIEW_MATRIX);
+	writer.write(matrix, sizeof(*matrix));
+}
+
+void DrawCapture::d3dProjectionMatrix(const struct matrix* matrix)
+{
+	writer.writeRecord(DrawCaptureStream::D3DPROJECTION_MATRIX);
+	writer.write(matrix, sizeof(*matrix));
+}
+
+void DrawCapture::texture(uint32_t texture, const void* pixels, uint32_t width, uint32_t height, uint32_t format)
+{
+	uint64_t pixelsHash = writer.writeBlob(pixels, DrawCaptureStream::textureSize(format, width, height));
+
+	writer.writeRecord(DrawCaptureStream::TEXTURE);
+	writer.writeUInt32(texture);
+	writer.writeUInt32(width);
+	writer.writeUInt32(height);
+	writer.writeUInt32(format);
+	writer.write(&pixelsHash, sizeof(pixelsHash));
+}
+
+void DrawCapture::textureDelete(uint32_t texture)
+{
+	writer.writeRecord(DrawCaptureStream::TEXTURE_DELETE);
+	writer.writeUInt32(texture);
+}
+
+void DrawCapture::viewport(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const struct matrix* matrix)
+{
+	writer.writeRecord(DrawCaptureStream::VIEWPORT);
+	writer.writeUInt32(x);
+	writer.writeUInt32(y);
+	writer.writeUInt32(width);
+	writer.writeUInt32(height);
+	writer.write(matrix, sizeof(*matrix));
+}
@@ -0,0 +1,66 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "draw_capture_writer.h"
+
+struct nvertex;
+struct matrix;
+
+/*
+ * Records everything the engine sends to the gl_* layer during the next frames into a binary file,
+ * so a rendering workload can be inspected or replayed without running the game.
+ * See DrawCaptureStream for the file format, and tools/replay for the replay tool.
+ *
+ * Only calls made by the engine are recorded, draws deferred and replayed later by the driver are recorded once,
+ * when the engine issued them.
+ */
+class DrawCapture
+{
+private:
+	DrawCaptureWriter writer;
+	uint32_t captureFrames = 0;
+	uint32_t draws = 0;
+
+public:
+	// Capture the next frames to a file in the game directory
+	void capture(uint32_t frameCount);
+	bool isCapturing();
+	// Whether calls should be recorded right now, deferred draws replayed by the driver itself are skipped
+	bool isRecording();
+	// To be called once per frame from the main thread
+	void frame();
+
+	void draw(uint32_t primitiveType, uint32_t vertexType, const struct nvertex* vertices, const void* normals, uint32_t vertexCount, const uint16_t* indices, uint32_t count, uint32_t clip, uint32_t mipmap);
+	void textureSet(uint32_t texture, bool fbTexture);
+	void renderState(uint32_t state, uint32_t option);
+	void blendMode(uint32_t mode);
+	void worldViewMatrix(const struct matrix* matrix);
+	void d3dProjectionMatrix(const struct matrix* matrix);
+	void texture(uint32_t texture, const void* pixels, uint32_t width, uint32_t height, uint32_t format);
+	void textureDelete(uint32_t texture);
+	void viewport(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const struct matrix* matrix);
+};
+
+extern DrawCapture drawCapture;
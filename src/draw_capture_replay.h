@@ -0,0 +1,177 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "draw_capture_stream.h"
+
+/*
+ * Replay of a draw capture made with DrawCapture, timing the CPU cost of every frame.
+ *
+ * The events are fed to a Target, with the captured texture handles mapped to the ones the Target created:
+ *   uint32_t createTexture(uint32_t captured, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t format)
+ *   void deleteTexture(uint32_t texture)
+ *   void useTexture(uint32_t texture, bool fbTexture)
+ *   void renderState(uint32_t state, uint32_t option)
+ *   void blendMode(uint32_t mode)
+ *   void worldViewMatrix(const float* matrix)
+ *   void d3dProjectionMatrix(const float* matrix)
+ *   void viewport(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* matrix)
+ *   void draw(uint32_t primitiveType, uint32_t vertexType, const uint8_t* vertices, const uint8_t* normals, uint32_t vertexCount, const uint8_t* indices, uint32_t count, uint32_t clip)
+ *   void show(bool timed)
+ * The Target is a template parameter only so that the replay can be built and checked without the renderer,
+ * see tools/replay for the one feeding the Renderer.
+ *
+ * The first frame is partial, the capture started in the middle of it, it is replayed but not timed.
+ */
+template<typename Target>
+class DrawCaptureReplay
+{
+private:
+	Target& target;
+	const DrawCaptureStream& stream;
+	// Captured texture handle => replayed texture handle
+	std::unordered_map<uint32_t, uint32_t> textures;
+	// Bound instead of the textures created before the capture started
+	uint32_t missingTexture;
+
+	void deleteTexture(uint32_t captured)
+	{
+		auto it = textures.find(captured);
+
+		if (it == textures.end()) return;
+
+		target.deleteTexture(it->second);
+		textures.erase(it);
+	}
+
+	void replayEvent(const DrawCaptureStream::Event& event)
+	{
+		switch (event.type)
+		{
+		case DrawCaptureStream::DRAW:
+			// Draws without vertices or indices were skipped by the driver too
+			if (event.data[0] == nullptr || event.data[2] == nullptr) break;
+
+			target.draw(event.args[0], event.args[1], event.data[0], event.data[1], event.args[2], event.data[2], event.args[3], event.args[4]);
+			draws++;
+			break;
+		case DrawCaptureStream::TEXTURE_SET:
+		{
+			uint32_t texture = 0;
+
+			if (event.args[0])
+			{
+				auto it = textures.find(event.args[0]);
+
+				if (it != textures.end()) texture = it->second;
+				else
+				{
+					texture = missingTexture;
+					missingTextureBinds++;
+				}
+			}
+
+			target.useTexture(texture, event.args[1]);
+			break;
+		}
+		case DrawCaptureStream::RENDERSTATE:
+			target.renderState(event.args[0], event.args[1]);
+			break;
+		case DrawCaptureStream::BLEND_MODE:
+			target.blendMode(event.args[0]);
+			break;
+		case DrawCaptureStream::WORLDVIEW_MATRIX:
+			target.worldViewMatrix(event.matrix);
+			break;
+		case DrawCaptureStream::D3DPROJECTION_MATRIX:
+			target.d3dProjectionMatrix(event.matrix);
+			break;
+		case DrawCaptureStream::VIEWPORT:
+			target.viewport(event.args[0], event.args[1], event.args[2], event.args[3], event.matrix);
+			break;
+		case DrawCaptureStream::TEXTURE:
+			// The handle was not released through the renderer, the texture it referred to is gone anyway
+			deleteTexture(event.args[0]);
+
+			textures[event.args[0]] = target.createTexture(event.args[0], event.data[0], event.args[1], event.args[2], event.args[3]);
+			break;
+		case DrawCaptureStream::TEXTURE_DELETE:
+			deleteTexture(event.args[0]);
+			break;
+		default:
+			break;
+		}
+	}
+
+public:
+	// Draws replayed and binds of the missing texture, during the last loop
+	uint32_t draws = 0;
+	uint32_t missingTextureBinds = 0;
+	// CPU time of every timed frame in milliseconds. The first loop is kept apart,
+	// it also pays for the shaders and the textures loaded on first use
+	std::vector<double> firstLoopTimes;
+	std::vector<double> frameTimes;
+
+	DrawCaptureReplay(Target& target, const DrawCaptureStream& stream, uint32_t missingTexture) : target(target), stream(stream), missingTexture(missingTexture) {}
+
+	void replay(uint32_t loops)
+	{
+		firstLoopTimes.clear();
+		frameTimes.clear();
+
+		for (uint32_t loop = 0; loop < loops; loop++)
+		{
+			std::vector<double>& times = loop == 0 ? firstLoopTimes : frameTimes;
+			bool timed = false;
+			auto frameStart = std::chrono::steady_clock::now();
+
+			draws = 0;
+			missingTextureBinds = 0;
+
+			for (const DrawCaptureStream::Event& event : stream.events)
+			{
+				if (event.type != DrawCaptureStream::FRAME)
+				{
+					replayEvent(event);
+					continue;
+				}
+
+				target.show(timed);
+
+				auto frameEnd = std::chrono::steady_clock::now();
+
+				if (timed) times.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+
+				timed = true;
+				frameStart = frameEnd;
+			}
+
+			// Every loop starts without the textures created by the previous one
+			while (!textures.empty()) deleteTexture(textures.begin()->first);
+		}
+	}
+};
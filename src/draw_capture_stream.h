@@ -0,0 +1,207 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#define DRAW_CAPTURE_VERSION 2
+
+// Size of a struct nvertex and of a vector3<float> normal, checked against the engine structures in draw_capture.cpp
+#define DRAW_CAPTURE_VERTEX_SIZE 32
+#define DRAW_CAPTURE_NORMAL_SIZE 12
+
+/*
+ * Binary format of the draw captures, written by DrawCapture and read back by the replay tool.
+ *
+ * The file starts with the "FFNXDRAW" magic, the format version and whether the game is FF8.
+ * It is then a flat list of records, a one byte Record followed by its payload.
+ * Vertex, index and texture payloads are stored once as BLOB records, keyed by their hash,
+ * and referenced by key by the records which use them. A payload whose hash is already the key of a different
+ * payload takes the next free key, see DrawCaptureWriter. A key of 0 means no payload.
+ *
+ * Texture handles are the ones the driver handed out during the capture, they are only unique
+ * between a TEXTURE record and the TEXTURE_DELETE record of the same handle.
+ */
+class DrawCaptureStream
+{
+public:
+	enum Record : uint8_t
+	{
+		FRAME = 1,            // uint32 frame counter
+		BLOB,                 // uint64 hash, uint32 size, data
+		DRAW,                 // uint32 primitive type, vertex type, vertex count, index count, clip, mipmap, uint64 vertices, normals, indices
+		TEXTURE_SET,          // uint32 texture handle, fb texture
+		RENDERSTATE,          // uint32 state, option
+		BLEND_MODE,           // uint32 blend mode
+		WORLDVIEW_MATRIX,     // 16 floats
+		D3DPROJECTION_MATRIX, // 16 floats
+		TEXTURE,              // uint32 texture handle, width, height, format, uint64 pixels
+		TEXTURE_DELETE,       // uint32 texture handle
+		VIEWPORT              // uint32 x, y, width, height, 16 floats of the emulated Direct3D viewport matrix
+	};
+
+	struct Event
+	{
+		Record type;
+		// uint32 fields of the record, in file order
+		uint32_t args[6];
+		// Payloads referenced by hash, in file order, nullptr when the hash is 0
+		const uint8_t* data[3];
+		float matrix[16];
+	};
+
+private:
+	const uint8_t* cursor = nullptr;
+	const uint8_t* end = nullptr;
+	std::unordered_map<uint64_t, std::vector<uint8_t>> blobs;
+
+	bool read(void* out, size_t size)
+	{
+		if (size_t(end - cursor) < size) return false;
+
+		memcpy(out, cursor, size);
+		cursor += size;
+
+		return true;
+	}
+
+	// Payloads must have been stored before being referenced, and have the size their record implies
+	bool readBlobReference(const uint8_t*& out, uint64_t expectedSize)
+	{
+		uint64_t hash;
+
+		if (!read(&hash, sizeof(hash))) return false;
+
+		out = nullptr;
+
+		if (hash == 0) return true;
+
+		auto it = blobs.find(hash);
+
+		if (it == blobs.end() || it->second.size() != expectedSize) return false;
+
+		out = it->second.data();
+
+		return true;
+	}
+
+	bool readEvent(Event& event)
+	{
+		uint64_t hash;
+		uint32_t size;
+
+		switch (event.type)
+		{
+		case BLOB:
+			if (!read(&hash, sizeof(hash)) || !read(&size, sizeof(size)) || size_t(end - cursor) < size) return false;
+			if (hash == 0) return false;
+
+			if (!blobs.count(hash)) blobs[hash].assign(cursor, cursor + size);
+			cursor += size;
+			return true;
+		case FRAME:
+		case BLEND_MODE:
+		case TEXTURE_DELETE:
+			return read(event.args, sizeof(uint32_t));
+		case TEXTURE_SET:
+		case RENDERSTATE:
+			return read(event.args, 2 * sizeof(uint32_t));
+		case WORLDVIEW_MATRIX:
+		case D3DPROJECTION_MATRIX:
+			return read(event.matrix, sizeof(event.matrix));
+		case VIEWPORT:
+			return read(event.args, 4 * sizeof(uint32_t)) && read(event.matrix, sizeof(event.matrix));
+		case TEXTURE:
+			if (!read(event.args, 4 * sizeof(uint32_t))) return false;
+
+			// Unknown formats have no size, they can only come without pixels
+			return readBlobReference(event.data[0], textureSize(event.args[3], event.args[1], event.args[2]));
+		case DRAW:
+			if (!read(event.args, 6 * sizeof(uint32_t))) return false;
+
+			return readBlobReference(event.data[0], uint64_t(event.args[2]) * DRAW_CAPTURE_VERTEX_SIZE)
+				&& readBlobReference(event.data[1], uint64_t(event.args[2]) * DRAW_CAPTURE_NORMAL_SIZE)
+				&& readBlobReference(event.data[2], uint64_t(event.args[3]) * sizeof(uint16_t));
+		default:
+			return false;
+		}
+	}
+
+public:
+	bool isFF8 = false;
+	uint32_t frames = 0;
+	// Every record except the blobs, in file order
+	std::vector<Event> events;
+
+	// Size of the pixels of a texture, by RendererTextureType
+	static uint64_t textureSize(uint32_t format, uint32_t width, uint32_t height)
+	{
+		// BGRA, YUV, YUV_UV, YUV16, YUV16_UV
+		static const uint32_t bytesPerPixel[] = { 4, 1, 2, 2, 4 };
+
+		if (format >= sizeof(bytesPerPixel) / sizeof(bytesPerPixel[0])) return 0;
+
+		return uint64_t(width) * height * bytesPerPixel[format];
+	}
+
+	// Fails on an unknown record, a record cut short, or a payload which is missing or of the wrong size
+	bool parse(const uint8_t* buffer, size_t size)
+	{
+		char magic[8];
+		uint32_t version, ff8;
+
+		cursor = buffer;
+		end = buffer + size;
+		blobs.clear();
+		events.clear();
+		frames = 0;
+
+		if (!read(magic, sizeof(magic)) || memcmp(magic, "FFNXDRAW", sizeof(magic)) != 0) return false;
+		if (!read(&version, sizeof(version)) || version != DRAW_CAPTURE_VERSION) return false;
+		if (!read(&ff8, sizeof(ff8))) return false;
+
+		isFF8 = ff8 != 0;
+
+		while (cursor < end)
+		{
+			Event event = {};
+
+			if (!read(&event.type, sizeof(event.type)) || !readEvent(event)) return false;
+
+			if (event.type == BLOB) continue;
+
+			if (event.type == FRAME) frames++;
+
+			events.push_back(event);
+		}
+
+		return true;
+	}
+
+	size_t getBlobCount()
+	{
+		return blobs.size();
+	}
+};
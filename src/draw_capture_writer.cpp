@@ -0,0 +1,156 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <string.h>
+
+#include "draw_capture_writer.h"
+
+// PRIVATE
+
+bool DrawCaptureWriter::matches(const Blob& blob, const void* data, size_t size)
+{
+	if (blob.size != size) return false;
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint8_t chunk[4096];
+	bool ret = true;
+
+	// Switching from writing to reading needs a seek, which flushes the pending writes
+	fseek(file, blob.offset, SEEK_SET);
+
+	for (size_t offset = 0; ret && offset < size; offset += sizeof(chunk))
+	{
+		size_t chunkSize = size - offset < sizeof(chunk) ? size - offset : sizeof(chunk);
+
+		ret = fread(chunk, 1, chunkSize, file) == chunkSize && memcmp(chunk, bytes + offset, chunkSize) == 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+
+	return ret;
+}
+
+// PUBLIC
+
+uint64_t DrawCaptureWriter::hash(const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t ret = 0xCBF29CE484222325ULL;
+
+	for (size_t i = 0; i < size; i++) ret = (ret ^ bytes[i]) * 0x100000001B3ULL;
+
+	return ret;
+}
+
+bool DrawCaptureWriter::open(const char* filename, bool isFF8)
+{
+	uint32_t version = DRAW_CAPTURE_VERSION;
+	uint32_t ff8 = isFF8;
+
+	close();
+
+	// Read back to tell apart payloads with the same hash
+	file = fopen(filename, "w+b");
+
+	if (file == nullptr) return false;
+
+	write("FFNXDRAW", 8);
+	write(&version, sizeof(version));
+	write(&ff8, sizeof(ff8));
+
+	return true;
+}
+
+void DrawCaptureWriter::close()
+{
+	if (file != nullptr) fclose(file);
+
+	file = nullptr;
+	blobs.clear();
+	blobBytes = 0;
+}
+
+bool DrawCaptureWriter::isOpen()
+{
+	return file != nullptr;
+}
+
+void DrawCaptureWriter::write(const void* data, size_t size)
+{
+	fwrite(data, 1, size, file);
+}
+
+void DrawCaptureWriter::writeRecord(DrawCaptureStream::Record type)
+{
+	write(&type, sizeof(type));
+}
+
+void DrawCaptureWriter::writeUInt32(uint32_t value)
+{
+	write(&value, sizeof(value));
+}
+
+uint64_t DrawCaptureWriter::writeBlob(const void* data, size_t size)
+{
+	if (data == nullptr || size == 0) return 0;
+
+	return writeBlob(data, size, hash(data, size));
+}
+
+uint64_t DrawCaptureWriter::writeBlob(const void* data, size_t size, uint64_t hash)
+{
+	if (data == nullptr || size == 0) return 0;
+
+	// 0 means no payload
+	uint64_t key = hash ? hash : 1;
+
+	// Keys taken by other payloads are skipped, they are compared too since a key may also be the hash of another payload
+	for (auto it = blobs.find(key); it != blobs.end(); it = blobs.find(key))
+	{
+		if (matches(it->second, data, size)) return key;
+
+		key = key + 1 ? key + 1 : 1;
+	}
+
+	uint32_t blobSize = size;
+
+	writeRecord(DrawCaptureStream::BLOB);
+	write(&key, sizeof(key));
+	write(&blobSize, sizeof(blobSize));
+
+	blobs[key] = Blob{ ftell(file), blobSize };
+
+	write(data, size);
+
+	blobBytes += size;
+
+	return key;
+}
+
+size_t DrawCaptureWriter::getBlobCount()
+{
+	return blobs.size();
+}
+
+size_t DrawCaptureWriter::getBlobBytes()
+{
+	return blobBytes;
+}
@@ -0,0 +1,70 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+
+#include "draw_capture_stream.h"
+
+/*
+ * Writes the records of a draw capture, see DrawCaptureStream for the format.
+ *
+ * Payloads are stored once and referenced by a key derived from their hash. A payload whose hash is already taken
+ * is compared with the stored one, read back from the file, and gets the next free key when they differ.
+ */
+class DrawCaptureWriter
+{
+private:
+	// Where a stored payload is in the file
+	struct Blob
+	{
+		long offset;
+		uint32_t size;
+	};
+
+	FILE* file = nullptr;
+	std::unordered_map<uint64_t, Blob> blobs;
+	size_t blobBytes = 0;
+
+	bool matches(const Blob& blob, const void* data, size_t size);
+
+public:
+	// FNV-1a
+	static uint64_t hash(const void* data, size_t size);
+
+	// Starts a capture with the file header, false if the file cannot be created
+	bool open(const char* filename, bool isFF8);
+	void close();
+	bool isOpen();
+
+	void write(const void* data, size_t size);
+	void writeRecord(DrawCaptureStream::Record type);
+	void writeUInt32(uint32_t value);
+	// Stores the payload if needed and returns the key to reference it with, 0 for no payload
+	uint64_t writeBlob(const void* data, size_t size);
+	uint64_t writeBlob(const void* data, size_t size, uint64_t hash);
+
+	size_t getBlobCount();
+	size_t getBlobBytes();
+};
@@ -82,9 +82,11 @@ uint32_t field_open_flevel_siz();
 void ff7_world_hook_init();
 
 // file
+#define NUM_LGP_ARCHIVES 18
+
 FILE *open_lgp_file(char *filename, uint32_t mode);
 void close_lgp_file(FILE *fd);
-extern char lgp_names[18][256];
+extern char lgp_names[NUM_LGP_ARCHIVES][256];
 uint32_t lgp_chdir(char *path);
 struct lgp_file *lgp_open_file(char *filename, uint32_t lgp_num);
 uint32_t lgp_seek_file(uint32_t offset, uint32_t lgp_num);
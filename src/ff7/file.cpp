@@ -29,10 +29,41 @@
 #include "../hext.h"
 #include "../redirect.h"
 #include "../achievement.h"
+#include "../lgp.h"
+
+// LGP names used for modpath lookup
+char lgp_names[NUM_LGP_ARCHIVES][256] = {
+	"char",
+	"flevel",
+	"battle",
+	"magic",
+	"menu",
+	"world",
+	"condor",
+	"chocobo",
+	"high",
+	"coaster",
+	"snowboard",
+	"midi",
+	"",
+	"",
+	"moviecam",
+	"cr",
+	"disc",
+	"sub",
+};
+
+// Mapped and indexed copy of the archives the game opened, by LGP number
+LgpArchive lgp_archives[NUM_LGP_ARCHIVES];
+FILE *lgp_archive_fds[NUM_LGP_ARCHIVES];
+
+// Read position in each mapped archive, replaces the position of the game's own file handle
+uint32_t lgp_positions[NUM_LGP_ARCHIVES];
 
 FILE *open_lgp_file(char *filename, uint32_t mode)
 {
 	char _filename[260]{ 0 };
+	char fname[_MAX_FNAME];
 	if(trace_all || trace_files) ffnx_trace("opening lgp file %s\n", filename);
 
 	int redirect_status = attempt_redirection(filename, _filename, sizeof(_filename));
@@ -42,7 +73,24 @@ FILE *open_lgp_file(char *filename, uint32_t mode)
 		strcpy(_filename, filename);
 	}
 
-	return fopen(_filename, "rb");
+	FILE *ret = fopen(_filename, "rb");
+
+	if(!ret) return ret;
+
+	// The game still reads the table of contents through its own handle, everything else goes through the mapping
+	_splitpath(_filename, 0, 0, fname, 0);
+
+	for(uint32_t lgp_num = 0; lgp_num < NUM_LGP_ARCHIVES; lgp_num++)
+	{
+		if(lgp_names[lgp_num][0] && !_stricmp(lgp_names[lgp_num], fname))
+		{
+			if(lgp_archives[lgp_num].open(_filename)) lgp_archive_fds[lgp_num] = ret;
+
+			break;
+		}
+	}
+
+	return ret;
 }
 
 void close_lgp_file(FILE *fd)
@@ -51,30 +99,25 @@ void close_lgp_file(FILE *fd)
 
 	if(trace_all || trace_files) ffnx_trace("closing lgp file\n");
 
+	for(uint32_t lgp_num = 0; lgp_num < NUM_LGP_ARCHIVES; lgp_num++)
+	{
+		if(lgp_archive_fds[lgp_num] == fd)
+		{
+			lgp_archives[lgp_num].close();
+			lgp_archive_fds[lgp_num] = 0;
+		}
+	}
+
 	fclose(fd);
 }
 
-// LGP names used for modpath lookup
-char lgp_names[18][256] = {
-	"char",
-	"flevel",
-	"battle",
-	"magic",
-	"menu",
-	"world",
-	"condor",
-	"chocobo",
-	"high",
-	"coaster",
-	"snowboard",
-	"midi",
-	"",
-	"",
-	"moviecam",
-	"cr",
-	"disc",
-	"sub",
-};
+// returns the mapped archive matching the file handle the game is currently using for this LGP number, if any
+LgpArchive *lgp_get_archive(uint32_t lgp_num)
+{
+	if(lgp_num >= NUM_LGP_ARCHIVES || !lgp_archive_fds[lgp_num] || lgp_archive_fds[lgp_num] != ff7_externals.lgp_fds[lgp_num]) return 0;
+
+	return &lgp_archives[lgp_num];
+}
 
 struct lgp_file
 {
@@ -233,9 +276,26 @@ struct lgp_file *lgp_open_file(char *filename, uint32_t lgp_num)
 
 	if(!ret->fd)
 	{
+		LgpArchive *archive = lgp_get_archive(lgp_num);
+		uint32_t found;
+
 		sprintf(name, "%s%s", fname, ext);
 
-		if(!original_lgp_open_file(name, lgp_num, ret))
+		if(archive)
+		{
+			bool resolved_conflict;
+
+			found = archive->find(name, lgp_current_dir, ret->offset, resolved_conflict);
+
+			if(found)
+			{
+				ret->is_lgp_offset = true;
+				ret->resolved_conflict = resolved_conflict;
+			}
+		}
+		else found = original_lgp_open_file(name, lgp_num, ret);
+
+		if(!found)
 		{
 			if(!direct_mode_path.empty()) ffnx_error("failed to find file %s; tried %s/%s/%s, %s/%s/%s/%s, %s/%s (LGP) (path: %s)\n", filename, direct_mode_path.c_str(), lgp_names[lgp_num], name, direct_mode_path.c_str(), lgp_names[lgp_num], lgp_current_dir, name, lgp_names[lgp_num], name, lgp_current_dir);
 			else ffnx_error("failed to find file %s/%s (LGP) (path: %s)\n", lgp_names[lgp_num], name, lgp_current_dir);
@@ -272,6 +332,13 @@ uint32_t lgp_seek_file(uint32_t offset, uint32_t lgp_num)
 {
 	if(!ff7_externals.lgp_fds[lgp_num]) return false;
 
+	if(lgp_get_archive(lgp_num))
+	{
+		lgp_positions[lgp_num] = offset;
+
+		return true;
+	}
+
 	fseek(ff7_externals.lgp_fds[lgp_num], offset, SEEK_SET);
 
 	return true;
@@ -282,7 +349,21 @@ uint32_t lgp_read(uint32_t lgp_num, char *dest, uint32_t size)
 {
 	if(!ff7_externals.lgp_fds[lgp_num]) return 0;
 
-	if(last->is_lgp_offset) return fread(dest, 1, size, ff7_externals.lgp_fds[lgp_num]);
+	if(last->is_lgp_offset)
+	{
+		LgpArchive *archive = lgp_get_archive(lgp_num);
+
+		if(archive)
+		{
+			uint32_t ret = archive->read(lgp_positions[lgp_num], dest, size);
+
+			lgp_positions[lgp_num] += ret;
+
+			return ret;
+		}
+
+		return fread(dest, 1, size, ff7_externals.lgp_fds[lgp_num]);
+	}
 
 	return fread(dest, 1, size, last->fd);
 }
@@ -294,7 +375,19 @@ uint32_t lgp_read_file(struct lgp_file *file, uint32_t lgp_num, char *dest, uint
 
 	if(file->is_lgp_offset)
 	{
+		LgpArchive *archive = lgp_get_archive(lgp_num);
+
 		lgp_seek_file(file->offset + 24, lgp_num);
+
+		if(archive)
+		{
+			uint32_t ret = archive->read(lgp_positions[lgp_num], dest, size);
+
+			lgp_positions[lgp_num] += ret;
+
+			return ret;
+		}
+
 		return fread(dest, 1, size, ff7_externals.lgp_fds[lgp_num]);
 	}
 
@@ -306,8 +399,11 @@ uint32_t lgp_get_filesize(struct lgp_file *file, uint32_t lgp_num)
 {
 	if(file->is_lgp_offset)
 	{
+		LgpArchive *archive = lgp_get_archive(lgp_num);
 		uint32_t size;
 
+		if(archive) return archive->getFileSize(file->offset);
+
 		lgp_seek_file(file->offset + 20, lgp_num);
 		fread(&size, 4, 1, ff7_externals.lgp_fds[lgp_num]);
 		return size;
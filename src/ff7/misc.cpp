@@ -25,6 +25,7 @@
 #include "camera.h"
 
 #include "../audio.h"
+#include "../frame_limiter.h"
 #include "../gamepad.h"
 #include "../gamehacks.h"
 #include "../joystick.h"
@@ -473,8 +474,6 @@ void* ff7_menu_sub_6F5C0C(uint32_t param1, uint32_t param2, uint8_t param3, uint
 
 void ff7_limit_fps()
 {
-	static time_t last_gametime;
-	time_t gametime;
 	double framerate = 30.0f;
 
 	struct ff7_game_obj *game_object = (ff7_game_obj *)common_externals.get_game_object();
@@ -486,13 +485,13 @@ void ff7_limit_fps()
 		if (ff7_externals.movie_object->is_playing && !*ff7_externals.field_limit_fps)
 		{
 			// Some movies do not expect to be frame limited
-			qpc_get_time(&last_gametime);
+			frameLimiter.reset();
 			return;
 		}
 		break;
 	case MODE_GAMEOVER:
 		// Gameover screen has nothing to limit
-		qpc_get_time(&last_gametime);
+		frameLimiter.reset();
 		return;
 	}
 
@@ -524,12 +523,7 @@ void ff7_limit_fps()
 		break;
 	}
 
-	framerate *= gamehacks.getCurrentSpeedhack();
-
-	do qpc_get_time(&gametime);
-	while ((gametime > last_gametime) && qpc_diff_time(&gametime, &last_gametime, NULL) < ((ff7_game_obj*)common_externals.get_game_object())->countspersecond / framerate);
-
-	last_gametime = gametime;
+	frameLimiter.waitFrame(framerate, gamehacks.getCurrentSpeedhack());
 }
 
 void ff7_handle_ambient_playback()
@@ -0,0 +1,213 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "file_index.h"
+#include "log.h"
+#include "cfg.h"
+
+// Name of a file as the game would spell it. Names which cannot be written in the ANSI code page
+// can never be requested, and would make std::filesystem throw when converted.
+static bool get_ansi_filename(const std::filesystem::path& path, std::string& out)
+{
+#ifdef _WIN32
+	const std::wstring& wide = path.filename().native();
+
+	if (wide.empty()) return false;
+
+	if (GetACP() == CP_UTF8)
+	{
+		std::u8string utf8 = path.filename().u8string();
+
+		out.assign(utf8.begin(), utf8.end());
+
+		return true;
+	}
+
+	BOOL usedDefaultChar = FALSE;
+	int size = WideCharToMultiByte(CP_ACP, WC_NO_BEST_FIT_CHARS, wide.data(), int(wide.size()), nullptr, 0, nullptr, &usedDefaultChar);
+
+	if (size <= 0 || usedDefaultChar) return false;
+
+	out.resize(size);
+	WideCharToMultiByte(CP_ACP, WC_NO_BEST_FIT_CHARS, wide.data(), int(wide.size()), out.data(), size, nullptr, nullptr);
+
+	return true;
+#else
+	out = path.filename().string();
+
+	return !out.empty();
+#endif
+}
+
+// PRIVATE
+
+void FileIndex::scan(const std::string& dir, Directory& directory)
+{
+	std::error_code ec;
+	std::filesystem::path path = dir.empty() ? std::filesystem::path(root) : std::filesystem::path(root) / dir;
+
+	directory.files.clear();
+	directory.exists = std::filesystem::is_directory(path, ec);
+	directory.lastCheck = std::chrono::steady_clock::now();
+
+	if (!directory.exists) return;
+
+	directory.lastWriteTime = std::filesystem::last_write_time(path, ec);
+
+	std::string filename;
+
+	// The range-for increment throws on errors, a folder being modified while it is scanned must not take the game down
+	for (std::filesystem::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec))
+	{
+		std::error_code fileEc;
+
+		if (it->is_regular_file(fileEc) && get_ansi_filename(it->path(), filename)) directory.files.insert(normalize(filename));
+	}
+
+	scans++;
+
+	if (trace_all || trace_files) ffnx_trace("FileIndex: indexed %zu files in %s/%s\n", directory.files.size(), root.c_str(), dir.c_str());
+}
+
+FileIndex::Directory& FileIndex::getDirectory(const std::string& dir)
+{
+	auto it = directories.find(dir);
+
+	if (it == directories.end())
+	{
+		Directory& directory = directories[dir];
+
+		scan(dir, directory);
+
+		return directory;
+	}
+
+	Directory& directory = it->second;
+	auto now = std::chrono::steady_clock::now();
+
+	if (std::chrono::duration_cast<std::chrono::milliseconds>(now - directory.lastCheck).count() >= FILE_INDEX_REVALIDATE_MS)
+	{
+		std::error_code ec;
+		std::filesystem::path path = dir.empty() ? std::filesystem::path(root) : std::filesystem::path(root) / dir;
+		std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time(path, ec);
+
+		// Directory appeared, disappeared or its content changed since the last scan
+		if (directory.exists == bool(ec) || (!ec && lastWriteTime != directory.lastWriteTime)) scan(dir, directory);
+		else directory.lastCheck = now;
+	}
+
+	return directory;
+}
+
+// PUBLIC
+
+std::string FileIndex::normalize(std::string path)
+{
+	std::replace(path.begin(), path.end(), '\\', '/');
+	std::transform(path.begin(), path.end(), path.begin(), [](unsigned char c) { return std::tolower(c); });
+
+	// Collapse duplicated separators, the engine sometimes produces them
+	path.erase(std::unique(path.begin(), path.end(), [](char a, char b) { return a == '/' && b == '/'; }), path.end());
+
+	if (!path.empty() && path.front() == '/') path.erase(0, 1);
+
+	return path;
+}
+
+void FileIndex::setRoot(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (root == path) return;
+
+	root = path;
+	directories.clear();
+}
+
+const std::string& FileIndex::getRoot()
+{
+	return root;
+}
+
+bool FileIndex::exists(const std::string& relativePath)
+{
+	std::string path = normalize(relativePath);
+	size_t pos = path.find_last_of('/');
+	std::string dir = pos == std::string::npos ? "" : path.substr(0, pos);
+	std::string file = pos == std::string::npos ? path : path.substr(pos + 1);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Directory& directory = getDirectory(dir);
+
+	return directory.exists && directory.files.count(file) > 0;
+}
+
+void FileIndex::add(const std::string& relativePath)
+{
+	std::string path = normalize(relativePath);
+	size_t pos = path.find_last_of('/');
+	std::string dir = pos == std::string::npos ? "" : path.substr(0, pos);
+	std::string file = pos == std::string::npos ? path : path.substr(pos + 1);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Directory& directory = getDirectory(dir);
+
+	directory.exists = true;
+	directory.files.insert(file);
+}
+
+void FileIndex::invalidate()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	directories.clear();
+
+	if (trace_all || trace_files) ffnx_trace("FileIndex: invalidated index for %s\n", root.c_str());
+}
+
+size_t FileIndex::getDirectoryCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return directories.size();
+}
+
+size_t FileIndex::getFileCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t ret = 0;
+
+	for (const auto& it : directories) ret += it.second.files.size();
+
+	return ret;
+}
+
+uint32_t FileIndex::getScanCount()
+{
+	return scans;
+}
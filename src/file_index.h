@@ -0,0 +1,77 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// How often a directory which was already scanned is checked again for changes on disk
+#define FILE_INDEX_REVALIDATE_MS 1000
+
+/*
+ * In-memory index of the files contained in a directory tree.
+ *
+ * Each sub-directory is scanned lazily the first time a file inside it is requested.
+ * Lookups are then answered with a hash lookup instead of a stat() call.
+ * File and directory names are case-folded and forward-slashed, like the Windows filesystem would resolve them.
+ *
+ * A directory is revalidated against its last write time at most once every FILE_INDEX_REVALIDATE_MS,
+ * so files added by modders while the game is running are picked up without a restart.
+ */
+class FileIndex
+{
+private:
+	struct Directory
+	{
+		bool exists = false;
+		std::filesystem::file_time_type lastWriteTime;
+		std::chrono::steady_clock::time_point lastCheck;
+		std::unordered_set<std::string> files;
+	};
+
+	std::string root;
+	std::unordered_map<std::string, Directory> directories;
+	std::mutex mutex;
+
+	uint32_t scans = 0;
+
+	void scan(const std::string& dir, Directory& directory);
+	Directory& getDirectory(const std::string& dir);
+
+public:
+	static std::string normalize(std::string path);
+
+	void setRoot(const std::string& path);
+	const std::string& getRoot();
+
+	bool exists(const std::string& relativePath);
+	void add(const std::string& relativePath);
+	void invalidate();
+
+	size_t getDirectoryCount();
+	size_t getFileCount();
+	uint32_t getScanCount();
+};
@@ -0,0 +1,253 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+#include <string.h>
+
+#include "frame_limiter.h"
+
+// Shorter sleeps are not worth it, what is left is spent spinning
+#define FRAME_LIMITER_MIN_SLEEP_US 250
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+FrameLimiter frameLimiter;
+
+static const uint32_t bucketLimits[FRAME_LIMITER_BUCKETS - 1] = FRAME_LIMITER_BUCKET_LIMITS;
+
+#ifdef _WIN32
+class SystemClock : public FrameLimiter::Clock
+{
+private:
+	time_t freq = 0;
+	HANDLE timer = NULL;
+	bool timerInitialized = false;
+
+public:
+	SystemClock()
+	{
+		QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+	}
+
+	~SystemClock()
+	{
+		shutdown();
+	}
+
+	time_t now() override
+	{
+		time_t ret;
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&ret);
+
+		return ret;
+	}
+
+	time_t frequency() override
+	{
+		return freq;
+	}
+
+	void sleep(uint32_t us) override
+	{
+		if (!timerInitialized)
+		{
+			// High resolution waitable timers exist since Windows 10 1803, older systems need a finer scheduler tick for Sleep to be usable
+			timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+			if (timer == NULL) timeBeginPeriod(1);
+
+			timerInitialized = true;
+		}
+
+		if (timer != NULL)
+		{
+			LARGE_INTEGER dueTime;
+
+			// Relative time, in 100 nanoseconds units
+			dueTime.QuadPart = -(LONGLONG)us * 10;
+
+			if (SetWaitableTimer(timer, &dueTime, 0, NULL, NULL, FALSE))
+			{
+				WaitForSingleObject(timer, INFINITE);
+				return;
+			}
+		}
+
+		Sleep(us / 1000);
+	}
+
+	void shutdown() override
+	{
+		if (!timerInitialized) return;
+
+		// timeBeginPeriod raises the timer resolution of the whole system until it is paired
+		if (timer != NULL) CloseHandle(timer);
+		else timeEndPeriod(1);
+
+		timer = NULL;
+		timerInitialized = false;
+	}
+};
+#else
+class SystemClock : public FrameLimiter::Clock
+{
+public:
+	time_t now() override
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	time_t frequency() override
+	{
+		return 1000000000;
+	}
+
+	void sleep(uint32_t us) override
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(us));
+	}
+};
+#endif
+
+static SystemClock systemClock;
+
+// PRIVATE
+
+void FrameLimiter::record(time_t lateness)
+{
+	uint32_t us = uint32_t(double(lateness) * 1000000.0 / double(clock->frequency()));
+	uint32_t bucket = 0;
+
+	while (bucket < FRAME_LIMITER_BUCKETS - 1 && us >= bucketLimits[bucket]) bucket++;
+
+	histogram[bucket]++;
+	frames++;
+}
+
+// PUBLIC
+
+FrameLimiter::FrameLimiter()
+{
+	clock = &systemClock;
+}
+
+void FrameLimiter::setClock(Clock* newClock)
+{
+	clock = newClock != nullptr ? newClock : &systemClock;
+	lastFrame = 0;
+}
+
+FrameLimiter::Clock* FrameLimiter::getClock()
+{
+	return clock;
+}
+
+void FrameLimiter::shutdown()
+{
+	clock->shutdown();
+}
+
+void FrameLimiter::reset()
+{
+	lastFrame = clock->now();
+}
+
+void FrameLimiter::waitFrame(double framerate, double speed)
+{
+	time_t now = clock->now();
+
+	// Nothing to wait for on the first frame, or if the clock went backwards
+	if (lastFrame > 0 && now > lastFrame && framerate * speed > 0.0)
+	{
+		waitUntil(lastFrame + time_t(double(clock->frequency()) / (framerate * speed)));
+	}
+
+	lastFrame = clock->now();
+}
+
+void FrameLimiter::waitUntil(time_t deadline)
+{
+	double frequency = double(clock->frequency());
+	time_t now = clock->now();
+
+	while (now < deadline)
+	{
+		double request = double(deadline - now) * 1000000.0 / frequency - sleepOvershoot;
+
+		if (request < FRAME_LIMITER_MIN_SLEEP_US) break;
+
+		time_t before = now;
+
+		clock->sleep(uint32_t(request));
+
+		now = clock->now();
+
+		double overshoot = double(now - before) * 1000000.0 / frequency - double(uint32_t(request));
+
+		if (overshoot < 0.0) overshoot = 0.0;
+
+		// Follow a timer getting worse quickly, and one getting better slowly
+		sleepOvershoot += (overshoot - sleepOvershoot) * (overshoot > sleepOvershoot ? 0.5 : 0.05);
+		sleptTime += now - before;
+	}
+
+	time_t spinStart = now;
+
+	while (now < deadline) now = clock->now();
+
+	spunTime += now - spinStart;
+
+	record(now - deadline);
+}
+
+void FrameLimiter::resetStats()
+{
+	memset(histogram, 0, sizeof(histogram));
+	frames = 0;
+	sleptTime = 0;
+	spunTime = 0;
+}
+
+const uint32_t* FrameLimiter::getHistogram()
+{
+	return histogram;
+}
+
+uint32_t FrameLimiter::getFrameCount()
+{
+	return frames;
+}
+
+double FrameLimiter::getSleepRatio()
+{
+	time_t total = sleptTime + spunTime;
+
+	return total > 0 ? double(sleptTime) / double(total) : 0.0;
+}
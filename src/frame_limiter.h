@@ -0,0 +1,92 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+// Upper bounds, in microseconds, of the frame lateness histogram buckets. The last bucket has no upper bound
+#define FRAME_LIMITER_BUCKETS 7
+#define FRAME_LIMITER_BUCKET_LIMITS { 100, 250, 500, 1000, 2000, 4000 }
+
+/*
+ * Waits for the next frame without keeping a core busy.
+ *
+ * Most of the interval is spent sleeping, only what is left after the last sleep is spent spinning.
+ * How late the sleeps wake up is measured as we go, so the spin only covers the timer imprecision.
+ * How late every frame ends up compared to its deadline is collected in a histogram.
+ *
+ * Time is read through a Clock, so the pacing logic can be driven by a deterministic clock
+ * instead of the performance counter.
+ */
+class FrameLimiter
+{
+public:
+	class Clock
+	{
+	public:
+		virtual ~Clock() {}
+
+		virtual time_t now() = 0;
+		virtual time_t frequency() = 0;
+		virtual void sleep(uint32_t us) = 0;
+		// Give back what sleeping may have acquired, the next sleep acquires it again
+		virtual void shutdown() {}
+	};
+
+private:
+	Clock* clock = nullptr;
+
+	time_t lastFrame = 0;
+	// Running average of how late a sleep wakes up, in microseconds
+	double sleepOvershoot = 1000.0;
+
+	uint32_t histogram[FRAME_LIMITER_BUCKETS] = { 0 };
+	uint32_t frames = 0;
+	time_t sleptTime = 0;
+	time_t spunTime = 0;
+
+	void record(time_t lateness);
+
+public:
+	FrameLimiter();
+
+	void setClock(Clock* newClock);
+	Clock* getClock();
+	// To be called when the game exits, restores the system timer resolution if it had to be raised
+	void shutdown();
+
+	// Start counting the next frame from now, without waiting
+	void reset();
+	// Wait until 1 / (framerate * speed) seconds have passed since the previous frame
+	void waitFrame(double framerate, double speed = 1.0);
+	// Wait until the clock reaches deadline
+	void waitUntil(time_t deadline);
+
+	void resetStats();
+	const uint32_t* getHistogram();
+	uint32_t getFrameCount();
+	// Share of the waiting time spent sleeping, between 0 and 1
+	double getSleepRatio();
+};
+
+extern FrameLimiter frameLimiter;
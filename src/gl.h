@@ -22,6 +22,8 @@
 
 #pragma once
 
+#include <set>
+
 #include "common.h"
 
 #define VERTEX 1
@@ -58,6 +60,8 @@ struct driver_state
 	struct matrix d3dprojection_matrix;
 };
 
+#define DEFERRED_NONE 0xFFFFFFFF
+
 struct deferred_draw
 {
 	uint32_t primitivetype;
@@ -65,10 +69,11 @@ struct deferred_draw
 	uint32_t vertexcount;
 	uint32_t count;
 	uint32_t draworder;
-	struct nvertex* vertices;
-	vector3<float>* normals;
-	WORD *indices;
-	struct boundingbox* boundingbox;
+	// offsets in the deferred arena, DEFERRED_NONE when missing
+	uint32_t vertices;
+	uint32_t normals;
+	uint32_t indices;
+	uint32_t boundingbox;
 	uint32_t clip;
 	uint32_t mipmap;
 	struct driver_state state;
@@ -92,6 +97,8 @@ struct gl_texture_set
 	std::map<std::string, uint32_t> animated_textures;
 	// ADDITIONAL TEXTURES
 	std::map<uint16_t, uint32_t> additional_textures;
+	// STREAMED TEXTURES
+	std::set<uint32_t> streamed_palettes;
 };
 
 extern struct matrix d3dviewport_matrix;
@@ -113,6 +120,9 @@ struct boundingbox calculateSceneAabb();
 void gl_draw_sorted_deferred();
 void gl_check_deferred(struct texture_set *texture_set);
 void gl_cleanup_deferred();
+void gl_reset_deferred();
+uint32_t gl_deferred_arena_size();
+uint32_t gl_deferred_arena_peak();
 uint32_t gl_special_case(uint32_t primitivetype, uint32_t vertextype, struct nvertex *vertices, uint32_t vertexcount, WORD *indices, uint32_t count, struct graphics_object *graphics_object, uint32_t clip, uint32_t mipmap);
 void gl_draw_without_lighting(struct indexed_primitive* ip, uint32_t clip);
 void gl_draw_with_lighting(struct indexed_primitive *ip, struct polygon_data *polydata, uint32_t clip);
@@ -20,29 +20,101 @@
 //    GNU General Public License for more details.                          //
 /****************************************************************************/
 
+#include <algorithm>
+#include <vector>
+
 #include "../renderer.h"
 
 #include "../gl.h"
 #include "../macro.h"
 #include "../log.h"
 
+#include "deferred_order.h"
+
 uint32_t nodefer = false;
 
 #define DEFERRED_MAX 1024
 
+#define DEFERRED_ARENA_SIZE (1024 * 1024)
+#define DEFERRED_ARENA_ALIGN 16
+
 struct deferred_draw *deferred_draws;
 uint32_t num_deferred;
+uint32_t max_deferred;
 
 struct deferred_sorted_draw *deferred_sorted_draws;
 uint32_t num_sorted_deferred;
+uint32_t max_sorted_deferred;
+
+// linear storage for the vertices, indices, normals and bounding boxes of all deferred draws
+// rewound once per frame, draws still queued by then are moved to the front of the spare one
+struct deferred_arena
+{
+	uint8_t *data;
+	uint32_t size;
+	uint32_t used;
+} deferred_arena, deferred_spare_arena;
+
+uint32_t deferred_arena_peak;
+
+uint32_t gl_arena_alloc(struct deferred_arena *arena, uint32_t size)
+{
+	uint32_t offset = (arena->used + DEFERRED_ARENA_ALIGN - 1) & ~(DEFERRED_ARENA_ALIGN - 1);
+
+	if (offset + size > arena->size)
+	{
+		uint32_t new_size = std::max<uint32_t>(arena->size * 2, DEFERRED_ARENA_SIZE);
+
+		while (offset + size > new_size) new_size *= 2;
+
+		// draws only hold offsets, so moving the arena around is fine
+		arena->data = (uint8_t*)driver_realloc(arena->data, new_size);
+		arena->size = new_size;
+
+		if (trace_all) ffnx_trace("gl_arena_alloc: arena grown to %u bytes\n", new_size);
+	}
+
+	arena->used = offset + size;
+
+	return offset;
+}
+
+uint32_t gl_deferred_alloc(uint32_t size)
+{
+	uint32_t offset = gl_arena_alloc(&deferred_arena, size);
+
+	deferred_arena_peak = std::max(deferred_arena_peak, deferred_arena.used);
+
+	return offset;
+}
+
+template<typename T>
+T *gl_deferred_ptr(uint32_t offset)
+{
+	return offset == DEFERRED_NONE ? nullptr : (T*)(deferred_arena.data + offset);
+}
+
+// make room for more draws in a deferred queue, growing it if needed
+template<typename T>
+void gl_reserve_deferred(T **queue, uint32_t *max, uint32_t needed)
+{
+	if (needed <= *max) return;
+
+	uint32_t new_max = std::max<uint32_t>(*max * 2, DEFERRED_MAX);
+
+	while (needed > new_max) new_max *= 2;
+
+	*queue = (T*)driver_realloc(*queue, sizeof(**queue) * new_max);
+	*max = new_max;
+
+	if (trace_all) ffnx_trace("gl_reserve_deferred: deferred draw queue grown to %u entries\n", new_max);
+}
 
 // save a draw call for later processing
 uint32_t gl_defer_draw(uint32_t primitivetype, uint32_t vertextype, struct nvertex* vertices, vector3<float>* normals, uint32_t vertexcount, WORD* indices, uint32_t count, struct boundingbox* boundingbox, uint32_t clip, uint32_t mipmap)
 {
 	if (trace_all) ffnx_trace("gl_defer_draw: call with primitivetype: %u - vertextype: %u - vertexcount: %u - count: %u - clip: %d - mipmap: %d\n", primitivetype, vertextype, vertexcount, count, clip, mipmap);
 
-	if (!deferred_draws) deferred_draws = (deferred_draw*)driver_calloc(sizeof(*deferred_draws), DEFERRED_MAX);
-
 	if (ff8 || !enable_lighting)
 	{
 		return false;
@@ -54,11 +126,7 @@ uint32_t gl_defer_draw(uint32_t primitivetype, uint32_t vertextype, struct nvert
 		return false;
 	}
 
-	if (num_deferred + 1 > DEFERRED_MAX)
-	{
-		if (trace_all) ffnx_trace("gl_defer_draw: deferred draw queue overflow - num_deferred: %u - count: %u - DEFERRED_MAX: %u\n", num_deferred, count, DEFERRED_MAX);
-		return false;
-	}
+	gl_reserve_deferred(&deferred_draws, &max_deferred, num_deferred + 1);
 
 	uint32_t defer = num_deferred;
 
@@ -68,12 +136,16 @@ uint32_t gl_defer_draw(uint32_t primitivetype, uint32_t vertextype, struct nvert
 	deferred_draws[defer].primitivetype = primitivetype;
 	deferred_draws[defer].vertextype = vertextype;
 	deferred_draws[defer].vertexcount = vertexcount;
-	deferred_draws[defer].indices = (WORD*)driver_malloc(sizeof(*indices) * count);
-	deferred_draws[defer].vertices = (nvertex*)driver_malloc(sizeof(*vertices) * vertexcount);
+	deferred_draws[defer].indices = gl_deferred_alloc(sizeof(*indices) * count);
+	deferred_draws[defer].vertices = gl_deferred_alloc(sizeof(*vertices) * vertexcount);
+	deferred_draws[defer].boundingbox = gl_deferred_alloc(sizeof(struct boundingbox));
+	deferred_draws[defer].normals = normals ? gl_deferred_alloc(sizeof(*normals) * vertexcount) : DEFERRED_NONE;
 	gl_save_state(&deferred_draws[defer].state);
 
-	memcpy(deferred_draws[defer].indices, indices, sizeof(*indices) * count);
-	memcpy(deferred_draws[defer].vertices, vertices, sizeof(*vertices) * vertexcount);
+	memcpy(gl_deferred_ptr<WORD>(deferred_draws[defer].indices), indices, sizeof(*indices) * count);
+	memcpy(gl_deferred_ptr<nvertex>(deferred_draws[defer].vertices), vertices, sizeof(*vertices) * vertexcount);
+
+	struct boundingbox* deferred_boundingbox = gl_deferred_ptr<struct boundingbox>(deferred_draws[defer].boundingbox);
 
 	int draworder = DRAW_ORDER_1;
 	if (vertextype == TLVERTEX)	draworder = deferred_draws[defer].state.blend_mode != 4 ? DRAW_ORDER_2 : DRAW_ORDER_0;
@@ -82,27 +154,23 @@ uint32_t gl_defer_draw(uint32_t primitivetype, uint32_t vertextype, struct nvert
 
 	if (boundingbox)
 	{
-		deferred_draws[defer].boundingbox = (struct boundingbox*)driver_malloc(sizeof(struct boundingbox));
-
-		deferred_draws[defer].boundingbox->min_x = boundingbox->min_x;
-		deferred_draws[defer].boundingbox->min_y = boundingbox->min_y;
-		deferred_draws[defer].boundingbox->min_z = boundingbox->min_z;
+		deferred_boundingbox->min_x = boundingbox->min_x;
+		deferred_boundingbox->min_y = boundingbox->min_y;
+		deferred_boundingbox->min_z = boundingbox->min_z;
 
-		deferred_draws[defer].boundingbox->max_x = boundingbox->max_x;
-		deferred_draws[defer].boundingbox->max_y = boundingbox->max_y;
-		deferred_draws[defer].boundingbox->max_z = boundingbox->max_z;
+		deferred_boundingbox->max_x = boundingbox->max_x;
+		deferred_boundingbox->max_y = boundingbox->max_y;
+		deferred_boundingbox->max_z = boundingbox->max_z;
 	}
 	else // calculate AABB if no bounding box found
 	{
-		deferred_draws[defer].boundingbox = (struct boundingbox*)driver_malloc(sizeof(struct boundingbox));
+		deferred_boundingbox->min_x = FLT_MAX;
+		deferred_boundingbox->min_y = FLT_MAX;
+		deferred_boundingbox->min_z = FLT_MAX;
 
-		deferred_draws[defer].boundingbox->min_x = FLT_MAX;
-		deferred_draws[defer].boundingbox->min_y = FLT_MAX;
-		deferred_draws[defer].boundingbox->min_z = FLT_MAX;
-
-		deferred_draws[defer].boundingbox->max_x = FLT_MIN;
-		deferred_draws[defer].boundingbox->max_y = FLT_MIN;
-		deferred_draws[defer].boundingbox->max_z = FLT_MIN;
+		deferred_boundingbox->max_x = FLT_MIN;
+		deferred_boundingbox->max_y = FLT_MIN;
+		deferred_boundingbox->max_z = FLT_MIN;
 
 		for (int i = 0; i < vertexcount; ++i)
 		{
@@ -110,21 +178,17 @@ uint32_t gl_defer_draw(uint32_t primitivetype, uint32_t vertextype, struct nvert
 			float vy = vertices[i]._.y;
 			float vz = vertices[i]._.z;
 
-			deferred_draws[defer].boundingbox->min_x = std::min(deferred_draws[defer].boundingbox->min_x, vx);
-			deferred_draws[defer].boundingbox->min_y = std::min(deferred_draws[defer].boundingbox->min_y, vy);
-			deferred_draws[defer].boundingbox->min_z = std::min(deferred_draws[defer].boundingbox->min_z, vz);
+			deferred_boundingbox->min_x = std::min(deferred_boundingbox->min_x, vx);
+			deferred_boundingbox->min_y = std::min(deferred_boundingbox->min_y, vy);
+			deferred_boundingbox->min_z = std::min(deferred_boundingbox->min_z, vz);
 
-			deferred_draws[defer].boundingbox->max_x = std::max(deferred_draws[defer].boundingbox->max_x, vx);
-			deferred_draws[defer].boundingbox->max_y = std::max(deferred_draws[defer].boundingbox->max_y, vy);
-			deferred_draws[defer].boundingbox->max_z = std::max(deferred_draws[defer].boundingbox->max_z, vz);
+			deferred_boundingbox->max_x = std::max(deferred_boundingbox->max_x, vx);
+			deferred_boundingbox->max_y = std::max(deferred_boundingbox->max_y, vy);
+			deferred_boundingbox->max_z = std::max(deferred_boundingbox->max_z, vz);
 		}
 	}
 
-	if (normals)
-	{
-		deferred_draws[defer].normals = (vector3<float>*)driver_malloc(sizeof(*normals) * vertexcount);
-		memcpy(deferred_draws[defer].normals, normals, sizeof(*normals) * vertexcount);
-	}
+	if (normals) memcpy(gl_deferred_ptr<vector3<float>>(deferred_draws[defer].normals), normals, sizeof(*normals) * vertexcount);
 
 	num_deferred++;
 
@@ -144,8 +208,6 @@ uint32_t gl_defer_sorted_draw(uint32_t primitivetype, uint32_t vertextype, struc
 
 	if (trace_all) ffnx_trace("gl_defer_sorted_draw: call with primitivetype: %u - vertextype: %u - vertexcount: %u - count: %u - clip: %d - mipmap: %d\n", primitivetype, vertextype, vertexcount, count, clip, mipmap);
 
-	if(!deferred_sorted_draws) deferred_sorted_draws = (deferred_sorted_draw*)driver_calloc(sizeof(*deferred_sorted_draws), DEFERRED_MAX);
-
 	// global disable
 	if (nodefer) {
 		if (trace_all) ffnx_trace("gl_defer_sorted_draw: nodefer true\n");
@@ -208,11 +270,7 @@ uint32_t gl_defer_sorted_draw(uint32_t primitivetype, uint32_t vertextype, struc
 		return false;
 	}
 
-	if(num_sorted_deferred + count / 3 > DEFERRED_MAX)
-	{
-		if (trace_all) ffnx_trace("gl_defer_sorted_draw: deferred draw queue overflow - num_sorted_deferred: %u - count: %u - DEFERRED_MAX: %u\n", num_sorted_deferred, count, DEFERRED_MAX);
-		return false;
-	}
+	gl_reserve_deferred(&deferred_sorted_draws, &max_sorted_deferred, num_sorted_deferred + count / 3);
 
 	tri_deferred = (uint32_t*)driver_calloc(sizeof(*tri_deferred), count / 3);
 	tri_z = (float*)driver_calloc(sizeof(*tri_z), count / 3);
@@ -257,22 +315,27 @@ uint32_t gl_defer_sorted_draw(uint32_t primitivetype, uint32_t vertextype, struc
 		deferred_sorted_draws[defer].deferred_draw.primitivetype = primitivetype;
 		deferred_sorted_draws[defer].deferred_draw.vertextype = vertextype;
 		deferred_sorted_draws[defer].deferred_draw.vertexcount = tri_num * 3;
-		deferred_sorted_draws[defer].deferred_draw.indices = (WORD*)driver_malloc(sizeof(*indices) * tri_num * 3);
-		deferred_sorted_draws[defer].deferred_draw.vertices = (nvertex*)driver_malloc(sizeof(*vertices) * tri_num * 3);
+		deferred_sorted_draws[defer].deferred_draw.indices = gl_deferred_alloc(sizeof(*indices) * tri_num * 3);
+		deferred_sorted_draws[defer].deferred_draw.vertices = gl_deferred_alloc(sizeof(*vertices) * tri_num * 3);
+		deferred_sorted_draws[defer].deferred_draw.normals = DEFERRED_NONE;
+		deferred_sorted_draws[defer].deferred_draw.boundingbox = DEFERRED_NONE;
 		gl_save_state(&deferred_sorted_draws[defer].deferred_draw.state);
 		deferred_sorted_draws[defer].drawn = false;
 		deferred_sorted_draws[defer].z = z;
 
+		struct nvertex *layer_vertices = gl_deferred_ptr<nvertex>(deferred_sorted_draws[defer].deferred_draw.vertices);
+		WORD *layer_indices = gl_deferred_ptr<WORD>(deferred_sorted_draws[defer].deferred_draw.indices);
+
 		for(tri = 0; tri < count / 3 && vert_index < tri_num * 3; tri++)
 		{
 			if(tri_z[tri] == z)
 			{
-				memcpy(&deferred_sorted_draws[defer].deferred_draw.vertices[vert_index + 0], &vertices[indices[tri * 3 + 0]], sizeof(*vertices));
-				memcpy(&deferred_sorted_draws[defer].deferred_draw.vertices[vert_index + 1], &vertices[indices[tri * 3 + 1]], sizeof(*vertices));
-				memcpy(&deferred_sorted_draws[defer].deferred_draw.vertices[vert_index + 2], &vertices[indices[tri * 3 + 2]], sizeof(*vertices));
-				deferred_sorted_draws[defer].deferred_draw.indices[vert_index + 0] = vert_index + 0;
-				deferred_sorted_draws[defer].deferred_draw.indices[vert_index + 1] = vert_index + 1;
-				deferred_sorted_draws[defer].deferred_draw.indices[vert_index + 2] = vert_index + 2;
+				memcpy(&layer_vertices[vert_index + 0], &vertices[indices[tri * 3 + 0]], sizeof(*vertices));
+				memcpy(&layer_vertices[vert_index + 1], &vertices[indices[tri * 3 + 1]], sizeof(*vertices));
+				memcpy(&layer_vertices[vert_index + 2], &vertices[indices[tri * 3 + 2]], sizeof(*vertices));
+				layer_indices[vert_index + 0] = vert_index + 0;
+				layer_indices[vert_index + 1] = vert_index + 1;
+				layer_indices[vert_index + 2] = vert_index + 2;
 
 				vert_index += 3;
 
@@ -311,7 +374,7 @@ void gl_draw_deferred(bool isDrawOrderEnabled, DrawOrder draworder)
 
 	for (int i = 0; i < num_deferred; ++i)
 	{
-		if (deferred_draws[i].vertices == nullptr)
+		if (deferred_draws[i].vertices == DEFERRED_NONE)
 		{
 			continue;
 		}
@@ -325,27 +388,20 @@ void gl_draw_deferred(bool isDrawOrderEnabled, DrawOrder draworder)
 
 		gl_draw_indexed_primitive(deferred_draws[i].primitivetype,
 			deferred_draws[i].vertextype,
-			deferred_draws[i].vertices,
-			deferred_draws[i].normals,
+			gl_deferred_ptr<nvertex>(deferred_draws[i].vertices),
+			gl_deferred_ptr<vector3<float>>(deferred_draws[i].normals),
 			deferred_draws[i].vertexcount,
-			deferred_draws[i].indices,
+			gl_deferred_ptr<WORD>(deferred_draws[i].indices),
 			deferred_draws[i].count,
 			0,
-			deferred_draws[i].boundingbox,
+			gl_deferred_ptr<struct boundingbox>(deferred_draws[i].boundingbox),
 			deferred_draws[i].clip,
 			deferred_draws[i].mipmap
 		);
 
 		++stats.deferred;
 
-		driver_free(deferred_draws[i].vertices);
-		deferred_draws[i].vertices = nullptr;
-		driver_free(deferred_draws[i].indices);
-		deferred_draws[i].indices = nullptr;
-		driver_free(deferred_draws[i].normals);
-		deferred_draws[i].normals = nullptr;
-		driver_free(deferred_draws[i].boundingbox);
-		deferred_draws[i].boundingbox = nullptr;
+		deferred_draws[i].vertices = DEFERRED_NONE;
 	}
 
 	if(!isDrawOrderEnabled || draworder == DRAW_ORDER_COUNT - 1) num_deferred = 0;
@@ -391,12 +447,17 @@ struct boundingbox calculateSceneAabb()
 		{
 			continue;
 		}
-		if (deferred_draws[i].normals == nullptr || deferred_draws[i].count == 3)
+		// already drawn, or invalidated by gl_check_deferred
+		if (deferred_draws[i].vertices == DEFERRED_NONE)
+		{
+			continue;
+		}
+		if (deferred_draws[i].normals == DEFERRED_NONE || deferred_draws[i].count == 3)
 		{
 			continue;
 		}
 
-		struct boundingbox* bb = deferred_draws[i].boundingbox;
+		struct boundingbox* bb = gl_deferred_ptr<struct boundingbox>(deferred_draws[i].boundingbox);
 		if (bb)
 		{
 			vector3<float> corners[8] = { {bb->min_x, bb->min_y, bb->min_z},
@@ -428,10 +489,23 @@ struct boundingbox calculateSceneAabb()
 	return sceneAabb;
 }
 
+// layers can be drawn with a single call when nothing but their geometry differs
+bool gl_can_merge_sorted_deferred(struct deferred_draw *a, struct deferred_draw *b)
+{
+	return a->primitivetype == b->primitivetype
+		&& a->vertextype == b->vertextype
+		&& a->clip == b->clip
+		&& a->mipmap == b->mipmap
+		&& !memcmp(&a->state, &b->state, sizeof(a->state));
+}
+
 // draw all the layers we've accumulated in the correct order and reset queue
 void gl_draw_sorted_deferred()
 {
 	struct driver_state saved_state;
+	static std::vector<uint32_t> order;
+	static std::vector<nvertex> merged_vertices;
+	static std::vector<WORD> merged_indices;
 
 	if (num_sorted_deferred == 0) {
 		if (trace_all) ffnx_trace("gl_draw_sorted_deferred: num_sorted_deferred == 0\n");
@@ -444,43 +518,74 @@ void gl_draw_sorted_deferred()
 
 	stats.deferred += num_sorted_deferred;
 
-	while(true)
+	gl_order_sorted_deferred(deferred_sorted_draws, num_sorted_deferred, order);
+
+	for(uint32_t i = 0; i < order.size();)
 	{
-		uint32_t i;
-		double z = -1.0;
-		uint32_t next = -1;
+		struct deferred_draw *draw = &deferred_sorted_draws[order[i]].deferred_draw;
+		uint32_t next = i + 1;
 
-		for(i = 0; i < num_sorted_deferred; i++)
+		merged_vertices.clear();
+		merged_indices.clear();
+
+		// concatenate the following layers sharing the same state, as long as indices fit
+		while(next < order.size() && gl_can_merge_sorted_deferred(draw, &deferred_sorted_draws[order[next]].deferred_draw)
+			&& (merged_vertices.empty() ? draw->vertexcount : merged_vertices.size()) + deferred_sorted_draws[order[next]].deferred_draw.vertexcount <= UINT16_MAX)
 		{
-			if(deferred_sorted_draws[i].z > z && !deferred_sorted_draws[i].drawn)
+			if(merged_vertices.empty())
 			{
-				next = i;
-				z = deferred_sorted_draws[i].z;
+				merged_vertices.insert(merged_vertices.end(), gl_deferred_ptr<nvertex>(draw->vertices), gl_deferred_ptr<nvertex>(draw->vertices) + draw->vertexcount);
+				merged_indices.insert(merged_indices.end(), gl_deferred_ptr<WORD>(draw->indices), gl_deferred_ptr<WORD>(draw->indices) + draw->count);
 			}
-		}
 
-		if(next == -1) break;
+			struct deferred_draw *other = &deferred_sorted_draws[order[next]].deferred_draw;
+			WORD base = merged_vertices.size();
+			WORD *other_indices = gl_deferred_ptr<WORD>(other->indices);
 
-		gl_load_state(&deferred_sorted_draws[next].deferred_draw.state);
+			merged_vertices.insert(merged_vertices.end(), gl_deferred_ptr<nvertex>(other->vertices), gl_deferred_ptr<nvertex>(other->vertices) + other->vertexcount);
+			for(uint32_t idx = 0; idx < other->count; idx++) merged_indices.push_back(base + other_indices[idx]);
+
+			deferred_sorted_draws[order[next]].drawn = true;
+			next++;
+		}
+
+		gl_load_state(&draw->state);
 		internal_set_renderstate(V_DEPTHTEST, 1, 0);
 		internal_set_renderstate(V_DEPTHMASK, 1, 0);
 
-		gl_draw_indexed_primitive(deferred_sorted_draws[next].deferred_draw.primitivetype,
-								  deferred_sorted_draws[next].deferred_draw.vertextype,
-								  deferred_sorted_draws[next].deferred_draw.vertices,
-								  0,
-								  deferred_sorted_draws[next].deferred_draw.vertexcount,
-								  deferred_sorted_draws[next].deferred_draw.indices,
-								  deferred_sorted_draws[next].deferred_draw.count,
-								  0,
-								  0,
-								  deferred_sorted_draws[next].deferred_draw.clip,
-								  deferred_sorted_draws[next].deferred_draw.mipmap
-								  );
-
-		driver_free(deferred_sorted_draws[next].deferred_draw.vertices);
-		driver_free(deferred_sorted_draws[next].deferred_draw.indices);
-		deferred_sorted_draws[next].drawn = true;
+		if(merged_vertices.empty())
+		{
+			gl_draw_indexed_primitive(draw->primitivetype,
+									  draw->vertextype,
+									  gl_deferred_ptr<nvertex>(draw->vertices),
+									  0,
+									  draw->vertexcount,
+									  gl_deferred_ptr<WORD>(draw->indices),
+									  draw->count,
+									  0,
+									  0,
+									  draw->clip,
+									  draw->mipmap
+									  );
+		}
+		else
+		{
+			gl_draw_indexed_primitive(draw->primitivetype,
+									  draw->vertextype,
+									  merged_vertices.data(),
+									  0,
+									  merged_vertices.size(),
+									  merged_indices.data(),
+									  merged_indices.size(),
+									  0,
+									  0,
+									  draw->clip,
+									  draw->mipmap
+									  );
+		}
+
+		deferred_sorted_draws[order[i]].drawn = true;
+		i = next;
 	}
 
 	num_sorted_deferred = 0;
@@ -498,27 +603,12 @@ void gl_check_deferred(struct texture_set *texture_set)
 
 	for (i = 0; i < num_deferred; i++)
 	{
-		if (deferred_draws[i].state.texture_set == texture_set)
-		{
-			driver_free(deferred_draws[i].vertices);
-			deferred_draws[i].vertices = nullptr;
-			driver_free(deferred_draws[i].indices);
-			deferred_draws[i].indices = nullptr;
-			driver_free(deferred_draws[i].normals);
-			deferred_draws[i].normals = nullptr;
-			driver_free(deferred_draws[i].boundingbox);
-			deferred_draws[i].boundingbox = nullptr;
-		}
+		if (deferred_draws[i].state.texture_set == texture_set) deferred_draws[i].vertices = DEFERRED_NONE;
 	}
 
 	for(i = 0; i < num_sorted_deferred; i++)
 	{
-		if(deferred_sorted_draws[i].deferred_draw.state.texture_set == texture_set)
-		{
-			driver_free(deferred_sorted_draws[i].deferred_draw.vertices);
-			driver_free(deferred_sorted_draws[i].deferred_draw.indices);
-			deferred_sorted_draws[i].drawn = true;
-		}
+		if(deferred_sorted_draws[i].deferred_draw.state.texture_set == texture_set) deferred_sorted_draws[i].drawn = true;
 	}
 }
 
@@ -526,5 +616,90 @@ void gl_cleanup_deferred()
 {
 	driver_free(deferred_draws);
 	driver_free(deferred_sorted_draws);
+	driver_free(deferred_arena.data);
+	driver_free(deferred_spare_arena.data);
+
+	deferred_draws = nullptr;
+	num_deferred = 0;
+	max_deferred = 0;
+
+	deferred_sorted_draws = nullptr;
+	num_sorted_deferred = 0;
+	max_sorted_deferred = 0;
+
+	deferred_arena = {};
+	deferred_spare_arena = {};
+	deferred_arena_peak = 0;
+}
+
+// copy a block still in use to the spare arena
+uint32_t gl_move_deferred(uint32_t offset, uint32_t size)
+{
+	if (offset == DEFERRED_NONE) return DEFERRED_NONE;
+
+	uint32_t moved = gl_arena_alloc(&deferred_spare_arena, size);
+
+	memcpy(deferred_spare_arena.data + moved, deferred_arena.data + offset, size);
+
+	return moved;
+}
+
+void gl_move_deferred_draw(struct deferred_draw *draw)
+{
+	draw->indices = gl_move_deferred(draw->indices, sizeof(WORD) * draw->count);
+	draw->vertices = gl_move_deferred(draw->vertices, sizeof(struct nvertex) * draw->vertexcount);
+	draw->normals = gl_move_deferred(draw->normals, sizeof(vector3<float>) * draw->vertexcount);
+	draw->boundingbox = gl_move_deferred(draw->boundingbox, sizeof(struct boundingbox));
+}
+
+// called once per frame, draws still queued are compacted so the arena never grows past what is live
+void gl_reset_deferred()
+{
+	uint32_t live = 0;
+
+	if (num_deferred == 0 && num_sorted_deferred == 0)
+	{
+		deferred_arena.used = 0;
+		return;
+	}
+
+	deferred_spare_arena.used = 0;
+
+	for (uint32_t i = 0; i < num_deferred; i++)
+	{
+		if (deferred_draws[i].vertices == DEFERRED_NONE) continue;
+
+		deferred_draws[live] = deferred_draws[i];
+		gl_move_deferred_draw(&deferred_draws[live]);
+		live++;
+	}
+
+	num_deferred = live;
+	live = 0;
+
+	for (uint32_t i = 0; i < num_sorted_deferred; i++)
+	{
+		if (deferred_sorted_draws[i].drawn) continue;
+
+		deferred_sorted_draws[live] = deferred_sorted_draws[i];
+		gl_move_deferred_draw(&deferred_sorted_draws[live].deferred_draw);
+		live++;
+	}
+
+	num_sorted_deferred = live;
+
+	if (trace_all) ffnx_trace("gl_reset_deferred: %u draws left queued, %u bytes kept\n", num_deferred + num_sorted_deferred, deferred_spare_arena.used);
+
+	std::swap(deferred_arena, deferred_spare_arena);
+}
+
+uint32_t gl_deferred_arena_size()
+{
+	return deferred_arena.size;
+}
+
+uint32_t gl_deferred_arena_peak()
+{
+	return deferred_arena_peak;
 }
 
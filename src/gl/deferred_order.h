@@ -0,0 +1,42 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+// order in which the z-sorted layers are drawn: back to front, layers with the same Z keep the order they were queued in.
+// layers already drawn, or with a Z of -1 or less, are skipped. this is the order the engine used to get by repeatedly
+// picking the first remaining layer with the largest Z, without going through the queue once per layer
+template<typename Layer>
+void gl_order_sorted_deferred(const Layer *layers, uint32_t count, std::vector<uint32_t> &order)
+{
+	order.clear();
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(!layers[i].drawn && layers[i].z > -1.0) order.push_back(i);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [layers](uint32_t a, uint32_t b) { return layers[a].z > layers[b].z; });
+}
@@ -32,6 +32,8 @@
 #include "../macro.h"
 #include "../log.h"
 #include "../matrix.h"
+#include "../profiler.h"
+#include "../draw_capture.h"
 
 struct matrix d3dviewport_matrix = {
 	1.0f, 0.0f, 0.0f, 0.0f,
@@ -226,6 +228,8 @@ void gl_draw_with_lighting(struct indexed_primitive *ip, struct polygon_data *po
 // main rendering routine, draws a set of primitives according to the current render state
 void gl_draw_indexed_primitive(uint32_t primitivetype, uint32_t vertextype, struct nvertex *vertices, vector3<float>* normals, uint32_t vertexcount, WORD *indices, uint32_t count, struct graphics_object *graphics_object, struct boundingbox* boundingbox, uint32_t clip, uint32_t mipmap)
 {
+	PROFILE_ZONE("gl_draw_indexed_primitive");
+
 	FILE *log;
 	uint32_t i;
 	uint32_t mode = getmode_cached()->driver_mode;
@@ -236,6 +240,8 @@ void gl_draw_indexed_primitive(uint32_t primitivetype, uint32_t vertextype, stru
 	// should never happen, broken 3rd-party models cause this
 	if(!count) return;
 
+	if (drawCapture.isRecording()) drawCapture.draw(primitivetype, vertextype, vertices, normals, vertexcount, indices, count, clip, mipmap);
+
 	// scissor test is used to emulate D3D viewports
 	if (clip) newRenderer.doScissorTest(true);
 	else newRenderer.doScissorTest(false);
@@ -293,13 +299,26 @@ void gl_draw_indexed_primitive(uint32_t primitivetype, uint32_t vertextype, stru
 	if (ff8) newRenderer.doModulateAlpha(false);
 	else newRenderer.doModulateAlpha(true);
 
-	//// upload vertex data
-	newRenderer.bindVertexBuffer(vertices, normals, vertexcount);
-	newRenderer.bindIndexBuffer(indices, count);
 	newRenderer.setPrimitiveType(RendererPrimitiveType(primitivetype));
 
-	if (!ff8 && enable_lighting && isLightingEnabledTexture) newRenderer.drawWithLighting(normals != nullptr);
-	else newRenderer.draw();
+	if (!ff8 && enable_lighting && isLightingEnabledTexture)
+	{
+		newRenderer.bindVertexBuffer(vertices, normals, vertexcount);
+		newRenderer.bindIndexBuffer(indices, count);
+		newRenderer.drawWithLighting(normals != nullptr);
+	}
+	// 2D draws come in long runs of small quads sharing the same state, merge them into a single submit
+	else if (enable_draw_batching && vertextype == TLVERTEX && primitivetype == RendererPrimitiveType::PT_TRIANGLES)
+	{
+		newRenderer.drawBatched(vertices, vertexcount, indices, count);
+	}
+	else
+	{
+		//// upload vertex data
+		newRenderer.bindVertexBuffer(vertices, normals, vertexcount);
+		newRenderer.bindIndexBuffer(indices, count);
+		newRenderer.draw();
+	}
 
 	stats.vertex_count += count;
 
@@ -308,12 +327,16 @@ void gl_draw_indexed_primitive(uint32_t primitivetype, uint32_t vertextype, stru
 
 void gl_set_worldview_matrix(struct matrix *matrix)
 {
+	if (drawCapture.isRecording()) drawCapture.worldViewMatrix(matrix);
+
 	newRenderer.setWorldViewMatrix(matrix);
 	memcpy(&current_state.world_view_matrix, matrix, sizeof(struct matrix));
 }
 
 void gl_set_d3dprojection_matrix(struct matrix *matrix)
 {
+	if (drawCapture.isRecording()) drawCapture.d3dProjectionMatrix(matrix);
+
 	memcpy(&current_state.d3dprojection_matrix, matrix, sizeof(struct matrix));
 }
 
@@ -322,6 +345,8 @@ void gl_set_blend_func(uint32_t blend_mode)
 {
 	if(trace_all) ffnx_trace("set blend mode %i\n", blend_mode);
 
+	if (drawCapture.isRecording()) drawCapture.blendMode(blend_mode);
+
 	current_state.blend_mode = blend_mode;
 
 	newRenderer.setBlendMode(RendererBlendMode(blend_mode));
@@ -25,6 +25,7 @@
 #include "../gl.h"
 #include "../macro.h"
 #include "../saveload.h"
+#include "../draw_capture.h"
 
 // check to make sure we can actually load a given texture
 bool gl_check_texture_dimensions(uint32_t width, uint32_t height, char *source)
@@ -72,13 +73,22 @@ void gl_upload_texture(struct texture_set *texture_set, uint32_t palette_index,
 
 	gl_check_texture_dimensions(w, h, "unknown");
 
-	uint32_t newTexture = newRenderer.createTexture(
-		(uint8_t*)image_data,
-		w,
-		h,
-		0,
-		RendererTextureType(format)
-	);
+	uint32_t newTexture = 0;
+
+	// Small game textures share a few atlas pages, so that consecutive 2D draws can be batched
+	if (!VREF(texture_set, ogl.external) && !VREF(texture_set, ogl.gl_set->is_animated) && VREF(tex_header, version) != FB_TEX_VERSION && format == RendererTextureType::BGRA)
+		newTexture = textureAtlas.add((uint32_t*)image_data, w, h);
+
+	if (!newTexture)
+		newTexture = newRenderer.createTexture(
+			(uint8_t*)image_data,
+			w,
+			h,
+			0,
+			RendererTextureType(format)
+		);
+
+	if (drawCapture.isRecording()) drawCapture.texture(newTexture, image_data, w, h, format);
 
 	gl_replace_texture(
 		texture_set,
@@ -107,6 +117,8 @@ void gl_bind_texture_set(struct texture_set *_texture_set)
 	}
 	else gl_set_texture(0, NULL);
 
+	if (drawCapture.isRecording()) drawCapture.textureSet(current_state.texture_handle, current_state.fb_texture);
+
 	current_state.texture_set = _texture_set;
 }
 
@@ -26,40 +26,40 @@ Hext hextPatcher;
 
 // PRIVATE
 
-int Hext::getAddress(std::string token)
+Hext::Address Hext::getAddress(std::string token)
 {
-    int ret;
+    Address ret;
 
     std::vector<std::string> sparts = split(token, "[+-]+");
-    std::vector<int> iparts;
 
+    // The pointer is read only when the patch is applied, its target may not exist yet
     if (ends_with(sparts[0], "^"))
     {
-        std::stringstream ss;
-        int *ptr = (int*)(std::stoi(sparts[0].substr(0, sparts[0].length() - 1), nullptr, 16) + inGlobalOffset);
-        ss << std::hex << *ptr;
-        sparts[0] = ss.str();
+        ret.indirect = true;
+        sparts[0] = sparts[0].substr(0, sparts[0].length() - 1);
     }
 
-    for (auto &part : sparts)
-    {
-        iparts.push_back(
-            std::stoi(part, nullptr, 16)
-        );
-    }
-
-    ret = iparts[0];
+    ret.base = std::stoi(sparts[0], nullptr, 16);
 
     if (contains(token, "+"))
     {
-        ret += iparts[1];
+        ret.delta = std::stoi(sparts[1], nullptr, 16);
     }
     else if (contains(token, "-"))
     {
-        ret -= iparts[1];
+        ret.delta = -std::stoi(sparts[1], nullptr, 16);
     }
 
-    return ret + inGlobalOffset;
+    ret.globalOffset = inGlobalOffset;
+
+    return ret;
+}
+
+int Hext::resolveAddress(const Address& address)
+{
+    int base = address.indirect ? *(int*)(address.base + address.globalOffset) : address.base;
+
+    return base + address.delta + address.globalOffset;
 }
 
 std::vector<char> Hext::getBytes(std::string token)
@@ -99,26 +99,13 @@ bool Hext::hasCheckpoint(std::string token)
     return false;
 }
 
-bool Hext::parseCheckpoint(std::string token, std::string checkpoint)
-{
-    if (starts_with(token, "!"))
-    {
-        if (contains(token, checkpoint))
-        {
-            return true;
-        }
-    }
-
-    return false;
-}
-
-bool Hext::parseCommands(std::string token)
+bool Hext::parseCommands(std::string token, std::vector<Operation>& operations)
 {
     if (starts_with(token, ">>"))
     {
         if (ends_with(token, "FF7_CENTER_FIELDS = 1"))
         {
-            ff7_center_fields = true;
+            operations.push_back(Operation{ Operation::CENTER_FIELDS });
 
             return true;
         }
@@ -130,7 +117,9 @@ bool Hext::parseCommands(std::string token)
 
         trim(token);
 
-        ffnx_trace("%s\n", token.data());
+        Operation operation{ Operation::TRACE };
+        operation.text = token;
+        operations.push_back(operation);
 
         return true;
     }
@@ -177,17 +166,16 @@ bool Hext::parseGlobalOffset(std::string token)
     return false;
 }
 
-bool Hext::parseMemoryPermission(std::string token)
+bool Hext::parseMemoryPermission(std::string token, std::vector<Operation>& operations)
 {
     if (contains(token, ":"))
     {
-        DWORD dummy;
-
         std::vector<std::string> parts = split(token, "[:]+");
-        int addr = getAddress(parts[0]);
-        int length = std::stoi(parts[1], nullptr, 16);
 
-        VirtualProtect((LPVOID)addr, length, PAGE_EXECUTE_READWRITE, &dummy);
+        Operation operation{ Operation::MEMORY_PERMISSION };
+        operation.address = getAddress(parts[0]);
+        operation.length = std::stoi(parts[1], nullptr, 16);
+        operations.push_back(operation);
 
         return true;
     }
@@ -195,17 +183,16 @@ bool Hext::parseMemoryPermission(std::string token)
     return false;
 }
 
-bool Hext::parseMemoryPatch(std::string token)
+bool Hext::parseMemoryPatch(std::string token, std::vector<Operation>& operations)
 {
     if (contains(token, "="))
     {
-        DWORD dummy;
-
         std::vector<std::string> parts = split(token, "[=]+");
-        int addr = getAddress(parts[0]);
-        std::vector<char> bytes = getBytes(parts[1]);
 
-        memcpy_code(addr, bytes.data(), bytes.size());
+        Operation operation{ Operation::MEMORY_PATCH };
+        operation.address = getAddress(parts[0]);
+        operation.bytes = getBytes(parts[1]);
+        operations.push_back(operation);
 
         return true;
     }
@@ -213,115 +200,220 @@ bool Hext::parseMemoryPatch(std::string token)
     return false;
 }
 
-// PUBLIC
+bool Hext::parseOperation(std::string token, std::vector<Operation>& operations)
+{
+    // Check if is a command
+    if (parseCommands(token, operations)) return true;
+
+    // Check if is a global offset
+    if (parseGlobalOffset(token)) return true;
+
+    // Check if is a memory permission range
+    if (parseMemoryPermission(token, operations)) return true;
 
-void Hext::apply(std::string filename)
+    // Check if is a memory patch instruction
+    if (parseMemoryPatch(token, operations)) return true;
+
+    return false;
+}
+
+void Hext::parse(std::string filename, Patch& immediate, Patch& delayed)
 {
     std::string line;
     std::ifstream ifs(filename);
+    uint32_t lineNumber = 0;
+    bool isDelayed = false, isImmediate = false;
+
+    immediate.filename = delayed.filename = filename;
+    inGlobalOffset = 0;
+    isMultilineComment = false;
 
     while (std::getline(ifs, line))
     {
+        lineNumber++;
+
         if (line.empty()) continue;
 
-        // Check if delayed, if so it should not be applied
-        if (hasCheckpoint(line)) {
-            ifs.close();
-            return;
-        }
+        try
+        {
+            if (isDelayed)
+            {
+                // Check if is a comment
+                if (parseComment(line)) continue;
+
+                // Further checkpoints do not start anything new
+                if (hasCheckpoint(line)) continue;
+
+                parseOperation(line, delayed.operations);
+            }
+            else
+            {
+                // Delayed patches start with their checkpoint, anything after it waits for the game to print it
+                if (hasCheckpoint(line))
+                {
+                    if (isImmediate) break;
 
-        // Check if is a comment
-        if (parseComment(line)) continue;
+                    isDelayed = true;
+                    delayed.checkpoint = line;
 
-        // Check if is a command
-        if (parseCommands(line)) continue;
+                    continue;
+                }
 
-        // Check if is a global offset
-        if (parseGlobalOffset(line)) continue;
+                // Check if is a comment
+                if (parseComment(line)) continue;
 
-        // Check if is a memory permission range
-        if (parseMemoryPermission(line)) continue;
+                isImmediate = true;
 
-        // Check if is a memory patch instruction
-        if (parseMemoryPatch(line)) continue;
+                parseOperation(line, immediate.operations);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            ffnx_error("Hext: %s line %u could not be parsed ( %s ), ignored\n", filename.c_str(), lineNumber, e.what());
+        }
     }
 
     ifs.close();
 
-    ffnx_trace("Applied Hext patch: %s\n", filename.c_str());
+    inGlobalOffset = 0;
 }
 
-void Hext::applyDelayed(std::string filename, std::string checkpoint)
+void Hext::load(bool applyImmediate)
 {
-    std::string line;
-    std::ifstream ifs(filename);
+    delayedPatches.clear();
+    checkpointMatches.clear();
+    loaded = true;
 
-    bool matchCheckpoint = false;
+    if (_access(hext_patching_path.c_str(), 0) != 0) return;
 
-    while (std::getline(ifs, line))
+    for (const auto& entry : std::filesystem::directory_iterator(hext_patching_path))
     {
-        if (line.empty()) continue;
+        if (!entry.is_regular_file()) continue;
+
+        Patch immediate, delayed;
 
-        // Check if is a comment
-        if (parseComment(line)) continue;
+        parse(entry.path().string(), immediate, delayed);
 
-        // Check if is a delayed patch.
-        if (parseCheckpoint(line, checkpoint)) {
-            matchCheckpoint = true;
+        if (applyImmediate && !immediate.operations.empty())
+        {
+            execute(immediate);
 
-            continue;
+            ffnx_trace("Applied Hext patch: %s\n", immediate.filename.c_str());
         }
 
-        if (matchCheckpoint)
-        {
-            // Check if is a command
-            if (parseCommands(line)) continue;
+        if (!delayed.checkpoint.empty()) delayedPatches.push_back(delayed);
+    }
 
-            // Check if is a global offset
-            if (parseGlobalOffset(line)) continue;
+    ffnx_trace("Hext: %zu delayed patches indexed\n", delayedPatches.size());
+}
 
-            // Check if is a memory permission range
-            if (parseMemoryPermission(line)) continue;
+void Hext::watch()
+{
+    // Called for every debug message, a directory which cannot be watched is not tried again
+    if (watchFailed) return;
 
-            // Check if is a memory patch instruction
-            if (parseMemoryPatch(line)) continue;
-        }
-        else
+    if (watcher == INVALID_HANDLE_VALUE)
+    {
+        if (_access(hext_patching_path.c_str(), 0) == 0)
+            watcher = FindFirstChangeNotificationA(hext_patching_path.c_str(), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+
+        if (watcher == INVALID_HANDLE_VALUE)
         {
-            break;
+            watchFailed = true;
+
+            ffnx_trace("Hext: %s cannot be watched, delayed patches will not be reloaded on changes\n", hext_patching_path.c_str());
         }
+
+        return;
     }
 
-    ifs.close();
+    if (WaitForSingleObject(watcher, 0) == WAIT_OBJECT_0)
+    {
+        ffnx_info("Hext: %s changed, reloading delayed patches\n", hext_patching_path.c_str());
 
-    if (matchCheckpoint) ffnx_trace("Applied delayed Hext patch: %s\n", filename.c_str());
+        // Immediate patches were already applied at startup, only checkpoints are taken again
+        load(false);
+
+        FindNextChangeNotification(watcher);
+    }
 }
 
-void Hext::applyAll(std::string checkpoint)
+void Hext::execute(const Patch& patch)
 {
-    if (_access(hext_patching_path.c_str(), 0) == 0)
+    for (const Operation& operation : patch.operations)
     {
-        if (!checkpoint.empty())
+        switch (operation.type)
         {
-            for (const auto& entry : std::filesystem::directory_iterator(hext_patching_path))
+        case Operation::MEMORY_PATCH:
+            memcpy_code(resolveAddress(operation.address), (void*)operation.bytes.data(), operation.bytes.size());
+            break;
+        case Operation::MEMORY_PERMISSION:
             {
-                if (entry.is_regular_file()) {
-                    applyDelayed(entry.path().string(), checkpoint);
-                }
+                DWORD dummy;
 
-                inGlobalOffset = 0;
+                VirtualProtect((LPVOID)resolveAddress(operation.address), operation.length, PAGE_EXECUTE_READWRITE, &dummy);
             }
+            break;
+        case Operation::CENTER_FIELDS:
+            ff7_center_fields = true;
+            break;
+        case Operation::TRACE:
+            ffnx_trace("%s\n", operation.text.data());
+            break;
         }
-        else
-        {
-            for (const auto& entry : std::filesystem::directory_iterator(hext_patching_path))
-            {
-                if (entry.is_regular_file()) {
-                    apply(entry.path().string());
-                }
+    }
+}
 
-                inGlobalOffset = 0;
-            }
+// PUBLIC
+
+Hext::~Hext()
+{
+    shutdown();
+}
+
+void Hext::applyAll(std::string checkpoint)
+{
+    if (checkpoint.empty())
+    {
+        load(true);
+
+        return;
+    }
+
+    if (!loaded) load(false);
+
+    if (enable_devtools) watch();
+
+    auto it = checkpointMatches.find(checkpoint);
+
+    // First time this message is printed, find which checkpoints mention it
+    if (it == checkpointMatches.end())
+    {
+        if (checkpointMatches.size() >= HEXT_MAX_CHECKPOINT_MATCHES) checkpointMatches.clear();
+
+        std::vector<size_t> matches;
+
+        for (size_t idx = 0; idx < delayedPatches.size(); idx++)
+        {
+            if (contains(delayedPatches[idx].checkpoint, checkpoint)) matches.push_back(idx);
         }
+
+        it = checkpointMatches.emplace(checkpoint, matches).first;
     }
+
+    for (size_t idx : it->second)
+    {
+        execute(delayedPatches[idx]);
+
+        ffnx_trace("Applied delayed Hext patch: %s\n", delayedPatches[idx].filename.c_str());
+    }
+}
+
+void Hext::shutdown()
+{
+    if (watcher != INVALID_HANDLE_VALUE) FindCloseChangeNotification(watcher);
+
+    watcher = INVALID_HANDLE_VALUE;
+    // Messages printed while quitting must not open it again
+    watchFailed = true;
 }
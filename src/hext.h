@@ -36,30 +36,86 @@
 #include <fstream>
 #include <locale>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 
 #include "patch.h"
 
+// Distinct debug messages remembered with the delayed patches they trigger, before starting over
+#define HEXT_MAX_CHECKPOINT_MATCHES 1024
+
+/*
+	Every patch file is parsed once into a list of operations. Files starting with a checkpoint are kept aside
+	and applied whenever the game prints a debug message found in their checkpoint line, without touching the disk.
+	Addresses read through a pointer (^) are still resolved when the patch is applied.
+
+	When the DevTools are enabled, the patch directory is watched and delayed patches are parsed again on changes.
+*/
 class Hext {
 private:
+	struct Address
+	{
+		int base = 0;
+		bool indirect = false;
+		int delta = 0;
+		int globalOffset = 0;
+	};
+
+	struct Operation
+	{
+		enum Type
+		{
+			MEMORY_PATCH,
+			MEMORY_PERMISSION,
+			CENTER_FIELDS,
+			TRACE
+		};
+
+		Type type;
+		Address address;
+		std::vector<char> bytes;
+		int length = 0;
+		std::string text;
+	};
+
+	struct Patch
+	{
+		std::string filename;
+		std::string checkpoint;
+		std::vector<Operation> operations;
+	};
+
 	int inGlobalOffset;
 	bool isMultilineComment = false;
 
-	int getAddress(std::string token);
+	bool loaded = false;
+	std::vector<Patch> delayedPatches;
+	std::unordered_map<std::string, std::vector<size_t>> checkpointMatches;
+	HANDLE watcher = INVALID_HANDLE_VALUE;
+	bool watchFailed = false;
+
+	Address getAddress(std::string token);
+	int resolveAddress(const Address& address);
 	std::vector<char> getBytes(std::string token);
 
 	bool hasCheckpoint(std::string token);
-	bool parseCheckpoint(std::string token, std::string checkpoint);
-	bool parseCommands(std::string token);
+	bool parseCommands(std::string token, std::vector<Operation>& operations);
 	bool parseComment(std::string token);
 	bool parseGlobalOffset(std::string token);
-	bool parseMemoryPermission(std::string token);
-	bool parseMemoryPatch(std::string token);
+	bool parseMemoryPermission(std::string token, std::vector<Operation>& operations);
+	bool parseMemoryPatch(std::string token, std::vector<Operation>& operations);
+	bool parseOperation(std::string token, std::vector<Operation>& operations);
+
+	void parse(std::string filename, Patch& immediate, Patch& delayed);
+	void load(bool applyImmediate);
+	void watch();
+	void execute(const Patch& patch);
 
 public:
-	void apply(std::string filename);
-	void applyDelayed(std::string filename, std::string checkpoint);
+	~Hext();
+
 	void applyAll(std::string checkpoint = std::string());
+	void shutdown();
 };
 
 extern Hext hextPatcher;
@@ -0,0 +1,283 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <algorithm>
+#include <cctype>
+#include <string.h>
+#include <vector>
+
+#include "lgp.h"
+#ifdef _WIN32
+#include "log.h"
+#endif
+
+// On-disk layout, see https://wiki.ffrtt.ru/index.php/FF7/LGP_format
+#define LGP_HEADER_SIZE 16
+#define LGP_TOC_ENTRY_SIZE 27
+#define LGP_TOC_NAME_SIZE 20
+#define LGP_LOOKUP_TABLE_SIZE (30 * 30 * 4)
+#define LGP_CONFLICT_ENTRY_SIZE 130
+#define LGP_CONFLICT_NAME_SIZE 128
+
+static uint16_t read16(const uint8_t *ptr)
+{
+	uint16_t ret;
+
+	memcpy(&ret, ptr, sizeof(ret));
+
+	return ret;
+}
+
+static uint32_t read32(const uint8_t *ptr)
+{
+	uint32_t ret;
+
+	memcpy(&ret, ptr, sizeof(ret));
+
+	return ret;
+}
+
+// PRIVATE
+
+bool LgpArchive::parse()
+{
+	if (size < LGP_HEADER_SIZE) return false;
+
+	uint32_t fileCount = read32(data + 12);
+
+	// Checked before computing the table size, which could overflow on 32-bit
+	if (fileCount > (size - LGP_HEADER_SIZE) / LGP_TOC_ENTRY_SIZE) return false;
+
+	size_t tocEnd = LGP_HEADER_SIZE + size_t(fileCount) * LGP_TOC_ENTRY_SIZE;
+
+	if (size - tocEnd < LGP_LOOKUP_TABLE_SIZE + 2) return false;
+
+	std::vector<const uint8_t *> toc(fileCount);
+
+	for (uint32_t i = 0; i < fileCount; i++)
+	{
+		const uint8_t *tocEntry = data + LGP_HEADER_SIZE + size_t(i) * LGP_TOC_ENTRY_SIZE;
+		Entry entry;
+
+		toc[i] = tocEntry;
+		entry.offset = read32(tocEntry + LGP_TOC_NAME_SIZE);
+		entry.conflict = read16(tocEntry + LGP_TOC_NAME_SIZE + 5) != 0;
+
+		if (size_t(entry.offset) + LGP_FILE_HEADER_SIZE > size) return false;
+
+		// Keep the first entry, like the engine lookup would
+		names.emplace(normalize((const char *)tocEntry, LGP_TOC_NAME_SIZE), entry);
+	}
+
+	size_t cursor = tocEnd + LGP_LOOKUP_TABLE_SIZE;
+	uint16_t conflictCount = read16(data + cursor);
+
+	cursor += 2;
+
+	for (uint16_t i = 0; i < conflictCount; i++)
+	{
+		if (size - cursor < 2) return false;
+
+		uint16_t entryCount = read16(data + cursor);
+
+		cursor += 2;
+
+		if (size - cursor < size_t(entryCount) * LGP_CONFLICT_ENTRY_SIZE) return false;
+
+		for (uint16_t j = 0; j < entryCount; j++, cursor += LGP_CONFLICT_ENTRY_SIZE)
+		{
+			uint16_t tocIndex = read16(data + cursor + LGP_CONFLICT_NAME_SIZE);
+
+			if (tocIndex >= fileCount) return false;
+
+			std::string key = normalize((const char *)data + cursor, LGP_CONFLICT_NAME_SIZE);
+
+			key += '/';
+			key += normalize((const char *)toc[tocIndex], LGP_TOC_NAME_SIZE);
+
+			conflicts.emplace(key, read32(toc[tocIndex] + LGP_TOC_NAME_SIZE));
+		}
+	}
+
+	return true;
+}
+
+// PUBLIC
+
+LgpArchive::~LgpArchive()
+{
+	close();
+}
+
+std::string LgpArchive::normalize(const char *name, size_t length)
+{
+	std::string ret(name, strnlen(name, length));
+
+	std::replace(ret.begin(), ret.end(), '\\', '/');
+	std::transform(ret.begin(), ret.end(), ret.begin(), [](unsigned char c) { return std::tolower(c); });
+
+	while (!ret.empty() && ret.back() == '/') ret.pop_back();
+
+	return ret;
+}
+
+bool LgpArchive::parse(const uint8_t *buffer, size_t bufferSize)
+{
+	names.clear();
+	conflicts.clear();
+
+	data = buffer;
+	size = bufferSize;
+
+	if (parse()) return true;
+
+	names.clear();
+	conflicts.clear();
+
+	data = nullptr;
+	size = 0;
+
+	return false;
+}
+
+#ifdef _WIN32
+bool LgpArchive::open(const std::string &archivePath)
+{
+	close();
+
+	path = archivePath;
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > LGP_MAX_MAPPED_SIZE)
+	{
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if (mapping != nullptr) view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (view == nullptr)
+	{
+		ffnx_warning("LgpArchive: could not map %s, falling back to regular reads\n", path.c_str());
+		close();
+		return false;
+	}
+
+	if (!parse((const uint8_t *)view, size_t(fileSize.QuadPart)))
+	{
+		ffnx_glitch("LgpArchive: could not parse the table of contents of %s, falling back to the engine lookup\n", path.c_str());
+		close();
+		return false;
+	}
+
+	if (trace_all || trace_files) ffnx_trace("LgpArchive: indexed %zu files (%zu conflicts) in %s\n", names.size(), conflicts.size(), path.c_str());
+
+	return true;
+}
+#endif
+
+void LgpArchive::close()
+{
+#ifdef _WIN32
+	if (view != nullptr) UnmapViewOfFile(view);
+	if (mapping != nullptr) CloseHandle(mapping);
+	if (file != nullptr) CloseHandle(file);
+#endif
+
+	view = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	data = nullptr;
+	size = 0;
+
+	names.clear();
+	conflicts.clear();
+}
+
+bool LgpArchive::isOpen()
+{
+	return data != nullptr;
+}
+
+bool LgpArchive::find(const char *name, const char *currentDir, uint32_t &offset, bool &resolvedConflict)
+{
+	// TOC names are cut at LGP_TOC_NAME_SIZE, a longer name would match an entry sharing its first characters
+	if (strnlen(name, LGP_TOC_NAME_SIZE + 1) > LGP_TOC_NAME_SIZE) return false;
+
+	std::string key = normalize(name, LGP_TOC_NAME_SIZE);
+	auto it = names.find(key);
+
+	if (it == names.end()) return false;
+
+	if (!it->second.conflict)
+	{
+		offset = it->second.offset;
+		resolvedConflict = false;
+
+		return true;
+	}
+
+	// There are multiple files with this name, the current directory tells which one
+	auto conflict = conflicts.find(normalize(currentDir, strlen(currentDir)) + '/' + key);
+
+	if (conflict == conflicts.end()) return false;
+
+	offset = conflict->second;
+	resolvedConflict = true;
+
+	return true;
+}
+
+uint32_t LgpArchive::getFileSize(uint32_t offset)
+{
+	if (size_t(offset) + LGP_FILE_HEADER_SIZE > size) return 0;
+
+	return read32(data + offset + LGP_FILE_HEADER_SIZE - 4);
+}
+
+uint32_t LgpArchive::read(uint32_t position, void *dest, uint32_t count)
+{
+	if (position >= size) return 0;
+
+	if (count > size - position) count = uint32_t(size - position);
+
+	memcpy(dest, data + position, count);
+
+	return count;
+}
+
+size_t LgpArchive::getFileCount()
+{
+	return names.size();
+}
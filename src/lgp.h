@@ -0,0 +1,86 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+// Archives bigger than this are read through the game's own file handle instead of being mapped
+#define LGP_MAX_MAPPED_SIZE (512 * 1024 * 1024)
+
+/*
+ * Read-only view of an LGP archive.
+ *
+ * The table of contents is parsed once when the archive is opened, and file names are resolved with a hash lookup
+ * instead of the engine's lookup table and linear scans. Files sharing the same name across several directories
+ * are resolved through the conflict table, against the current directory, like the engine does.
+ *
+ * File data is served straight from a memory mapping of the archive.
+ * Parsing only needs the archive bytes, only the mapping itself is Windows specific.
+ */
+class LgpArchive
+{
+public:
+	struct Entry
+	{
+		uint32_t offset; // Offset of the file header in the archive, the data starts LGP_FILE_HEADER_SIZE bytes later
+		bool conflict;
+	};
+
+	static const uint32_t LGP_FILE_HEADER_SIZE = 24;
+
+private:
+	std::string path;
+	void *file = nullptr;
+	void *mapping = nullptr;
+	const void *view = nullptr;
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+
+	std::unordered_map<std::string, Entry> names;
+	std::unordered_map<std::string, uint32_t> conflicts;
+
+	bool parse();
+
+public:
+	~LgpArchive();
+
+	static std::string normalize(const char *name, size_t length);
+
+	// Index an archive already in memory, the buffer is not copied and must outlive the archive
+	bool parse(const uint8_t *buffer, size_t bufferSize);
+
+#ifdef _WIN32
+	bool open(const std::string &archivePath);
+#endif
+	void close();
+	bool isOpen();
+
+	// Returns false when the file does not exist in the archive, or exists only in other directories
+	bool find(const char *name, const char *currentDir, uint32_t &offset, bool &resolvedConflict);
+
+	uint32_t getFileSize(uint32_t offset);
+	uint32_t read(uint32_t position, void *dest, uint32_t count);
+
+	size_t getFileCount();
+};
@@ -27,6 +27,7 @@
 #include "ff8.h"
 #include "field.h"
 #include "cfg.h"
+#include "profiler.h"
 
 Lighting lighting;
 
@@ -701,6 +702,8 @@ void Lighting::init()
 
 void Lighting::draw(struct game_obj* game_object)
 {
+    PROFILE_ZONE("Lighting::draw");
+
     VOBJ(game_obj, game_object, game_object);
     struct game_mode* mode = getmode_cached();
 
@@ -19,7 +19,10 @@
 //    GNU General Public License for more details.                          //
 /****************************************************************************/
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <stdio.h>
 #include <windows.h>
 
@@ -30,11 +33,156 @@
 
 FILE *app_log;
 
+struct log_record
+{
+	std::atomic<uint32_t> sequence;
+	uint32_t frame;
+	uint32_t length;
+	char text[LOG_RECORD_SIZE];
+};
+
+struct log_category
+{
+	const char *name;
+	std::atomic<uint32_t> window;
+	std::atomic<uint32_t> count;
+	std::atomic<uint32_t> suppressed;
+};
+
+// Bounded multi-producer queue, every slot carries a sequence number telling whether it is free or filled
+// See https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+static log_record log_queue[LOG_QUEUE_SIZE];
+static std::atomic<uint32_t> log_enqueue_pos = 0;
+static uint32_t log_dequeue_pos = 0;
+static std::atomic<uint32_t> log_dropped = 0;
+
+// Held by whoever is consuming the queue, the writer thread or a synchronous flush
+static std::mutex log_write_mutex;
+static std::thread log_writer;
+static std::atomic<bool> log_writer_running = false;
+static HANDLE log_writer_event = NULL;
+
+static char log_batch[LOG_BATCH_SIZE];
+static uint32_t log_batch_length = 0;
+
+static log_category log_categories[] = {
+	{ "WARNING" }, { "INFO" }, { "DUMP" }, { "TRACE" }, { "GLITCH" }, { "UNEXPECTED" }
+};
+
+static void log_batch_append(const char *str, uint32_t length)
+{
+	if (log_batch_length + length > sizeof(log_batch))
+	{
+		fwrite(log_batch, 1, log_batch_length, app_log);
+		log_batch_length = 0;
+	}
+
+	memcpy(log_batch + log_batch_length, str, length);
+	log_batch_length += length;
+}
+
+static void log_batch_append_line(uint32_t frame, const char *str, uint32_t length)
+{
+	char tmp_str[16];
+
+	log_batch_append(tmp_str, sprintf(tmp_str, "[%08i] ", frame));
+	log_batch_append(str, length);
+}
+
+// Must be called with log_write_mutex held
+static void log_drain()
+{
+	uint32_t dropped = log_dropped.exchange(0);
+
+	while (true)
+	{
+		log_record *record = &log_queue[log_dequeue_pos & (LOG_QUEUE_SIZE - 1)];
+
+		if (int32_t(record->sequence.load(std::memory_order_acquire) - (log_dequeue_pos + 1)) < 0) break;
+
+		log_batch_append_line(record->frame, record->text, record->length);
+
+		record->sequence.store(log_dequeue_pos + LOG_QUEUE_SIZE, std::memory_order_release);
+		log_dequeue_pos++;
+	}
+
+	if (dropped > 0)
+	{
+		char tmp_str[128];
+
+		log_batch_append_line(frame_counter, tmp_str, sprintf(tmp_str, "WARNING: log queue full, %u lines dropped\n", dropped));
+	}
+
+	if (log_batch_length > 0)
+	{
+		fwrite(log_batch, 1, log_batch_length, app_log);
+		fflush(app_log);
+		log_batch_length = 0;
+	}
+}
+
+static void log_writer_work()
+{
+	while (log_writer_running)
+	{
+		WaitForSingleObject(log_writer_event, LOG_WRITER_INTERVAL_MS);
+
+		std::lock_guard<std::mutex> lock(log_write_mutex);
+
+		log_drain();
+	}
+}
+
 void open_applog(char *path)
 {
 	app_log = fopen(path, "wb");
 
-	if(!app_log) MessageBoxA(gameHwnd, "Failed to open log file", "Error", 0);
+	if(!app_log)
+	{
+		MessageBoxA(gameHwnd, "Failed to open log file", "Error", 0);
+		return;
+	}
+
+	for (uint32_t i = 0; i < LOG_QUEUE_SIZE; i++) log_queue[i].sequence = i;
+
+	log_writer_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+	log_writer_running = true;
+	log_writer = std::thread(log_writer_work);
+}
+
+void flush_applog()
+{
+	if (!app_log) return;
+
+	// Never wait forever, we may be called from a crash which happened while the queue was being written
+	for (uint32_t i = 0; i < LOG_FLUSH_TIMEOUT_MS; i++)
+	{
+		if (log_write_mutex.try_lock())
+		{
+			log_drain();
+			log_write_mutex.unlock();
+
+			return;
+		}
+
+		Sleep(1);
+	}
+}
+
+void close_applog()
+{
+	if (!log_writer_running) return;
+
+	log_writer_running = false;
+	// Pairs with the fence in debug_print, a record published after the final flush sees the writer stopped
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	SetEvent(log_writer_event);
+	log_writer.join();
+
+	CloseHandle(log_writer_event);
+	log_writer_event = NULL;
+
+	flush_applog();
 }
 
 void plugin_trace(const char *fmt, ...)
@@ -95,12 +243,106 @@ void plugin_error(const char *fmt, ...)
 
 void debug_print(const char *str)
 {
-	char tmp_str[1024];
+	if (!app_log) return;
+
+	uint32_t length = strnlen(str, LOG_RECORD_SIZE);
+
+	// Nobody is consuming the queue once the writer is closed, write straight to the file
+	if (!log_writer_running)
+	{
+		std::lock_guard<std::mutex> lock(log_write_mutex);
+
+		log_batch_append_line(frame_counter, str, length);
+		fwrite(log_batch, 1, log_batch_length, app_log);
+		fflush(app_log);
+		log_batch_length = 0;
+
+		return;
+	}
+
+	uint32_t pos = log_enqueue_pos.load(std::memory_order_relaxed);
+	log_record *record;
+
+	while (true)
+	{
+		record = &log_queue[pos & (LOG_QUEUE_SIZE - 1)];
+
+		int32_t diff = int32_t(record->sequence.load(std::memory_order_acquire) - pos);
+
+		if (diff == 0)
+		{
+			if (log_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		}
+		else if (diff < 0)
+		{
+			// Full, the writer thread will report how many lines were lost
+			log_dropped++;
+			SetEvent(log_writer_event);
+
+			return;
+		}
+		else pos = log_enqueue_pos.load(std::memory_order_relaxed);
+	}
+
+	record->frame = frame_counter;
+	record->length = length;
+	memcpy(record->text, str, length);
 
-	sprintf(tmp_str, "[%08i] %s", frame_counter, str);
+	record->sequence.store(pos + 1, std::memory_order_release);
 
-	fwrite(tmp_str, 1, strlen(tmp_str), app_log);
-	fflush(app_log);
+	// The writer may have been closed, and its final flush done, while this record was being filled: nobody would write it then
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (!log_writer_running)
+	{
+		std::lock_guard<std::mutex> lock(log_write_mutex);
+
+		log_drain();
+
+		return;
+	}
+
+	// Wake up the writer every half queue instead of on every line, otherwise it drains on its own interval
+	if ((pos & (LOG_QUEUE_SIZE / 2 - 1)) == 0) SetEvent(log_writer_event);
+}
+
+// Returns false if the line has to be suppressed as its category already printed too many lines in the current second
+static bool log_rate_limit(const char *prefix)
+{
+	if (log_max_lines_per_second <= 0 || prefix == nullptr) return true;
+
+	for (log_category& category : log_categories)
+	{
+		if (strcmp(category.name, prefix) != 0) continue;
+
+		uint32_t now = GetTickCount() / 1000;
+
+		if (category.window.exchange(now) != now)
+		{
+			uint32_t suppressed = category.suppressed.exchange(0);
+
+			category.count = 0;
+
+			if (suppressed > 0)
+			{
+				char tmp_str[128];
+
+				_snprintf(tmp_str, sizeof(tmp_str), "WARNING: %u %s lines suppressed by log_max_lines_per_second\n", suppressed, category.name);
+				debug_print(tmp_str);
+			}
+		}
+
+		if (++category.count > uint32_t(log_max_lines_per_second))
+		{
+			category.suppressed++;
+
+			return false;
+		}
+
+		return true;
+	}
+
+	return true;
 }
 
 void show_popup_msg(uint8_t text_color, const char* fmt, ...)
@@ -164,6 +406,8 @@ void debug_printf(const char *prefix, uint32_t color, const char *fmt, ...)
 	char tmp_str[1024];
 	char tmp_str2[1024];
 
+	if (!log_rate_limit(prefix)) return;
+
 	va_start(args, fmt);
 
 	vsnprintf(tmp_str, sizeof(tmp_str), fmt, args);
@@ -36,7 +36,16 @@
 #define ffnx_glitch_once(x, ...) { static uint32_t glitch_ ## __LINE__ = false; if(!glitch_ ## __LINE__) { ffnx_glitch(x, __VA_ARGS__); glitch_ ## __LINE__ = true; } }
 #define ffnx_unexpected_once(x, ...) { static uint32_t unexpected_ ## __LINE__ = false; if(!unexpected_ ## __LINE__) { ffnx_unexpected(x, __VA_ARGS__); unexpected_ ## __LINE__ = true; } }
 
+// Lines are queued by the caller and written in batches by a background thread
+#define LOG_QUEUE_SIZE 2048 // Must be a power of two
+#define LOG_RECORD_SIZE 1024
+#define LOG_BATCH_SIZE (64 * 1024)
+#define LOG_WRITER_INTERVAL_MS 100
+#define LOG_FLUSH_TIMEOUT_MS 1000
+
 void open_applog(char *path);
+void flush_applog();
+void close_applog();
 
 void plugin_trace(const char *fmt, ...);
 void plugin_info(const char *fmt, ...);
@@ -30,6 +30,11 @@
 #include "api.h"
 #include "renderer.h"
 #include "lighting_debug.h"
+#include "saveload.h"
+#include "profiler.h"
+#include "draw_capture.h"
+#include "texture_atlas.h"
+#include "audio.h"
 
 #define IMGUI_VIEW_ID 255
 
@@ -309,11 +314,53 @@ void Overlay::drawMainWindow() {
             ImGui::MenuItem("Field Debug", NULL, &field_debug_open);
             if (!ff8) ImGui::MenuItem("Lighting Debug", NULL, &lighting_debug_open);
             if (ff8) ImGui::MenuItem("World Debug", NULL, &world_debug_open);
+            ImGui::MenuItem("Texture Atlas", NULL, &texture_atlas_open);
             ImGui::EndMenu();
         }
         ImGui::EndMenuBar();
     }
     ImGui::Text("Select a dev tool from the menu.");
+    ImGui::Separator();
+    ImGui::Text("Mod path index: %zu files in %zu directories", modPathIndex.getFileCount(), modPathIndex.getDirectoryCount());
+    if (ImGui::Button("Rescan mod path")) modPathIndex.invalidate();
+    ImGui::Text("Audio path index: %zu files", nxAudioEngine.getFileIndexCount());
+    if (ImGui::Button("Rescan audio paths")) nxAudioEngine.invalidateFileIndex();
+    ImGui::SameLine();
+    if (ImGui::Button("Reload audio config")) nxAudioEngine.reloadConfig();
+    ImGui::Separator();
+    ImGui::Text("Deferred draw arena: %u KB, peak %u KB", gl_deferred_arena_size() / 1024, gl_deferred_arena_peak() / 1024);
+    if (ImGui::Button(drawCapture.isCapturing() ? "Capturing draws..." : "Capture draw stream (60 frames)")) drawCapture.capture(60);
+    if (profiler.isEnabled())
+    {
+        ImGui::Separator();
+        if (ImGui::Button(profiler.isCapturing() ? "Capturing..." : "Capture 60 frames")) profiler.capture(60);
+        if (profiler.getDroppedCount() > 0)
+        {
+            ImGui::SameLine();
+            ImGui::Text("%u zones dropped", profiler.getDroppedCount());
+        }
+        if (ImGui::BeginTable("Profiler", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Zone");
+            ImGui::TableSetupColumn("ms/frame");
+            ImGui::TableSetupColumn("max ms");
+            ImGui::TableSetupColumn("calls/frame");
+            ImGui::TableHeadersRow();
+            for (const Profiler::ZoneStats& zone : profiler.getZoneStats())
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(zone.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", zone.averageMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", zone.maxMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", zone.averageCalls);
+            }
+            ImGui::EndTable();
+        }
+    }
     ImGui::End();
 }
 
@@ -329,6 +376,7 @@ void Overlay::draw()
         if (field_debug_open) field_debug(&field_debug_open);
         if (!ff8 && lighting_debug_open) lighting_debug(&lighting_debug_open);
         if (ff8 && world_debug_open) world_debug(&world_debug_open);
+        if (texture_atlas_open) texture_atlas_debug(&texture_atlas_open);
     }
 
     ImGui::Render();
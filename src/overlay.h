@@ -40,6 +40,7 @@ private:
 	bool field_debug_open = false;
 	bool lighting_debug_open = false;
 	bool world_debug_open = false;
+	bool texture_atlas_open = false;
 
 	void UpdateMousePos();
 	bool UpdateMouseCursor();
@@ -0,0 +1,325 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <algorithm>
+
+#include "profiler.h"
+#include "log.h"
+
+Profiler profiler;
+
+thread_local Profiler::ThreadBuffer* Profiler::currentThread = nullptr;
+thread_local Profiler::ThreadBufferOwner Profiler::currentThreadOwner;
+
+Profiler::ThreadBufferOwner::~ThreadBufferOwner()
+{
+	if (buffer != nullptr) buffer->retired.store(true, std::memory_order_release);
+}
+
+// PRIVATE
+
+time_t Profiler::now()
+{
+	time_t ret;
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&ret);
+
+	return ret;
+}
+
+Profiler::ThreadBuffer* Profiler::getThreadBuffer()
+{
+	if (currentThread == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Threads such as the movie decoder come and go, their buffers are recycled instead of piling up
+		for (ThreadBuffer* thread : threads)
+		{
+			if (thread->retired.load(std::memory_order_acquire) && thread->collected == thread->written.load(std::memory_order_relaxed))
+			{
+				currentThread = thread;
+				break;
+			}
+		}
+
+		if (currentThread == nullptr)
+		{
+			currentThread = new ThreadBuffer();
+			currentThread->id = threads.size();
+
+			threads.push_back(currentThread);
+		}
+
+		currentThread->name = "Thread " + std::to_string(currentThread->id);
+		currentThread->depth = 0;
+		currentThread->retired.store(false, std::memory_order_relaxed);
+
+		currentThreadOwner.buffer = currentThread;
+	}
+
+	return currentThread;
+}
+
+void Profiler::collect(ThreadBuffer* thread)
+{
+	uint32_t written = thread->written.load(std::memory_order_acquire);
+
+	// The thread recorded more than the ring can hold since the last frame
+	if (written - thread->collected > PROFILER_RING_SIZE)
+	{
+		dropped += written - thread->collected - PROFILER_RING_SIZE;
+		thread->collected = written - PROFILER_RING_SIZE;
+	}
+
+	for (; thread->collected != written; thread->collected++)
+	{
+		Event event = thread->events[thread->collected % PROFILER_RING_SIZE];
+
+		// The thread may have wrapped around the ring and overwritten the slot while it was copied
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (thread->written.load(std::memory_order_relaxed) - thread->collected >= PROFILER_RING_SIZE)
+		{
+			dropped++;
+			continue;
+		}
+
+		Zone& zone = zones[event.name];
+
+		zone.frameMs += double(event.end - event.begin) * 1000.0 / double(frequency);
+		zone.frameCalls++;
+
+		if (captureFrames > 0) captured.push_back({ event.name, event.begin, event.end, thread->id });
+	}
+}
+
+void Profiler::writeCapture()
+{
+	char filename[64];
+
+	sprintf(filename, "profile_%u.json", frames);
+
+	FILE* file = fopen(filename, "wb");
+
+	if (file == nullptr)
+	{
+		ffnx_error("Profiler: could not open %s for writing\n", filename);
+		captured.clear();
+		return;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (ThreadBuffer* thread : threads)
+		{
+			fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", thread->id, thread->name.c_str());
+		}
+	}
+
+	for (const CapturedEvent& event : captured)
+	{
+		double ts = double(event.begin - captureStart) * 1000000.0 / double(frequency);
+		double dur = double(event.end - event.begin) * 1000000.0 / double(frequency);
+
+		fprintf(file, "{\"name\":\"");
+
+		// Zone names are identifiers, only quotes and backslashes need escaping
+		for (const char* c = event.name; *c; c++)
+		{
+			if (*c == '"' || *c == '\\') fputc('\\', file);
+			fputc(*c, file);
+		}
+
+		fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n", event.thread, ts, dur);
+	}
+
+	// Closing metadata event, so every previous entry can end with a comma
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"FFNx\"}}\n]}\n");
+
+	fclose(file);
+
+	ffnx_info("Profiler: saved %zu zones to %s\n", captured.size(), filename);
+
+	captured.clear();
+}
+
+// PUBLIC
+
+void Profiler::init(bool enable)
+{
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+	enabled = enable;
+
+	// init runs on the game thread, which may not be the first one to record a zone
+	setThreadName("Main");
+}
+
+bool Profiler::isEnabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::begin(const char* name)
+{
+	ThreadBuffer* thread = getThreadBuffer();
+
+	if (thread->depth < PROFILER_MAX_DEPTH)
+	{
+		thread->openNames[thread->depth] = name;
+		thread->openTimes[thread->depth] = now();
+	}
+
+	thread->depth++;
+}
+
+void Profiler::beginCopy(const char* name)
+{
+	const char* interned;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		interned = names.insert(name).first->c_str();
+	}
+
+	begin(interned);
+}
+
+void Profiler::end()
+{
+	ThreadBuffer* thread = currentThread;
+
+	// Zone opened before the profiler was enabled
+	if (thread == nullptr || thread->depth == 0) return;
+
+	thread->depth--;
+
+	if (thread->depth >= PROFILER_MAX_DEPTH) return;
+
+	uint32_t index = thread->written.load(std::memory_order_relaxed);
+	Event& event = thread->events[index % PROFILER_RING_SIZE];
+
+	event.name = thread->openNames[thread->depth];
+	event.begin = thread->openTimes[thread->depth];
+	event.end = now();
+	event.depth = thread->depth;
+
+	thread->written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	if (!isEnabled()) return;
+
+	ThreadBuffer* thread = getThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	thread->name = name;
+}
+
+void Profiler::frame()
+{
+	if (!isEnabled()) return;
+
+	uint32_t slot = frames % PROFILER_AVERAGE_FRAMES;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (ThreadBuffer* thread : threads) collect(thread);
+	}
+
+	for (auto& it : zones)
+	{
+		Zone& zone = it.second;
+
+		zone.ms[slot] = zone.frameMs;
+		zone.calls[slot] = zone.frameCalls;
+		zone.frameMs = 0.0;
+		zone.frameCalls = 0;
+	}
+
+	frames++;
+
+	if (captureFrames > 0)
+	{
+		captureFrames--;
+
+		if (captureFrames == 0) writeCapture();
+	}
+}
+
+void Profiler::capture(uint32_t frameCount)
+{
+	if (!isEnabled() || captureFrames > 0) return;
+
+	captureFrames = frameCount;
+	captureStart = now();
+	captured.clear();
+}
+
+bool Profiler::isCapturing()
+{
+	return captureFrames > 0;
+}
+
+std::vector<Profiler::ZoneStats> Profiler::getZoneStats()
+{
+	std::vector<ZoneStats> ret;
+	uint32_t count = std::min<uint32_t>(frames, PROFILER_AVERAGE_FRAMES);
+
+	if (count == 0) return ret;
+
+	for (const auto& it : zones)
+	{
+		const Zone& zone = it.second;
+		ZoneStats stats;
+
+		stats.name = it.first;
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			stats.averageMs += zone.ms[i];
+			stats.averageCalls += zone.calls[i];
+			stats.maxMs = std::max(stats.maxMs, zone.ms[i]);
+		}
+
+		stats.averageMs /= count;
+		stats.averageCalls /= count;
+
+		ret.push_back(stats);
+	}
+
+	std::sort(ret.begin(), ret.end(), [](const ZoneStats& a, const ZoneStats& b) { return a.averageMs > b.averageMs; });
+
+	return ret;
+}
+
+uint32_t Profiler::getDroppedCount()
+{
+	return dropped;
+}
@@ -0,0 +1,178 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+
+// Events each thread can record before they are collected at the end of the frame
+#define PROFILER_RING_SIZE 16384
+// Deepest zone nesting tracked per thread
+#define PROFILER_MAX_DEPTH 64
+// Frames averaged in the zone table
+#define PROFILER_AVERAGE_FRAMES 60
+
+#define PROFILE_CONCAT_(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Time the rest of the enclosing scope. The name must outlive the program, use a string literal
+#define PROFILE_ZONE(name) ProfilerZone PROFILE_CONCAT(profiler_zone_, __LINE__)(name)
+
+/*
+ * Low overhead CPU profiler made of named scoped zones.
+ *
+ * Every thread records the zones it closes into its own ring buffer, without locking.
+ * Buffers of threads which exited are reused by the next threads, once all their zones are collected.
+ * At the end of every frame the main thread collects them, to feed a rolling per-zone table
+ * and, while a capture is running, a Chrome trace-event JSON file ( chrome://tracing, Perfetto ).
+ *
+ * Zones cost a single branch while the profiler is disabled.
+ */
+class Profiler
+{
+public:
+	struct ZoneStats
+	{
+		const char* name = nullptr;
+		double averageMs = 0.0;
+		double maxMs = 0.0;
+		double averageCalls = 0.0;
+	};
+
+private:
+	struct Event
+	{
+		const char* name;
+		time_t begin;
+		time_t end;
+		uint32_t depth;
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t id = 0;
+		std::string name;
+		// Set when the thread exits, the buffer is given to the next new thread once collected
+		std::atomic<bool> retired = false;
+
+		Event events[PROFILER_RING_SIZE];
+		std::atomic<uint32_t> written = 0;
+		// Only touched by the collecting thread
+		uint32_t collected = 0;
+
+		const char* openNames[PROFILER_MAX_DEPTH];
+		time_t openTimes[PROFILER_MAX_DEPTH];
+		uint32_t depth = 0;
+	};
+
+	struct Zone
+	{
+		double frameMs = 0.0;
+		uint32_t frameCalls = 0;
+		double ms[PROFILER_AVERAGE_FRAMES] = { 0.0 };
+		uint32_t calls[PROFILER_AVERAGE_FRAMES] = { 0 };
+	};
+
+	struct CapturedEvent
+	{
+		const char* name;
+		time_t begin;
+		time_t end;
+		uint32_t thread;
+	};
+
+	// Retires the buffer of the thread it belongs to when the thread exits
+	struct ThreadBufferOwner
+	{
+		ThreadBuffer* buffer = nullptr;
+
+		~ThreadBufferOwner();
+	};
+
+	static thread_local ThreadBuffer* currentThread;
+	static thread_local ThreadBufferOwner currentThreadOwner;
+
+	std::atomic<bool> enabled = false;
+	time_t frequency = 0;
+	uint32_t frames = 0;
+	uint32_t dropped = 0;
+
+	// Protects the thread list and the interned names
+	std::mutex mutex;
+	std::vector<ThreadBuffer*> threads;
+	std::unordered_set<std::string> names;
+
+	std::unordered_map<const char*, Zone> zones;
+
+	uint32_t captureFrames = 0;
+	time_t captureStart = 0;
+	std::vector<CapturedEvent> captured;
+
+	time_t now();
+	ThreadBuffer* getThreadBuffer();
+	void collect(ThreadBuffer* thread);
+	void writeCapture();
+
+public:
+	void init(bool enable);
+	bool isEnabled();
+
+	void begin(const char* name);
+	// For names which do not outlive the call, they are copied once and kept
+	void beginCopy(const char* name);
+	void end();
+
+	void setThreadName(const char* name);
+
+	// Collect the zones recorded since the previous frame, to be called once per frame from the main thread
+	void frame();
+	// Save the zones of the next frames to a Chrome trace-event JSON file
+	void capture(uint32_t frameCount);
+	bool isCapturing();
+
+	std::vector<ZoneStats> getZoneStats();
+	uint32_t getDroppedCount();
+};
+
+extern Profiler profiler;
+
+class ProfilerZone
+{
+private:
+	bool active;
+
+public:
+	ProfilerZone(const char* name) : active(profiler.isEnabled())
+	{
+		if (active) profiler.begin(name);
+	}
+
+	~ProfilerZone()
+	{
+		if (active) profiler.end();
+	}
+};
@@ -20,12 +20,48 @@
 //    GNU General Public License for more details.                          //
 /****************************************************************************/
 
+#include <algorithm>
+
 #include "renderer.h"
+#include "renderer_vertices.h"
 #include "lighting.h"
+#include "profiler.h"
+#include "draw_capture.h"
 
 Renderer newRenderer;
 RendererCallbacks bgfxCallbacks;
 
+// Shader names of Renderer::RendererUniform, in the same order
+static const struct
+{
+    const char* name;
+    bgfx::UniformType::Enum type;
+} RendererUniformDefs[] = {
+    { "VSFlags", bgfx::UniformType::Vec4 },
+    { "FSAlphaFlags", bgfx::UniformType::Vec4 },
+    { "FSMiscFlags", bgfx::UniformType::Vec4 },
+    { "FSTexFlags", bgfx::UniformType::Vec4 },
+    { "d3dViewport", bgfx::UniformType::Mat4 },
+    { "d3dProjection", bgfx::UniformType::Mat4 },
+    { "worldView", bgfx::UniformType::Mat4 },
+    { "normalMatrix", bgfx::UniformType::Mat4 },
+    { "viewMatrix", bgfx::UniformType::Mat4 },
+    { "invViewMatrix", bgfx::UniformType::Mat4 },
+    { "lightingSettings", bgfx::UniformType::Vec4 },
+    { "lightDirData", bgfx::UniformType::Vec4 },
+    { "lightData", bgfx::UniformType::Vec4 },
+    { "ambientLightData", bgfx::UniformType::Vec4 },
+    { "shadowData", bgfx::UniformType::Vec4 },
+    { "fieldShadowData", bgfx::UniformType::Vec4 },
+    { "materialData", bgfx::UniformType::Vec4 },
+    { "materialScaleData", bgfx::UniformType::Vec4 },
+    { "lightingDebugData", bgfx::UniformType::Vec4 },
+    { "iblData", bgfx::UniformType::Vec4 },
+    { "lightViewProjMatrix", bgfx::UniformType::Mat4 },
+    { "lightViewProjTexMatrix", bgfx::UniformType::Mat4 },
+    { "lightInvViewProjTexMatrix", bgfx::UniformType::Mat4 },
+};
+
 // BGFX CALLBACKS
 void RendererCallbacks::fatal(const char* _filePath, uint16_t _line, bgfx::Fatal::Enum _code, const char* _str)
 {
@@ -57,6 +93,21 @@ void RendererCallbacks::traceVargs(const char* _filePath, uint16_t _line, const
     }
 }
 
+void RendererCallbacks::profilerBegin(const char* _name, uint32_t _abgr, const char* _filePath, uint16_t _line)
+{
+    if (profiler.isEnabled()) profiler.beginCopy(_name);
+}
+
+void RendererCallbacks::profilerBeginLiteral(const char* _name, uint32_t _abgr, const char* _filePath, uint16_t _line)
+{
+    if (profiler.isEnabled()) profiler.begin(_name);
+}
+
+void RendererCallbacks::profilerEnd()
+{
+    if (profiler.isEnabled()) profiler.end();
+}
+
 uint32_t RendererCallbacks::cacheReadSize(uint64_t _id)
 {
     // Return 0 if shader is not found.
@@ -75,13 +126,40 @@ void RendererCallbacks::cacheWrite(uint64_t _id, const void* _data, uint32_t _si
 
 // PRIVATE
 
+void Renderer::getTextureFormat(RendererTextureType type, bgfx::TextureFormat::Enum* texFormat, bimg::TextureFormat::Enum* imgFormat)
+{
+    switch (type)
+    {
+    case RendererTextureType::BGRA:
+        *texFormat = bgfx::TextureFormat::BGRA8;
+        *imgFormat = bimg::TextureFormat::BGRA8;
+        break;
+    case RendererTextureType::YUV_UV:
+        *texFormat = bgfx::TextureFormat::RG8;
+        *imgFormat = bimg::TextureFormat::RG8;
+        break;
+    case RendererTextureType::YUV16:
+        *texFormat = bgfx::TextureFormat::R16;
+        *imgFormat = bimg::TextureFormat::R16;
+        break;
+    case RendererTextureType::YUV16_UV:
+        *texFormat = bgfx::TextureFormat::RG16;
+        *imgFormat = bimg::TextureFormat::RG16;
+        break;
+    default:
+        *texFormat = bgfx::TextureFormat::R8;
+        *imgFormat = bimg::TextureFormat::R8;
+        break;
+    }
+}
+
 // Via https://stackoverflow.com/a/14375308
 uint32_t Renderer::createBGRA(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
 {
     return ((b & 0xff) << 24) + ((g & 0xff) << 16) + ((r & 0xff) << 8) + (a & 0xff);
 }
 
-void Renderer::setCommonUniforms()
+void Renderer::setCommonUniforms(bgfx::ViewId viewId)
 {
     internalState.VSFlags = {
         (float)internalState.bIsTLVertex,
@@ -111,41 +189,41 @@ void Renderer::setCommonUniforms()
         (float)(internalState.texHandlers[RendererTextureSlot::TEX_NML].idx != bgfx::kInvalidHandle),
         (float)(internalState.texHandlers[RendererTextureSlot::TEX_PBR].idx != bgfx::kInvalidHandle),
         (float)(specularIblTexture.idx != bgfx::kInvalidHandle && diffuseIblTexture.idx != bgfx::kInvalidHandle && envBrdfTexture.idx != bgfx::kInvalidHandle),
-        NULL
+        (float)internalState.bIsMovieInterleavedUV
     };
-    if (uniform_log) ffnx_trace("%s: FSTexFlags XYZW(isNmlTextureLoaded %f, isPbrTextureLoaded %f, NULL, NULL)\n", __func__, internalState.FSTexFlags[0], internalState.FSTexFlags[1]);
-
-    setUniform("VSFlags", bgfx::UniformType::Vec4, internalState.VSFlags.data());
-    setUniform("FSAlphaFlags", bgfx::UniformType::Vec4, internalState.FSAlphaFlags.data());
-    setUniform("FSMiscFlags", bgfx::UniformType::Vec4, internalState.FSMiscFlags.data());
-    setUniform("FSTexFlags", bgfx::UniformType::Vec4, internalState.FSTexFlags.data());
-
-    setUniform("d3dViewport", bgfx::UniformType::Mat4, internalState.d3dViewMatrix);
-    setUniform("d3dProjection", bgfx::UniformType::Mat4, internalState.d3dProjectionMatrix);
-    setUniform("worldView", bgfx::UniformType::Mat4, internalState.worldViewMatrix);
-    setUniform("normalMatrix", bgfx::UniformType::Mat4, internalState.normalMatrix);
-    setUniform("viewMatrix", bgfx::UniformType::Mat4, internalState.viewMatrix);
-    setUniform("invViewMatrix", bgfx::UniformType::Mat4, internalState.invViewMatrix);
+    if (uniform_log) ffnx_trace("%s: FSTexFlags XYZW(isNmlTextureLoaded %f, isPbrTextureLoaded %f, isIblTextureLoaded %f, isMovieInterleavedUV %f)\n", __func__, internalState.FSTexFlags[0], internalState.FSTexFlags[1], internalState.FSTexFlags[2], internalState.FSTexFlags[3]);
+
+    setUniform(VS_FLAGS, viewId, internalState.VSFlags.data());
+    setUniform(FS_ALPHA_FLAGS, viewId, internalState.FSAlphaFlags.data());
+    setUniform(FS_MISC_FLAGS, viewId, internalState.FSMiscFlags.data());
+    setUniform(FS_TEX_FLAGS, viewId, internalState.FSTexFlags.data());
+
+    setUniform(D3D_VIEWPORT, viewId, internalState.d3dViewMatrix);
+    setUniform(D3D_PROJECTION, viewId, internalState.d3dProjectionMatrix);
+    setUniform(WORLD_VIEW, viewId, internalState.worldViewMatrix);
+    setUniform(NORMAL_MATRIX, viewId, internalState.normalMatrix);
+    setUniform(VIEW_MATRIX, viewId, internalState.viewMatrix);
+    setUniform(INV_VIEW_MATRIX, viewId, internalState.invViewMatrix);
 }
 
-void Renderer::setLightingUniforms()
+void Renderer::setLightingUniforms(bgfx::ViewId viewId)
 {
-    auto lightingState = lighting.getLightingState();
+    const LightingState& lightingState = lighting.getLightingState();
 
-    setUniform("lightingSettings", bgfx::UniformType::Vec4, lightingState.lightingSettings);
-    setUniform("lightDirData", bgfx::UniformType::Vec4, lightingState.lightDirData);
-    setUniform("lightData", bgfx::UniformType::Vec4, lightingState.lightData);
-    setUniform("ambientLightData", bgfx::UniformType::Vec4, lightingState.ambientLightData);
-    setUniform("shadowData", bgfx::UniformType::Vec4, lightingState.shadowData);
-    setUniform("fieldShadowData", bgfx::UniformType::Vec4, lightingState.fieldShadowData);
-    setUniform("materialData", bgfx::UniformType::Vec4, lightingState.materialData);
-    setUniform("materialScaleData", bgfx::UniformType::Vec4, lightingState.materialScaleData);
-    setUniform("lightingDebugData", bgfx::UniformType::Vec4, lightingState.lightingDebugData);
-    setUniform("iblData", bgfx::UniformType::Vec4, lightingState.iblData);
+    setUniform(LIGHTING_SETTINGS, viewId, lightingState.lightingSettings);
+    setUniform(LIGHT_DIR_DATA, viewId, lightingState.lightDirData);
+    setUniform(LIGHT_DATA, viewId, lightingState.lightData);
+    setUniform(AMBIENT_LIGHT_DATA, viewId, lightingState.ambientLightData);
+    setUniform(SHADOW_DATA, viewId, lightingState.shadowData);
+    setUniform(FIELD_SHADOW_DATA, viewId, lightingState.fieldShadowData);
+    setUniform(MATERIAL_DATA, viewId, lightingState.materialData);
+    setUniform(MATERIAL_SCALE_DATA, viewId, lightingState.materialScaleData);
+    setUniform(LIGHTING_DEBUG_DATA, viewId, lightingState.lightingDebugData);
+    setUniform(IBL_DATA, viewId, lightingState.iblData);
 
-    setUniform("lightViewProjMatrix", bgfx::UniformType::Mat4, lightingState.lightViewProjMatrix);
-    setUniform("lightViewProjTexMatrix", bgfx::UniformType::Mat4, lightingState.lightViewProjTexMatrix);
-    setUniform("lightInvViewProjTexMatrix", bgfx::UniformType::Mat4, lightingState.lightInvViewProjTexMatrix);
+    setUniform(LIGHT_VIEW_PROJ_MATRIX, viewId, lightingState.lightViewProjMatrix);
+    setUniform(LIGHT_VIEW_PROJ_TEX_MATRIX, viewId, lightingState.lightViewProjTexMatrix);
+    setUniform(LIGHT_INV_VIEW_PROJ_TEX_MATRIX, viewId, lightingState.lightInvViewProjTexMatrix);
 }
 
 bgfx::RendererType::Enum Renderer::getUserChosenRenderer() {
@@ -171,6 +249,9 @@ bgfx::RendererType::Enum Renderer::getUserChosenRenderer() {
     case RENDERER_BACKEND_VULKAN:
         ret = bgfx::RendererType::Vulkan;
         break;
+    case RENDERER_BACKEND_NOOP:
+        ret = bgfx::RendererType::Noop;
+        break;
     default:
         ret = bgfx::RendererType::Noop;
         break;
@@ -181,8 +262,6 @@ bgfx::RendererType::Enum Renderer::getUserChosenRenderer() {
 
 void Renderer::updateRendererShaderPaths()
 {
-    std::string shaderSuffix;
-
     switch (getCaps()->rendererType)
     {
     case bgfx::RendererType::OpenGL:
@@ -205,6 +284,11 @@ void Renderer::updateRendererShaderPaths()
         currentRenderer = "Vulkan";
         shaderSuffix = ".vk";
         break;
+    case bgfx::RendererType::Noop:
+        // Used by the replay tool, which never compiles the shaders, any of the shipped binaries will do
+        currentRenderer = "Noop";
+        shaderSuffix = ".d3d11";
+        break;
     }
 
     vertexPathFlat += ".flat" + shaderSuffix + ".vert";
@@ -226,12 +310,14 @@ void Renderer::updateRendererShaderPaths()
 }
 
 // Via https://dev.to/pperon/hello-bgfx-4dka
-bgfx::ShaderHandle Renderer::getShader(const char* filePath)
+bgfx::ShaderHandle Renderer::getShader(const char* filePath, bool required)
 {
     bgfx::ShaderHandle handle = BGFX_INVALID_HANDLE;
 
     FILE* file = fopen(filePath, "rb");
 
+    if (file == NULL && !required) return handle;
+
     if (file == NULL)
     {
         char tmp[1024]{ 0 };
@@ -261,53 +347,145 @@ bgfx::ShaderHandle Renderer::getShader(const char* filePath)
     return handle;
 }
 
-bgfx::UniformHandle Renderer::getUniform(std::string uniformName, bgfx::UniformType::Enum uniformType)
+int Renderer::getPermutation()
 {
-    bgfx::UniformHandle handle;
-    auto ret = bgfxUniformHandles.find(uniformName);
+    // Movies and framebuffer textures are rare enough to stay on the generic shader
+    if (internalState.bIsMovie || internalState.bIsMovieYUV || internalState.bIsFBTexture) return -1;
+
+    int ret = 0;
 
-    if (ret != bgfxUniformHandles.end())
+    if (internalState.bIsTLVertex) ret |= PERMUTATION_TLVERTEX;
+
+    if (internalState.bIsTexture)
     {
-        handle = { (uint16_t)ret->second };
+        ret |= PERMUTATION_TEXTURE;
+
+        if (internalState.bDoAlphaTest) ret |= PERMUTATION_ALPHATEST;
     }
-    else
+
+    return ret;
+}
+
+bgfx::ProgramHandle Renderer::getGameProgram()
+{
+    bgfx::ProgramHandle fallback = backendProgramHandles[backendProgram];
+
+    if (!enable_shader_permutations || (backendProgram != RendererProgram::FLAT && backendProgram != RendererProgram::SMOOTH)) return fallback;
+
+    int permutation = getPermutation();
+
+    if (permutation < 0) return fallback;
+
+    uint32_t idx = (backendProgram == RendererProgram::SMOOTH ? PERMUTATION_COUNT : 0) + permutation;
+
+    if (!permutationLoaded[idx])
     {
-        handle = bgfx::createUniform(uniformName.c_str(), uniformType);
-        bgfxUniformHandles[uniformName] = handle.idx;
+        permutationLoaded.set(idx);
+
+        std::string path = std::string("shaders/FFNx") + (backendProgram == RendererProgram::SMOOTH ? ".smooth" : ".flat") + ".p" + std::to_string(permutation) + shaderSuffix;
+        bgfx::ShaderHandle vertexShader = getShader((path + ".vert").c_str(), false);
+        bgfx::ShaderHandle fragmentShader = getShader((path + ".frag").c_str(), false);
+
+        if (bgfx::isValid(vertexShader) && bgfx::isValid(fragmentShader))
+        {
+            permutationProgramHandles[idx] = bgfx::createProgram(vertexShader, fragmentShader, true);
+
+            if (trace_all || trace_renderer) ffnx_trace("Renderer::%s: loaded shader permutation %s\n", __func__, path.c_str());
+        }
+        else
+        {
+            // Shaders from an older build, keep using the generic shader for this state
+            if (bgfx::isValid(vertexShader)) bgfx::destroy(vertexShader);
+            if (bgfx::isValid(fragmentShader)) bgfx::destroy(fragmentShader);
+
+            ffnx_warning("Renderer: missing shader permutation %s, falling back to the generic shader\n", path.c_str());
+        }
     }
 
-    return handle;
+    if (bgfx::isValid(permutationProgramHandles[idx])) return permutationProgramHandles[idx];
+
+    return fallback;
 }
 
-bgfx::UniformHandle Renderer::setUniform(const char* uniformName, bgfx::UniformType::Enum uniformType, const void* uniformValue)
+bgfx::UniformHandle Renderer::getUniform(RendererUniform uniform)
 {
-    bgfx::UniformHandle handle = getUniform(std::string(uniformName), uniformType);
+    UniformSlot& slot = uniforms[uniform];
 
-    if (bgfx::isValid(handle))
+    if (!bgfx::isValid(slot.handle))
+        slot.handle = bgfx::createUniform(RendererUniformDefs[uniform].name, RendererUniformDefs[uniform].type);
+
+    return slot.handle;
+}
+
+bgfx::UniformHandle Renderer::getSampler(uint32_t slot)
+{
+    UniformSlot& sampler = samplers[slot];
+
+    if (!bgfx::isValid(sampler.handle))
+    {
+        char name[16];
+
+        sprintf(name, "tex_%u", slot);
+
+        sampler.handle = bgfx::createUniform(name, bgfx::UniformType::Sampler);
+    }
+
+    return sampler.handle;
+}
+
+void Renderer::setUniform(RendererUniform uniform, bgfx::ViewId viewId, const void* uniformValue)
+{
+    bgfx::UniformHandle handle = getUniform(uniform);
+    UniformSlot& slot = uniforms[uniform];
+    uint32_t size = RendererUniformDefs[uniform].type == bgfx::UniformType::Mat4 ? 16 * sizeof(float) : 4 * sizeof(float);
+
+    if (!bgfx::isValid(handle)) return;
+
+    // Draws of a sequential view are executed in the order they were submitted, and bgfx keeps uniform values from one draw to the next.
+    // Other views are sorted, and all the draws of a view run before the next view, so anything else has to be sent again.
+    if (sequentialViews[viewId] && slot.viewId == viewId && memcmp(slot.value, uniformValue, size) == 0)
     {
-        bgfx::setUniform(handle, uniformValue);
+        uniformBytesSkipped += size;
+        return;
     }
 
-    return handle;
+    bgfx::setUniform(handle, uniformValue);
+
+    memcpy(slot.value, uniformValue, size);
+    slot.viewId = sequentialViews[viewId] ? viewId : UINT16_MAX;
+
+    uniformBytesSubmitted += size;
 }
 
 void Renderer::destroyUniforms()
 {
-    for (const auto& item : bgfxUniformHandles)
+    for (UniformSlot& slot : uniforms)
     {
-        bgfx::UniformHandle handle = { item.second };
+        if (bgfx::isValid(slot.handle))
+            bgfx::destroy(slot.handle);
 
-        if (bgfx::isValid(handle))
-            bgfx::destroy(handle);
+        slot.handle = BGFX_INVALID_HANDLE;
+        slot.viewId = UINT16_MAX;
     }
 
-    bgfxUniformHandles.clear();
+    for (UniformSlot& slot : samplers)
+    {
+        if (bgfx::isValid(slot.handle))
+            bgfx::destroy(slot.handle);
+
+        slot.handle = BGFX_INVALID_HANDLE;
+    }
 }
 
 void Renderer::destroyAll()
 {
     destroyUniforms();
 
+    // Owned by the texture atlas
+    if (internalState.atlasTexture) internalState.texHandlers[RendererTextureSlot::TEX_Y] = BGFX_INVALID_HANDLE;
+
+    textureAtlas.destroy();
+
     for (auto& handle : internalState.texHandlers)
     {
         if (bgfx::isValid(handle))
@@ -328,6 +506,12 @@ void Renderer::destroyAll()
             bgfx::destroy(handle);
     }
 
+    for (auto& handle : permutationProgramHandles)
+    {
+        if (bgfx::isValid(handle))
+            bgfx::destroy(handle);
+    }
+
     if (enable_devtools)
         overlay.destroy();
 };
@@ -346,6 +530,7 @@ void Renderer::resetState()
     setInterpolationQualifier();
     isTLVertex();
     isYUV();
+    isInterleavedUV();
     isFullRange();
     isFBTexture();
     isTexture();
@@ -437,10 +622,12 @@ bool Renderer::doesItFitInMemory(size_t size)
 {
     if (size <= 0) ffnx_glitch("Unexpected texture size while checking if it fits in memory.\n");
 
-    // We need to check this value as much as in real time as possible, to avoid possible crashes
-    GlobalMemoryStatusEx(&last_ram_state);
+    // We need to check this value as much as in real time as possible, to avoid possible crashes.
+    // A local copy is used as this can be called from the texture streamer worker threads.
+    MEMORYSTATUSEX ram_state = { sizeof(ram_state) };
+    GlobalMemoryStatusEx(&ram_state);
 
-    return size < last_ram_state.ullAvailVirtual;
+    return size < ram_state.ullAvailVirtual;
 }
 
 void Renderer::recalcInternals()
@@ -585,7 +772,7 @@ void Renderer::bindTextures()
 
                 if (flags == 0) flags = UINT32_MAX;
 
-                bgfx::setTexture(idx, getUniform("tex_" + std::to_string(idx), bgfx::UniformType::Sampler), handle, flags);
+                bgfx::setTexture(idx, getSampler(idx), handle, flags);
             }
         }
 
@@ -619,6 +806,8 @@ void Renderer::init()
 
     internalState.texHandlers.resize(RendererTextureSlot::COUNT, BGFX_INVALID_HANDLE);
 
+    textureAtlas.init();
+
     updateRendererShaderPaths();
 
     bx::mtxOrtho(
@@ -792,7 +981,7 @@ void Renderer::drawToShadowMap()
     if (trace_all || trace_renderer) ffnx_trace("Renderer::%s with backendProgram %d\n", __func__, backendProgram);
 
     // Lighting state
-    auto lightingState = lighting.getLightingState();
+    const LightingState& lightingState = lighting.getLightingState();
 
     // Set view to render in the framebuffer
     bgfx::setViewFrameBuffer(0, shadowMapFrameBuffer);
@@ -805,8 +994,8 @@ void Renderer::drawToShadowMap()
     bgfx::setViewTransform(0, lightingState.lightViewMatrix, lightingState.lightProjMatrix);
 
     // Set uniforms
-    setLightingUniforms();
-    setCommonUniforms();
+    setLightingUniforms(0);
+    setCommonUniforms(0);
 
     // Bind textures in pipeline
     bindTextures();
@@ -839,24 +1028,24 @@ void Renderer::drawWithLighting(bool isCastShadow)
     backendProgram = backendProgram == SMOOTH ? LIGHTING_SMOOTH : LIGHTING_FLAT;
 
     // Re-Bind shadow map with comparison sampler
-    bgfx::setTexture(RendererTextureSlot::TEX_S, getUniform("tex_" + std::to_string(RendererTextureSlot::TEX_S), bgfx::UniformType::Sampler), bgfx::getTexture(shadowMapFrameBuffer));
+    bgfx::setTexture(RendererTextureSlot::TEX_S, getSampler(RendererTextureSlot::TEX_S), bgfx::getTexture(shadowMapFrameBuffer));
 
     // Bind specular IBL cubemap
     if (bgfx::isValid(specularIblTexture))
     {
-        bgfx::setTexture(RendererTextureSlot::TEX_IBL_SPEC, getUniform("tex_" + std::to_string(RendererTextureSlot::TEX_IBL_SPEC), bgfx::UniformType::Sampler), specularIblTexture);
+        bgfx::setTexture(RendererTextureSlot::TEX_IBL_SPEC, getSampler(RendererTextureSlot::TEX_IBL_SPEC), specularIblTexture);
     }
 
     // Bind diffuse IBL cubemap
     if (bgfx::isValid(diffuseIblTexture))
     {
-        bgfx::setTexture(RendererTextureSlot::TEX_IBL_DIFF, getUniform("tex_" + std::to_string(RendererTextureSlot::TEX_IBL_DIFF), bgfx::UniformType::Sampler), diffuseIblTexture);
+        bgfx::setTexture(RendererTextureSlot::TEX_IBL_DIFF, getSampler(RendererTextureSlot::TEX_IBL_DIFF), diffuseIblTexture);
     }
 
     // Bind environment BRDF texture
     if (bgfx::isValid(envBrdfTexture))
     {
-        bgfx::setTexture(RendererTextureSlot::TEX_BRDF, getUniform("tex_" + std::to_string(RendererTextureSlot::TEX_BRDF), bgfx::UniformType::Sampler), envBrdfTexture, BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
+        bgfx::setTexture(RendererTextureSlot::TEX_BRDF, getSampler(RendererTextureSlot::TEX_BRDF), envBrdfTexture, BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
     }
 
     // Draw with lighting
@@ -865,6 +1054,8 @@ void Renderer::drawWithLighting(bool isCastShadow)
 
 void Renderer::backupDepthBuffer()
 {
+    flushBatch();
+
     backendViewId++;
     bgfx::setViewClear(backendViewId, BGFX_CLEAR_NONE, internalState.clearColorValue, 1.0f);
     bgfx::touch(backendViewId);
@@ -876,6 +1067,8 @@ void Renderer::backupDepthBuffer()
 
 void Renderer::recoverDepthBuffer()
 {
+    flushBatch();
+
     backendViewId++;
     bgfx::setViewClear(backendViewId, BGFX_CLEAR_NONE, internalState.clearColorValue, 1.0f);
     bgfx::touch(backendViewId);
@@ -890,10 +1083,10 @@ void Renderer::drawFieldShadow()
     backendProgram = RendererProgram::FIELD_SHADOW;
 
     // Re-Bind shadow map with comparison sampler
-    bgfx::setTexture(RendererTextureSlot::TEX_S, getUniform("tex_" + std::to_string(RendererTextureSlot::TEX_S), bgfx::UniformType::Sampler), bgfx::getTexture(shadowMapFrameBuffer));
+    bgfx::setTexture(RendererTextureSlot::TEX_S, getSampler(RendererTextureSlot::TEX_S), bgfx::getTexture(shadowMapFrameBuffer));
 
     // Re-Bind shadow map for direct depth sampling
-    bgfx::setTexture(RendererTextureSlot::TEX_D, getUniform("tex_" + std::to_string(RendererTextureSlot::TEX_D), bgfx::UniformType::Sampler), bgfx::getTexture(shadowMapFrameBuffer), BGFX_TEXTURE_RT | BGFX_SAMPLER_POINT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_W_CLAMP);
+    bgfx::setTexture(RendererTextureSlot::TEX_D, getSampler(RendererTextureSlot::TEX_D), bgfx::getTexture(shadowMapFrameBuffer), BGFX_TEXTURE_RT | BGFX_SAMPLER_POINT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_W_CLAMP);
 
     draw();
 }
@@ -920,8 +1113,8 @@ void Renderer::draw(bool uniformsAlreadyAttached)
     // Skip uniform attachment as it has been done already
     if (!uniformsAlreadyAttached)
     {
-        setCommonUniforms();
-        setLightingUniforms();
+        setCommonUniforms(backendViewId);
+        setLightingUniforms(backendViewId);
     }
 
     // Bind textures in pipeline
@@ -978,12 +1171,51 @@ void Renderer::draw(bool uniformsAlreadyAttached)
     }
     bgfx::setState(internalState.state);
 
-    bgfx::submit(backendViewId, backendProgramHandles[backendProgram]);
+    bgfx::submit(backendViewId, getGameProgram());
+
+    submitCount++;
 
     internalState.bHasDrawBeenDone = true;
     internalState.bTexturesBound = false;
 };
 
+void Renderer::drawBatched(struct nvertex* inVertex, uint32_t vertexCount, WORD* inIndex, uint32_t indexCount)
+{
+    resolveAtlasTexture(inVertex, vertexCount);
+
+    if (batch.indexCount > 0)
+    {
+        if (canMergeBatch(vertexCount)) mergedDrawCount++;
+        else flushBatch();
+    }
+
+    uint32_t vertexOffset = stageVertices(inVertex, 0, vertexCount);
+    uint32_t indexOffset = stageIndices(inIndex, indexCount);
+
+    if (batch.indexCount == 0)
+    {
+        batch.state = internalState;
+        batch.viewId = backendViewId;
+        batch.program = backendProgram;
+        batch.scissorOffsetX = scissorOffsetX;
+        batch.scissorOffsetY = scissorOffsetY;
+        batch.scissorWidth = scissorWidth;
+        batch.scissorHeight = scissorHeight;
+        batch.firstVertex = vertexOffset;
+        batch.firstIndex = indexOffset;
+    }
+    else
+    {
+        // Indices are relative to the first vertex of the batch now
+        WORD base = vertexOffset - batch.firstVertex;
+
+        for (uint32_t idx = indexOffset; idx < indexOffset + indexCount; idx++) indexBufferData[idx] += base;
+    }
+
+    batch.vertexCount += vertexCount;
+    batch.indexCount += indexCount;
+}
+
 void Renderer::drawOverlay()
 {
     if (enable_devtools)
@@ -992,44 +1224,66 @@ void Renderer::drawOverlay()
 
 void Renderer::show()
 {
+    flushBatch();
+
     // Reset internal state
     resetState();
 
     renderFrame();
 
-    bgfx::update(
-        vertexBufferHandle,
-        0,
-        bgfx::copy(
-            vertexBufferData.data(),
-            vectorSizeOf(vertexBufferData)
-        )
-    );
+    // bgfx reads referenced memory up to the end of the next frame, the staging buffers are swapped below to keep it alive
+    if (bgfx::isValid(vertexBufferHandle) && vertexBufferCount > 0)
+        bgfx::update(
+            vertexBufferHandle,
+            0,
+            bgfx::makeRef(
+                vertexBufferData.data(),
+                vertexBufferCount * sizeof(Vertex)
+            )
+        );
 
-    bgfx::update(
-        indexBufferHandle,
-        0,
-        bgfx::copy(
-            indexBufferData.data(),
-            vectorSizeOf(indexBufferData)
-        )
-    );
+    if (bgfx::isValid(indexBufferHandle) && indexBufferCount > 0)
+        bgfx::update(
+            indexBufferHandle,
+            0,
+            bgfx::makeRef(
+                indexBufferData.data(),
+                indexBufferCount * sizeof(WORD)
+            )
+        );
 
     bgfx::frame(doCaptureFrame);
 
+    // Atlas regions released during the frame can be reused now
+    textureAtlas.frame();
+
     if (trace_all || trace_renderer) ffnx_trace("Renderer::%s\n", __func__);
 
     bgfx::dbgTextClear();
 
     backendViewId = 1;
 
-    vertexBufferData.clear();
-    vertexBufferData.shrink_to_fit();
+    // Nothing is known about the values bgfx will start the next frame with
+    for (UniformSlot& slot : uniforms) slot.viewId = UINT16_MAX;
+
+    lastFrameUniformBytesSubmitted = uniformBytesSubmitted;
+    lastFrameUniformBytesSkipped = uniformBytesSkipped;
+    uniformBytesSubmitted = 0;
+    uniformBytesSkipped = 0;
+
+    lastFrameSubmitCount = submitCount;
+    lastFrameMergedDrawCount = mergedDrawCount;
+    submitCount = 0;
+    mergedDrawCount = 0;
 
-    indexBufferData.clear();
-    indexBufferData.shrink_to_fit();
+    vertexBufferData.swap(previousVertexBufferData);
+    vertexBufferCount = 0;
+
+    indexBufferData.swap(previousIndexBufferData);
+    indexBufferCount = 0;
 
     bgfx::setViewMode(backendViewId, bgfx::ViewMode::Sequential);
+    sequentialViews.set(backendViewId);
 }
 
 void Renderer::printText(uint16_t x, uint16_t y, uint32_t color, const char* text)
@@ -1057,51 +1311,189 @@ const bgfx::Stats* Renderer::getStats()
     return bgfx::getStats();
 }
 
-void Renderer::bindVertexBuffer(struct nvertex* inVertex, vector3<float>* normals, uint32_t inCount)
+uint32_t Renderer::getUniformBytesSubmitted()
 {
-    if (!bgfx::isValid(vertexBufferHandle)) vertexBufferHandle = bgfx::createDynamicVertexBuffer(inCount, vertexLayout, BGFX_BUFFER_ALLOW_RESIZE);
+    return lastFrameUniformBytesSubmitted;
+}
+
+uint32_t Renderer::getUniformBytesSkipped()
+{
+    return lastFrameUniformBytesSkipped;
+}
 
-    uint32_t currentOffset = vertexBufferData.size();
+uint32_t Renderer::getSubmitCount()
+{
+    return lastFrameSubmitCount;
+}
 
-    for (uint32_t idx = 0; idx < inCount; idx++)
-    {
-        vertexBufferData.push_back(Vertex());
+uint32_t Renderer::getMergedDrawCount()
+{
+    return lastFrameMergedDrawCount;
+}
+
+void Renderer::resolveAtlasTexture(struct nvertex* inVertex, uint32_t inCount)
+{
+    uint16_t handle = internalState.atlasTexture;
+
+    atlasRemap = false;
+
+    if (handle == 0) return;
 
-        vertexBufferData[currentOffset + idx].x = inVertex[idx]._.x;
-        vertexBufferData[currentOffset + idx].y = inVertex[idx]._.y;
-        vertexBufferData[currentOffset + idx].z = inVertex[idx]._.z;
-        vertexBufferData[currentOffset + idx].w = ( ::isinf(inVertex[idx].color.w) ? 1.0f : inVertex[idx].color.w );
-        vertexBufferData[currentOffset + idx].bgra = inVertex[idx].color.color;
-        vertexBufferData[currentOffset + idx].u = inVertex[idx].u;
-        vertexBufferData[currentOffset + idx].v = inVertex[idx].v;
+    bgfx::TextureHandle texture = textureAtlas.resolve(handle, atlasRemap);
 
-        if (normals)
+    if (atlasRemap)
+    {
+        // Wrapping coordinates cannot be remapped into the atlas
+        for (uint32_t idx = 0; idx < inCount; idx++)
         {
-            vertexBufferData[currentOffset + idx].nx = normals[idx].x;
-            vertexBufferData[currentOffset + idx].ny = normals[idx].y;
-            vertexBufferData[currentOffset + idx].nz = normals[idx].z;
+            if (inVertex[idx].u < -0.001f || inVertex[idx].u > 1.001f || inVertex[idx].v < -0.001f || inVertex[idx].v > 1.001f)
+            {
+                texture = textureAtlas.promote(handle);
+                atlasRemap = false;
+                break;
+            }
         }
+    }
+
+    if (atlasRemap) textureAtlas.getTransform(handle, atlasScaleU, atlasScaleV, atlasOffsetU, atlasOffsetV);
+
+    internalState.texHandlers[RendererTextureSlot::TEX_Y] = texture;
+}
+
+uint32_t Renderer::stageVertices(struct nvertex* inVertex, vector3<float>* normals, uint32_t inCount)
+{
+    if (!bgfx::isValid(vertexBufferHandle)) vertexBufferHandle = bgfx::createDynamicVertexBuffer(inCount, vertexLayout, BGFX_BUFFER_ALLOW_RESIZE);
+
+    uint32_t currentOffset = vertexBufferCount;
+
+    // Grow geometrically, the capacity is then kept for the following frames
+    if (currentOffset + inCount > vertexBufferData.size()) vertexBufferData.resize(std::max<size_t>((currentOffset + inCount) * 2, RENDERER_MIN_STAGING_VERTICES));
+
+    Vertex* outVertex = &vertexBufferData[currentOffset];
+
+    RendererConvertVertices(outVertex, inVertex, normals, inCount);
 
-        if (vertex_log && idx == 0) ffnx_trace("%s: %u [XYZW(%f, %f, %f, %f), BGRA(%08x), UV(%f, %f)]\n", __func__, idx, vertexBufferData[currentOffset + idx].x, vertexBufferData[currentOffset + idx].y, vertexBufferData[currentOffset + idx].z, vertexBufferData[currentOffset + idx].w, vertexBufferData[currentOffset + idx].bgra, vertexBufferData[currentOffset + idx].u, vertexBufferData[currentOffset + idx].v);
-        if (vertex_log && idx == 1) ffnx_trace("%s: See the rest on RenderDoc.\n", __func__);
+    if (atlasRemap)
+    {
+        for (uint32_t idx = 0; idx < inCount; idx++)
+        {
+            outVertex[idx].u = atlasOffsetU + outVertex[idx].u * atlasScaleU;
+            outVertex[idx].v = atlasOffsetV + outVertex[idx].v * atlasScaleV;
+        }
     }
 
-    bgfx::setVertexBuffer(0, vertexBufferHandle, currentOffset, inCount);
-};
+    vertexBufferCount += inCount;
 
-void Renderer::bindIndexBuffer(WORD* inIndex, uint32_t inCount)
+    if (vertex_log && inCount > 0) ffnx_trace("%s: %u [XYZW(%f, %f, %f, %f), BGRA(%08x), UV(%f, %f)]\n", __func__, 0, outVertex->x, outVertex->y, outVertex->z, outVertex->w, outVertex->bgra, outVertex->u, outVertex->v);
+    if (vertex_log && inCount > 1) ffnx_trace("%s: See the rest on RenderDoc.\n", __func__);
+
+    return currentOffset;
+}
+
+uint32_t Renderer::stageIndices(WORD* inIndex, uint32_t inCount)
 {
     if (!bgfx::isValid(indexBufferHandle)) indexBufferHandle = bgfx::createDynamicIndexBuffer(inCount, BGFX_BUFFER_ALLOW_RESIZE);
 
-    uint32_t currentOffset = indexBufferData.size();
+    uint32_t currentOffset = indexBufferCount;
+
+    if (currentOffset + inCount > indexBufferData.size()) indexBufferData.resize(std::max<size_t>((currentOffset + inCount) * 2, RENDERER_MIN_STAGING_INDICES));
+
+    memcpy(&indexBufferData[currentOffset], inIndex, inCount * sizeof(WORD));
 
-    for (uint32_t idx = 0; idx < inCount; idx++)
+    indexBufferCount += inCount;
+
+    return currentOffset;
+}
+
+bool Renderer::canMergeBatch(uint32_t vertexCount)
+{
+    const RendererState& batchState = batch.state;
+
+    // Indices are 16 bits wide
+    if (batch.vertexCount + vertexCount > UINT16_MAX + 1) return false;
+
+    if (batch.viewId != backendViewId || batch.program != backendProgram) return false;
+
+    for (uint32_t idx = 0; idx < RendererTextureSlot::COUNT; idx++)
     {
-        indexBufferData.push_back(inIndex[idx]);
+        if (batchState.texHandlers[idx].idx != internalState.texHandlers[idx].idx) return false;
     }
 
+    if (batchState.bDoScissorTest != internalState.bDoScissorTest) return false;
+
+    if (internalState.bDoScissorTest && (batch.scissorOffsetX != scissorOffsetX || batch.scissorOffsetY != scissorOffsetY || batch.scissorWidth != scissorWidth || batch.scissorHeight != scissorHeight)) return false;
+
+    if (batchState.bDoAlphaTest != internalState.bDoAlphaTest || batchState.alphaRef != internalState.alphaRef || batchState.alphaFunc != internalState.alphaFunc) return false;
+
+    return batchState.bDoDepthTest == internalState.bDoDepthTest
+        && batchState.bDoDepthWrite == internalState.bDoDepthWrite
+        && batchState.bIsTLVertex == internalState.bIsTLVertex
+        && batchState.bIsFBTexture == internalState.bIsFBTexture
+        && batchState.bIsTexture == internalState.bIsTexture
+        && batchState.bDoTextureFiltering == internalState.bDoTextureFiltering
+        && batchState.bModulateAlpha == internalState.bModulateAlpha
+        && batchState.bIsMovie == internalState.bIsMovie
+        && batchState.bIsMovieFullRange == internalState.bIsMovieFullRange
+        && batchState.bIsMovieYUV == internalState.bIsMovieYUV
+        && batchState.bIsMovieInterleavedUV == internalState.bIsMovieInterleavedUV
+        && batchState.bIsExternalTexture == internalState.bIsExternalTexture
+        && batchState.cullMode == internalState.cullMode
+        && batchState.blendMode == internalState.blendMode
+        && batchState.primitiveType == internalState.primitiveType
+        && memcmp(batchState.backendProjMatrix, internalState.backendProjMatrix, sizeof(internalState.backendProjMatrix)) == 0;
+}
+
+void Renderer::flushBatch()
+{
+    if (batch.indexCount == 0) return;
+
+    // Draw with the state the batch was started with, then restore the current one
+    std::swap(internalState, batch.state);
+    std::swap(backendViewId, batch.viewId);
+    std::swap(backendProgram, batch.program);
+    std::swap(scissorOffsetX, batch.scissorOffsetX);
+    std::swap(scissorOffsetY, batch.scissorOffsetY);
+    std::swap(scissorWidth, batch.scissorWidth);
+    std::swap(scissorHeight, batch.scissorHeight);
+
+    bgfx::setVertexBuffer(0, vertexBufferHandle, batch.firstVertex, batch.vertexCount);
+    bgfx::setIndexBuffer(indexBufferHandle, batch.firstIndex, batch.indexCount);
+
+    draw();
+
+    std::swap(internalState, batch.state);
+    std::swap(backendViewId, batch.viewId);
+    std::swap(backendProgram, batch.program);
+    std::swap(scissorOffsetX, batch.scissorOffsetX);
+    std::swap(scissorOffsetY, batch.scissorOffsetY);
+    std::swap(scissorWidth, batch.scissorWidth);
+    std::swap(scissorHeight, batch.scissorHeight);
+
+    internalState.bHasDrawBeenDone = true;
+    internalState.bTexturesBound = false;
+
+    batch.vertexCount = 0;
+    batch.indexCount = 0;
+}
+
+void Renderer::bindVertexBuffer(struct nvertex* inVertex, vector3<float>* normals, uint32_t inCount)
+{
+    // Pending draws go first, and must not pick up the buffers bound below
+    flushBatch();
+
+    resolveAtlasTexture(inVertex, inCount);
+
+    uint32_t currentOffset = stageVertices(inVertex, normals, inCount);
+
+    bgfx::setVertexBuffer(0, vertexBufferHandle, currentOffset, inCount);
+}
+
+void Renderer::bindIndexBuffer(WORD* inIndex, uint32_t inCount)
+{
+    uint32_t currentOffset = stageIndices(inIndex, inCount);
+
     bgfx::setIndexBuffer(indexBufferHandle, currentOffset, inCount);
-};
+}
 
 void Renderer::setScissor(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
 {
@@ -1115,6 +1507,8 @@ void Renderer::setClearFlags(bool doClearColor, bool doClearDepth)
 {
     if (trace_all || trace_renderer) ffnx_trace("Renderer::%s clearColor=%d,clearDepth=%d\n", __func__, doClearColor, doClearDepth);
 
+    flushBatch();
+
     uint16_t clearFlags = BGFX_CLEAR_NONE;
 
     if (doClearColor)
@@ -1138,14 +1532,10 @@ uint32_t Renderer::createTexture(uint8_t* data, size_t width, size_t height, int
 {
     bgfx::TextureHandle ret = FFNX_RENDERER_INVALID_HANDLE;
 
-    bgfx::TextureFormat::Enum texFormat = bgfx::TextureFormat::R8;
-    bimg::TextureFormat::Enum imgFormat = bimg::TextureFormat::R8;
+    bgfx::TextureFormat::Enum texFormat;
+    bimg::TextureFormat::Enum imgFormat;
 
-    if (type == RendererTextureType::BGRA)
-    {
-        texFormat = bgfx::TextureFormat::BGRA8;
-        imgFormat = bimg::TextureFormat::BGRA8;
-    }
+    getTextureFormat(type, &texFormat, &imgFormat);
 
     bimg::TextureInfo texInfo;
     bimg::imageGetSize(&texInfo, width, height, 0, false, false, 1, imgFormat);
@@ -1190,6 +1580,85 @@ uint32_t Renderer::createTexture(uint8_t* data, size_t width, size_t height, int
     return ret.idx;
 };
 
+uint32_t Renderer::createDynamicTexture(size_t width, size_t height, RendererTextureType type, bool isSrgb)
+{
+    bgfx::TextureHandle ret = FFNX_RENDERER_INVALID_HANDLE;
+
+    bgfx::TextureFormat::Enum texFormat;
+    bimg::TextureFormat::Enum imgFormat;
+
+    getTextureFormat(type, &texFormat, &imgFormat);
+
+    bimg::TextureInfo texInfo;
+    bimg::imageGetSize(&texInfo, width, height, 0, false, false, 1, imgFormat);
+
+    if (doesItFitInMemory(texInfo.storageSize))
+    {
+        uint64_t flags = BGFX_SAMPLER_NONE;
+
+        if (isSrgb) flags |= BGFX_TEXTURE_SRGB;
+        else flags |= BGFX_TEXTURE_NONE;
+
+        // No initial memory, so the texture stays mutable
+        ret = bgfx::createTexture2D(
+            width,
+            height,
+            false,
+            1,
+            texFormat,
+            flags,
+            NULL
+        );
+
+        if (trace_all || trace_renderer) ffnx_trace("Renderer::%s: %u => %ux%u\n", __func__, ret.idx, width, height);
+    }
+
+    return ret.idx;
+}
+
+void Renderer::updateTexture(uint16_t texId, uint8_t* data, size_t width, size_t height, int stride, RendererTextureType type, bgfx::ReleaseFn releaseFn, void* userData)
+{
+    bgfx::TextureHandle handle = { texId };
+
+    if (texId == 0 || !bgfx::isValid(handle) || data == NULL)
+    {
+        // The caller expects the reference to be given back in any case
+        if (releaseFn != nullptr) releaseFn(data, userData);
+
+        return;
+    }
+
+    uint32_t size = 0;
+
+    if (stride > 0) size = stride * height;
+    else
+    {
+        bgfx::TextureFormat::Enum texFormat;
+        bimg::TextureFormat::Enum imgFormat;
+
+        getTextureFormat(type, &texFormat, &imgFormat);
+
+        bimg::TextureInfo texInfo;
+        bimg::imageGetSize(&texInfo, width, height, 0, false, false, 1, imgFormat);
+
+        size = texInfo.storageSize;
+    }
+
+    const bgfx::Memory* mem = releaseFn != nullptr ? bgfx::makeRef(data, size, releaseFn, userData) : bgfx::copy(data, size);
+
+    bgfx::updateTexture2D(
+        handle,
+        0,
+        0,
+        0,
+        0,
+        width,
+        height,
+        mem,
+        stride > 0 ? stride : UINT16_MAX
+    );
+}
+
 uint32_t Renderer::createTexture(char* filename, uint32_t* width, uint32_t* height, uint32_t* mipCount, bool isSrgb)
 {
     bgfx::TextureHandle handle = createTextureHandle(filename, width, height, mipCount, isSrgb);
@@ -1197,15 +1666,67 @@ uint32_t Renderer::createTexture(char* filename, uint32_t* width, uint32_t* heig
 }
 
 bgfx::TextureHandle Renderer::createTextureHandle(char* filename, uint32_t* width, uint32_t* height, uint32_t* mipCount, bool isSrgb)
+{
+    return createTextureHandle(loadImageContainer(filename), filename, width, height, mipCount, isSrgb);
+}
+
+bgfx::TextureHandle Renderer::createTextureHandle(bimg::ImageContainer* img, char* filename, uint32_t* width, uint32_t* height, uint32_t* mipCount, bool isSrgb)
 {
     bgfx::TextureHandle ret = BGFX_INVALID_HANDLE;
 
+    if (img != nullptr)
+    {
+        uint64_t flags = BGFX_SAMPLER_NONE;
+
+        if (isSrgb) flags |= BGFX_TEXTURE_SRGB;
+        else flags |= BGFX_TEXTURE_NONE;
+
+        // The image container is released by bgfx once the upload is done
+        const bgfx::Memory* mem = bgfx::makeRef(img->m_data, img->m_size, RendererReleaseImageContainer, img);
+        if (img->m_cubeMap)
+        {
+            ret = bgfx::createTextureCube(
+                img->m_width,
+                1 < img->m_numMips,
+                img->m_numLayers,
+                bgfx::TextureFormat::Enum(img->m_format),
+                flags,
+                mem
+            );
+        }
+        else
+        {
+
+            ret = bgfx::createTexture2D(
+                img->m_width,
+                img->m_height,
+                1 < img->m_numMips,
+                img->m_numLayers,
+                bgfx::TextureFormat::Enum(img->m_format),
+                flags,
+                mem
+            );
+        }
+
+        *width = img->m_width;
+        *height = img->m_height;
+        if (mipCount != nullptr) *mipCount = img->m_numMips;
+
+        if (trace_all || trace_renderer) ffnx_trace("Renderer::%s: %u => %ux%u from filename %s\n", __func__, ret.idx, *width, *height, filename);
+    }
+
+    return ret;
+}
+
+bimg::ImageContainer* Renderer::loadImageContainer(char* filename)
+{
+    bimg::ImageContainer* img = nullptr;
+
     FILE* file = fopen(filename, "rb");
 
     if (file)
     {
         size_t filesize = 0;
-        bimg::ImageContainer* img = nullptr;
         char* buffer = nullptr;
 
         fseek(file, 0, SEEK_END);
@@ -1231,54 +1752,21 @@ bgfx::TextureHandle Renderer::createTextureHandle(char* filename, uint32_t* widt
 
         if (img != nullptr)
         {
-            if (gl_check_texture_dimensions(img->m_width, img->m_height, filename) && doesItFitInMemory(img->m_size))
+            if (!gl_check_texture_dimensions(img->m_width, img->m_height, filename) || !doesItFitInMemory(img->m_size))
             {
-                uint64_t flags = BGFX_SAMPLER_NONE;
-
-                if (isSrgb) flags |= BGFX_TEXTURE_SRGB;
-                else flags |= BGFX_TEXTURE_NONE;
-
-                const bgfx::Memory* mem = bgfx::makeRef(img->m_data, img->m_size, RendererReleaseImageContainer, img);
-                if (img->m_cubeMap)
-                {
-                    ret = bgfx::createTextureCube(
-                        img->m_width,
-                        1 < img->m_numMips,
-                        img->m_numLayers,
-                        bgfx::TextureFormat::Enum(img->m_format),
-                        flags,
-                        mem
-                    );
-                }
-                else
-                {
-
-                    ret = bgfx::createTexture2D(
-                        img->m_width,
-                        img->m_height,
-                        1 < img->m_numMips,
-                        img->m_numLayers,
-                        bgfx::TextureFormat::Enum(img->m_format),
-                        flags,
-                        mem
-                    );
-                }
-
-                *width = img->m_width;
-                *height = img->m_height;
-                *mipCount = img->m_numMips;
+                bimg::imageFree(img);
 
-                if (trace_all || trace_renderer) ffnx_trace("Renderer::%s: %u => %ux%u from filename %s\n", __func__, ret.idx, width, height, filename);
+                img = nullptr;
             }
         }
     }
 
-    return ret;
+    return img;
 }
 
-uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t* height, bool isSrgb)
+bimg::ImageContainer* Renderer::loadLibPngImageContainer(char* filename)
 {
-    bgfx::TextureHandle ret = FFNX_RENDERER_INVALID_HANDLE;
+    bimg::ImageContainer* img = nullptr;
 
     FILE* file = fopen(filename, "rb");
 
@@ -1293,7 +1781,6 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
         png_bytepp rowptrs = nullptr;
         size_t rowbytes = 0;
 
-        uint8_t* data = nullptr;
         size_t datasize = 0;
 
         fseek(file, 0, SEEK_END);
@@ -1306,7 +1793,7 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
         {
             fclose(file);
 
-            return ret.idx;
+            return img;
         }
 
         info_ptr = png_create_info_struct(png_ptr);
@@ -1317,7 +1804,7 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
 
             fclose(file);
 
-            return ret.idx;
+            return img;
         }
 
         if (setjmp(png_jmpbuf(png_ptr)))
@@ -1326,7 +1813,7 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
 
             fclose(file);
 
-            return ret.idx;
+            return nullptr;
         }
 
         png_init_io(png_ptr, file);
@@ -1339,7 +1826,7 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
 
             fclose(file);
 
-            return ret.idx;
+            return img;
         }
 
         png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_EXPAND, NULL);
@@ -1354,26 +1841,9 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
 
         datasize = rowbytes * _height;
 
-        if (!doesItFitInMemory(datasize))
-        {
-            png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-
-            fclose(file);
-
-            return ret.idx;
-        }
-
-        data = (uint8_t*)driver_calloc(datasize, sizeof(uint8_t));
-
-        for (png_uint_32 y = 0; y < _height; y++) memcpy(data + (rowbytes * y), rowptrs[y], rowbytes);
-
-        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-
-        fclose(file);
-
         // ------------------------------------------------------------
 
-        bgfx::TextureFormat::Enum texFmt = bgfx::TextureFormat::Unknown;
+        bimg::TextureFormat::Enum texFmt = bimg::TextureFormat::Unknown;
 
         switch (bit_depth)
         {
@@ -1382,17 +1852,17 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
             switch (color_type)
             {
             case PNG_COLOR_TYPE_GRAY:
-                texFmt = bgfx::TextureFormat::R8;
+                texFmt = bimg::TextureFormat::R8;
                 break;
             case PNG_COLOR_TYPE_GRAY_ALPHA:
-                texFmt = bgfx::TextureFormat::RG8;
+                texFmt = bimg::TextureFormat::RG8;
                 break;
             case PNG_COLOR_TYPE_RGB:
-                texFmt = bgfx::TextureFormat::RGB8;
+                texFmt = bimg::TextureFormat::RGB8;
                 break;
             case PNG_COLOR_TYPE_RGBA:
             case PNG_COLOR_TYPE_PALETTE:
-                texFmt = bgfx::TextureFormat::RGBA8;
+                texFmt = bimg::TextureFormat::RGBA8;
                 break;
             }
             break;
@@ -1402,14 +1872,14 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
             switch (color_type)
             {
             case PNG_COLOR_TYPE_GRAY:
-                texFmt = bgfx::TextureFormat::R16;
+                texFmt = bimg::TextureFormat::R16;
                 break;
             case PNG_COLOR_TYPE_GRAY_ALPHA:
-                texFmt = bgfx::TextureFormat::RG16;
+                texFmt = bimg::TextureFormat::RG16;
                 break;
             case PNG_COLOR_TYPE_RGB:
             case PNG_COLOR_TYPE_RGBA:
-                texFmt = bgfx::TextureFormat::RGBA16;
+                texFmt = bimg::TextureFormat::RGBA16;
                 break;
             case PNG_COLOR_TYPE_PALETTE:
                 break;
@@ -1420,34 +1890,40 @@ uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t
             break;
         }
 
-        if (texFmt != bgfx::TextureFormat::Unknown)
+        if (texFmt != bimg::TextureFormat::Unknown && doesItFitInMemory(datasize))
         {
-            const bgfx::Memory* mem = bgfx::makeRef(data, datasize, RendererReleaseData, data);
-
-            uint64_t flags = BGFX_SAMPLER_NONE;
+            img = bimg::imageAlloc(&defaultAllocator, texFmt, _width, _height, 0, 1, false, false);
 
-            if (isSrgb) flags |= BGFX_TEXTURE_SRGB;
-            else flags |= BGFX_TEXTURE_NONE;
+            if (img != nullptr)
+            {
+                if (img->m_size == datasize)
+                {
+                    uint8_t* data = (uint8_t*)img->m_data;
 
-            ret = bgfx::createTexture2D(
-                _width,
-                _height,
-                false,
-                1,
-                texFmt,
-                flags,
-                mem
-            );
+                    for (png_uint_32 y = 0; y < _height; y++) memcpy(data + (rowbytes * y), rowptrs[y], rowbytes);
+                }
+                else
+                {
+                    // Row layout does not match what bgfx expects for this format
+                    bimg::imageFree(img);
 
-            *width = _width;
-            *height = _height;
+                    img = nullptr;
+                }
+            }
         }
-        else
-            driver_free(data);
 
-        if (trace_all || trace_renderer) ffnx_trace("Renderer::%s: %u => %ux%u from filename %s\n", __func__, ret.idx, width, height, filename);
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+
+        fclose(file);
     }
 
+    return img;
+}
+
+uint32_t Renderer::createTextureLibPng(char* filename, uint32_t* width, uint32_t* height, bool isSrgb)
+{
+    bgfx::TextureHandle ret = createTextureHandle(loadLibPngImageContainer(filename), filename, width, height, nullptr, isSrgb);
+
     return ret.idx;
 }
 
@@ -1477,11 +1953,24 @@ bool Renderer::saveTexture(char* filename, uint32_t width, uint32_t height, void
 
 void Renderer::deleteTexture(uint16_t rt)
 {
-    if (rt > 0)
+    // The replay has to know when a handle stops referring to the texture it was created for
+    if (rt > 0 && drawCapture.isRecording()) drawCapture.textureDelete(rt);
+
+    if (TextureAtlas::isAtlasHandle(rt))
+    {
+        // The atlas page may still be referenced by a pending batch
+        flushBatch();
+
+        textureAtlas.remove(rt);
+    }
+    else if (rt > 0)
     {
         bgfx::TextureHandle handle = { rt };
 
         if (bgfx::isValid(handle)) {
+            // The texture may still be referenced by a pending batch
+            flushBatch();
+
             bgfx::destroy(handle);
 
             if (trace_all || trace_renderer) ffnx_trace("Renderer::%s: %u Texture was valid and is now destroyed!\n", __func__, rt);
@@ -1493,7 +1982,16 @@ void Renderer::useTexture(uint16_t rt, uint32_t slot)
 {
     if (trace_all || trace_renderer) ffnx_trace("Renderer::%s: [%u] => %u\n", __func__, slot, rt);
 
-    if (rt > 0)
+    if (slot == RendererTextureSlot::TEX_Y) internalState.atlasTexture = TextureAtlas::isAtlasHandle(rt) ? rt : 0;
+
+    if (TextureAtlas::isAtlasHandle(rt))
+    {
+        bool inAtlas;
+
+        internalState.texHandlers[slot] = textureAtlas.resolve(rt, inAtlas);
+        if (slot == RendererTextureSlot::TEX_Y) isTexture(true);
+    }
+    else if (rt > 0)
     {
         internalState.texHandlers[slot] = { rt };
         if (slot == RendererTextureSlot::TEX_Y) isTexture(true);
@@ -1507,6 +2005,8 @@ void Renderer::useTexture(uint16_t rt, uint32_t slot)
 
 uint32_t Renderer::blitTexture(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
 {
+    flushBatch();
+
     uint16_t newX = getInternalCoordX(x);
     uint16_t newY = getInternalCoordY(y);
     uint16_t newWidth = getInternalCoordX(width);
@@ -1584,6 +2084,11 @@ void Renderer::isYUV(bool flag)
     internalState.bIsMovieYUV = flag;
 };
 
+void Renderer::isInterleavedUV(bool flag)
+{
+    internalState.bIsMovieInterleavedUV = flag;
+};
+
 void Renderer::doModulateAlpha(bool flag)
 {
     internalState.bModulateAlpha = flag;
@@ -26,6 +26,7 @@
 #include <iterator>
 #include <vector>
 #include <map>
+#include <bitset>
 #include <string>
 #include <math.h>
 #include <bx/math.h>
@@ -41,9 +42,14 @@
 #include "log.h"
 #include "gl.h"
 #include "overlay.h"
+#include "texture_atlas.h"
 
 #define FFNX_RENDERER_INVALID_HANDLE { 0 }
 
+// Smallest staging buffers allocated for the vertices and indices of a frame
+#define RENDERER_MIN_STAGING_VERTICES 16384
+#define RENDERER_MIN_STAGING_INDICES 32768
+
 enum RendererInterpolationQualifier {
     FLAT = 0,
     SMOOTH
@@ -91,7 +97,14 @@ enum RendererPrimitiveType
 enum RendererTextureType
 {
     BGRA = 0,
-    YUV
+    // One 8-bit plane of a YUV image
+    YUV,
+    // 8-bit U and V interleaved in a single plane (NV12)
+    YUV_UV,
+    // One 16-bit plane of a YUV image (P010)
+    YUV16,
+    // 16-bit U and V interleaved in a single plane (P010)
+    YUV16_UV
 };
 
 enum RendererTextureSlot
@@ -138,9 +151,9 @@ struct RendererCallbacks : public bgfx::CallbackI {
     virtual ~RendererCallbacks() {};
     virtual void fatal(const char* _filePath, uint16_t _line, bgfx::Fatal::Enum _code, const char* _str) override;
     virtual void traceVargs(const char* _filePath, uint16_t _line, const char* _format, va_list _argList) override;
-    virtual void profilerBegin(const char* _name, uint32_t _abgr, const char* _filePath, uint16_t _line) override {};
-    virtual void profilerBeginLiteral(const char* _name, uint32_t _abgr, const char* _filePath, uint16_t _line) override {};
-    virtual void profilerEnd() override {};
+    virtual void profilerBegin(const char* _name, uint32_t _abgr, const char* _filePath, uint16_t _line) override;
+    virtual void profilerBeginLiteral(const char* _name, uint32_t _abgr, const char* _filePath, uint16_t _line) override;
+    virtual void profilerEnd() override;
     virtual uint32_t cacheReadSize(uint64_t _id) override;
     virtual bool cacheRead(uint64_t _id, void* _data, uint32_t _size) override;
     virtual void cacheWrite(uint64_t _id, const void* _data, uint32_t _size) override;
@@ -165,6 +178,50 @@ private:
         COUNT
     };
 
+    // Draw states baked into the specialized variants of the game shaders, see misc/FFNx.frag
+    enum RendererPermutation {
+        PERMUTATION_TLVERTEX = 1 << 0,
+        PERMUTATION_TEXTURE = 1 << 1,
+        PERMUTATION_ALPHATEST = 1 << 2,
+        PERMUTATION_COUNT = 1 << 3
+    };
+
+    // Uniforms used by the shaders, resolved once to a bgfx handle
+    enum RendererUniform {
+        VS_FLAGS = 0,
+        FS_ALPHA_FLAGS,
+        FS_MISC_FLAGS,
+        FS_TEX_FLAGS,
+        D3D_VIEWPORT,
+        D3D_PROJECTION,
+        WORLD_VIEW,
+        NORMAL_MATRIX,
+        VIEW_MATRIX,
+        INV_VIEW_MATRIX,
+        LIGHTING_SETTINGS,
+        LIGHT_DIR_DATA,
+        LIGHT_DATA,
+        AMBIENT_LIGHT_DATA,
+        SHADOW_DATA,
+        FIELD_SHADOW_DATA,
+        MATERIAL_DATA,
+        MATERIAL_SCALE_DATA,
+        LIGHTING_DEBUG_DATA,
+        IBL_DATA,
+        LIGHT_VIEW_PROJ_MATRIX,
+        LIGHT_VIEW_PROJ_TEX_MATRIX,
+        LIGHT_INV_VIEW_PROJ_TEX_MATRIX,
+        UNIFORM_COUNT
+    };
+
+    // Last value submitted for a uniform, and the view it was submitted to
+    struct UniformSlot
+    {
+        bgfx::UniformHandle handle = BGFX_INVALID_HANDLE;
+        bgfx::ViewId viewId = UINT16_MAX;
+        float value[16];
+    };
+
     // Vertex data structure
     struct Vertex
     {
@@ -184,6 +241,8 @@ private:
     {
         std::vector<bgfx::TextureHandle> texHandlers;
         bool bTexturesBound = false;
+        // Texture atlas handle bound to TEX_Y, resolved to the atlas page before every draw
+        uint16_t atlasTexture = 0;
 
         bool bHasDrawBeenDone = false;
 
@@ -203,6 +262,7 @@ private:
         bool bIsMovie = false;
         bool bIsMovieFullRange = false;
         bool bIsMovieYUV = false;
+        bool bIsMovieInterleavedUV = false;
         bool bIsExternalTexture = false;
 
         float backendProjMatrix[16];
@@ -228,6 +288,23 @@ private:
         uint64_t state = BGFX_STATE_MSAA;
     };
 
+    // Consecutive TL draws waiting to be submitted as one, with the state they were drawn with
+    struct RendererBatch
+    {
+        RendererState state;
+        bgfx::ViewId viewId = 0;
+        RendererProgram program = RendererProgram::SMOOTH;
+        uint16_t scissorOffsetX = 0;
+        uint16_t scissorOffsetY = 0;
+        uint16_t scissorWidth = 0;
+        uint16_t scissorHeight = 0;
+
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
     std::string vertexPathFlat = "shaders/FFNx";
     std::string fragmentPathFlat = "shaders/FFNx";
     std::string vertexPathSmooth = "shaders/FFNx";
@@ -250,6 +327,11 @@ private:
 
     std::vector<bgfx::ProgramHandle> backendProgramHandles = std::vector<bgfx::ProgramHandle>(RendererProgram::COUNT, BGFX_INVALID_HANDLE);
 
+    // Specialized game programs, indexed by varying ( flat, smooth ) then permutation. Loaded on first use
+    std::string shaderSuffix;
+    std::vector<bgfx::ProgramHandle> permutationProgramHandles = std::vector<bgfx::ProgramHandle>(2 * PERMUTATION_COUNT, BGFX_INVALID_HANDLE);
+    std::bitset<2 * PERMUTATION_COUNT> permutationLoaded;
+
     std::vector<bgfx::TextureHandle> backendFrameBufferRT = { BGFX_INVALID_HANDLE, BGFX_INVALID_HANDLE };
     bgfx::FrameBufferHandle backendFrameBuffer = BGFX_INVALID_HANDLE;
 
@@ -262,15 +344,44 @@ private:
     bgfx::TextureHandle diffuseIblTexture = BGFX_INVALID_HANDLE;
     bgfx::TextureHandle envBrdfTexture = BGFX_INVALID_HANDLE;
 
+    // Staging buffers are uploaded by reference, so the ones of the previous frame are kept untouched until bgfx is done with them.
+    // Their capacity is kept across frames, only the first vertexBufferCount / indexBufferCount entries are used
     std::vector<Vertex> vertexBufferData;
+    std::vector<Vertex> previousVertexBufferData;
+    uint32_t vertexBufferCount = 0;
     bgfx::DynamicVertexBufferHandle vertexBufferHandle = BGFX_INVALID_HANDLE;
 
     std::vector<WORD> indexBufferData;
+    std::vector<WORD> previousIndexBufferData;
+    uint32_t indexBufferCount = 0;
     bgfx::DynamicIndexBufferHandle indexBufferHandle = BGFX_INVALID_HANDLE;
 
     bgfx::VertexLayout vertexLayout;
 
-    std::map<std::string,uint16_t> bgfxUniformHandles;
+    UniformSlot uniforms[UNIFORM_COUNT];
+    UniformSlot samplers[RendererTextureSlot::COUNT];
+
+    // Views drawn in submission order, where a uniform keeps the value of the previous draw
+    std::bitset<256> sequentialViews;
+
+    uint32_t uniformBytesSubmitted = 0;
+    uint32_t uniformBytesSkipped = 0;
+    uint32_t lastFrameUniformBytesSubmitted = 0;
+    uint32_t lastFrameUniformBytesSkipped = 0;
+
+    RendererBatch batch;
+
+    // Remapping of the vertex coordinates into the atlas page of the texture being drawn
+    bool atlasRemap = false;
+    float atlasScaleU = 1.0f;
+    float atlasScaleV = 1.0f;
+    float atlasOffsetU = 0.0f;
+    float atlasOffsetV = 0.0f;
+
+    uint32_t submitCount = 0;
+    uint32_t mergedDrawCount = 0;
+    uint32_t lastFrameSubmitCount = 0;
+    uint32_t lastFrameMergedDrawCount = 0;
 
     RendererState internalState;
 
@@ -291,14 +402,20 @@ private:
     uint16_t framebufferVertexWidth = 0;
 
     uint32_t createBGRA(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
-    void setCommonUniforms();
-    void setLightingUniforms();
+    void getTextureFormat(RendererTextureType type, bgfx::TextureFormat::Enum* texFormat, bimg::TextureFormat::Enum* imgFormat);
+
+    void setCommonUniforms(bgfx::ViewId viewId);
+    void setLightingUniforms(bgfx::ViewId viewId);
     bgfx::RendererType::Enum getUserChosenRenderer();
     void updateRendererShaderPaths();
-    bgfx::ShaderHandle getShader(const char* filePath);
+    bgfx::ShaderHandle getShader(const char* filePath, bool required = true);
 
-    bgfx::UniformHandle getUniform(std::string uniformName, bgfx::UniformType::Enum uniformType);
-    bgfx::UniformHandle setUniform(const char* uniformName, bgfx::UniformType::Enum uniformType, const void* uniformValue);
+    int getPermutation();
+    bgfx::ProgramHandle getGameProgram();
+
+    bgfx::UniformHandle getUniform(RendererUniform uniform);
+    bgfx::UniformHandle getSampler(uint32_t slot);
+    void setUniform(RendererUniform uniform, bgfx::ViewId viewId, const void* uniformValue);
     void destroyUniforms();
     void destroyAll();
 
@@ -315,6 +432,12 @@ private:
 
     void bindTextures();
 
+    void resolveAtlasTexture(struct nvertex* inVertex, uint32_t inCount);
+    uint32_t stageVertices(struct nvertex* inVertex, vector3<float>* normals, uint32_t inCount);
+    uint32_t stageIndices(WORD* inIndex, uint32_t inCount);
+    bool canMergeBatch(uint32_t vertexCount);
+    void flushBatch();
+
     bx::DefaultAllocator defaultAllocator;
     bx::FileWriter defaultWriter;
     Overlay overlay;
@@ -341,6 +464,7 @@ public:
     void drawFieldShadow();
     void recoverDepthBuffer();
     void draw(bool uniformsAlreadyAttached = false);
+    void drawBatched(struct nvertex* inVertex, uint32_t vertexCount, WORD* inIndex, uint32_t indexCount);
     void drawOverlay();
     void show();
 
@@ -351,6 +475,12 @@ public:
 
     const bgfx::Caps* getCaps();
     const bgfx::Stats* getStats();
+    // Uniform data sent to bgfx during the previous frame, and the amount skipped because it did not change
+    uint32_t getUniformBytesSubmitted();
+    uint32_t getUniformBytesSkipped();
+    // Draw calls submitted to bgfx during the previous frame, and the amount merged into another one
+    uint32_t getSubmitCount();
+    uint32_t getMergedDrawCount();
 
     void bindVertexBuffer(struct nvertex* inVertex, vector3<float>* normals, uint32_t inCount);
     void bindIndexBuffer(WORD* inIndex, uint32_t inCount);
@@ -360,8 +490,16 @@ public:
     void setBackgroundColor(float r = 0.0f, float g = 0.0f, float b = 0.0f, float a = 0.0f);
 
     uint32_t createTexture(uint8_t* data, size_t width, size_t height, int stride = 0, RendererTextureType type = RendererTextureType::BGRA, bool isSrgb = true);
+    // Empty texture meant to be refreshed with updateTexture, for content which changes every frame
+    uint32_t createDynamicTexture(size_t width, size_t height, RendererTextureType type = RendererTextureType::BGRA, bool isSrgb = true);
+    // When releaseFn is set, data is referenced instead of copied and releaseFn is called once the GPU upload is done, possibly from the rendering thread
+    void updateTexture(uint16_t texId, uint8_t* data, size_t width, size_t height, int stride = 0, RendererTextureType type = RendererTextureType::BGRA, bgfx::ReleaseFn releaseFn = nullptr, void* userData = nullptr);
     uint32_t createTexture(char* filename, uint32_t* width, uint32_t* height, uint32_t* mipCount, bool isSrgb = true);
     bgfx::TextureHandle createTextureHandle(char* filename, uint32_t* width, uint32_t* height, uint32_t* mipCount, bool isSrgb = true);
+    bgfx::TextureHandle createTextureHandle(bimg::ImageContainer* img, char* filename, uint32_t* width, uint32_t* height, uint32_t* mipCount, bool isSrgb = true);
+    // Decode only, safe to call outside of the rendering thread. The returned container is owned by the caller until passed to createTextureHandle
+    bimg::ImageContainer* loadImageContainer(char* filename);
+    bimg::ImageContainer* loadLibPngImageContainer(char* filename);
     uint32_t createTextureLibPng(char* filename, uint32_t* width, uint32_t* height, bool isSrgb = true);
     bool saveTexture(char* filename, uint32_t width, uint32_t height, void* data);
     void deleteTexture(uint16_t texId);
@@ -375,6 +513,7 @@ public:
     void isFBTexture(bool flag = false);
     void isFullRange(bool flag = false);
     void isYUV(bool flag = false);
+    void isInterleavedUV(bool flag = false);
     void doModulateAlpha(bool flag = false);
     void doTextureFiltering(bool flag = false);
     void isExternalTexture(bool flag = false);
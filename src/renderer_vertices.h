@@ -0,0 +1,116 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RENDERER_SSE2
+#endif
+
+/*
+ * Conversion of the vertices sent by the engine ( struct nvertex ) to the layout uploaded to bgfx ( Renderer::Vertex ).
+ *
+ * XYZ, color, U and V are copied as is, W is forced to 1.0 when infinite, the normals are taken from a separate array
+ * or zeroed. The types are template parameters only so that the conversion can be built and checked without the renderer.
+ */
+
+// Reference conversion, also used for the vertices left over by the SSE2 path
+template<typename Vertex, typename NVertex, typename Normal>
+inline void RendererConvertVerticesScalar(Vertex* outVertex, const NVertex* inVertex, const Normal* normals, uint32_t inCount, uint32_t idx = 0)
+{
+    for (; idx < inCount; idx++)
+    {
+        Vertex& out = outVertex[idx];
+
+        out.x = inVertex[idx]._.x;
+        out.y = inVertex[idx]._.y;
+        out.z = inVertex[idx]._.z;
+        out.w = ( std::isinf(inVertex[idx].color.w) ? 1.0f : inVertex[idx].color.w );
+        out.bgra = inVertex[idx].color.color;
+        out.u = inVertex[idx].u;
+        out.v = inVertex[idx].v;
+
+        if (normals)
+        {
+            out.nx = normals[idx].x;
+            out.ny = normals[idx].y;
+            out.nz = normals[idx].z;
+        }
+        else
+        {
+            out.nx = 0.0f;
+            out.ny = 0.0f;
+            out.nz = 0.0f;
+        }
+    }
+}
+
+template<typename Vertex, typename NVertex, typename Normal>
+inline void RendererConvertVertices(Vertex* outVertex, const NVertex* inVertex, const Normal* normals, uint32_t inCount)
+{
+    uint32_t idx = 0;
+
+#ifdef RENDERER_SSE2
+    static_assert(sizeof(NVertex) == 8 * sizeof(float) && sizeof(Vertex) == 10 * sizeof(float), "unexpected vertex layout");
+
+    // XYZW is copied as is, except W which is forced to 1.0 when infinite. Then color, specular, U and V
+    // are shuffled into BGRA, U, V and a slot overwritten by the normals
+    const __m128 wLane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 infinity = _mm_castsi128_ps(_mm_set1_epi32(0x7F800000));
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; idx < inCount; idx++)
+    {
+        const float* in = (const float*)&inVertex[idx];
+        float* out = (float*)&outVertex[idx];
+
+        __m128 xyzw = _mm_loadu_ps(in);
+        __m128 attributes = _mm_loadu_ps(in + 4);
+
+        __m128 isInfinite = _mm_and_ps(_mm_cmpeq_ps(_mm_and_ps(xyzw, absMask), infinity), wLane);
+        xyzw = _mm_or_ps(_mm_andnot_ps(isInfinite, xyzw), _mm_and_ps(isInfinite, one));
+
+        _mm_storeu_ps(out, xyzw);
+        // color, u, v, (specular)
+        _mm_storeu_ps(out + 4, _mm_shuffle_ps(attributes, attributes, _MM_SHUFFLE(1, 3, 2, 0)));
+
+        if (normals)
+        {
+            out[7] = normals[idx].x;
+            out[8] = normals[idx].y;
+            out[9] = normals[idx].z;
+        }
+        else
+        {
+            out[7] = 0.0f;
+            _mm_storel_pi((__m64*)(out + 8), zero);
+        }
+    }
+#endif
+
+    RendererConvertVerticesScalar(outVertex, inVertex, normals, inCount, idx);
+}
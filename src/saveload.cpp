@@ -20,7 +20,6 @@
 //    GNU General Public License for more details.                          //
 /****************************************************************************/
 
-#include <sys/stat.h>
 #include <stdio.h>
 #include <direct.h>
 #include "renderer.h"
@@ -30,6 +29,10 @@
 #include "macro.h"
 
 #include "discohash.h"
+#include "file_index.h"
+#include "texture_streamer.h"
+#include "texture_cache.h"
+#include "animated_texture_cache.h"
 #include <xxhash.h>
 
 // TEMPORARY! WILL BE REMOVED AFTER MIGRATION.
@@ -43,6 +46,27 @@ std::map<uint16_t, std::string> additional_textures = {
 	{RendererTextureSlot::TEX_PBR, "pbr"}
 };
 
+// in-memory view of mod_path, avoids probing the filesystem for every texture candidate
+FileIndex modPathIndex;
+
+void saveload_init()
+{
+	modPathIndex.setRoot(std::string(basedir) + "/" + mod_path);
+}
+
+// every mod_path filename is built as "<basedir>/<mod_path>/<relative>", return the relative part
+const char* mod_path_relative(const char *filename)
+{
+	size_t prefix = strlen(basedir) + mod_path.length() + 2;
+
+	return strlen(filename) > prefix ? filename + prefix : filename;
+}
+
+bool mod_path_exists(const char *filename)
+{
+	return modPathIndex.exists(mod_path_relative(filename));
+}
+
 void make_path(char *name)
 {
 	char *next = name;
@@ -76,7 +100,6 @@ void normalize_path(char *name)
 void save_texture(void *data, uint32_t dataSize, uint32_t width, uint32_t height, uint32_t palette_index, char *name, bool is_animated)
 {
 	char filename[sizeof(basedir) + 1024];
-	struct stat dummy;
 	uint64_t hash;
 
 	if (is_animated)
@@ -126,22 +149,34 @@ void save_texture(void *data, uint32_t dataSize, uint32_t width, uint32_t height
 
 	make_path(filename);
 
-	if (stat(filename, &dummy) != 0)
+	if (!mod_path_exists(filename))
 	{
-		if (!newRenderer.saveTexture(filename, width, height, data)) ffnx_error("Save texture failed for the file [ %s ].\n", filename);
+		if (newRenderer.saveTexture(filename, width, height, data)) modPathIndex.add(mod_path_relative(filename));
+		else ffnx_error("Save texture failed for the file [ %s ].\n", filename);
 	}
 	else
 		ffnx_warning("Save texture skipped because the file [ %s ] already exists.\n", filename);
 }
 
-uint32_t load_texture_helper(char* name, uint32_t* width, uint32_t* height, bool useLibPng, bool isSrgb)
+uint32_t load_texture_helper(char* name, uint32_t* width, uint32_t* height, bool useLibPng, bool isSrgb, uint16_t slot = RendererTextureSlot::TEX_Y)
 {
 	uint32_t ret = 0;
 
 	normalize_path(name);
 
 	if (useLibPng)
-		ret = newRenderer.createTextureLibPng(name, width, height, isSrgb);
+	{
+		std::string cached = textureCache.resolve(name, slot);
+
+		if (!cached.empty())
+		{
+			uint32_t mipCount = 0;
+			ret = newRenderer.createTexture(cached.data(), width, height, &mipCount, isSrgb);
+		}
+
+		// Keep using the PNG file if the cached copy could not be loaded
+		if (!ret) ret = newRenderer.createTextureLibPng(name, width, height, isSrgb);
+	}
 	else
 	{
 		uint32_t mipCount = 0;
@@ -156,45 +191,85 @@ uint32_t load_texture_helper(char* name, uint32_t* width, uint32_t* height, bool
 	return ret;
 }
 
-uint32_t load_texture(void* data, uint32_t dataSize, char* name, uint32_t palette_index, uint32_t* width, uint32_t* height, struct gl_texture_set* gl_set)
+// Look for an animated texture already loaded by this texture set, or by any other one through the cache
+uint32_t find_animated_texture(struct gl_texture_set* gl_set, const std::string& key)
+{
+	if (gl_set->animated_textures.count(key)) return gl_set->animated_textures[key];
+
+	uint32_t ret = animatedTextureCache.acquire(key);
+
+	if (ret) gl_set->animated_textures[key] = ret;
+
+	return ret;
+}
+
+uint32_t load_texture(void* data, uint32_t dataSize, char* name, uint32_t palette_index, uint32_t* width, uint32_t* height, struct gl_texture_set* gl_set, struct texture_set* stream_target, uint32_t stream_palette_index)
 {
 	uint32_t ret = 0;
 	char filename[sizeof(basedir) + 1024]{ 0 };
 	uint64_t hash;
 	bool is_animated = gl_set->is_animated;
-
-	struct stat dummy;
+	std::string cache_key;
 
 	if (is_animated) {
 		if (use_animated_textures_v2)
 			hash = XXH3_64bits(data, dataSize);
 		else
 			BEBB4185_64(data, dataSize, 0, &hash);
+
+		// We already know the texture, return its handler without looking on disk
+		cache_key = AnimatedTextureCache::getKey(name, palette_index, hash);
+		ret = find_animated_texture(gl_set, cache_key);
+
+		if (ret) return ret;
+	}
+	else if (stream_target != nullptr && gl_set->streamed_palettes.count(stream_palette_index))
+	{
+		// The external texture was already streamed in, keep it instead of decoding it again
+		return TEXTURE_STREAMER_QUEUED;
 	}
 
 	for (int idx = 0; idx < mod_ext.size(); idx++)
 	{
+		bool is_shared_frame = false;
+
 		if (is_animated)
 		{
 			_snprintf(filename, sizeof(filename), "%s/%s/%s_%02i_%llx.%s", basedir, mod_path.c_str(), name, palette_index, hash, mod_ext[idx].c_str());
+			cache_key = AnimatedTextureCache::getKey(name, palette_index, hash);
 
-			if (stat(filename, &dummy) != 0)
+			if (!mod_path_exists(filename))
 			{
 				if (trace_all || show_missing_textures) ffnx_trace("Could not find animated texture [ %s ].\n", filename);
 
 				_snprintf(filename, sizeof(filename), "%s/%s/%s_%02i.%s", basedir, mod_path.c_str(), name, palette_index, mod_ext[idx].c_str());
+
+				// Every frame without its own file shares the same texture
+				cache_key = AnimatedTextureCache::getKey(name, palette_index, 0);
+				is_shared_frame = true;
 			}
 		}
 		else
 			_snprintf(filename, sizeof(filename), "%s/%s/%s_%02i.%s", basedir, mod_path.c_str(), name, palette_index, mod_ext[idx].c_str());
 
-		if (stat(filename, &dummy) == 0)
+		if (mod_path_exists(filename))
 		{
-			if (is_animated && gl_set->animated_textures.count(filename))
+			if (is_shared_frame)
+			{
+				ret = find_animated_texture(gl_set, cache_key);
+
+				if (ret) break;
+			}
+
+			if (stream_target != nullptr && !is_animated)
 			{
-				// We already know the texture, return its handler and move on
-				ret = gl_set->animated_textures[filename];
-				break;
+				normalize_path(filename);
+
+				if (textureStreamer.request(stream_target, stream_palette_index, RendererTextureSlot::TEX_Y, filename, mod_ext[idx] == "png", true))
+				{
+					ret = TEXTURE_STREAMER_QUEUED;
+					break;
+				}
 			}
 
 			ret = load_texture_helper(filename, width, height, mod_ext[idx] == "png", true);
@@ -205,7 +280,7 @@ uint32_t load_texture(void* data, uint32_t dataSize, char* name, uint32_t palett
 				else ffnx_warning("External texture [%s] found but not loaded due to memory limitations.\n", filename);
 			}
 
-			if (is_animated && ret) gl_set->animated_textures[filename] = ret;
+			if (is_animated && ret) ret = gl_set->animated_textures[cache_key] = animatedTextureCache.insert(cache_key, ret, *width * *height * 4);
 
 			break;
 		}
@@ -220,7 +295,7 @@ uint32_t load_texture(void* data, uint32_t dataSize, char* name, uint32_t palett
 		if(palette_index != 0)
 		{
 			if(trace_all || show_missing_textures) ffnx_info("No external texture found, falling back to palette 0\n", basedir, mod_path.c_str(), name, palette_index);
-			return load_texture(data, dataSize, name, 0, width, height, gl_set);
+			return load_texture(data, dataSize, name, 0, width, height, gl_set, stream_target, stream_palette_index);
 		}
 		else
 		{
@@ -239,10 +314,14 @@ uint32_t load_texture(void* data, uint32_t dataSize, char* name, uint32_t palett
 				{
 					_snprintf(filename, sizeof(filename), "%s/%s/%s_%02i_%s.%s", basedir, mod_path.c_str(), name, palette_index, it.second.c_str(), mod_ext[idx].c_str());
 
-					if (stat(filename, &dummy) == 0)
+					if (mod_path_exists(filename))
 					{
+						normalize_path(filename);
+
+						if (stream_target != nullptr && textureStreamer.request(stream_target, stream_palette_index, it.first, filename, mod_ext[idx] == "png", false)) break;
+
 						if (gl_set->additional_textures.count(it.first)) newRenderer.deleteTexture(gl_set->additional_textures[it.first]);
-						gl_set->additional_textures[it.first] = load_texture_helper(filename, width, height, mod_ext[idx] == "png", false);
+						gl_set->additional_textures[it.first] = load_texture_helper(filename, width, height, mod_ext[idx] == "png", false, it.first);
 						break;
 					}
 					else if (trace_all || show_missing_textures)
@@ -21,5 +21,10 @@
 
 #pragma once
 
+#include "file_index.h"
+
+extern FileIndex modPathIndex;
+
+void saveload_init();
 void save_texture(void *data, uint32_t dataSize, uint32_t width, uint32_t height, uint32_t palette_index, char *name, bool is_animated);
-uint32_t load_texture(void *data, uint32_t dataSize, char *name, uint32_t palette_index, uint32_t *width, uint32_t *height, struct gl_texture_set* gl_set);
+uint32_t load_texture(void *data, uint32_t dataSize, char *name, uint32_t palette_index, uint32_t *width, uint32_t *height, struct gl_texture_set* gl_set, struct texture_set* stream_target = nullptr, uint32_t stream_palette_index = 0);
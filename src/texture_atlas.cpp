@@ -0,0 +1,421 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <algorithm>
+#include <imgui.h>
+
+#include "texture_atlas.h"
+#include "cfg.h"
+#include "log.h"
+
+TextureAtlas textureAtlas;
+
+// PRIVATE
+
+uint32_t TextureAtlas::getPaddedArea(const Entry& entry)
+{
+	return (entry.width + 2 * TEXTURE_ATLAS_PADDING) * (entry.height + 2 * TEXTURE_ATLAS_PADDING);
+}
+
+bool TextureAtlas::allocate(uint32_t page, uint16_t width, uint16_t height, uint16_t& x, uint16_t& y)
+{
+	Page& atlasPage = pages[page];
+	uint16_t paddedWidth = width + 2 * TEXTURE_ATLAS_PADDING;
+	uint16_t paddedHeight = height + 2 * TEXTURE_ATLAS_PADDING;
+	Shelf* best = nullptr;
+
+	// Lowest shelf the texture fits in
+	for (Shelf& shelf : atlasPage.shelves)
+	{
+		if (shelf.height >= paddedHeight && TEXTURE_ATLAS_PAGE_SIZE - shelf.x >= paddedWidth && (best == nullptr || shelf.height < best->height)) best = &shelf;
+	}
+
+	// Open a new shelf instead of wasting most of a much taller one
+	if (best == nullptr || best->height > 2 * paddedHeight)
+	{
+		uint16_t top = atlasPage.shelves.empty() ? 0 : atlasPage.shelves.back().y + atlasPage.shelves.back().height;
+
+		if (top + paddedHeight <= TEXTURE_ATLAS_PAGE_SIZE)
+		{
+			atlasPage.shelves.push_back({ top, paddedHeight, 0 });
+			best = &atlasPage.shelves.back();
+		}
+	}
+
+	if (best == nullptr) return false;
+
+	x = best->x + TEXTURE_ATLAS_PADDING;
+	y = best->y + TEXTURE_ATLAS_PADDING;
+
+	best->x += paddedWidth;
+	atlasPage.allocatedArea += paddedWidth * paddedHeight;
+
+	return true;
+}
+
+bool TextureAtlas::place(uint16_t id)
+{
+	Entry& entry = entries[id];
+	uint32_t page = 0;
+
+	for (; page < pages.size(); page++)
+	{
+		if (allocate(page, entry.width, entry.height, entry.x, entry.y)) break;
+	}
+
+	if (page == pages.size())
+	{
+		if (pages.size() >= TEXTURE_ATLAS_MAX_PAGES) return false;
+
+		Page& atlasPage = pages.emplace_back();
+
+		atlasPage.handle = bgfx::createTexture2D(TEXTURE_ATLAS_PAGE_SIZE, TEXTURE_ATLAS_PAGE_SIZE, false, 1, bgfx::TextureFormat::BGRA8, BGFX_TEXTURE_SRGB);
+
+		if (!bgfx::isValid(atlasPage.handle))
+		{
+			pages.pop_back();
+
+			return false;
+		}
+
+		bgfx::setName(atlasPage.handle, "Texture atlas");
+
+		if (trace_all || trace_renderer) ffnx_trace("TextureAtlas: created page %u\n", page);
+
+		if (!allocate(page, entry.width, entry.height, entry.x, entry.y)) return false;
+	}
+
+	entry.page = page;
+	pages[page].textureCount++;
+	pages[page].usedArea += getPaddedArea(entry);
+
+	upload(entry);
+
+	return true;
+}
+
+void TextureAtlas::upload(const Entry& entry)
+{
+	uint16_t paddedWidth = entry.width + 2 * TEXTURE_ATLAS_PADDING;
+	uint16_t paddedHeight = entry.height + 2 * TEXTURE_ATLAS_PADDING;
+	const bgfx::Memory* mem = bgfx::alloc(paddedWidth * paddedHeight * sizeof(uint32_t));
+	uint32_t* out = (uint32_t*)mem->data;
+
+	for (int row = 0; row < paddedHeight; row++)
+	{
+		const uint32_t* in = &entry.pixels[std::clamp(row - TEXTURE_ATLAS_PADDING, 0, entry.height - 1) * entry.width];
+
+		for (int col = 0; col < paddedWidth; col++) *out++ = in[std::clamp(col - TEXTURE_ATLAS_PADDING, 0, entry.width - 1)];
+	}
+
+	bgfx::updateTexture2D(pages[entry.page].handle, 0, 0, entry.x - TEXTURE_ATLAS_PADDING, entry.y - TEXTURE_ATLAS_PADDING, paddedWidth, paddedHeight, mem);
+}
+
+void TextureAtlas::releaseArea(Entry& entry)
+{
+	Page& atlasPage = pages[entry.page];
+
+	atlasPage.textureCount--;
+	atlasPage.usedArea -= getPaddedArea(entry);
+}
+
+void TextureAtlas::repack(uint32_t page)
+{
+	std::vector<uint16_t> ids;
+
+	for (uint16_t id = 0; id < entries.size(); id++)
+	{
+		const Entry& entry = entries[id];
+
+		if (entry.used && !bgfx::isValid(entry.standalone) && entry.page == page) ids.push_back(id);
+	}
+
+	// Tallest first packs shelves the tightest
+	std::sort(ids.begin(), ids.end(), [this](uint16_t a, uint16_t b) { return entries[a].height > entries[b].height; });
+
+	Page& atlasPage = pages[page];
+
+	atlasPage.shelves.clear();
+	atlasPage.textureCount = 0;
+	atlasPage.usedArea = 0;
+	atlasPage.allocatedArea = 0;
+
+	for (uint16_t id : ids)
+	{
+		Entry& entry = entries[id];
+
+		if (allocate(page, entry.width, entry.height, entry.x, entry.y))
+		{
+			atlasPage.textureCount++;
+			atlasPage.usedArea += getPaddedArea(entry);
+
+			upload(entry);
+		}
+		else if (!place(id))
+		{
+			entry.standalone = bgfx::createTexture2D(entry.width, entry.height, false, 1, bgfx::TextureFormat::BGRA8, BGFX_TEXTURE_SRGB, bgfx::copy(entry.pixels.data(), entry.pixels.size() * sizeof(uint32_t)));
+			promotions++;
+		}
+	}
+
+	repacks++;
+
+	if (trace_all || trace_renderer) ffnx_trace("TextureAtlas: repacked page %u, %u textures\n", page, atlasPage.textureCount);
+}
+
+// PUBLIC
+
+bool TextureAtlas::isAtlasHandle(uint16_t handle)
+{
+	return handle >= TEXTURE_ATLAS_HANDLE_BASE && handle != bgfx::kInvalidHandle;
+}
+
+void TextureAtlas::init()
+{
+	// Atlas handles must never collide with a real texture handle
+	enabled = enable_texture_atlas && bgfx::getCaps()->limits.maxTextures <= TEXTURE_ATLAS_HANDLE_BASE;
+
+	// Pages are referenced while new ones get created
+	pages.reserve(TEXTURE_ATLAS_MAX_PAGES);
+}
+
+void TextureAtlas::destroy()
+{
+	for (Page& page : pages) bgfx::destroy(page.handle);
+
+	for (Entry& entry : entries)
+	{
+		if (bgfx::isValid(entry.standalone)) bgfx::destroy(entry.standalone);
+	}
+
+	pages.clear();
+	entries.clear();
+	freeEntries.clear();
+	pendingRemoves.clear();
+}
+
+bool TextureAtlas::isEnabled()
+{
+	return enabled;
+}
+
+uint16_t TextureAtlas::add(const uint32_t* pixels, uint32_t width, uint32_t height)
+{
+	if (!enabled || pixels == nullptr || width == 0 || height == 0 || width > TEXTURE_ATLAS_MAX_TEXTURE_SIZE || height > TEXTURE_ATLAS_MAX_TEXTURE_SIZE) return 0;
+
+	uint16_t id;
+
+	if (!freeEntries.empty())
+	{
+		id = freeEntries.back();
+		freeEntries.pop_back();
+	}
+	else
+	{
+		if (entries.size() >= bgfx::kInvalidHandle - TEXTURE_ATLAS_HANDLE_BASE) return 0;
+
+		id = entries.size();
+		entries.emplace_back();
+	}
+
+	Entry& entry = entries[id];
+
+	entry.used = true;
+	entry.width = width;
+	entry.height = height;
+	entry.standalone = BGFX_INVALID_HANDLE;
+	entry.pixels.assign(pixels, pixels + width * height);
+
+	if (!place(id))
+	{
+		// Atlas is full, the caller creates a texture of its own
+		entry.used = false;
+		entry.pixels.clear();
+		freeEntries.push_back(id);
+
+		return 0;
+	}
+
+	return TEXTURE_ATLAS_HANDLE_BASE + id;
+}
+
+void TextureAtlas::remove(uint16_t handle)
+{
+	uint16_t id = handle - TEXTURE_ATLAS_HANDLE_BASE;
+
+	if (id >= entries.size() || !entries[id].used) return;
+
+	Entry& entry = entries[id];
+
+	if (bgfx::isValid(entry.standalone))
+	{
+		bgfx::destroy(entry.standalone);
+		entry.standalone = BGFX_INVALID_HANDLE;
+	}
+	else releaseArea(entry);
+
+	entry.used = false;
+	entry.pixels.clear();
+	entry.pixels.shrink_to_fit();
+
+	pendingRemoves.push_back(id);
+}
+
+bgfx::TextureHandle TextureAtlas::resolve(uint16_t handle, bool& inAtlas)
+{
+	uint16_t id = handle - TEXTURE_ATLAS_HANDLE_BASE;
+
+	inAtlas = false;
+
+	if (id >= entries.size() || !entries[id].used) return BGFX_INVALID_HANDLE;
+
+	const Entry& entry = entries[id];
+
+	if (bgfx::isValid(entry.standalone)) return entry.standalone;
+
+	inAtlas = true;
+
+	return pages[entry.page].handle;
+}
+
+void TextureAtlas::getTransform(uint16_t handle, float& scaleU, float& scaleV, float& offsetU, float& offsetV)
+{
+	const Entry& entry = entries[handle - TEXTURE_ATLAS_HANDLE_BASE];
+
+	scaleU = float(entry.width) / TEXTURE_ATLAS_PAGE_SIZE;
+	scaleV = float(entry.height) / TEXTURE_ATLAS_PAGE_SIZE;
+	offsetU = float(entry.x) / TEXTURE_ATLAS_PAGE_SIZE;
+	offsetV = float(entry.y) / TEXTURE_ATLAS_PAGE_SIZE;
+}
+
+bgfx::TextureHandle TextureAtlas::promote(uint16_t handle)
+{
+	Entry& entry = entries[handle - TEXTURE_ATLAS_HANDLE_BASE];
+
+	if (bgfx::isValid(entry.standalone)) return entry.standalone;
+
+	entry.standalone = bgfx::createTexture2D(entry.width, entry.height, false, 1, bgfx::TextureFormat::BGRA8, BGFX_TEXTURE_SRGB, bgfx::copy(entry.pixels.data(), entry.pixels.size() * sizeof(uint32_t)));
+	entry.pixels.clear();
+	entry.pixels.shrink_to_fit();
+
+	// The region is not reused before the end of the frame, draws already submitted still sample it
+	releaseArea(entry);
+
+	promotions++;
+
+	if (trace_all || trace_renderer) ffnx_trace("TextureAtlas: texture %u is drawn with wrapping coordinates, moved out of the atlas\n", handle);
+
+	return entry.standalone;
+}
+
+void TextureAtlas::frame()
+{
+	freeEntries.insert(freeEntries.end(), pendingRemoves.begin(), pendingRemoves.end());
+	pendingRemoves.clear();
+
+	for (uint32_t page = 0; page < pages.size(); page++)
+	{
+		Page& atlasPage = pages[page];
+
+		if (atlasPage.textureCount == 0)
+		{
+			atlasPage.shelves.clear();
+			atlasPage.allocatedArea = 0;
+		}
+		// More than half of the space handed out belongs to textures which are gone
+		else if (atlasPage.allocatedArea > TEXTURE_ATLAS_PAGE_SIZE * TEXTURE_ATLAS_PAGE_SIZE / 2 && atlasPage.allocatedArea > 2 * atlasPage.usedArea) repack(page);
+	}
+}
+
+uint32_t TextureAtlas::getTextureCount()
+{
+	uint32_t ret = 0;
+
+	for (const Entry& entry : entries)
+	{
+		if (entry.used) ret++;
+	}
+
+	return ret;
+}
+
+uint32_t TextureAtlas::getPromotionCount()
+{
+	return promotions;
+}
+
+uint32_t TextureAtlas::getRepackCount()
+{
+	return repacks;
+}
+
+std::vector<TextureAtlas::PageStats> TextureAtlas::getPageStats()
+{
+	std::vector<PageStats> ret;
+
+	for (const Page& page : pages)
+	{
+		PageStats& stats = ret.emplace_back();
+
+		stats.handle = page.handle;
+		stats.textureCount = page.textureCount;
+		stats.occupancy = 100.0f * page.usedArea / (TEXTURE_ATLAS_PAGE_SIZE * TEXTURE_ATLAS_PAGE_SIZE);
+		stats.allocated = 100.0f * page.allocatedArea / (TEXTURE_ATLAS_PAGE_SIZE * TEXTURE_ATLAS_PAGE_SIZE);
+	}
+
+	return ret;
+}
+
+void texture_atlas_debug(bool* isOpen)
+{
+	if (!ImGui::Begin("Texture Atlas", isOpen, ImGuiWindowFlags_::ImGuiWindowFlags_AlwaysAutoResize))
+	{
+		ImGui::End();
+		return;
+	}
+
+	if (!textureAtlas.isEnabled())
+	{
+		ImGui::Text("The texture atlas is disabled.");
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("Textures: %u, moved out: %u, repacks: %u", textureAtlas.getTextureCount(), textureAtlas.getPromotionCount(), textureAtlas.getRepackCount());
+
+	uint32_t idx = 0;
+
+	for (const TextureAtlas::PageStats& page : textureAtlas.getPageStats())
+	{
+		ImGui::Separator();
+		ImGui::Text("Page %u: %u textures, %.1f%% used, %.1f%% allocated", idx++, page.textureCount, page.occupancy, page.allocated);
+
+		// Same packing as the overlay renderer expects, with alpha blending enabled
+		union { ImTextureID ptr; struct { bgfx::TextureHandle handle; uint8_t flags; uint8_t mip; } s; } texture;
+		texture.s.handle = page.handle;
+		texture.s.flags = 1;
+		texture.s.mip = 0;
+
+		ImGui::Image(texture.ptr, ImVec2(256, 256));
+	}
+
+	ImGui::End();
+}
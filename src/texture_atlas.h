@@ -0,0 +1,136 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <bgfx/bgfx.h>
+
+// Width and height of an atlas page
+#define TEXTURE_ATLAS_PAGE_SIZE 1024
+#define TEXTURE_ATLAS_MAX_PAGES 4
+// Textures larger than this in any dimension keep their own texture
+#define TEXTURE_ATLAS_MAX_TEXTURE_SIZE 256
+// Border of replicated edge texels around every texture, so sampling at the edge never reads a neighbour
+#define TEXTURE_ATLAS_PADDING 1
+// Atlas textures are handed to the game as handles above every bgfx texture handle
+#define TEXTURE_ATLAS_HANDLE_BASE 0x8000
+
+/*
+ * Packs small internal game textures ( fonts, window borders, battle HUD ) into a few large textures,
+ * so that consecutive 2D draws use the same texture and can be merged by the renderer.
+ *
+ * Every page is filled with shelves. Space released by an unloaded texture is only reclaimed
+ * when its page becomes empty or gets repacked, which both happen between two frames so that
+ * draws already submitted never sample a region that was reused in the meantime.
+ *
+ * A copy of each texture is kept to rebuild pages, and to give a texture its own bgfx texture
+ * when it is drawn with coordinates outside of [0, 1] which would need wrapping.
+ */
+class TextureAtlas
+{
+public:
+	struct PageStats
+	{
+		bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
+		uint32_t textureCount = 0;
+		float occupancy = 0.0f;
+		float allocated = 0.0f;
+	};
+
+private:
+	struct Shelf
+	{
+		uint16_t y = 0;
+		uint16_t height = 0;
+		uint16_t x = 0;
+	};
+
+	struct Page
+	{
+		bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
+		std::vector<Shelf> shelves;
+		uint32_t textureCount = 0;
+		// Area of the live textures, and of everything handed out since the page was last reset
+		uint32_t usedArea = 0;
+		uint32_t allocatedArea = 0;
+	};
+
+	struct Entry
+	{
+		bool used = false;
+		bool pendingRemove = false;
+		uint8_t page = 0;
+		uint16_t x = 0;
+		uint16_t y = 0;
+		uint16_t width = 0;
+		uint16_t height = 0;
+		bgfx::TextureHandle standalone = BGFX_INVALID_HANDLE;
+		std::vector<uint32_t> pixels;
+	};
+
+	bool enabled = false;
+	std::vector<Page> pages;
+	std::vector<Entry> entries;
+	std::vector<uint16_t> freeEntries;
+	// Released during the current frame, recycled once it has been submitted
+	std::vector<uint16_t> pendingRemoves;
+
+	uint32_t promotions = 0;
+	uint32_t repacks = 0;
+
+	static uint32_t getPaddedArea(const Entry& entry);
+
+	bool allocate(uint32_t page, uint16_t width, uint16_t height, uint16_t& x, uint16_t& y);
+	bool place(uint16_t id);
+	void upload(const Entry& entry);
+	void releaseArea(Entry& entry);
+	void repack(uint32_t page);
+
+public:
+	static bool isAtlasHandle(uint16_t handle);
+
+	void init();
+	void destroy();
+	bool isEnabled();
+
+	uint16_t add(const uint32_t* pixels, uint32_t width, uint32_t height);
+	void remove(uint16_t handle);
+
+	// Texture to bind for a handle, and whether vertex coordinates have to be remapped with getTransform
+	bgfx::TextureHandle resolve(uint16_t handle, bool& inAtlas);
+	void getTransform(uint16_t handle, float& scaleU, float& scaleV, float& offsetU, float& offsetV);
+	// Move a texture out of the atlas into its own texture, for draws which wrap coordinates
+	bgfx::TextureHandle promote(uint16_t handle);
+
+	// Call after the frame has been submitted
+	void frame();
+
+	uint32_t getTextureCount();
+	uint32_t getPromotionCount();
+	uint32_t getRepackCount();
+	std::vector<PageStats> getPageStats();
+};
+
+extern TextureAtlas textureAtlas;
+
+void texture_atlas_debug(bool* isOpen);
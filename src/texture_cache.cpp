@@ -0,0 +1,255 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <filesystem>
+
+#include <string.h>
+
+#include <xxhash.h>
+
+#include "texture_cache.h"
+#include "texture_encoder.h"
+#include "renderer.h"
+#include "cfg.h"
+#include "log.h"
+
+TextureCache textureCache;
+
+// PRIVATE
+
+std::string TextureCache::getKey(const std::string& source, bimg::TextureFormat::Enum format)
+{
+	std::error_code ec;
+	uintmax_t size = std::filesystem::file_size(source, ec);
+
+	if (ec) return "";
+
+	auto lastWriteTime = std::filesystem::last_write_time(source, ec);
+
+	if (ec) return "";
+
+	std::string id = FileIndex::normalize(source) + "|" + std::to_string(size) + "|" + std::to_string(lastWriteTime.time_since_epoch().count())
+		+ "|" + std::to_string(format) + "|" + std::to_string(TEXTURE_CACHE_VERSION);
+	char key[32];
+
+	sprintf(key, "%016llx.dds", XXH3_64bits(id.data(), id.size()));
+
+	return key;
+}
+
+// Dimensions from the IHDR chunk, which always comes first in a PNG file
+static bool get_png_size(const std::string& filename, uint32_t& width, uint32_t& height)
+{
+	uint8_t header[24];
+	FILE* file = fopen(filename.c_str(), "rb");
+
+	if (file == nullptr) return false;
+
+	bool ret = fread(header, 1, sizeof(header), file) == sizeof(header) && !memcmp(header, "\x89PNG\r\n\x1a\n", 8) && !memcmp(header + 12, "IHDR", 4);
+
+	fclose(file);
+
+	if (ret)
+	{
+		width = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+		height = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+	}
+
+	return ret;
+}
+
+bool TextureCache::transcode(const std::string& source, const std::string& destination, bimg::TextureFormat::Enum format)
+{
+	bx::DefaultAllocator allocator;
+	bimg::ImageContainer* img = newRenderer.loadLibPngImageContainer((char*)source.c_str());
+
+	if (img == nullptr) return false;
+
+	// Encoders only accept RGBA8 as input
+	if (img->m_format != bimg::TextureFormat::RGBA8)
+	{
+		bimg::ImageContainer* rgba = bimg::imageConvert(&allocator, bimg::TextureFormat::RGBA8, *img);
+
+		bimg::imageFree(img);
+
+		if (rgba == nullptr) return false;
+
+		img = rgba;
+	}
+
+	bimg::ImageContainer* output = texture_encode(&allocator, *img, format, running);
+
+	bimg::imageFree(img);
+
+	if (output == nullptr) return false;
+
+	bool ret = texture_write_dds(*output, destination);
+
+	if (!ret) ffnx_warning("TextureCache: could not write %s\n", destination.c_str());
+
+	bimg::imageFree(output);
+
+	return ret;
+}
+
+void TextureCache::work()
+{
+	while (true)
+	{
+		Job job;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			condition.wait(lock, [this] { return !running || !pending.empty(); });
+
+			if (!running) return;
+
+			job = pending.front();
+			pending.pop_front();
+		}
+
+		if (transcode(job.source, index.getRoot() + "/" + job.key, job.format))
+		{
+			index.add(job.key);
+			transcoded++;
+
+			if (trace_all || trace_loaders) ffnx_trace("TextureCache: transcoded %s to %s\n", job.source.c_str(), job.key.c_str());
+		}
+	}
+}
+
+// PUBLIC
+
+bimg::TextureFormat::Enum TextureCache::getFormat(uint16_t slot)
+{
+	// Normal maps only use X and Y, Z is rebuilt in the shader
+	if (slot == RendererTextureSlot::TEX_NML) return bimg::TextureFormat::BC5;
+
+	return bimg::TextureFormat::BC7;
+}
+
+void TextureCache::init(const std::string& path, uint32_t threads)
+{
+	std::error_code ec;
+
+	std::filesystem::create_directories(path, ec);
+
+	if (ec)
+	{
+		ffnx_error("TextureCache: could not create %s, texture cache disabled\n", path.c_str());
+
+		return;
+	}
+
+	index.setRoot(path);
+	running = true;
+
+	for (uint32_t idx = 0; idx < threads; idx++) workers.emplace_back(&TextureCache::work, this);
+
+	if (trace_all || trace_loaders) ffnx_trace("TextureCache: started %u workers caching to %s\n", threads, path.c_str());
+}
+
+void TextureCache::shutdown()
+{
+	if (!isEnabled()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		running = false;
+	}
+
+	condition.notify_all();
+
+	for (auto& worker : workers) worker.join();
+
+	workers.clear();
+	pending.clear();
+}
+
+bool TextureCache::isEnabled()
+{
+	return !workers.empty();
+}
+
+std::string TextureCache::resolve(const char* filename, uint16_t slot)
+{
+	if (!isEnabled()) return "";
+
+	bimg::TextureFormat::Enum format = getFormat(slot);
+	std::string key = getKey(filename, format);
+
+	if (key.empty()) return "";
+
+	if (index.exists(key))
+	{
+		hits++;
+
+		return index.getRoot() + "/" + key;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Only try once per session, textures which cannot be cached would be decoded again at every load
+		if (!queued.insert(key).second) return "";
+	}
+
+	uint32_t width = 0, height = 0;
+
+	// Block compressed formats need whole 4x4 blocks, rule out the textures which will never be cached without decoding them
+	if (!get_png_size(filename, width, height)) return "";
+
+	if (width % 4 || height % 4)
+	{
+		if (trace_all || trace_loaders) ffnx_trace("TextureCache: %s is %ux%u, not a multiple of 4, will not be cached\n", filename, width, height);
+
+		return "";
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		pending.push_back({ filename, key, format });
+	}
+
+	condition.notify_one();
+
+	return "";
+}
+
+uint32_t TextureCache::getPendingCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return pending.size();
+}
+
+uint32_t TextureCache::getHitCount()
+{
+	return hits;
+}
+
+uint32_t TextureCache::getTranscodedCount()
+{
+	return transcoded;
+}
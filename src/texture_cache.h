@@ -0,0 +1,94 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <bimg/bimg.h>
+
+#include "file_index.h"
+
+// Bump to invalidate every file written by a previous version of the encoder
+#define TEXTURE_CACHE_VERSION 1
+
+/*
+ * On-disk cache of PNG mod textures transcoded to block compressed DDS files.
+ *
+ * PNG files are decoded by the CPU and uploaded uncompressed, every time they are loaded.
+ * The first time a PNG texture is used it is loaded as usual, and queued to be transcoded in background:
+ * BC7 for color and PBR textures, BC5 for normal maps which only need their X and Y channels.
+ * Next loads of the same texture use the DDS file instead, which is smaller to read and to keep on the GPU.
+ *
+ * Cached files are named after a hash of the source path, its size and its last write time,
+ * so editing a PNG file makes the cache miss until the new version has been transcoded.
+ * Textures whose dimensions are not a multiple of the block size are never cached.
+ */
+class TextureCache
+{
+private:
+	struct Job
+	{
+		std::string source;
+		std::string key;
+		bimg::TextureFormat::Enum format;
+	};
+
+	FileIndex index;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::atomic<bool> running = false;
+
+	std::deque<Job> pending;
+	std::unordered_set<std::string> queued;
+
+	std::atomic<uint32_t> hits = 0;
+	std::atomic<uint32_t> transcoded = 0;
+
+	std::string getKey(const std::string& source, bimg::TextureFormat::Enum format);
+	bool transcode(const std::string& source, const std::string& destination, bimg::TextureFormat::Enum format);
+	void work();
+
+public:
+	static bimg::TextureFormat::Enum getFormat(uint16_t slot);
+
+	void init(const std::string& path, uint32_t threads);
+	void shutdown();
+
+	bool isEnabled();
+
+	// Path of the transcoded copy of a PNG texture, or an empty string after queueing its transcoding
+	std::string resolve(const char* filename, uint16_t slot);
+
+	uint32_t getPendingCount();
+	uint32_t getHitCount();
+	uint32_t getTranscodedCount();
+};
+
+extern TextureCache textureCache;
@@ -0,0 +1,94 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <algorithm>
+#include <filesystem>
+
+#include <bimg/encode.h>
+#include <bx/file.h>
+
+#include "texture_encoder.h"
+
+bimg::ImageContainer* texture_encode(bx::AllocatorI* allocator, const bimg::ImageContainer& rgba, bimg::TextureFormat::Enum format, const std::atomic<bool>& running)
+{
+	uint32_t width = rgba.m_width, height = rgba.m_height;
+
+	// Block compressed formats need whole 4x4 blocks, and encoders only accept RGBA8 as input
+	if (width % 4 || height % 4 || rgba.m_format != bimg::TextureFormat::RGBA8) return nullptr;
+
+	bimg::ImageContainer* output = bimg::imageAlloc(allocator, format, width, height, 1, 1, false, false);
+	const uint32_t blockSize = bimg::getBlockInfo(format).blockSize;
+	bx::Error err;
+
+	// Encode a few block rows at a time, so that shutting down the game does not wait for large textures
+	for (uint32_t y = 0; y < height && running; y += TEXTURE_ENCODER_STRIPE_ROWS * 4)
+	{
+		uint32_t rows = std::min<uint32_t>(TEXTURE_ENCODER_STRIPE_ROWS * 4, height - y);
+
+		bimg::imageEncodeFromRgba8(
+			allocator,
+			(uint8_t*)output->m_data + (y / 4) * (width / 4) * blockSize,
+			(const uint8_t*)rgba.m_data + y * width * 4,
+			width,
+			rows,
+			1,
+			format,
+			bimg::Quality::Default,
+			&err
+		);
+
+		if (!err.isOk()) break;
+	}
+
+	if (!running || !err.isOk())
+	{
+		bimg::imageFree(output);
+
+		return nullptr;
+	}
+
+	return output;
+}
+
+bool texture_write_dds(bimg::ImageContainer& image, const std::string& destination)
+{
+	std::string temporary = destination + ".tmp";
+	bx::FileWriter writer;
+	bx::Error err;
+	std::error_code ec;
+
+	if (bx::open(&writer, temporary.c_str(), false, &err))
+	{
+		bimg::imageWriteDds(&writer, image, image.m_data, image.m_size, &err);
+		bx::close(&writer);
+	}
+
+	if (err.isOk()) std::filesystem::rename(temporary, destination, ec);
+
+	if (!err.isOk() || ec)
+	{
+		std::filesystem::remove(temporary, ec);
+
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,41 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include <bimg/bimg.h>
+
+// Amount of block rows encoded at once, the encoder checks for a stop request in between
+#define TEXTURE_ENCODER_STRIPE_ROWS 16
+
+/*
+ * Block compression used by the texture cache, done entirely on the CPU.
+ */
+
+// Encode an RGBA8 image whose dimensions are multiples of 4 to a block compressed format.
+// Returns nullptr if the encoder failed, or if running was cleared before the last block row.
+bimg::ImageContainer* texture_encode(bx::AllocatorI* allocator, const bimg::ImageContainer& rgba, bimg::TextureFormat::Enum format, const std::atomic<bool>& running);
+
+// Write an image to a DDS file, through a temporary file so an interrupted write never leaves a truncated one behind
+bool texture_write_dds(bimg::ImageContainer& image, const std::string& destination);
@@ -0,0 +1,317 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <algorithm>
+#include <filesystem>
+
+#include "texture_streamer.h"
+#include "texture_cache.h"
+#include "renderer.h"
+#include "cfg.h"
+#include "log.h"
+#include "gl.h"
+#include "macro.h"
+
+TextureStreamer textureStreamer;
+
+// PRIVATE
+
+bool TextureStreamer::isSameJob(Job* job, struct texture_set* texture_set, uint32_t palette_index, uint16_t slot)
+{
+	return job->texture_set == texture_set && job->palette_index == palette_index && job->slot == slot;
+}
+
+uint32_t TextureStreamer::getPriority(Job* job)
+{
+	uint32_t ret = 0;
+
+	// Textures requested while in another field are only a prefetch at this point
+	if (job->field_id != currentFieldId) ret += 2;
+
+	// Additional textures can be applied later than the main one
+	if (job->slot != RendererTextureSlot::TEX_Y) ret += 1;
+
+	return ret;
+}
+
+TextureStreamer::Job* TextureStreamer::pickJob()
+{
+	auto it = std::min_element(pending.begin(), pending.end(), [this](Job* a, Job* b) {
+		uint32_t priorityA = getPriority(a), priorityB = getPriority(b);
+
+		return priorityA < priorityB || (priorityA == priorityB && a->sequence < b->sequence);
+	});
+
+	Job* job = *it;
+
+	pending.erase(it);
+	inProgress.push_back(job);
+
+	return job;
+}
+
+void TextureStreamer::releaseJob(Job* job)
+{
+	if (job->img != nullptr) bimg::imageFree(job->img);
+
+	inFlightBytes -= job->bytes;
+
+	delete job;
+}
+
+void TextureStreamer::work()
+{
+	while (true)
+	{
+		Job* job = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			// The budget is only checked before picking a job, a single one can still go over it
+			condition.wait(lock, [this] { return !running || (!pending.empty() && inFlightBytes < maxInFlightBytes); });
+
+			if (!running) return;
+
+			job = pickJob();
+		}
+
+		std::error_code ec;
+		size_t filesize = std::filesystem::file_size(job->filename, ec);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			job->bytes = ec ? 0 : filesize;
+			inFlightBytes += job->bytes;
+		}
+
+		bimg::ImageContainer* img = nullptr;
+
+		if (job->useLibPng)
+		{
+			std::string cached = textureCache.resolve(job->filename.c_str(), job->slot);
+
+			if (!cached.empty()) img = newRenderer.loadImageContainer(cached.data());
+
+			// Keep using the PNG file if the cached copy could not be loaded
+			if (img == nullptr) img = newRenderer.loadLibPngImageContainer(job->filename.data());
+		}
+		else
+			img = newRenderer.loadImageContainer(job->filename.data());
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			inProgress.erase(std::find(inProgress.begin(), inProgress.end(), job));
+
+			// Account for the decoded size from now on, until the texture is uploaded
+			inFlightBytes -= job->bytes;
+			job->img = img;
+			job->bytes = img != nullptr ? img->m_size : 0;
+			inFlightBytes += job->bytes;
+
+			if (job->cancelled) releaseJob(job);
+			else completed.push_back(job);
+		}
+
+		condition.notify_all();
+	}
+}
+
+// PUBLIC
+
+void TextureStreamer::init(uint32_t threads, size_t maxBytes)
+{
+	maxInFlightBytes = maxBytes;
+	running = true;
+
+	for (uint32_t idx = 0; idx < threads; idx++) workers.emplace_back(&TextureStreamer::work, this);
+
+	if (trace_all || trace_loaders) ffnx_trace("TextureStreamer: started %u workers with a budget of %zu bytes\n", threads, maxBytes);
+}
+
+void TextureStreamer::shutdown()
+{
+	if (!isEnabled()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		running = false;
+	}
+
+	condition.notify_all();
+
+	for (auto& worker : workers) worker.join();
+
+	workers.clear();
+
+	for (Job* job : pending) releaseJob(job);
+	for (Job* job : completed) releaseJob(job);
+
+	pending.clear();
+	completed.clear();
+}
+
+bool TextureStreamer::isEnabled()
+{
+	return !workers.empty();
+}
+
+bool TextureStreamer::request(struct texture_set* texture_set, uint32_t palette_index, uint16_t slot, char* filename, bool useLibPng, bool isSrgb)
+{
+	if (!isEnabled()) return false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Already on its way
+		for (Job* job : pending) if (isSameJob(job, texture_set, palette_index, slot)) return true;
+		for (Job* job : inProgress) if (isSameJob(job, texture_set, palette_index, slot) && !job->cancelled) return true;
+		for (Job* job : completed) if (isSameJob(job, texture_set, palette_index, slot)) return true;
+
+		Job* job = new Job();
+
+		job->texture_set = texture_set;
+		job->palette_index = palette_index;
+		job->slot = slot;
+		job->filename = filename;
+		job->useLibPng = useLibPng;
+		job->isSrgb = isSrgb;
+		job->field_id = currentFieldId;
+		job->sequence = sequence++;
+
+		pending.push_back(job);
+	}
+
+	condition.notify_one();
+
+	if (trace_all || trace_loaders) ffnx_trace("TextureStreamer: queued %s for palette %u slot %u\n", filename, palette_index, slot);
+
+	return true;
+}
+
+void TextureStreamer::cancel(struct texture_set* texture_set)
+{
+	if (!isEnabled()) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto cancelled = [this, texture_set](Job* job) {
+		if (job->texture_set != texture_set) return false;
+
+		releaseJob(job);
+
+		return true;
+	};
+
+	pending.erase(std::remove_if(pending.begin(), pending.end(), cancelled), pending.end());
+	completed.erase(std::remove_if(completed.begin(), completed.end(), cancelled), completed.end());
+
+	// Workers will drop these as soon as they are done decoding
+	for (Job* job : inProgress) if (job->texture_set == texture_set) job->cancelled = true;
+}
+
+void TextureStreamer::update()
+{
+	if (!isEnabled()) return;
+
+	std::vector<Job*> ready;
+
+	currentFieldId = *common_externals.current_field_id;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		ready.swap(completed);
+	}
+
+	for (Job* job : ready)
+	{
+		VOBJ(texture_set, texture_set, job->texture_set);
+		struct gl_texture_set* gl_set = VREF(texture_set, ogl.gl_set);
+
+		// Animated textures are loaded synchronously, if the texture became animated in the meantime its handles are not ours anymore
+		if (job->img == nullptr || gl_set == nullptr || gl_set->is_animated || !VREF(texture_set, texturehandle) || job->palette_index >= gl_set->textures) continue;
+
+		uint32_t width = 0, height = 0;
+		bgfx::TextureHandle handle = newRenderer.createTextureHandle(job->img, job->filename.data(), &width, &height, nullptr, job->isSrgb);
+
+		// bgfx owns the image now
+		job->img = nullptr;
+
+		if (!bgfx::isValid(handle)) continue;
+
+		if (job->slot == RendererTextureSlot::TEX_Y)
+		{
+			// Replace the placeholder directly, gl_replace_texture would not expect an external texture to be replaced
+			newRenderer.deleteTexture(VREF(texture_set, texturehandle[job->palette_index]));
+			VRASS(texture_set, texturehandle[job->palette_index], handle.idx);
+			gl_set->streamed_palettes.insert(job->palette_index);
+
+			VRASS(texture_set, ogl.width, width);
+			VRASS(texture_set, ogl.height, height);
+
+			if (!VREF(texture_set, ogl.external)) stats.external_textures++;
+			VRASS(texture_set, ogl.external, true);
+		}
+		else
+		{
+			if (gl_set->additional_textures.count(job->slot)) newRenderer.deleteTexture(gl_set->additional_textures[job->slot]);
+			gl_set->additional_textures[job->slot] = handle.idx;
+		}
+
+		streamed++;
+
+		if (trace_all || trace_loaders) ffnx_trace("TextureStreamer: created external texture %u from %s\n", handle.idx, job->filename.c_str());
+	}
+
+	if (!ready.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (Job* job : ready) releaseJob(job);
+		}
+
+		condition.notify_all();
+	}
+}
+
+uint32_t TextureStreamer::getPendingCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return pending.size() + inProgress.size() + completed.size();
+}
+
+uint32_t TextureStreamer::getStreamedCount()
+{
+	return streamed;
+}
+
+size_t TextureStreamer::getInFlightBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return inFlightBytes;
+}
@@ -0,0 +1,102 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bimg/bimg.h>
+
+// Returned by load_texture when the external texture has been queued instead of loaded
+#define TEXTURE_STREAMER_QUEUED 0xFFFFFFFF
+
+/*
+ * Loads external textures on background threads.
+ *
+ * The game keeps using the texture converted from its own data as a placeholder,
+ * until the external file has been read and decoded by a worker. The result is then
+ * uploaded on the rendering thread in update(), and swapped into the texture set.
+ *
+ * Jobs requested for the field currently being played are served first, then main textures
+ * before additional ones ( normal maps, PBR, etc. ), then in request order.
+ * Workers stop picking up new jobs while the memory used by jobs not yet uploaded exceeds the configured budget.
+ */
+class TextureStreamer
+{
+private:
+	struct Job
+	{
+		struct texture_set* texture_set = nullptr;
+		uint32_t palette_index = 0;
+		uint16_t slot = 0;
+		std::string filename;
+		bool useLibPng = false;
+		bool isSrgb = true;
+		uint32_t field_id = 0;
+		uint64_t sequence = 0;
+		size_t bytes = 0;
+		bool cancelled = false;
+		bimg::ImageContainer* img = nullptr;
+	};
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool running = false;
+
+	std::vector<Job*> pending;
+	std::vector<Job*> inProgress;
+	std::vector<Job*> completed;
+
+	size_t maxInFlightBytes = 0;
+	size_t inFlightBytes = 0;
+	uint64_t sequence = 0;
+	std::atomic<uint32_t> currentFieldId = 0;
+
+	uint32_t streamed = 0;
+
+	bool isSameJob(Job* job, struct texture_set* texture_set, uint32_t palette_index, uint16_t slot);
+	uint32_t getPriority(Job* job);
+	Job* pickJob();
+	void releaseJob(Job* job);
+	void work();
+
+public:
+	void init(uint32_t threads, size_t maxBytes);
+	void shutdown();
+
+	bool isEnabled();
+
+	bool request(struct texture_set* texture_set, uint32_t palette_index, uint16_t slot, char* filename, bool useLibPng, bool isSrgb);
+	void cancel(struct texture_set* texture_set);
+	void update();
+
+	uint32_t getPendingCount();
+	uint32_t getStreamedCount();
+	size_t getInFlightBytes();
+};
+
+extern TextureStreamer textureStreamer;
@@ -0,0 +1,238 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+
+// decoded frames waiting to be uploaded
+#define DECODE_RING_SIZE 8
+
+class MovieFrameRing;
+
+// storage of a decoded frame, referenced by its ring slot and by every texture upload still pending on the GPU.
+// the last reference frees it, which may happen on the rendering thread after the movie has been released
+struct frame_buffer
+{
+	std::atomic<uint32_t> refs = 1;
+	uint8_t *data = nullptr;
+	std::atomic<MovieFrameRing *> ring = nullptr;
+
+	~frame_buffer() { delete[] data; }
+};
+
+struct decoded_frame
+{
+	struct frame_buffer *buffer = nullptr;
+	uint8_t *planes[3] = { 0 };
+	int strides[3] = { 0 };
+};
+
+/*
+ * Frames decoded by the movie decoder thread, in a single producer single consumer ring.
+ *
+ * Buffers are allocated once per movie and reused for every frame. A consumed frame goes back to the decoder
+ * only once every upload referencing it is done, see retire() and release_callback().
+ */
+class MovieFrameRing
+{
+private:
+	struct decoded_frame frames[DECODE_RING_SIZE];
+	uint32_t frameSize = 0;
+	std::atomic<uint32_t> read = 0;
+	std::atomic<uint32_t> write = 0;
+	// consumed frames whose uploads are done, their slots can be written again by the decoder
+	uint32_t retired = 0;
+	std::mutex mutex;
+	std::optional<std::counting_semaphore<>> freeSlots;
+	std::optional<std::counting_semaphore<>> filledSlots;
+	std::atomic<bool> stopping = false;
+
+public:
+	// allocate the buffers of a movie, planes are laid out one after another
+	void alloc(const int strides[3], const uint32_t heights[3])
+	{
+		uint32_t plane_sizes[3];
+
+		for(uint32_t i = 0; i < 3; i++) plane_sizes[i] = strides[i] * heights[i];
+
+		frameSize = plane_sizes[0] + plane_sizes[1] + plane_sizes[2];
+
+		for(uint32_t i = 0; i < DECODE_RING_SIZE; i++)
+		{
+			struct decoded_frame *frame = &frames[i];
+
+			frame->buffer = new frame_buffer();
+			frame->buffer->data = new uint8_t[frameSize];
+			frame->buffer->ring = this;
+
+			frame->planes[0] = frame->buffer->data;
+			frame->planes[1] = frame->planes[0] + plane_sizes[0];
+			frame->planes[2] = frame->planes[1] + plane_sizes[1];
+
+			memcpy(frame->strides, strides, sizeof(frame->strides));
+		}
+	}
+
+	// drop the ring references, buffers still referenced by pending uploads are freed by the last release callback
+	void release()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for(uint32_t i = 0; i < DECODE_RING_SIZE; i++)
+		{
+			struct frame_buffer *buffer = frames[i].buffer;
+
+			if(buffer)
+			{
+				buffer->ring = nullptr;
+
+				if(buffer->refs.fetch_sub(1) == 1) delete buffer;
+			}
+
+			frames[i] = decoded_frame();
+		}
+
+		frameSize = 0;
+		read = 0;
+		write = 0;
+		retired = 0;
+	}
+
+	// called before the decoder thread starts
+	void start()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// slots consumed but still referenced by pending uploads are not free yet, they will be retired later
+		freeSlots.emplace(DECODE_RING_SIZE - (write - retired));
+		filledSlots.emplace(0);
+		stopping = false;
+	}
+
+	// wake up the decoder if it is waiting for room in the ring, beginWrite returns nullptr from now on
+	void stop()
+	{
+		stopping = true;
+
+		if(freeSlots) freeSlots->release();
+	}
+
+	// once the decoder thread is joined, frames decoded ahead will never be shown
+	void discard()
+	{
+		read = write.load();
+		retire();
+	}
+
+	// decoder side: wait for a free slot
+	struct decoded_frame *beginWrite()
+	{
+		freeSlots->acquire();
+
+		if(stopping) return nullptr;
+
+		return &frames[write % DECODE_RING_SIZE];
+	}
+
+	void endWrite()
+	{
+		write++;
+		filledSlots->release();
+	}
+
+	// decoder side: no more frames, wakes up the consumer which will notice the ring is empty
+	void finish()
+	{
+		filledSlots->release();
+	}
+
+	// consumer side: wait for the next frame, nullptr once the decoder finished and everything was consumed
+	struct decoded_frame *peek()
+	{
+		filledSlots->acquire();
+
+		if(read.load() == write.load())
+		{
+			// nothing left, keep the end signaled for the next calls
+			filledSlots->release();
+
+			return nullptr;
+		}
+
+		return &frames[read % DECODE_RING_SIZE];
+	}
+
+	// consumer side: done with the frame returned by peek, uploads hold their own references on it
+	void pop()
+	{
+		read++;
+		retire();
+	}
+
+	// give the oldest consumed frames back to the decoder once no pending upload references them anymore.
+	// slots are retired in order, since the decoder always writes into the oldest one
+	void retire()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		while(retired != read)
+		{
+			struct frame_buffer *buffer = frames[retired % DECODE_RING_SIZE].buffer;
+
+			if(buffer && buffer->refs > 1) break;
+
+			retired++;
+			freeSlots->release();
+		}
+	}
+
+	// slot used by the decoder when frames are not going through the ring
+	struct decoded_frame *scratch()
+	{
+		return &frames[0];
+	}
+
+	uint32_t getFrameSize()
+	{
+		return frameSize;
+	}
+
+	uint32_t getReadIndex()
+	{
+		return read;
+	}
+
+	// release callback of the frame references given to the renderer
+	static void release_callback(void *, void *userData)
+	{
+		struct frame_buffer *buffer = (struct frame_buffer *)userData;
+		MovieFrameRing *ring = buffer->ring;
+
+		if(buffer->refs.fetch_sub(1) == 1) delete buffer;
+		else if(ring) ring->retire();
+	}
+};
@@ -19,9 +19,19 @@
 //    GNU General Public License for more details.                          //
 /****************************************************************************/
 
+#include <atomic>
+#include <thread>
+
 #include "../renderer.h"
+#include "../frame_limiter.h"
+#include "../profiler.h"
 
 #include "movies.h"
+#include "movie_frame_ring.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
 
 // 10 frames
 #define VIDEO_BUFFER_SIZE 10
@@ -45,6 +55,7 @@ int texture_units = 1;
 
 uint32_t yuv_init_done = false;
 uint32_t yuv_fast_path = false;
+uint32_t yuv16_supported = false;
 
 uint32_t audio_must_be_converted = false;
 
@@ -61,6 +72,10 @@ int videostream;
 int audiostream;
 
 uint32_t use_bgra_texture;
+// NV12 and P010 carry U and V in a single plane
+uint32_t yuv_interleaved_uv;
+// 2 for P010, which stores 10-bit samples in the high bits of 16-bit words
+uint32_t yuv_bytes_per_sample;
 
 struct video_frame
 {
@@ -72,6 +87,16 @@ struct video_frame video_buffer[VIDEO_BUFFER_SIZE];
 uint32_t vbuffer_read = 0;
 uint32_t vbuffer_write = 0;
 
+MovieFrameRing decode_ring;
+
+std::thread decoder_thread;
+std::atomic<bool> decoder_stop = false;
+std::atomic<bool> decoder_done = false;
+std::atomic<uint32_t> decoder_frames = 0;
+
+// when set, decoded frames are written to this file instead of the ring
+FILE *decoder_sink = nullptr;
+
 uint32_t movie_frame_counter = 0;
 uint32_t movie_frames;
 uint32_t movie_width, movie_height;
@@ -86,11 +111,219 @@ uint32_t first_audio_packet;
 time_t timer_freq;
 time_t start_time;
 
+FrameLimiter movieFrameLimiter;
+
+// allocate the decoded frame buffers once, in the layout expected by the upload functions
+void ffmpeg_alloc_decode_ring()
+{
+	int strides[3] = { 0 };
+	uint32_t heights[3] = { movie_height, movie_height / 2, movie_height / 2 };
+
+	if(use_bgra_texture)
+	{
+		strides[0] = movie_width * 4;
+	}
+	else
+	{
+		strides[0] = movie_width * yuv_bytes_per_sample;
+
+		if(yuv_interleaved_uv) strides[1] = (movie_width / 2) * 2 * yuv_bytes_per_sample;
+		else
+		{
+			strides[1] = (movie_width / 2) * yuv_bytes_per_sample;
+			strides[2] = strides[1];
+		}
+	}
+
+	decode_ring.alloc(strides, heights);
+}
+
+// copy or convert the last decoded video frame into a ring buffer
+void ffmpeg_convert_video_frame(struct decoded_frame *frame)
+{
+	PROFILE_ZONE("ffmpeg_convert_video_frame");
+
+	if(sws_ctx) sws_scale(sws_ctx, movie_frame->extended_data, movie_frame->linesize, 0, movie_height, frame->planes, frame->strides);
+	else if(use_bgra_texture) av_image_copy_plane(frame->planes[0], frame->strides[0], movie_frame->extended_data[0], movie_frame->linesize[0], movie_width * 4, movie_height);
+	else
+	{
+		av_image_copy_plane(frame->planes[0], frame->strides[0], movie_frame->extended_data[0], movie_frame->linesize[0], frame->strides[0], movie_height);
+		av_image_copy_plane(frame->planes[1], frame->strides[1], movie_frame->extended_data[1], movie_frame->linesize[1], frame->strides[1], movie_height / 2);
+		if(!yuv_interleaved_uv) av_image_copy_plane(frame->planes[2], frame->strides[2], movie_frame->extended_data[2], movie_frame->linesize[2], frame->strides[2], movie_height / 2);
+	}
+}
+
+void ffmpeg_buffer_audio_packet(AVPacket &packet)
+{
+	PROFILE_ZONE("ffmpeg_buffer_audio_packet");
+
+	int ret;
+	time_t now;
+	DWORD DSStatus;
+	uint8_t *buffer;
+	int buffer_size = 0;
+	int used_bytes;
+	DWORD playcursor;
+	DWORD writecursor;
+	uint32_t bytesperpacket = audio_must_be_converted ? av_get_bytes_per_sample(AV_SAMPLE_FMT_S16) : av_get_bytes_per_sample(acodec_ctx->sample_fmt);
+	uint32_t bytespersec = bytesperpacket * acodec_ctx->channels * acodec_ctx->sample_rate;
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
+
+	if(movie_sync_debug)
+	{
+		IDirectSoundBuffer_GetCurrentPosition(ffmpeg_sound_buffer, &playcursor, &writecursor);
+		ffnx_info("update_movie_sample(audio): DTS %f PTS %f (timebase %f) placed in sound buffer at real time %f (play %f write %f)\n", (double)packet.dts, (double)packet.pts, av_q2d(acodec_ctx->time_base), (double)(now - start_time) / (double)timer_freq, (double)playcursor / (double)bytespersec, (double)ffmpeg_sound_write_pointer / (double)bytespersec);
+	}
+
+	ret = avcodec_send_packet(acodec_ctx, &packet);
+
+	if (ret < 0)
+	{
+		ffnx_trace("%s: avcodec_send_packet -> %d\n", __func__, ret);
+		return;
+	}
+
+	ret = avcodec_receive_frame(acodec_ctx, movie_frame);
+
+	if (ret == AVERROR_EOF)
+	{
+		ffnx_trace("%s: avcodec_receive_frame -> %d\n", __func__, ret);
+		return;
+	}
+
+	if (ret >= 0)
+	{
+		int _size = bytesperpacket * movie_frame->nb_samples * acodec_ctx->channels;
+
+		// Sometimes the captured frame may have no sound samples. Just skip and move forward
+		if (_size)
+		{
+			LPVOID ptr1;
+			LPVOID ptr2;
+			DWORD bytes1;
+			DWORD bytes2;
+
+			av_samples_alloc(&buffer, movie_frame->linesize, acodec_ctx->channels, movie_frame->nb_samples, (audio_must_be_converted ? AV_SAMPLE_FMT_S16 : acodec_ctx->sample_fmt), 0);
+			if (audio_must_be_converted) swr_convert(swr_ctx, &buffer, movie_frame->nb_samples, (const uint8_t**)movie_frame->extended_data, movie_frame->nb_samples);
+			else av_samples_copy(&buffer, movie_frame->extended_data, 0, 0, movie_frame->nb_samples, acodec_ctx->channels, acodec_ctx->sample_fmt);
+
+			if (ffmpeg_sound_buffer) {
+				if (IDirectSoundBuffer_GetStatus(ffmpeg_sound_buffer, &DSStatus) == DS_OK) {
+					if (DSStatus != DSBSTATUS_BUFFERLOST) {
+						if (IDirectSoundBuffer_Lock(ffmpeg_sound_buffer, ffmpeg_sound_write_pointer, _size, &ptr1, &bytes1, &ptr2, &bytes2, 0)) ffnx_error("update_movie_sample: couldn't lock sound buffer\n");
+						memcpy(ptr1, buffer, bytes1);
+						memcpy(ptr2, &buffer[bytes1], bytes2);
+						if (IDirectSoundBuffer_Unlock(ffmpeg_sound_buffer, ptr1, bytes1, ptr2, bytes2)) ffnx_error("update_movie_sample: couldn't unlock sound buffer\n");
+					}
+				}
+
+				ffmpeg_sound_write_pointer = (ffmpeg_sound_write_pointer + bytes1 + bytes2) % ffmpeg_sound_buffer_size;
+				av_freep(&buffer);
+			}
+		}
+	}
+}
+
+// decoder thread, demuxes the movie, writes audio to the sound buffer and fills the decoded frame ring
+void ffmpeg_decode_movie()
+{
+	AVPacket packet;
+	int ret;
+
+	profiler.setThreadName("Movie decoder");
+
+	while(!decoder_stop && av_read_frame(format_ctx, &packet) >= 0)
+	{
+		if(packet.stream_index == videostream)
+		{
+			{
+				PROFILE_ZONE("ffmpeg_decode_video_packet");
+
+				ret = avcodec_send_packet(codec_ctx, &packet);
+			}
+
+			if (ret < 0) ffnx_trace("%s: avcodec_send_packet -> %d\n", __func__, ret);
+
+			while (ret >= 0 && !decoder_stop)
+			{
+				ret = avcodec_receive_frame(codec_ctx, movie_frame);
+
+				if (ret == AVERROR_EOF) ffnx_trace("%s: avcodec_receive_frame -> %d\n", __func__, ret);
+
+				if (ret < 0) break;
+
+				if(decoder_sink)
+				{
+					ffmpeg_convert_video_frame(decode_ring.scratch());
+					fwrite(decode_ring.scratch()->buffer->data, decode_ring.getFrameSize(), 1, decoder_sink);
+				}
+				else
+				{
+					// wait for the main thread to consume a frame if the ring is full
+					struct decoded_frame *frame = decode_ring.beginWrite();
+
+					if (!frame) break;
+
+					ffmpeg_convert_video_frame(frame);
+
+					decode_ring.endWrite();
+				}
+
+				decoder_frames++;
+			}
+		}
+
+		if(packet.stream_index == audiostream) ffmpeg_buffer_audio_packet(packet);
+
+		av_packet_unref(&packet);
+	}
+
+	decoder_done = true;
+
+	decode_ring.finish();
+}
+
+void ffmpeg_stop_decoder()
+{
+	if(!decoder_thread.joinable()) return;
+
+	decoder_stop = true;
+	decode_ring.stop();
+
+	decoder_thread.join();
+
+	decode_ring.discard();
+}
+
+void ffmpeg_start_decoder()
+{
+	// never replace a running decoder, assigning to a joinable std::thread terminates the process
+	if(decoder_thread.joinable()) ffmpeg_stop_decoder();
+
+	decode_ring.start();
+
+	decoder_stop = false;
+	decoder_done = false;
+	decoder_frames = 0;
+
+	decoder_thread = std::thread(ffmpeg_decode_movie);
+}
+
+// sleep until the next frame is due
+void ffmpeg_wait_next_frame()
+{
+	movieFrameLimiter.waitUntil(start_time + time_t((timer_freq / movie_fps) * movie_frame_counter));
+}
+
 void ffmpeg_movie_init()
 {
 	ffnx_info("FFMpeg movie player plugin loaded\n");
 
-	texture_units = newRenderer.getCaps()->limits.maxTextureSamplers;
+	const bgfx::Caps *caps = newRenderer.getCaps();
+
+	texture_units = caps->limits.maxTextureSamplers;
+	yuv16_supported = (caps->formats[bgfx::TextureFormat::R16] & BGFX_CAPS_FORMAT_TEXTURE_2D) && (caps->formats[bgfx::TextureFormat::RG16] & BGFX_CAPS_FORMAT_TEXTURE_2D);
 
 	if(texture_units < 3) ffnx_info("No multitexturing, codecs with YUV output will be slow. (texture units: %i)\n", texture_units);
 	else yuv_fast_path = true;
@@ -103,6 +336,10 @@ void ffmpeg_release_movie_objects()
 {
 	uint32_t i;
 
+	ffmpeg_stop_decoder();
+
+	decode_ring.release();
+
 	if (movie_frame) av_frame_free(&movie_frame);
 	if (codec_ctx) avcodec_close(codec_ctx);
 	if (acodec_ctx) avcodec_close(acodec_ctx);
@@ -121,8 +358,20 @@ void ffmpeg_release_movie_objects()
 	audio_must_be_converted = false;
 
 	if(skipped_frames > 0) ffnx_info("release_movie_objects: skipped %i frames\n", skipped_frames);
+
+	if(trace_movies && movieFrameLimiter.getFrameCount() > 0)
+	{
+		const uint32_t *histogram = movieFrameLimiter.getHistogram();
+
+		ffnx_trace("release_movie_objects: %u frames paced, %.0f%% of the wait asleep, late by <0.1/0.25/0.5/1/2/4/4+ ms: %u %u %u %u %u %u %u\n", movieFrameLimiter.getFrameCount(), movieFrameLimiter.getSleepRatio() * 100.0, histogram[0], histogram[1], histogram[2], histogram[3], histogram[4], histogram[5], histogram[6]);
+	}
+
+	movieFrameLimiter.resetStats();
 	skipped_frames = 0;
 
+	// movies dumped to a file never get textures, and may be decoded without any renderer
+	if(decoder_sink) return;
+
 	for(i = 0; i < VIDEO_BUFFER_SIZE; i++)
 	{
 		// Cleanup BGRA textures
@@ -150,6 +399,13 @@ uint32_t ffmpeg_prepare_movie(char *name, bool with_audio)
 	DSBUFFERDESC1 sbdesc;
 	uint32_t ret;
 
+	// the previous movie was never released ( FF8 Steam sometimes forgets to ), its decoder and ring must go first
+	if(format_ctx || decoder_thread.joinable())
+	{
+		ffmpeg_stop_decoder();
+		ffmpeg_release_movie_objects();
+	}
+
 	if(ret = avformat_open_input(&format_ctx, name, NULL, NULL))
 	{
 		ffnx_error("prepare_movie: couldn't open movie file: %s\n", name);
@@ -231,7 +487,7 @@ uint32_t ffmpeg_prepare_movie(char *name, bool with_audio)
 		else ffnx_info("prepare_movie: %s; %s/%s %ix%i, duration: %f, color_range: %d\n", name, codec->name, acodec_ctx ? acodec->name : "null", movie_width, movie_height, movie_duration, codec_ctx->color_range);
 	}
 
-	if(movie_width > max_texture_size || movie_height > max_texture_size)
+	if(!decoder_sink && (movie_width > max_texture_size || movie_height > max_texture_size))
 	{
 		ffnx_error("prepare_movie: movie dimensions exceed max texture size, skipping\n");
 		ffmpeg_release_movie_objects();
@@ -242,19 +498,47 @@ uint32_t ffmpeg_prepare_movie(char *name, bool with_audio)
 
 	if(sws_ctx) sws_freeContext(sws_ctx);
 
-	if(codec_ctx->pix_fmt == AV_PIX_FMT_YUV420P && yuv_fast_path) use_bgra_texture = false;
-	else use_bgra_texture = true;
+	use_bgra_texture = true;
+	yuv_interleaved_uv = false;
+	yuv_bytes_per_sample = 1;
+
+	// dumps keep the planar layout of the codec whatever the GPU supports, they must not depend on the renderer
+	if(yuv_fast_path || decoder_sink)
+	{
+		switch(codec_ctx->pix_fmt)
+		{
+		case AV_PIX_FMT_YUV420P:
+			use_bgra_texture = false;
+			break;
+		case AV_PIX_FMT_NV12:
+			use_bgra_texture = false;
+			yuv_interleaved_uv = true;
+			break;
+		case AV_PIX_FMT_P010LE:
+			if(yuv16_supported || decoder_sink)
+			{
+				use_bgra_texture = false;
+				yuv_interleaved_uv = true;
+				yuv_bytes_per_sample = 2;
+			}
+			break;
+		default:
+			break;
+		}
+	}
 
 	vbuffer_read = 0;
 	vbuffer_write = 0;
 
-	if(codec_ctx->pix_fmt != AV_PIX_FMT_BGRA && (codec_ctx->pix_fmt != AV_PIX_FMT_YUV420P || !yuv_fast_path))
+	if(codec_ctx->pix_fmt != AV_PIX_FMT_BGRA && use_bgra_texture)
 	{
 		sws_ctx = sws_getContext(movie_width, movie_height, codec_ctx->pix_fmt, movie_width, movie_height, AV_PIX_FMT_BGRA, SWS_FAST_BILINEAR | SWS_ACCURATE_RND, NULL, NULL, NULL);
 		if (trace_movies) ffnx_info("prepare_movie: slow output format from video codec %s; %i\n", codec->name, codec_ctx->pix_fmt);
 	}
 	else sws_ctx = 0;
 
+	ffmpeg_alloc_decode_ring();
+
 	if(audiostream != -1)
 	{
 		if (acodec_ctx->sample_fmt != AV_SAMPLE_FMT_U8 && acodec_ctx->sample_fmt != AV_SAMPLE_FMT_S16) {
@@ -324,6 +608,11 @@ exit:
 	movie_frame_counter = 0;
 	skipped_frames = 0;
 
+	if(format_ctx)
+	{
+		ffmpeg_start_decoder();
+	}
+
 	return movie_frames;
 }
 
@@ -333,24 +622,22 @@ void ffmpeg_stop_movie()
 	if(ffmpeg_sound_buffer && *common_externals.directsound) IDirectSoundBuffer_Stop(ffmpeg_sound_buffer);
 }
 
-void buffer_bgra_frame(uint8_t *data, int upload_stride)
+// upload a plane straight from the decoded frame, which stays referenced until the GPU copy is done
+void upload_movie_plane(uint32_t texture, struct decoded_frame *frame, uint32_t num, uint32_t width, uint32_t height, RendererTextureType type)
 {
-	uint32_t upload_width = upload_stride;
-	uint32_t tex_width = movie_width;
-	uint32_t tex_height = movie_height;
+	frame->buffer->refs++;
 
-	if(upload_stride < 0) return;
+	newRenderer.updateTexture(texture, frame->planes[num], width, height, frame->strides[num], type, MovieFrameRing::release_callback, frame->buffer);
+}
+
+void buffer_bgra_frame(struct decoded_frame *frame)
+{
+	struct video_frame *slot = &video_buffer[vbuffer_write];
 
-	if (video_buffer[vbuffer_write].bgra_texture)
-		newRenderer.deleteTexture(video_buffer[vbuffer_write].bgra_texture);
+	// textures are created on first use and kept until the movie is released
+	if(!slot->bgra_texture) slot->bgra_texture = newRenderer.createDynamicTexture(movie_width, movie_height, RendererTextureType::BGRA);
 
-	video_buffer[vbuffer_write].bgra_texture = newRenderer.createTexture(
-		data,
-		tex_width,
-		tex_height,
-		upload_width,
-		RendererTextureType::BGRA
-	);
+	upload_movie_plane(slot->bgra_texture, frame, 0, movie_width, movie_height, RendererTextureType::BGRA);
 
 	vbuffer_write = (vbuffer_write + 1) % VIDEO_BUFFER_SIZE;
 }
@@ -363,46 +650,53 @@ void draw_bgra_frame(uint32_t buffer_index)
 	newRenderer.isMovie(false);
 }
 
-void upload_yuv_texture(uint8_t **planes, int *strides, uint32_t num, uint32_t buffer_index)
+void buffer_yuv_frame(struct decoded_frame *frame)
 {
-	uint32_t upload_width = strides[num];
-	uint32_t tex_width = num == 0 ? movie_width : movie_width / 2;
-	uint32_t tex_height = num == 0 ? movie_height : movie_height / 2;
-
-	if (upload_width > tex_width) tex_width = upload_width;
-
-	if (video_buffer[buffer_index].yuv_textures[num])
-		newRenderer.deleteTexture(video_buffer[buffer_index].yuv_textures[num]);
-
-	video_buffer[buffer_index].yuv_textures[num] = newRenderer.createTexture(
-		planes[num],
-		tex_width,
-		tex_height,
-		upload_width,
-		RendererTextureType::YUV,
-		false
-	);
-}
+	struct video_frame *slot = &video_buffer[vbuffer_write];
+	RendererTextureType y_type = yuv_bytes_per_sample > 1 ? RendererTextureType::YUV16 : RendererTextureType::YUV;
+	RendererTextureType uv_type = yuv_bytes_per_sample > 1 ? RendererTextureType::YUV16_UV : RendererTextureType::YUV_UV;
 
-void buffer_yuv_frame(uint8_t **planes, int *strides)
-{
-	upload_yuv_texture(planes, strides, 0, vbuffer_write); // Y
-	upload_yuv_texture(planes, strides, 1, vbuffer_write); // U
-	upload_yuv_texture(planes, strides, 2, vbuffer_write); // V
+	// textures are created on first use and kept until the movie is released
+	if(!slot->yuv_textures[0])
+	{
+		slot->yuv_textures[0] = newRenderer.createDynamicTexture(movie_width, movie_height, y_type, false);
+
+		if(yuv_interleaved_uv) slot->yuv_textures[1] = newRenderer.createDynamicTexture(movie_width / 2, movie_height / 2, uv_type, false);
+		else
+		{
+			slot->yuv_textures[1] = newRenderer.createDynamicTexture(movie_width / 2, movie_height / 2, RendererTextureType::YUV, false);
+			slot->yuv_textures[2] = newRenderer.createDynamicTexture(movie_width / 2, movie_height / 2, RendererTextureType::YUV, false);
+		}
+	}
+
+	upload_movie_plane(slot->yuv_textures[0], frame, 0, movie_width, movie_height, y_type); // Y
+
+	if(yuv_interleaved_uv) upload_movie_plane(slot->yuv_textures[1], frame, 1, movie_width / 2, movie_height / 2, uv_type); // UV
+	else
+	{
+		upload_movie_plane(slot->yuv_textures[1], frame, 1, movie_width / 2, movie_height / 2, RendererTextureType::YUV); // U
+		upload_movie_plane(slot->yuv_textures[2], frame, 2, movie_width / 2, movie_height / 2, RendererTextureType::YUV); // V
+	}
 
 	vbuffer_write = (vbuffer_write + 1) % VIDEO_BUFFER_SIZE;
 }
 
 void draw_yuv_frame(uint32_t buffer_index, bool full_range)
 {
-	for (uint32_t idx = 0; idx < 3; idx++)
-		newRenderer.useTexture(video_buffer[buffer_index].yuv_textures[idx], idx);
+	struct video_frame *slot = &video_buffer[buffer_index];
+
+	newRenderer.useTexture(slot->yuv_textures[0], RendererTextureSlot::TEX_Y);
+	newRenderer.useTexture(slot->yuv_textures[1], RendererTextureSlot::TEX_U);
+	// interleaved chroma is only sampled from the U slot, keep V bound to something valid
+	newRenderer.useTexture(yuv_interleaved_uv ? slot->yuv_textures[1] : slot->yuv_textures[2], RendererTextureSlot::TEX_V);
 
 	newRenderer.isMovie(true);
 	newRenderer.isYUV(true);
+	newRenderer.isInterleavedUV(yuv_interleaved_uv);
 	newRenderer.isFullRange(full_range);
 	gl_draw_movie_quad(movie_width, movie_height);
 	newRenderer.isFullRange(false);
+	newRenderer.isInterleavedUV(false);
 	newRenderer.isYUV(false);
 	newRenderer.isMovie(false);
 }
@@ -410,8 +704,8 @@ void draw_yuv_frame(uint32_t buffer_index, bool full_range)
 // display the next frame
 uint32_t ffmpeg_update_movie_sample(bool use_movie_fps)
 {
-	AVPacket packet;
-	int ret;
+	PROFILE_ZONE("ffmpeg_update_movie_sample");
+
 	time_t now;
 	DWORD DSStatus;
 
@@ -421,155 +715,44 @@ uint32_t ffmpeg_update_movie_sample(bool use_movie_fps)
 	// keep track of when we started playing this movie
 	if(movie_frame_counter == 0) QueryPerformanceCounter((LARGE_INTEGER *)&start_time);
 
-	while((ret = av_read_frame(format_ctx, &packet)) >= 0)
-	{
-		if(packet.stream_index == videostream)
-		{
-			ret = avcodec_send_packet(codec_ctx, &packet);
-
-			if (ret < 0)
-			{
-				ffnx_trace("%s: avcodec_send_packet -> %d\n", __func__, ret);
-				av_packet_unref(&packet);
-				break;
-			}
-
-			ret = avcodec_receive_frame(codec_ctx, movie_frame);
-
-			if (ret == AVERROR_EOF)
-			{
-				ffnx_trace("%s: avcodec_receive_frame -> %d\n", __func__, ret);
-				av_packet_unref(&packet);
-				break;
-			}
-
-			if (ret >= 0)
-			{
-				QueryPerformanceCounter((LARGE_INTEGER *)&now);
-
-				// check if we are falling behind
-				if(skip_frames && movie_fps < 100.0 && LAG > 100.0) skipping_frames = true;
-
-				if(skipping_frames && LAG > 0.0)
-				{
-					skipped_frames++;
-
-					if(((skipped_frames - 1) & skipped_frames) == 0) ffnx_glitch("update_movie_sample: video playback is lagging behind, skipping frames (frame #: %i, skipped: %i, lag: %f)\n", movie_frame_counter, skipped_frames, LAG);
-
-					if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
-					else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
-
-					av_packet_unref(&packet);
-
-					break;
-				}
-				else skipping_frames = false;
-
-				if(movie_sync_debug) ffnx_info("update_movie_sample(video): DTS %f PTS %f (timebase %f) placed in video buffer at real time %f (play %f)\n", (double)packet.dts, (double)packet.pts, av_q2d(codec_ctx->time_base), (double)(now - start_time) / (double)timer_freq, (double)movie_frame_counter / (double)movie_fps);
-
-				if(sws_ctx)
-				{
-					uint8_t *planes[4] = { 0 };
-					int strides[4] = { 0 };
-					uint8_t *data = (uint8_t*)driver_calloc(movie_width * movie_height, 4);
-
-					planes[0] = data;
-					strides[0] = movie_width * 4;
-
-					sws_scale(sws_ctx, movie_frame->extended_data, movie_frame->linesize, 0, movie_height, planes, strides);
-
-					buffer_bgra_frame(data, movie_width * 4);
-
-					driver_free(data);
-				}
-				else if(use_bgra_texture) buffer_bgra_frame(movie_frame->extended_data[0], movie_frame->linesize[0]);
-				else buffer_yuv_frame(movie_frame->extended_data, movie_frame->linesize);
-
-				if(vbuffer_write == vbuffer_read)
-				{
-					if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
-					else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
-
-					vbuffer_read = (vbuffer_read + 1) % VIDEO_BUFFER_SIZE;
-
-					av_packet_unref(&packet);
+	// wait for the decoder thread to provide the next frame, or to reach the end of the movie
+	struct decoded_frame *frame = decode_ring.peek();
 
-					break;
-				}
-			}
-		}
+	if(!frame)
+	{
+		movie_frame_counter++;
 
-		if(packet.stream_index == audiostream)
-		{
-			uint8_t *buffer;
-			int buffer_size = 0;
-			int used_bytes;
-			DWORD playcursor;
-			DWORD writecursor;
-			uint32_t bytesperpacket = audio_must_be_converted ? av_get_bytes_per_sample(AV_SAMPLE_FMT_S16) : av_get_bytes_per_sample(acodec_ctx->sample_fmt);
-			uint32_t bytespersec = bytesperpacket * acodec_ctx->channels * acodec_ctx->sample_rate;
+		return false;
+	}
 
-			QueryPerformanceCounter((LARGE_INTEGER *)&now);
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
 
-			if(movie_sync_debug)
-			{
-				IDirectSoundBuffer_GetCurrentPosition(ffmpeg_sound_buffer, &playcursor, &writecursor);
-				ffnx_info("update_movie_sample(audio): DTS %f PTS %f (timebase %f) placed in sound buffer at real time %f (play %f write %f)\n", (double)packet.dts, (double)packet.pts, av_q2d(acodec_ctx->time_base), (double)(now - start_time) / (double)timer_freq, (double)playcursor / (double)bytespersec, (double)ffmpeg_sound_write_pointer / (double)bytespersec);
-			}
+	// check if we are falling behind
+	if(skip_frames && movie_fps < 100.0 && LAG > 100.0) skipping_frames = true;
 
-			ret = avcodec_send_packet(acodec_ctx, &packet);
+	if(skipping_frames && LAG > 0.0)
+	{
+		skipped_frames++;
 
-			if (ret < 0)
-			{
-				ffnx_trace("%s: avcodec_send_packet -> %d\n", __func__, ret);
-				av_packet_unref(&packet);
-				break;
-			}
+		if(((skipped_frames - 1) & skipped_frames) == 0) ffnx_glitch("update_movie_sample: video playback is lagging behind, skipping frames (frame #: %i, skipped: %i, lag: %f)\n", movie_frame_counter, skipped_frames, LAG);
+	}
+	else
+	{
+		skipping_frames = false;
 
-			ret = avcodec_receive_frame(acodec_ctx, movie_frame);
+		if(movie_sync_debug) ffnx_info("update_movie_sample(video): frame %u uploaded at real time %f (play %f)\n", decode_ring.getReadIndex(), (double)(now - start_time) / (double)timer_freq, (double)movie_frame_counter / (double)movie_fps);
 
-			if (ret == AVERROR_EOF)
-			{
-				ffnx_trace("%s: avcodec_receive_frame -> %d\n", __func__, ret);
-				av_packet_unref(&packet);
-				break;
-			}
+		vbuffer_read = vbuffer_write;
 
-			if (ret >= 0)
-			{
-				int _size = bytesperpacket * movie_frame->nb_samples * acodec_ctx->channels;
+		if(use_bgra_texture) buffer_bgra_frame(frame);
+		else buffer_yuv_frame(frame);
+	}
 
-				// Sometimes the captured frame may have no sound samples. Just skip and move forward
-				if (_size)
-				{
-					LPVOID ptr1;
-					LPVOID ptr2;
-					DWORD bytes1;
-					DWORD bytes2;
-
-					av_samples_alloc(&buffer, movie_frame->linesize, acodec_ctx->channels, movie_frame->nb_samples, (audio_must_be_converted ? AV_SAMPLE_FMT_S16 : acodec_ctx->sample_fmt), 0);
-					if (audio_must_be_converted) swr_convert(swr_ctx, &buffer, movie_frame->nb_samples, (const uint8_t**)movie_frame->extended_data, movie_frame->nb_samples);
-					else av_samples_copy(&buffer, movie_frame->extended_data, 0, 0, movie_frame->nb_samples, acodec_ctx->channels, acodec_ctx->sample_fmt);
-
-					if (ffmpeg_sound_buffer) {
-						if (IDirectSoundBuffer_GetStatus(ffmpeg_sound_buffer, &DSStatus) == DS_OK) {
-							if (DSStatus != DSBSTATUS_BUFFERLOST) {
-								if (IDirectSoundBuffer_Lock(ffmpeg_sound_buffer, ffmpeg_sound_write_pointer, _size, &ptr1, &bytes1, &ptr2, &bytes2, 0)) ffnx_error("update_movie_sample: couldn't lock sound buffer\n");
-								memcpy(ptr1, buffer, bytes1);
-								memcpy(ptr2, &buffer[bytes1], bytes2);
-								if (IDirectSoundBuffer_Unlock(ffmpeg_sound_buffer, ptr1, bytes1, ptr2, bytes2)) ffnx_error("update_movie_sample: couldn't unlock sound buffer\n");
-							}
-						}
-
-						ffmpeg_sound_write_pointer = (ffmpeg_sound_write_pointer + bytes1 + bytes2) % ffmpeg_sound_buffer_size;
-						av_freep(&buffer);
-					}
-				}
-			}
-		}
+	// the uploads hold their own references on the frame, the slot goes back to the decoder once they are done
+	decode_ring.pop();
 
-		av_packet_unref(&packet);
-	}
+	if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
+	else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
 
 	if(ffmpeg_sound_buffer && first_audio_packet)
 	{
@@ -588,29 +771,8 @@ uint32_t ffmpeg_update_movie_sample(bool use_movie_fps)
 
 	movie_frame_counter++;
 
-	// could not read any more frames, exhaust video buffer then end movie
-	if(ret < 0)
-	{
-		if(vbuffer_write != vbuffer_read)
-		{
-			if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
-			else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
-
-			vbuffer_read = (vbuffer_read + 1) % VIDEO_BUFFER_SIZE;
-		}
-
-		if(vbuffer_write == vbuffer_read) return false;
-	}
-
 	// Pure movie playback has no frame limiter, although it is not always required. Use it only when necessary
-	if (use_movie_fps)
-	{
-		// wait for the next frame
-		do
-		{
-			QueryPerformanceCounter((LARGE_INTEGER *)&now);
-		} while(LAG < 0.0);
-	}
+	if (use_movie_fps) ffmpeg_wait_next_frame();
 
 	// keep going
 	return true;
@@ -619,14 +781,57 @@ uint32_t ffmpeg_update_movie_sample(bool use_movie_fps)
 // draw the current frame, don't update anything
 void ffmpeg_draw_current_frame()
 {
-	if(use_bgra_texture) draw_bgra_frame((vbuffer_read - 1) % VIDEO_BUFFER_SIZE);
-	else draw_yuv_frame((vbuffer_read - 1) % VIDEO_BUFFER_SIZE, codec_ctx->color_range == AVCOL_RANGE_JPEG);
+	if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
+	else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
 }
 
 // loop back to the beginning of the movie
 void ffmpeg_loop()
 {
-	if(format_ctx) avformat_seek_file(format_ctx, -1, 0, 0, 0, 0);
+	if(!format_ctx) return;
+
+	ffmpeg_stop_decoder();
+
+	avformat_seek_file(format_ctx, -1, 0, 0, 0, 0);
+
+	ffmpeg_start_decoder();
+}
+
+// decode a whole movie without any window or sound, writing the raw frames one after another to a file
+// frames are stored as planar YUV 4:2:0 when the codec outputs YUV420P, NV12 or P010, as BGRA otherwise.
+// nothing here needs the renderer, so this works before it is initialized
+uint32_t ffmpeg_dump_movie(char *name, char *filename)
+{
+	uint32_t ret = 0;
+
+	// a movie being played has textures, release it while the renderer can still free them
+	if(format_ctx || decoder_thread.joinable()) ffmpeg_release_movie_objects();
+
+	decoder_sink = fopen(filename, "wb");
+
+	if(!decoder_sink)
+	{
+		ffnx_error("dump_movie: couldn't open output file: %s\n", filename);
+		return ret;
+	}
+
+	ffmpeg_prepare_movie(name, false);
+
+	if(format_ctx)
+	{
+		decoder_thread.join();
+
+		ret = decoder_frames;
+
+		if(trace_movies) ffnx_trace("dump_movie: %s; %u frames of %u bytes written to %s\n", name, ret, decode_ring.getFrameSize(), filename);
+	}
+
+	ffmpeg_release_movie_objects();
+
+	fclose(decoder_sink);
+	decoder_sink = nullptr;
+
+	return ret;
 }
 
 // get the current frame number
@@ -39,5 +39,6 @@ uint32_t ffmpeg_update_movie_sample(bool use_movie_fps = true);
 void ffmpeg_draw_current_frame();
 void ffmpeg_loop();
 uint32_t ffmpeg_get_movie_frame();
+uint32_t ffmpeg_dump_movie(char* name, char* filename);
 
 short ffmpeg_get_fps_ratio();
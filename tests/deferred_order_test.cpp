@@ -0,0 +1,139 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gl/deferred_order.h"
+#include "test.h"
+
+struct Layer
+{
+	double z;
+	uint32_t drawn;
+};
+
+// The selection loop gl_draw_sorted_deferred used before, kept as the reference
+static std::vector<uint32_t> referenceOrder(std::vector<Layer> layers)
+{
+	std::vector<uint32_t> ret;
+
+	while(true)
+	{
+		double z = -1.0;
+		uint32_t next = -1;
+
+		for(uint32_t i = 0; i < layers.size(); i++)
+		{
+			if(layers[i].z > z && !layers[i].drawn)
+			{
+				next = i;
+				z = layers[i].z;
+			}
+		}
+
+		if(next == uint32_t(-1)) break;
+
+		ret.push_back(next);
+		layers[next].drawn = true;
+	}
+
+	return ret;
+}
+
+static bool sameOrder(const std::vector<Layer> &layers)
+{
+	std::vector<uint32_t> order;
+
+	gl_order_sorted_deferred(layers.data(), uint32_t(layers.size()), order);
+
+	return order == referenceOrder(layers);
+}
+
+static void testRecordedQueues()
+{
+	// Menu: every window, border and cursor layer queued on a handful of depths
+	CHECK(sameOrder({ { 0.9, 0 }, { 0.9, 0 }, { 0.5, 0 }, { 0.9, 0 }, { 0.5, 0 }, { 0.1, 0 }, { 0.9, 0 }, { 0.1, 0 } }));
+
+	// Battle: already drawn layers, and the sentinel depths the engine uses for hidden ones
+	CHECK(sameOrder({ { 0.3, 1 }, { 0.7, 0 }, { -1.0, 0 }, { 0.7, 1 }, { -5.0, 0 }, { 0.0, 0 }, { 0.3, 0 }, { -0.5, 0 } }));
+
+	// Not a number is never picked
+	CHECK(sameOrder({ { NAN, 0 }, { 0.2, 0 }, { NAN, 0 }, { 0.2, 0 } }));
+
+	CHECK(sameOrder({}));
+	CHECK(sameOrder({ { -1.0, 0 }, { 0.4, 1 } }));
+}
+
+static void testRandomQueues()
+{
+	std::mt19937 rng(1234);
+
+	for (uint32_t run = 0; run < 2000; run++)
+	{
+		std::vector<Layer> layers(rng() % 200);
+		// Few distinct depths make ties, the case where the order is easy to get wrong
+		uint32_t depths = 1 + rng() % 8;
+
+		for (Layer &layer : layers)
+		{
+			layer.z = double(int(rng() % (depths + 2)) - 2) / depths;
+			layer.drawn = rng() % 10 == 0;
+		}
+
+		CHECK(sameOrder(layers));
+	}
+}
+
+static void benchmark()
+{
+	std::mt19937 rng(5678);
+	std::vector<Layer> layers(2000);
+	std::vector<uint32_t> order;
+
+	for (Layer &layer : layers) layer = { double(rng() % 64) / 64, 0 };
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < 10; i++) gl_order_sorted_deferred(layers.data(), uint32_t(layers.size()), order);
+
+	auto middle = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < 10; i++) order = referenceOrder(layers);
+
+	auto end = std::chrono::steady_clock::now();
+
+	printf("%zu layers: sorted in %.3f ms, selection loop in %.3f ms\n", layers.size(),
+		std::chrono::duration<double, std::milli>(middle - start).count() / 10,
+		std::chrono::duration<double, std::milli>(end - middle).count() / 10);
+}
+
+int main()
+{
+	testRecordedQueues();
+	testRandomQueues();
+	benchmark();
+
+	return test_result();
+}
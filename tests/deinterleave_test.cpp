@@ -0,0 +1,134 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "audio/vgmstream/deinterleave.h"
+#include "test.h"
+
+// The conversion getAudio used before, kept as the reference
+static void referenceLoop(float* aDst, unsigned int aPitch, const int16_t* aSrc, unsigned int aCount, unsigned int aChannels)
+{
+	for (unsigned int j = 0; j < aCount; j++)
+	{
+		for (unsigned int k = 0; k < aChannels; k++)
+		{
+			aDst[k * aPitch + j] = aSrc[j * aChannels + k] / (float)INT16_MAX;
+		}
+	}
+}
+
+static void testBitExact()
+{
+	std::mt19937 rng(99);
+
+	for (unsigned int channels = 1; channels <= 6; channels++)
+	{
+		for (unsigned int base : { 0u, 8u, 16u, 512u })
+		{
+			// Tails of every length the SIMD paths leave to the scalar loop
+			for (unsigned int tail = 0; tail < 8; tail++)
+			{
+				unsigned int count = base + tail;
+				// Planes further apart than the samples, like when getAudio is asked for more than one chunk
+				unsigned int pitch = count + 5;
+				std::vector<int16_t> src(count * channels);
+
+				for (size_t i = 0; i < src.size(); i++)
+				{
+					static const int16_t extremes[] = { INT16_MIN, INT16_MIN + 1, -1, 0, 1, INT16_MAX - 1, INT16_MAX };
+
+					src[i] = i < 7 ? extremes[i] : int16_t(rng());
+				}
+
+				std::vector<float> expected(pitch * channels), scalar(pitch * channels), simd(pitch * channels);
+
+				// Bytes outside of the planes must be left alone
+				memset(expected.data(), 0xAB, expected.size() * sizeof(float));
+				memset(scalar.data(), 0xAB, scalar.size() * sizeof(float));
+				memset(simd.data(), 0xAB, simd.size() * sizeof(float));
+
+				referenceLoop(expected.data(), pitch, src.data(), count, channels);
+				SoLoud::deinterleave_samples_scalar(scalar.data(), pitch, src.data(), count, channels);
+				SoLoud::deinterleave_samples(simd.data(), pitch, src.data(), count, channels);
+
+				CHECK(memcmp(expected.data(), scalar.data(), expected.size() * sizeof(float)) == 0);
+
+				if (memcmp(expected.data(), simd.data(), expected.size() * sizeof(float)) != 0)
+				{
+					fprintf(stderr, "mismatch with %u channels and %u samples\n", channels, count);
+					CHECK(false);
+				}
+			}
+		}
+	}
+}
+
+// Nanoseconds per sample frame, over one second of 44.1 kHz audio converted a few hundred times
+template<typename Convert>
+static double nsPerSample(unsigned int channels, Convert convert)
+{
+	const unsigned int count = 44100, rounds = 200;
+	std::vector<int16_t> src(count * channels);
+	std::vector<float> dst(count * channels);
+	std::mt19937 rng(7);
+
+	for (int16_t& sample : src) sample = int16_t(rng());
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned int i = 0; i < rounds; i++) convert(dst.data(), count, src.data(), count, channels);
+
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+	// Keep the conversions from being optimized away
+	volatile float sink = dst[count / 2];
+	(void)sink;
+
+	return elapsed.count() / (double(count) * rounds);
+}
+
+static void benchmark()
+{
+	for (unsigned int channels : { 1u, 2u, 6u })
+	{
+		double scalar = nsPerSample(channels, [](float* aDst, unsigned int aPitch, const int16_t* aSrc, unsigned int aCount, unsigned int aChannels) { SoLoud::deinterleave_samples_scalar(aDst, aPitch, aSrc, aCount, aChannels); });
+		double simd = nsPerSample(channels, SoLoud::deinterleave_samples);
+
+		printf("%u channel(s): scalar %.2f ns/sample, deinterleave_samples %.2f ns/sample\n", channels, scalar, simd);
+	}
+}
+
+int main()
+{
+#ifndef SOLOUD_VGMSTREAM_SSE2
+	printf("SSE2 is not available, only the scalar conversion is checked\n");
+#endif
+
+	testBitExact();
+	benchmark();
+
+	return test_result();
+}
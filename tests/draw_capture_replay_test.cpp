@@ -0,0 +1,343 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "draw_capture_replay.h"
+#include "draw_capture_writer.h"
+#include "test.h"
+
+#define LOOPS 3
+#define MISSING_TEXTURE 1000
+
+// Stands for the Renderer, remembering what the replay asked for
+struct RecordingTarget
+{
+	// Replayed handle => first byte of its pixels, for the textures alive
+	std::map<uint32_t, uint8_t> textures;
+	uint32_t nextTexture = 1;
+	uint32_t boundTexture = 0;
+	uint32_t badDeletes = 0;
+	uint32_t shows = 0;
+	uint32_t timedShows = 0;
+	uint32_t draws = 0;
+	uint32_t drawsWithBoundTexture = 0;
+	uint32_t badDraws = 0;
+	uint32_t renderStates = 0;
+	uint32_t lastBlendMode = 0;
+	float lastWorldView = 0.0f;
+	float lastProjection = 0.0f;
+	uint32_t lastViewportWidth = 0;
+
+	uint32_t createTexture(uint32_t captured, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t format)
+	{
+		if (pixels == nullptr || width == 0 || height == 0 || format != 0 || captured == 0) return 0;
+
+		textures[nextTexture] = pixels[0];
+
+		return nextTexture++;
+	}
+
+	void deleteTexture(uint32_t texture)
+	{
+		if (!textures.erase(texture)) badDeletes++;
+	}
+
+	void useTexture(uint32_t texture, bool)
+	{
+		boundTexture = texture;
+	}
+
+	void renderState(uint32_t, uint32_t)
+	{
+		renderStates++;
+	}
+
+	void blendMode(uint32_t mode)
+	{
+		lastBlendMode = mode;
+	}
+
+	void worldViewMatrix(const float* matrix)
+	{
+		lastWorldView = matrix[0];
+	}
+
+	void d3dProjectionMatrix(const float* matrix)
+	{
+		lastProjection = matrix[0];
+	}
+
+	void viewport(uint32_t, uint32_t, uint32_t width, uint32_t, const float*)
+	{
+		lastViewportWidth = width;
+	}
+
+	void draw(uint32_t primitiveType, uint32_t vertexType, const uint8_t* vertices, const uint8_t* normals, uint32_t vertexCount, const uint8_t* indices, uint32_t count, uint32_t clip)
+	{
+		// Vertices are filled with their vertex count, indices with zeros
+		bool ok = primitiveType == 4 && vertexType == 3 && clip == 1 && normals == nullptr && count == 3;
+
+		for (uint32_t i = 0; ok && i < vertexCount * DRAW_CAPTURE_VERTEX_SIZE; i++) ok = vertices[i] == vertexCount;
+		for (uint32_t i = 0; ok && i < count * sizeof(uint16_t); i++) ok = indices[i] == 0;
+
+		if (!ok) badDraws++;
+
+		if (boundTexture == MISSING_TEXTURE || textures.count(boundTexture)) drawsWithBoundTexture++;
+
+		draws++;
+	}
+
+	void show(bool timed)
+	{
+		shows++;
+
+		if (timed) timedShows++;
+	}
+};
+
+// Writes records the way DrawCapture does
+struct CaptureWriter
+{
+	DrawCaptureWriter writer;
+
+	void frame(uint32_t counter)
+	{
+		writer.writeRecord(DrawCaptureStream::FRAME);
+		writer.writeUInt32(counter);
+	}
+
+	void texture(uint32_t handle, uint8_t value)
+	{
+		std::vector<uint8_t> pixels(2 * 2 * 4, value);
+		uint64_t pixelsKey = writer.writeBlob(pixels.data(), pixels.size());
+
+		writer.writeRecord(DrawCaptureStream::TEXTURE);
+		writer.writeUInt32(handle);
+		writer.writeUInt32(2);
+		writer.writeUInt32(2);
+		writer.writeUInt32(0);
+		writer.write(&pixelsKey, sizeof(pixelsKey));
+	}
+
+	void textureDelete(uint32_t handle)
+	{
+		writer.writeRecord(DrawCaptureStream::TEXTURE_DELETE);
+		writer.writeUInt32(handle);
+	}
+
+	void textureSet(uint32_t handle)
+	{
+		writer.writeRecord(DrawCaptureStream::TEXTURE_SET);
+		writer.writeUInt32(handle);
+		writer.writeUInt32(0);
+	}
+
+	void renderState(uint32_t state, uint32_t option)
+	{
+		writer.writeRecord(DrawCaptureStream::RENDERSTATE);
+		writer.writeUInt32(state);
+		writer.writeUInt32(option);
+	}
+
+	void blendMode(uint32_t mode)
+	{
+		writer.writeRecord(DrawCaptureStream::BLEND_MODE);
+		writer.writeUInt32(mode);
+	}
+
+	void matrix(DrawCaptureStream::Record type, float value)
+	{
+		float matrix[16] = { value };
+
+		writer.writeRecord(type);
+		writer.write(matrix, sizeof(matrix));
+	}
+
+	void viewport(uint32_t width)
+	{
+		float matrix[16] = {};
+
+		writer.writeRecord(DrawCaptureStream::VIEWPORT);
+		writer.writeUInt32(0);
+		writer.writeUInt32(0);
+		writer.writeUInt32(width);
+		writer.writeUInt32(480);
+		writer.write(matrix, sizeof(matrix));
+	}
+
+	void draw(uint32_t vertexCount)
+	{
+		std::vector<uint8_t> vertices(vertexCount * DRAW_CAPTURE_VERTEX_SIZE, uint8_t(vertexCount));
+		uint16_t indices[3] = { 0, 0, 0 };
+		uint64_t verticesKey = writer.writeBlob(vertices.data(), vertices.size());
+		uint64_t normalsKey = 0;
+		uint64_t indicesKey = writer.writeBlob(indices, sizeof(indices));
+
+		writer.writeRecord(DrawCaptureStream::DRAW);
+		writer.writeUInt32(4);
+		writer.writeUInt32(3);
+		writer.writeUInt32(vertexCount);
+		writer.writeUInt32(3);
+		writer.writeUInt32(1);
+		writer.writeUInt32(0);
+		writer.write(&verticesKey, sizeof(verticesKey));
+		writer.write(&normalsKey, sizeof(normalsKey));
+		writer.write(&indicesKey, sizeof(indicesKey));
+	}
+};
+
+static std::vector<uint8_t> readFile(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Three frames, the first one partial: a texture created before the capture, handles reused, one left alive
+static std::vector<uint8_t> writeCapture()
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "ffnx_draw_capture_replay_test.bin";
+	CaptureWriter capture;
+
+	CHECK(capture.writer.open(path.string().c_str(), true));
+
+	capture.textureSet(5);
+	capture.draw(3);
+	capture.frame(100);
+
+	capture.renderState(1, 1);
+	capture.blendMode(2);
+	capture.matrix(DrawCaptureStream::WORLDVIEW_MATRIX, 2.0f);
+	capture.matrix(DrawCaptureStream::D3DPROJECTION_MATRIX, 3.0f);
+	capture.viewport(640);
+	capture.texture(7, 0xAA);
+	capture.textureSet(7);
+	capture.draw(3);
+	capture.draw(4);
+	capture.textureDelete(7);
+	capture.texture(7, 0xBB);
+	capture.textureSet(7);
+	capture.draw(3);
+	capture.frame(101);
+
+	capture.texture(8, 0xCC);
+	capture.textureSet(8);
+	capture.draw(6);
+	// Created again without being deleted first
+	capture.texture(8, 0xDD);
+	capture.textureSet(8);
+	capture.draw(3);
+	capture.textureSet(0);
+	capture.draw(3);
+	capture.frame(102);
+
+	capture.writer.close();
+
+	std::vector<uint8_t> ret = readFile(path);
+
+	std::filesystem::remove(path);
+
+	return ret;
+}
+
+static void testReplay()
+{
+	std::vector<uint8_t> data = writeCapture();
+	DrawCaptureStream stream;
+	RecordingTarget target;
+
+	CHECK(stream.parse(data.data(), data.size()));
+	CHECK(stream.isFF8 && stream.frames == 3);
+
+	DrawCaptureReplay<RecordingTarget> replay(target, stream, MISSING_TEXTURE);
+
+	replay.replay(LOOPS);
+
+	// The partial first frame is replayed but not timed
+	CHECK(target.shows == LOOPS * 3);
+	CHECK(target.timedShows == LOOPS * 2);
+	CHECK(replay.firstLoopTimes.size() == 2);
+	CHECK(replay.frameTimes.size() == (LOOPS - 1) * 2);
+
+	for (double time : replay.frameTimes) CHECK(time >= 0.0);
+
+	CHECK(replay.draws == 7);
+	CHECK(target.draws == LOOPS * 7);
+	CHECK(target.badDraws == 0);
+	CHECK(target.drawsWithBoundTexture == LOOPS * 6);
+	CHECK(replay.missingTextureBinds == 1);
+
+	// Each texture is created once per loop, reused handles replace their texture, and nothing outlives a loop
+	CHECK(target.nextTexture == 1 + LOOPS * 4);
+	CHECK(target.textures.empty());
+	CHECK(target.badDeletes == 0);
+
+	CHECK(target.renderStates == LOOPS);
+	CHECK(target.lastBlendMode == 2);
+	CHECK(target.lastWorldView == 2.0f && target.lastProjection == 3.0f);
+	CHECK(target.lastViewportWidth == 640);
+}
+
+// The draws reach the target with the texture the capture had bound
+static void testBoundTextures()
+{
+	std::vector<uint8_t> data = writeCapture();
+	DrawCaptureStream stream;
+
+	struct : RecordingTarget
+	{
+		std::vector<int> bound;
+
+		void draw(uint32_t primitiveType, uint32_t vertexType, const uint8_t* vertices, const uint8_t* normals, uint32_t vertexCount, const uint8_t* indices, uint32_t count, uint32_t clip)
+		{
+			RecordingTarget::draw(primitiveType, vertexType, vertices, normals, vertexCount, indices, count, clip);
+
+			if (boundTexture == MISSING_TEXTURE) bound.push_back(-1);
+			else if (boundTexture == 0) bound.push_back(0);
+			else bound.push_back(textures.count(boundTexture) ? textures[boundTexture] : -2);
+		}
+	} target;
+
+	CHECK(stream.parse(data.data(), data.size()));
+
+	DrawCaptureReplay<decltype(target)> replay(target, stream, MISSING_TEXTURE);
+
+	replay.replay(1);
+
+	std::vector<int> expected = { -1, 0xAA, 0xAA, 0xBB, 0xCC, 0xDD, 0 };
+
+	CHECK(target.bound == expected);
+}
+
+int main()
+{
+	testReplay();
+	testBoundTextures();
+
+	return test_result();
+}
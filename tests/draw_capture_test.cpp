@@ -0,0 +1,432 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "draw_capture_writer.h"
+#include "test.h"
+
+// Writes a stream the way DrawCapture does, remembering where each record ends
+struct StreamBuilder
+{
+	std::vector<uint8_t> data;
+	std::vector<size_t> recordEnds;
+
+	StreamBuilder(uint32_t version = DRAW_CAPTURE_VERSION)
+	{
+		uint32_t ff8 = 1;
+
+		put("FFNXDRAW", 8);
+		put(&version, sizeof(version));
+		put(&ff8, sizeof(ff8));
+		recordEnds.push_back(data.size());
+	}
+
+	void put(const void* value, size_t size)
+	{
+		data.insert(data.end(), (const uint8_t*)value, (const uint8_t*)value + size);
+	}
+
+	void put32(uint32_t value)
+	{
+		put(&value, sizeof(value));
+	}
+
+	void put64(uint64_t value)
+	{
+		put(&value, sizeof(value));
+	}
+
+	void record(DrawCaptureStream::Record type)
+	{
+		put(&type, sizeof(type));
+	}
+
+	void end()
+	{
+		recordEnds.push_back(data.size());
+	}
+
+	void blob(uint64_t hash, const std::vector<uint8_t>& payload)
+	{
+		record(DrawCaptureStream::BLOB);
+		put64(hash);
+		put32(payload.size());
+		put(payload.data(), payload.size());
+		end();
+	}
+
+	void frame(uint32_t counter)
+	{
+		record(DrawCaptureStream::FRAME);
+		put32(counter);
+		end();
+	}
+
+	void texture(uint32_t handle, uint32_t width, uint32_t height, uint32_t format, uint64_t pixels)
+	{
+		record(DrawCaptureStream::TEXTURE);
+		put32(handle);
+		put32(width);
+		put32(height);
+		put32(format);
+		put64(pixels);
+		end();
+	}
+
+	void textureDelete(uint32_t handle)
+	{
+		record(DrawCaptureStream::TEXTURE_DELETE);
+		put32(handle);
+		end();
+	}
+
+	void textureSet(uint32_t handle)
+	{
+		record(DrawCaptureStream::TEXTURE_SET);
+		put32(handle);
+		put32(0);
+		end();
+	}
+
+	void draw(uint32_t vertexCount, uint32_t indexCount, uint64_t vertices, uint64_t normals, uint64_t indices)
+	{
+		record(DrawCaptureStream::DRAW);
+		put32(4);
+		put32(3);
+		put32(vertexCount);
+		put32(indexCount);
+		put32(1);
+		put32(0);
+		put64(vertices);
+		put64(normals);
+		put64(indices);
+		end();
+	}
+
+	void viewport()
+	{
+		float matrix[16] = {};
+
+		matrix[0] = 0.5f;
+		matrix[15] = 1.0f;
+
+		record(DrawCaptureStream::VIEWPORT);
+		put32(0);
+		put32(16);
+		put32(640);
+		put32(448);
+		put(matrix, sizeof(matrix));
+		end();
+	}
+};
+
+static std::vector<uint8_t> filled(size_t size, uint8_t value)
+{
+	return std::vector<uint8_t>(size, value);
+}
+
+static bool parse(DrawCaptureStream& stream, const std::vector<uint8_t>& data, size_t size)
+{
+	return stream.parse(data.data(), size);
+}
+
+static void testTextureSizes()
+{
+	CHECK(DrawCaptureStream::textureSize(0, 16, 8) == 16 * 8 * 4);
+	CHECK(DrawCaptureStream::textureSize(1, 16, 8) == 16 * 8);
+	CHECK(DrawCaptureStream::textureSize(2, 16, 8) == 16 * 8 * 2);
+	CHECK(DrawCaptureStream::textureSize(3, 16, 8) == 16 * 8 * 2);
+	CHECK(DrawCaptureStream::textureSize(4, 16, 8) == 16 * 8 * 4);
+	CHECK(DrawCaptureStream::textureSize(5, 16, 8) == 0);
+	// Does not wrap around 32 bits
+	CHECK(DrawCaptureStream::textureSize(0, 65536, 65536) == 65536ull * 65536ull * 4);
+}
+
+// One frame of everything a replay needs, with a texture handle reused once the first texture is deleted
+static StreamBuilder buildStream()
+{
+	StreamBuilder builder;
+
+	builder.frame(1);
+	builder.blob(0x10, filled(2 * 2 * 4, 0xAA));
+	builder.texture(7, 2, 2, 0, 0x10);
+	// Movie planes are not BGRA
+	builder.blob(0x11, filled(4 * 2 * 2, 0xBB));
+	builder.texture(8, 4, 2, 2, 0x11);
+	builder.viewport();
+	builder.textureSet(7);
+	builder.blob(0x20, filled(3 * DRAW_CAPTURE_VERTEX_SIZE, 0x01));
+	builder.blob(0x21, filled(3 * sizeof(uint16_t), 0x00));
+	builder.draw(3, 3, 0x20, 0, 0x21);
+	builder.textureDelete(7);
+	builder.blob(0x12, filled(2 * 2 * 4, 0xCC));
+	builder.texture(7, 2, 2, 0, 0x12);
+	builder.textureSet(7);
+	// Same payloads, referenced again without being stored twice
+	builder.draw(3, 3, 0x20, 0, 0x21);
+	builder.frame(2);
+
+	return builder;
+}
+
+static void testRoundTrip()
+{
+	StreamBuilder builder = buildStream();
+	DrawCaptureStream stream;
+
+	CHECK(parse(stream, builder.data, builder.data.size()));
+	CHECK(stream.isFF8);
+	CHECK(stream.frames == 2);
+	CHECK(stream.getBlobCount() == 5);
+	CHECK(stream.events.size() == 11);
+
+	if (stream.events.size() != 11) return;
+
+	const DrawCaptureStream::Event* events = stream.events.data();
+
+	CHECK(events[0].type == DrawCaptureStream::FRAME && events[0].args[0] == 1);
+
+	CHECK(events[1].type == DrawCaptureStream::TEXTURE);
+	CHECK(events[1].args[0] == 7 && events[1].args[1] == 2 && events[1].args[2] == 2 && events[1].args[3] == 0);
+	CHECK(events[1].data[0] != nullptr && events[1].data[0][0] == 0xAA);
+
+	CHECK(events[2].type == DrawCaptureStream::TEXTURE && events[2].args[3] == 2);
+	CHECK(events[2].data[0] != nullptr && events[2].data[0][15] == 0xBB);
+
+	CHECK(events[3].type == DrawCaptureStream::VIEWPORT);
+	CHECK(events[3].args[1] == 16 && events[3].args[3] == 448 && events[3].matrix[0] == 0.5f);
+
+	CHECK(events[5].type == DrawCaptureStream::DRAW);
+	CHECK(events[5].args[2] == 3 && events[5].args[3] == 3 && events[5].args[4] == 1);
+	CHECK(events[5].data[0] != nullptr && events[5].data[1] == nullptr && events[5].data[2] != nullptr);
+
+	CHECK(events[6].type == DrawCaptureStream::TEXTURE_DELETE && events[6].args[0] == 7);
+
+	// The reused handle comes with its own pixels
+	CHECK(events[7].type == DrawCaptureStream::TEXTURE && events[7].args[0] == 7);
+	CHECK(events[7].data[0] != nullptr && events[7].data[0][0] == 0xCC);
+
+	CHECK(events[9].data[0] == events[5].data[0] && events[9].data[2] == events[5].data[2]);
+	CHECK(events[10].type == DrawCaptureStream::FRAME && events[10].args[0] == 2);
+}
+
+static void testTruncated()
+{
+	StreamBuilder builder = buildStream();
+	DrawCaptureStream stream;
+	size_t nextEnd = 0;
+	uint32_t mismatches = 0;
+
+	// Only a cut between two records leaves a valid stream
+	for (size_t size = 0; size <= builder.data.size(); size++)
+	{
+		bool isRecordEnd = nextEnd < builder.recordEnds.size() && builder.recordEnds[nextEnd] == size;
+
+		if (isRecordEnd) nextEnd++;
+
+		if (parse(stream, builder.data, size) != isRecordEnd) mismatches++;
+	}
+
+	CHECK(mismatches == 0);
+}
+
+static void testCorrupt()
+{
+	DrawCaptureStream stream;
+
+	{
+		StreamBuilder builder(DRAW_CAPTURE_VERSION - 1);
+
+		builder.frame(1);
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	{
+		StreamBuilder builder;
+
+		builder.data[0] = 'X';
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	{
+		StreamBuilder builder;
+
+		builder.record(DrawCaptureStream::Record(0x7F));
+		builder.put32(0);
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	// 0 means no payload, it cannot be stored
+	{
+		StreamBuilder builder;
+
+		builder.blob(0, filled(16, 0));
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	// Referenced before being stored
+	{
+		StreamBuilder builder;
+
+		builder.texture(1, 2, 2, 0, 0x10);
+		builder.blob(0x10, filled(2 * 2 * 4, 0));
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	// Payloads of the wrong size
+	{
+		StreamBuilder builder;
+
+		builder.blob(0x10, filled(2 * 2 * 4, 0));
+		builder.texture(1, 2, 2, 2, 0x10);
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	{
+		StreamBuilder builder;
+
+		builder.blob(0x20, filled(3 * DRAW_CAPTURE_VERTEX_SIZE, 0));
+		builder.blob(0x21, filled(4 * sizeof(uint16_t), 0));
+		builder.draw(3, 3, 0x20, 0, 0x21);
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	{
+		StreamBuilder builder;
+
+		builder.blob(0x10, filled(16, 0));
+		builder.texture(1, 2, 2, 9, 0x10);
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+
+	// A blob larger than what is left
+	{
+		StreamBuilder builder;
+
+		builder.blob(0x10, filled(16, 0));
+		builder.data.resize(builder.data.size() - 1);
+		CHECK(!parse(stream, builder.data, builder.data.size()));
+	}
+}
+
+static std::vector<uint8_t> readFile(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeDraw(DrawCaptureWriter& writer, const std::vector<uint8_t>& vertices, uint64_t verticesHash, const std::vector<uint8_t>& indices)
+{
+	uint64_t verticesKey = writer.writeBlob(vertices.data(), vertices.size(), verticesHash);
+	uint64_t normalsKey = writer.writeBlob(nullptr, 0);
+	uint64_t indicesKey = writer.writeBlob(indices.data(), indices.size());
+
+	writer.writeRecord(DrawCaptureStream::DRAW);
+	writer.writeUInt32(4);
+	writer.writeUInt32(3);
+	writer.writeUInt32(vertices.size() / DRAW_CAPTURE_VERTEX_SIZE);
+	writer.writeUInt32(indices.size() / sizeof(uint16_t));
+	writer.writeUInt32(0);
+	writer.writeUInt32(0);
+	writer.write(&verticesKey, sizeof(verticesKey));
+	writer.write(&normalsKey, sizeof(normalsKey));
+	writer.write(&indicesKey, sizeof(indicesKey));
+}
+
+// Payloads with the same hash must each be replayed with their own data
+static void testWriterCollisions()
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "ffnx_draw_capture_test.bin";
+	DrawCaptureWriter writer;
+	std::vector<uint8_t> first = filled(3 * DRAW_CAPTURE_VERTEX_SIZE, 0x01), second = filled(3 * DRAW_CAPTURE_VERTEX_SIZE, 0x02);
+	std::vector<uint8_t> larger = filled(6 * DRAW_CAPTURE_VERTEX_SIZE, 0x03), indices = filled(3 * sizeof(uint16_t), 0x00);
+	// Large enough to be compared in several chunks, differing in the last byte only
+	std::vector<uint8_t> big = filled(200 * DRAW_CAPTURE_VERTEX_SIZE, 0x04), bigLast = big;
+
+	bigLast.back() = 0x05;
+
+	CHECK(writer.open(path.string().c_str(), false));
+
+	writer.writeRecord(DrawCaptureStream::FRAME);
+	writer.writeUInt32(1);
+	writeDraw(writer, first, 0x42, indices);
+	// Same hash as the first vertices, different content then different size
+	writeDraw(writer, second, 0x42, indices);
+	writeDraw(writer, larger, 0x42, indices);
+	// Stored once
+	writeDraw(writer, second, 0x42, indices);
+	// The keys taken by the second and larger vertices, stored again under the next free key
+	writeDraw(writer, first, 0x43, indices);
+	writeDraw(writer, big, 0x50, indices);
+	writeDraw(writer, bigLast, 0x50, indices);
+	// 0 means no payload, key 1 is used instead
+	writeDraw(writer, first, 0, indices);
+	writer.writeRecord(DrawCaptureStream::FRAME);
+	writer.writeUInt32(2);
+
+	CHECK(writer.getBlobCount() == 8);
+	CHECK(writer.getBlobBytes() == 3 * first.size() + second.size() + larger.size() + 2 * big.size() + indices.size());
+
+	writer.close();
+
+	std::vector<uint8_t> data = readFile(path);
+	DrawCaptureStream stream;
+
+	std::filesystem::remove(path);
+
+	CHECK(parse(stream, data, data.size()));
+	CHECK(stream.getBlobCount() == 8);
+	CHECK(stream.events.size() == 10);
+
+	if (stream.events.size() != 10) return;
+
+	const std::vector<uint8_t>* expected[] = { &first, &second, &larger, &second, &first, &big, &bigLast, &first };
+
+	for (size_t i = 0; i < std::size(expected); i++)
+	{
+		const DrawCaptureStream::Event& event = stream.events[i + 1];
+
+		CHECK(event.type == DrawCaptureStream::DRAW && event.args[2] * DRAW_CAPTURE_VERTEX_SIZE == expected[i]->size());
+		CHECK(event.data[0] != nullptr && memcmp(event.data[0], expected[i]->data(), expected[i]->size()) == 0);
+		CHECK(event.data[1] == nullptr && event.data[2] != nullptr);
+	}
+
+	CHECK(stream.events[4].data[0] == stream.events[2].data[0]);
+	CHECK(stream.events[5].data[0] != stream.events[1].data[0]);
+}
+
+int main()
+{
+	testTextureSizes();
+	testRoundTrip();
+	testTruncated();
+	testCorrupt();
+	testWriterCollisions();
+
+	return test_result();
+}
@@ -0,0 +1,235 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <vector>
+
+#include "frame_limiter.h"
+#include "test.h"
+
+// Deterministic clock counting microseconds. Sleeps wake up late by a configurable amount,
+// every read of the time advances it a little so that spinning eventually reaches the deadline
+class FakeClock : public FrameLimiter::Clock
+{
+public:
+	time_t time = 1000000;
+	time_t readStep = 1;
+	std::vector<uint32_t> overshoots = { 0 };
+	uint32_t sleeps = 0;
+	time_t slept = 0;
+	uint32_t shutdowns = 0;
+
+	time_t now() override
+	{
+		time_t ret = time;
+
+		time += readStep;
+
+		return ret;
+	}
+
+	time_t frequency() override
+	{
+		return 1000000;
+	}
+
+	void sleep(uint32_t us) override
+	{
+		uint32_t overshoot = overshoots[sleeps % overshoots.size()];
+
+		time += us + overshoot;
+		slept += us + overshoot;
+		sleeps++;
+	}
+
+	void shutdown() override
+	{
+		shutdowns++;
+	}
+};
+
+static uint32_t countFrom(FrameLimiter &limiter, uint32_t firstBucket)
+{
+	uint32_t ret = 0;
+
+	for (uint32_t i = firstBucket; i < FRAME_LIMITER_BUCKETS; i++) ret += limiter.getHistogram()[i];
+
+	return ret;
+}
+
+static void testBuckets()
+{
+	FakeClock clock;
+	FrameLimiter limiter;
+
+	limiter.setClock(&clock);
+	clock.readStep = 0;
+
+	// Deadlines already passed, the lateness is exactly how far in the past they are
+	const struct { time_t lateness; uint32_t bucket; } cases[] = {
+		{ 0, 0 }, { 99, 0 }, { 100, 1 }, { 249, 1 }, { 250, 2 }, { 499, 2 }, { 500, 3 },
+		{ 999, 3 }, { 1000, 4 }, { 1999, 4 }, { 2000, 5 }, { 3999, 5 }, { 4000, 6 }, { 100000, 6 },
+	};
+
+	for (const auto &c : cases)
+	{
+		limiter.resetStats();
+		limiter.waitUntil(clock.time - c.lateness);
+
+		CHECK(limiter.getFrameCount() == 1);
+		CHECK(limiter.getHistogram()[c.bucket] == 1);
+	}
+
+	CHECK(clock.sleeps == 0);
+
+	limiter.resetStats();
+
+	CHECK(limiter.getFrameCount() == 0);
+	CHECK(countFrom(limiter, 0) == 0);
+	CHECK(limiter.getSleepRatio() == 0.0);
+}
+
+static void testPreciseTimer()
+{
+	FakeClock clock;
+	FrameLimiter limiter;
+
+	limiter.setClock(&clock);
+	limiter.reset();
+
+	time_t start = clock.time;
+
+	for (uint32_t i = 0; i < 600; i++) limiter.waitFrame(60.0);
+
+	// Every frame on time, and nearly all of the wait spent asleep
+	CHECK(limiter.getFrameCount() == 600);
+	CHECK(limiter.getHistogram()[0] == 600);
+	CHECK(limiter.getSleepRatio() > 0.9);
+
+	// 10 seconds of frames, give or take the time spent reading the clock
+	time_t elapsed = clock.time - start;
+
+	CHECK(elapsed >= 10000000 - 600 && elapsed <= 10000000 + 600 * 8);
+}
+
+static void testCoarseTimer()
+{
+	FakeClock clock;
+	FrameLimiter limiter;
+
+	// Like Sleep with the default scheduler tick, always 2 ms late
+	clock.overshoots = { 2000 };
+	limiter.setClock(&clock);
+	limiter.reset();
+
+	for (uint32_t i = 0; i < 600; i++) limiter.waitFrame(60.0);
+
+	// Only the first sleeps wake up late, until the overshoot has been learnt
+	CHECK(limiter.getFrameCount() == 600);
+	CHECK(countFrom(limiter, 3) <= 3);
+	CHECK(limiter.getHistogram()[0] >= 590);
+	// The spin covers the overshoot, the rest is still spent asleep
+	CHECK(limiter.getSleepRatio() > 0.7);
+}
+
+static void testLateWakeups()
+{
+	FakeClock clock;
+	FrameLimiter limiter;
+
+	// One sleep out of 50 is 3 ms late, which the spin cannot make up for
+	clock.overshoots = std::vector<uint32_t>(50, 0);
+	clock.overshoots[25] = 3000;
+	limiter.setClock(&clock);
+	limiter.reset();
+
+	for (uint32_t i = 0; i < 500; i++) limiter.waitFrame(60.0);
+
+	uint32_t spikes = (clock.sleeps + 24) / 50;
+
+	CHECK(limiter.getFrameCount() == 500);
+	CHECK(spikes >= 9);
+	// Each spike makes its frame late by 1 to 4 ms, at worst
+	CHECK(limiter.getHistogram()[4] + limiter.getHistogram()[5] == spikes);
+	CHECK(limiter.getHistogram()[6] == 0);
+	// The frames right after a spike play it safe, they are not late
+	CHECK(limiter.getHistogram()[0] + limiter.getHistogram()[1] + limiter.getHistogram()[2] + limiter.getHistogram()[3] == 500 - spikes);
+}
+
+static void testSpeed()
+{
+	FakeClock clock;
+	FrameLimiter limiter;
+
+	limiter.setClock(&clock);
+
+	// The first frame does not wait
+	limiter.waitFrame(30.0, 2.0);
+
+	CHECK(limiter.getFrameCount() == 0);
+	CHECK(clock.sleeps == 0);
+
+	time_t start = clock.time;
+
+	limiter.waitFrame(30.0, 2.0);
+
+	// 30 FPS at double speed is 60 FPS
+	CHECK(clock.time - start >= 16666 && clock.time - start <= 16666 + 8);
+	CHECK(limiter.getFrameCount() == 1);
+
+	// No limit at all
+	start = clock.time;
+	limiter.waitFrame(0.0);
+
+	CHECK(clock.time - start <= 2);
+	CHECK(limiter.getFrameCount() == 1);
+}
+
+static void testShutdown()
+{
+	FakeClock clock;
+	FrameLimiter limiter;
+
+	limiter.setClock(&clock);
+	limiter.shutdown();
+
+	CHECK(clock.shutdowns == 1);
+
+	// The limiter keeps working afterwards, the clock acquires its timer again
+	limiter.reset();
+	clock.time += 2000;
+	limiter.waitFrame(60.0);
+
+	CHECK(clock.sleeps > 0);
+	CHECK(limiter.getFrameCount() == 1);
+}
+
+int main()
+{
+	testBuckets();
+	testPreciseTimer();
+	testCoarseTimer();
+	testLateWakeups();
+	testSpeed();
+	testShutdown();
+
+	return test_result();
+}
@@ -0,0 +1,297 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "lgp.h"
+#include "test.h"
+
+struct SyntheticFile
+{
+	std::string name;
+	std::string dir;
+	std::string content;
+};
+
+static void put16(std::vector<uint8_t> &out, size_t pos, uint16_t value)
+{
+	memcpy(out.data() + pos, &value, sizeof(value));
+}
+
+static void put32(std::vector<uint8_t> &out, size_t pos, uint32_t value)
+{
+	memcpy(out.data() + pos, &value, sizeof(value));
+}
+
+static void putString(std::vector<uint8_t> &out, size_t pos, const std::string &value, size_t maxLength)
+{
+	memcpy(out.data() + pos, value.data(), std::min(value.size(), maxLength));
+}
+
+// Files sharing the same name are listed in one conflict group, resolved by their directory
+static std::vector<uint8_t> buildArchive(const std::vector<SyntheticFile> &files)
+{
+	const size_t tocEnd = 16 + files.size() * 27;
+	std::vector<std::vector<size_t>> groups;
+	std::vector<uint16_t> groupOf(files.size(), 0);
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		for (size_t j = 0; j < i; j++)
+		{
+			if (files[j].name != files[i].name) continue;
+
+			if (!groupOf[j])
+			{
+				groups.push_back({ j });
+				groupOf[j] = uint16_t(groups.size());
+			}
+
+			groups[groupOf[j] - 1].push_back(i);
+			groupOf[i] = groupOf[j];
+			break;
+		}
+	}
+
+	size_t conflictSize = 2;
+
+	for (const auto &group : groups) conflictSize += 2 + group.size() * 130;
+
+	std::vector<uint8_t> out(tocEnd + 3600 + conflictSize, 0);
+
+	putString(out, 0, "SQUARESOFT", 12);
+	put32(out, 12, uint32_t(files.size()));
+
+	size_t pos = tocEnd + 3600;
+
+	put16(out, pos, uint16_t(groups.size()));
+	pos += 2;
+
+	for (const auto &group : groups)
+	{
+		put16(out, pos, uint16_t(group.size()));
+		pos += 2;
+
+		for (size_t idx : group)
+		{
+			putString(out, pos, files[idx].dir, 128);
+			put16(out, pos + 128, uint16_t(idx));
+			pos += 130;
+		}
+	}
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		size_t toc = 16 + i * 27;
+		size_t header = out.size();
+
+		putString(out, toc, files[i].name, 20);
+		put32(out, toc + 20, uint32_t(header));
+		out[toc + 24] = 14;
+		put16(out, toc + 25, groupOf[i]);
+
+		out.resize(header + LgpArchive::LGP_FILE_HEADER_SIZE + files[i].content.size(), 0);
+		putString(out, header, files[i].name, 20);
+		put32(out, header + 20, uint32_t(files[i].content.size()));
+		memcpy(out.data() + header + LgpArchive::LGP_FILE_HEADER_SIZE, files[i].content.data(), files[i].content.size());
+	}
+
+	return out;
+}
+
+// Go through an actual file, like the game does
+static std::vector<uint8_t> writeAndReadBack(const std::vector<uint8_t> &archive)
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "ffnx_lgp_test.lgp";
+
+	{
+		std::ofstream file(path, std::ios::binary);
+
+		file.write((const char *)archive.data(), archive.size());
+	}
+
+	std::vector<uint8_t> ret;
+
+	{
+		std::ifstream file(path, std::ios::binary);
+
+		ret.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	std::filesystem::remove(path);
+
+	return ret;
+}
+
+static std::string readFile(LgpArchive &lgp, uint32_t offset)
+{
+	std::string ret(lgp.getFileSize(offset), '\0');
+
+	lgp.read(offset + LgpArchive::LGP_FILE_HEADER_SIZE, ret.data(), uint32_t(ret.size()));
+
+	return ret;
+}
+
+static void testLookups()
+{
+	std::vector<uint8_t> archive = writeAndReadBack(buildArchive({
+		{ "plain.tex", "", "plain content" },
+		{ "dup.p", "field", "field version" },
+		{ "dup.p", "world\\map\\", "world version, longer" },
+		{ "MixedCase.TEX", "", "mixed" },
+		{ "twenty_chars_name.ab", "", "full length" },
+	}));
+	LgpArchive lgp;
+	uint32_t offset = 0;
+	bool resolvedConflict = true;
+
+	CHECK(lgp.parse(archive.data(), archive.size()));
+	CHECK(lgp.isOpen());
+	CHECK(lgp.getFileCount() == 4);
+
+	// Plain hit
+	CHECK(lgp.find("plain.tex", "", offset, resolvedConflict));
+	CHECK(!resolvedConflict);
+	CHECK(lgp.getFileSize(offset) == strlen("plain content"));
+	CHECK(readFile(lgp, offset) == "plain content");
+
+	// Case-folded hits, both ways
+	CHECK(lgp.find("PLAIN.TEX", "", offset, resolvedConflict));
+	CHECK(readFile(lgp, offset) == "plain content");
+	CHECK(lgp.find("mixedcase.tex", "", offset, resolvedConflict));
+	CHECK(readFile(lgp, offset) == "mixed");
+
+	// Conflict resolved by the current directory
+	CHECK(lgp.find("dup.p", "FIELD", offset, resolvedConflict));
+	CHECK(resolvedConflict);
+	CHECK(lgp.getFileSize(offset) == strlen("field version"));
+	CHECK(readFile(lgp, offset) == "field version");
+
+	CHECK(lgp.find("dup.p", "world/map", offset, resolvedConflict));
+	CHECK(resolvedConflict);
+	CHECK(lgp.getFileSize(offset) == strlen("world version, longer"));
+	CHECK(readFile(lgp, offset) == "world version, longer");
+
+	// Conflict without a matching directory is left to the engine
+	CHECK(!lgp.find("dup.p", "menu", offset, resolvedConflict));
+	CHECK(!lgp.find("dup.p", "", offset, resolvedConflict));
+
+	// Not in the archive
+	CHECK(!lgp.find("missing.tex", "", offset, resolvedConflict));
+
+	// Names filling the whole TOC entry, and longer ones which only share their first characters with it
+	CHECK(lgp.find("twenty_chars_name.ab", "", offset, resolvedConflict));
+	CHECK(readFile(lgp, offset) == "full length");
+	CHECK(!lgp.find("twenty_chars_name.abc", "", offset, resolvedConflict));
+
+	// Out of bounds accesses
+	CHECK(lgp.getFileSize(uint32_t(archive.size())) == 0);
+
+	char buffer[8];
+
+	CHECK(lgp.read(uint32_t(archive.size()), buffer, sizeof(buffer)) == 0);
+	CHECK(lgp.read(uint32_t(archive.size() - 2), buffer, sizeof(buffer)) == 2);
+}
+
+static void checkRejected(const std::vector<uint8_t> &archive, const char *what)
+{
+	LgpArchive lgp;
+	uint32_t offset = 0;
+	bool resolvedConflict = false;
+
+	if (lgp.parse(archive.data(), archive.size())) fprintf(stderr, "accepted %s\n", what);
+
+	CHECK(!lgp.isOpen());
+	CHECK(lgp.getFileCount() == 0);
+	CHECK(!lgp.find("plain.tex", "", offset, resolvedConflict));
+}
+
+static void testCorruptArchives()
+{
+	const std::vector<uint8_t> archive = buildArchive({
+		{ "plain.tex", "", "plain content" },
+		{ "dup.p", "field", "field version" },
+		{ "dup.p", "world", "world version" },
+	});
+	const size_t tocEnd = 16 + 3 * 27;
+	const size_t conflictTable = tocEnd + 3600;
+	std::vector<uint8_t> corrupt;
+
+	// Truncated everywhere in the tables
+	for (size_t size : { size_t(0), size_t(8), size_t(16 + 27 + 5), tocEnd + 100, conflictTable + 1, conflictTable + 3, conflictTable + 4 + 129 })
+	{
+		corrupt.assign(archive.begin(), archive.begin() + size);
+		checkRejected(corrupt, "a truncated archive");
+	}
+
+	// File count way beyond the archive size, also catches the size computation overflowing
+	corrupt = archive;
+	put32(corrupt, 12, 0xFFFFFFFF);
+	checkRejected(corrupt, "a huge file count");
+
+	corrupt = archive;
+	put32(corrupt, 12, 200);
+	checkRejected(corrupt, "a file count beyond the table of contents");
+
+	// File header past the end of the archive
+	corrupt = archive;
+	put32(corrupt, 16 + 20, uint32_t(archive.size() - 4));
+	checkRejected(corrupt, "a file offset past the end");
+
+	// Conflict entry pointing outside the table of contents
+	corrupt = archive;
+	put16(corrupt, conflictTable + 4 + 128, 3);
+	checkRejected(corrupt, "a conflict on a missing file");
+
+	// More conflict groups, or entries, than the table holds
+	corrupt = archive;
+	put16(corrupt, conflictTable, 40);
+	checkRejected(corrupt, "too many conflict groups");
+
+	corrupt = archive;
+	put16(corrupt, conflictTable + 2, 0xFFFF);
+	checkRejected(corrupt, "too many conflict entries");
+
+	// A failed parse must leave a previously parsed archive closed, not half indexed
+	LgpArchive lgp;
+	uint32_t offset = 0;
+	bool resolvedConflict = false;
+
+	CHECK(lgp.parse(archive.data(), archive.size()));
+	CHECK(!lgp.parse(corrupt.data(), corrupt.size()));
+	CHECK(!lgp.isOpen());
+	CHECK(!lgp.find("plain.tex", "", offset, resolvedConflict));
+}
+
+int main()
+{
+	testLookups();
+	testCorruptArchives();
+
+	return test_result();
+}
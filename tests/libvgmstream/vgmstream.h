@@ -0,0 +1,42 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The part of vgmstream's STREAMFILE interface used by audio/vgmstream/mapped_streamfile.cpp, same layout as the library
+
+typedef int64_t offv_t;
+
+typedef struct _STREAMFILE {
+	size_t (*read)(struct _STREAMFILE* sf, uint8_t* dst, offv_t offset, size_t length);
+	size_t (*get_size)(struct _STREAMFILE* sf);
+	offv_t (*get_offset)(struct _STREAMFILE* sf);
+	void (*get_name)(struct _STREAMFILE* sf, char* name, size_t name_size);
+	struct _STREAMFILE* (*open)(struct _STREAMFILE* sf, const char* const filename, size_t buffer_size);
+	void (*close)(struct _STREAMFILE* sf);
+	struct _STREAMFILE* stream_index;
+} STREAMFILE;
+
+// Defined by the test, to see when the mapping falls back to it
+STREAMFILE* open_stdio_streamfile(const char* filename);
@@ -0,0 +1,340 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "audio/vgmstream/mapped_streamfile.h"
+#include "test.h"
+
+using namespace SoLoud;
+
+static uint32_t stdio_opened = 0;
+
+STREAMFILE* open_stdio_streamfile(const char*)
+{
+	stdio_opened++;
+
+	return nullptr;
+}
+
+static void testBudget()
+{
+	const size_t limit = MAPPED_STREAMFILE_MAX_TOTAL;
+	MappedBudget budget(limit);
+	std::atomic<size_t> held = 0;
+	std::atomic<size_t> peak = 0;
+	std::vector<std::thread> threads;
+
+	CHECK(!budget.reserve(limit + 1));
+	CHECK(budget.reserve(limit));
+	CHECK(!budget.reserve(1));
+	budget.release(limit);
+	CHECK(budget.getUsed() == 0);
+
+	// The game thread and the music loader opening files at the same time, many times over
+	for (uint32_t t = 0; t < 8; t++)
+	{
+		threads.emplace_back([&, t] {
+			std::mt19937 rng(t);
+
+			for (uint32_t i = 0; i < 20000; i++)
+			{
+				size_t size = 1 + rng() % MAPPED_STREAMFILE_MAX_SIZE;
+
+				if (!budget.reserve(size)) continue;
+
+				size_t now = held += size;
+				size_t previous = peak;
+
+				while (now > previous && !peak.compare_exchange_weak(previous, now));
+
+				// Keep it a little, so that reservations overlap
+				std::this_thread::yield();
+
+				held -= size;
+				budget.release(size);
+			}
+		});
+	}
+
+	for (auto &thread : threads) thread.join();
+
+	CHECK(peak <= limit);
+	CHECK(budget.getUsed() == 0);
+}
+
+// Pages of simulated files, brought in memory either by prefetch requests served by a disk, or by page faults.
+// Time is simulated in microseconds, so the outcome does not depend on the load of the machine running the test.
+#define PAGE_SIZE (64 * 1024)
+#define STREAMS 16
+#define FILE_SIZE (4 * 1024 * 1024)
+#define CHUNK_SIZE (16 * 1024)
+#define CHUNK_PERIOD_US 1000
+// Far more than the streams consume together, but not instant
+#define DISK_BYTES_PER_US 2048
+
+class SimulatedDisk
+{
+private:
+	uint64_t busyUntil = 0;
+	// Time at which each page of each stream is in memory
+	std::vector<std::vector<uint64_t>> residentAt;
+
+public:
+	SimulatedDisk() : residentAt(STREAMS, std::vector<uint64_t>(FILE_SIZE / PAGE_SIZE, UINT64_MAX)) {}
+
+	// Same clamping as mapped_read_ahead, requests are served one after the other
+	void prefetch(uint32_t stream, size_t offset, size_t length, uint64_t now)
+	{
+		if (offset >= FILE_SIZE) return;
+
+		length = std::min<size_t>(length, FILE_SIZE - offset);
+		busyUntil = std::max(busyUntil, now) + length / DISK_BYTES_PER_US;
+
+		for (size_t page = offset / PAGE_SIZE; page * PAGE_SIZE < offset + length; page++) residentAt[stream][page] = std::min(residentAt[stream][page], busyUntil);
+	}
+
+	// Returns whether the read had to wait for the disk
+	bool read(uint32_t stream, size_t offset, size_t length, uint64_t now)
+	{
+		bool missing = false;
+
+		for (size_t page = offset / PAGE_SIZE; page * PAGE_SIZE < offset + length; page++)
+		{
+			if (residentAt[stream][page] > now) missing = true;
+
+			residentAt[stream][page] = std::min(residentAt[stream][page], now);
+		}
+
+		return missing;
+	}
+};
+
+// Decoders reading their file at a steady pace, then looping back to the first quarter once
+static uint32_t runStreams(bool readAhead, uint32_t &reads, uint32_t &steadyUnderruns)
+{
+	SimulatedDisk disk;
+	std::vector<MappedReadAhead> windows(STREAMS);
+	uint32_t underruns = 0;
+	uint64_t now = 0;
+
+	reads = 0;
+	steadyUnderruns = 0;
+
+	for (uint32_t stream = 0; stream < STREAMS; stream++)
+	{
+		windows[stream].open([&](size_t aOffset, size_t aLength) { if (readAhead) disk.prefetch(stream, aOffset, aLength, now); });
+	}
+
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		for (size_t offset = pass == 0 ? 0 : FILE_SIZE / 4; offset < FILE_SIZE; offset += CHUNK_SIZE)
+		{
+			for (uint32_t stream = 0; stream < STREAMS; stream++)
+			{
+				windows[stream].read(offset, offset + CHUNK_SIZE, [&](size_t aOffset, size_t aLength) { if (readAhead) disk.prefetch(stream, aOffset, aLength, now); });
+
+				if (disk.read(stream, offset, CHUNK_SIZE, now))
+				{
+					underruns++;
+
+					// Past the first window, which all streams request at the same time when opened
+					if (offset >= 2 * MAPPED_STREAMFILE_READ_AHEAD) steadyUnderruns++;
+				}
+
+				reads++;
+			}
+
+			now += CHUNK_PERIOD_US;
+		}
+	}
+
+	return underruns;
+}
+
+static void testReadAheadUnderruns()
+{
+	uint32_t reads = 0, steadyWithout = 0, steadyWith = 0;
+	uint32_t withoutReadAhead = runStreams(false, reads, steadyWithout);
+	uint32_t withReadAhead = runStreams(true, reads, steadyWith);
+
+	printf("%u streams, %u reads: %u underruns without read-ahead, %u with read-ahead ( %u past the first window )\n", STREAMS, reads, withoutReadAhead, withReadAhead, steadyWith);
+
+	// Every page is missed once without read-ahead
+	CHECK(withoutReadAhead == STREAMS * (FILE_SIZE / PAGE_SIZE));
+	// Only the first reads may race the initial prefetch, once the windows are running a whole window of slack is kept
+	CHECK(withReadAhead < STREAMS * (2 * MAPPED_STREAMFILE_READ_AHEAD / PAGE_SIZE));
+	CHECK(steadyWith == 0);
+}
+
+static void testWindow()
+{
+	MappedReadAhead window;
+	std::vector<std::pair<size_t, size_t>> requests;
+	auto prefetch = [&](size_t aOffset, size_t aLength) { requests.push_back({ aOffset, aLength }); };
+
+	window.open(prefetch);
+	CHECK(requests.size() == 1 && requests[0].first == 0 && requests[0].second == 2 * MAPPED_STREAMFILE_READ_AHEAD);
+
+	// Inside the first window, nothing to do
+	window.read(0, MAPPED_STREAMFILE_READ_AHEAD - 1, prefetch);
+	CHECK(requests.size() == 1);
+
+	// Less than one window left, the next one is requested once
+	window.read(MAPPED_STREAMFILE_READ_AHEAD, MAPPED_STREAMFILE_READ_AHEAD + 16, prefetch);
+	window.read(MAPPED_STREAMFILE_READ_AHEAD + 16, MAPPED_STREAMFILE_READ_AHEAD + 32, prefetch);
+	CHECK(requests.size() == 2 && requests[1].first == 2 * MAPPED_STREAMFILE_READ_AHEAD && requests[1].second == MAPPED_STREAMFILE_READ_AHEAD);
+
+	// Seeking past the window, or before it, restarts it
+	window.read(10 * MAPPED_STREAMFILE_READ_AHEAD, 10 * MAPPED_STREAMFILE_READ_AHEAD + 1, prefetch);
+	CHECK(window.mStart == 10 * MAPPED_STREAMFILE_READ_AHEAD && window.mEnd == 12 * MAPPED_STREAMFILE_READ_AHEAD);
+	CHECK(requests.size() == 3 && requests[2].first == 10 * MAPPED_STREAMFILE_READ_AHEAD && requests[2].second == 2 * MAPPED_STREAMFILE_READ_AHEAD);
+
+	window.read(100, 200, prefetch);
+	CHECK(window.mStart == 100 && window.mEnd == 100 + 2 * MAPPED_STREAMFILE_READ_AHEAD);
+	CHECK(requests.size() == 4 && requests[3].first == 100);
+}
+
+// Not a multiple of the window nor of a page, so the last read is a short one
+#define REAL_FILE_SIZE (3 * MAPPED_STREAMFILE_READ_AHEAD + 12345)
+
+static std::vector<uint8_t> writeFile(const std::filesystem::path &path, size_t size, uint32_t seed)
+{
+	std::vector<uint8_t> data(size);
+	std::mt19937 rng(seed);
+
+	for (uint8_t &byte : data) byte = uint8_t(rng());
+
+	std::ofstream(path, std::ios::binary).write((const char*)data.data(), data.size());
+
+	return data;
+}
+
+static bool readMatches(STREAMFILE* sf, const std::vector<uint8_t> &expected, size_t offset, size_t length)
+{
+	std::vector<uint8_t> buffer(length + 1, 0xCD);
+	size_t available = offset < expected.size() ? std::min(length, expected.size() - offset) : 0;
+
+	if (sf->read(sf, buffer.data(), offv_t(offset), length) != available) return false;
+
+	// Nothing is written past what was read
+	return std::equal(buffer.begin(), buffer.begin() + available, expected.begin() + std::min(offset, expected.size())) && buffer[available] == 0xCD;
+}
+
+static void testStreamFile()
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "ffnx_mapped_streamfile_test.bin";
+	std::filesystem::path otherPath = std::filesystem::temp_directory_path() / "ffnx_mapped_streamfile_test_other.bin";
+	std::filesystem::path emptyPath = std::filesystem::temp_directory_path() / "ffnx_mapped_streamfile_test_empty.bin";
+	std::vector<uint8_t> expected = writeFile(path, REAL_FILE_SIZE, 1);
+	std::vector<uint8_t> otherExpected = writeFile(otherPath, 4096, 2);
+	writeFile(emptyPath, 0, 3);
+
+	STREAMFILE* sf = open_mapped_streamfile(path.string().c_str());
+
+	CHECK(sf != nullptr && stdio_opened == 0);
+	if (sf == nullptr) return;
+
+	CHECK(sf->get_size(sf) == REAL_FILE_SIZE);
+
+	char name[8];
+	sf->get_name(sf, name, sizeof(name));
+	CHECK(strlen(name) == sizeof(name) - 1 && path.string().compare(0, sizeof(name) - 1, name) == 0);
+
+	// Sequential reads crossing page and window boundaries
+	for (size_t offset = 0; offset < REAL_FILE_SIZE; offset += 4093) CHECK(readMatches(sf, expected, offset, 4093));
+
+	// Right around the boundaries
+	for (size_t boundary : { size_t(4096), size_t(PAGE_SIZE), size_t(MAPPED_STREAMFILE_READ_AHEAD), size_t(2 * MAPPED_STREAMFILE_READ_AHEAD), size_t(3 * MAPPED_STREAMFILE_READ_AHEAD) })
+	{
+		CHECK(readMatches(sf, expected, boundary - 1, 2));
+		CHECK(readMatches(sf, expected, boundary - 100, 200));
+		CHECK(readMatches(sf, expected, boundary, 1));
+	}
+
+	// Seeks in any direction
+	std::mt19937 rng(4);
+
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		size_t offset = rng() % REAL_FILE_SIZE;
+
+		CHECK(readMatches(sf, expected, offset, rng() % (2 * MAPPED_STREAMFILE_READ_AHEAD)));
+	}
+
+	// End of file
+	uint8_t byte = 0;
+	CHECK(readMatches(sf, expected, REAL_FILE_SIZE - 10, 100));
+	CHECK(readMatches(sf, expected, REAL_FILE_SIZE - 10, 11));
+	CHECK(readMatches(sf, expected, REAL_FILE_SIZE - 1, 1));
+	CHECK(sf->read(sf, &byte, REAL_FILE_SIZE, 1) == 0);
+	CHECK(sf->read(sf, &byte, -1, 1) == 0);
+	CHECK(sf->read(sf, nullptr, 0, 1) == 0);
+
+	// Reopening the same file shares the mapping, which outlives the first streamfile
+	STREAMFILE* reopened = sf->open(sf, path.string().c_str(), 0);
+	CHECK(reopened != nullptr && reopened != sf && stdio_opened == 0);
+
+	// Other files get their own
+	STREAMFILE* other = sf->open(sf, otherPath.string().c_str(), 0);
+	CHECK(other != nullptr && stdio_opened == 0);
+
+	sf->close(sf);
+
+	if (reopened != nullptr)
+	{
+		CHECK(reopened->get_size(reopened) == REAL_FILE_SIZE);
+		CHECK(readMatches(reopened, expected, 0, REAL_FILE_SIZE));
+		reopened->close(reopened);
+	}
+
+	if (other != nullptr)
+	{
+		CHECK(other->get_size(other) == otherExpected.size());
+		CHECK(readMatches(other, otherExpected, 0, 8192));
+		other->close(other);
+	}
+
+	// Files which cannot be mapped go through stdio
+	CHECK(open_mapped_streamfile(emptyPath.string().c_str()) == nullptr && stdio_opened == 1);
+	CHECK(open_mapped_streamfile((path.string() + ".missing").c_str()) == nullptr && stdio_opened == 2);
+
+	std::filesystem::remove(path);
+	std::filesystem::remove(otherPath);
+	std::filesystem::remove(emptyPath);
+}
+
+int main()
+{
+	testBudget();
+	testWindow();
+	testReadAheadUnderruns();
+	testStreamFile();
+
+	return test_result();
+}
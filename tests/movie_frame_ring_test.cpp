@@ -0,0 +1,274 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "video/movie_frame_ring.h"
+#include "test.h"
+
+// A tiny BGRA clip, every byte of a frame holds its number
+#define WIDTH 16
+#define HEIGHT 8
+#define FRAMES 40
+
+static const int bgraStrides[3] = { WIDTH * 4, 0, 0 };
+static const uint32_t heights[3] = { HEIGHT, HEIGHT / 2, HEIGHT / 2 };
+
+static bool holds(struct frame_buffer *buffer, uint32_t size, uint32_t number)
+{
+	for (uint32_t i = 0; i < size; i++) if (buffer->data[i] != uint8_t(number)) return false;
+
+	return true;
+}
+
+// Stands for the decoder thread of movies.cpp
+class Decoder
+{
+private:
+	MovieFrameRing &ring;
+	std::thread thread;
+
+public:
+	std::atomic<uint32_t> written = 0;
+	std::atomic<bool> waiting = false;
+
+	Decoder(MovieFrameRing &ring, uint32_t first = 0) : ring(ring)
+	{
+		ring.start();
+
+		thread = std::thread([this, first] {
+			for (uint32_t number = first; number < FRAMES; number++)
+			{
+				waiting = true;
+				struct decoded_frame *frame = this->ring.beginWrite();
+				waiting = false;
+
+				if (!frame) return;
+
+				memset(frame->planes[0], number, this->ring.getFrameSize());
+
+				this->ring.endWrite();
+				written++;
+			}
+
+			this->ring.finish();
+		});
+	}
+
+	// Blocked on a full ring after writing exactly that many frames, false if it wrote past them
+	bool waitBlocked(uint32_t frames)
+	{
+		while (!(waiting && written == frames))
+		{
+			if (written > frames) return false;
+
+			std::this_thread::yield();
+		}
+
+		return true;
+	}
+
+	void stop()
+	{
+		ring.stop();
+		thread.join();
+		ring.discard();
+	}
+
+	void join()
+	{
+		thread.join();
+	}
+};
+
+static void testLayout()
+{
+	MovieFrameRing ring;
+	const int yuvStrides[3] = { WIDTH, WIDTH / 2, WIDTH / 2 };
+
+	ring.alloc(yuvStrides, heights);
+
+	struct decoded_frame *frame = ring.scratch();
+
+	CHECK(ring.getFrameSize() == WIDTH * HEIGHT * 3 / 2);
+	CHECK(frame->planes[1] == frame->planes[0] + WIDTH * HEIGHT);
+	CHECK(frame->planes[2] == frame->planes[1] + WIDTH * HEIGHT / 4);
+	CHECK(frame->strides[0] == WIDTH && frame->strides[1] == WIDTH / 2 && frame->strides[2] == WIDTH / 2);
+
+	ring.release();
+	CHECK(ring.getFrameSize() == 0);
+}
+
+// Plays the clip while the renderer keeps references on the frames it is uploading
+static void testPlayback()
+{
+	MovieFrameRing ring;
+	std::vector<struct frame_buffer *> uploads;
+	uint32_t played = 0;
+
+	ring.alloc(bgraStrides, heights);
+
+	Decoder decoder(ring);
+	const uint32_t size = ring.getFrameSize();
+
+	// Every slot is being uploaded, the decoder must wait instead of overwriting any of them
+	for (; played < DECODE_RING_SIZE; played++)
+	{
+		struct decoded_frame *frame = ring.peek();
+
+		CHECK(frame != nullptr && holds(frame->buffer, size, played));
+		if (frame == nullptr) return;
+
+		frame->buffer->refs++;
+		uploads.push_back(frame->buffer);
+		ring.pop();
+	}
+
+	CHECK(decoder.waitBlocked(DECODE_RING_SIZE));
+
+	for (uint32_t i = 0; i < uploads.size(); i++) CHECK(holds(uploads[i], size, i));
+
+	// Uploads complete, out of order
+	for (int32_t i = uploads.size() - 1; i >= 0; i--) MovieFrameRing::release_callback(nullptr, uploads[i]);
+
+	uploads.clear();
+
+	// Then the usual two frames of GPU latency
+	std::deque<std::pair<struct frame_buffer *, uint32_t>> pending;
+
+	while (struct decoded_frame *frame = ring.peek())
+	{
+		CHECK(holds(frame->buffer, size, played));
+
+		frame->buffer->refs++;
+		pending.push_back({ frame->buffer, played });
+		ring.pop();
+		played++;
+
+		if (pending.size() > 2)
+		{
+			CHECK(holds(pending.front().first, size, pending.front().second));
+			MovieFrameRing::release_callback(nullptr, pending.front().first);
+			pending.pop_front();
+		}
+	}
+
+	CHECK(played == FRAMES);
+
+	// The end of the movie stays signaled
+	CHECK(ring.peek() == nullptr);
+	CHECK(ring.peek() == nullptr);
+
+	decoder.join();
+
+	for (auto &upload : pending) MovieFrameRing::release_callback(nullptr, upload.first);
+
+	ring.release();
+}
+
+// Looping stops the decoder while it waits for room, then starts it again from another frame
+static void testLoop()
+{
+	MovieFrameRing ring;
+
+	ring.alloc(bgraStrides, heights);
+
+	{
+		Decoder decoder(ring);
+
+		CHECK(decoder.waitBlocked(DECODE_RING_SIZE));
+		decoder.stop();
+	}
+
+	// Frames decoded ahead were dropped, the whole ring is free again
+	{
+		Decoder decoder(ring, 10);
+
+		CHECK(decoder.waitBlocked(DECODE_RING_SIZE));
+
+		struct decoded_frame *frame = ring.peek();
+
+		CHECK(frame != nullptr && holds(frame->buffer, ring.getFrameSize(), 10));
+		if (frame == nullptr) return;
+
+		// Still being uploaded when the movie loops again
+		struct frame_buffer *upload = frame->buffer;
+
+		upload->refs++;
+		ring.pop();
+
+		decoder.stop();
+
+		Decoder again(ring, 20);
+
+		// The decoder writes slots in order and its next one is still being uploaded, nothing can be decoded until it is done
+		CHECK(again.waitBlocked(0));
+		CHECK(holds(upload, ring.getFrameSize(), 10));
+
+		MovieFrameRing::release_callback(nullptr, upload);
+
+		CHECK(again.waitBlocked(DECODE_RING_SIZE));
+		again.stop();
+	}
+
+	ring.release();
+}
+
+// Uploads may outlive the movie, the last reference frees the buffer
+static void testReleaseWhileUploading()
+{
+	MovieFrameRing ring;
+
+	ring.alloc(bgraStrides, heights);
+
+	Decoder decoder(ring);
+
+	struct decoded_frame *frame = ring.peek();
+
+	CHECK(frame != nullptr);
+	if (frame == nullptr) return;
+
+	struct frame_buffer *upload = frame->buffer;
+
+	upload->refs++;
+	ring.pop();
+
+	decoder.stop();
+	ring.release();
+
+	CHECK(upload->ring == nullptr && upload->refs == 1);
+
+	MovieFrameRing::release_callback(nullptr, upload);
+}
+
+int main()
+{
+	testLayout();
+	testPlayback();
+	testLoop();
+	testReleaseWhileUploading();
+
+	return test_result();
+}
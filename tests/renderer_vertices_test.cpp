@@ -0,0 +1,202 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "renderer_vertices.h"
+#include "test.h"
+
+// Same layouts as in common_imports.h, matrix.h and renderer.h, which cannot be built outside of Windows
+
+template <typename T>
+struct vector3
+{
+	T x;
+	T y;
+	T z;
+};
+
+struct nvertex
+{
+	vector3<float> _;
+
+	union
+	{
+		struct
+		{
+			float w;
+			uint32_t color;
+			uint32_t specular;
+		} color;
+
+		vector3<float> normal;
+	};
+
+	float u;
+	float v;
+};
+
+struct Vertex
+{
+	float x;
+	float y;
+	float z;
+	float w;
+	uint32_t bgra;
+	float u;
+	float v;
+	float nx;
+	float ny;
+	float nz;
+};
+
+static float bits(uint32_t value)
+{
+	float ret;
+
+	memcpy(&ret, &value, sizeof(ret));
+
+	return ret;
+}
+
+// A TL stream as sent by the field and menu modules, followed by every W the engine can produce
+static std::vector<nvertex> recordedStream()
+{
+	std::vector<nvertex> ret = {
+		{ { 12.0f, 240.0f, 0.9990234f }, { { 1.0009775f, 0x80FFFFFF, 0xFF000000 } }, 0.0f, 0.0f },
+		{ { 332.0f, 240.0f, 0.9990234f }, { { 1.0009775f, 0x80FFFFFF, 0xFF000000 } }, 1.0f, 0.0f },
+		{ { 12.0f, 480.0f, 0.9990234f }, { { 1.0009775f, 0x80FFFFFF, 0xFF000000 } }, 0.0f, 1.0f },
+		{ { -3.5f, 17.25f, 0.5f }, { { std::numeric_limits<float>::infinity(), 0xFF102030, 0x00000000 } }, 0.25f, 0.75f },
+		{ { 1.0f, 2.0f, 3.0f }, { { -std::numeric_limits<float>::infinity(), 0x00000000, 0x12345678 } }, -1.0f, 2.0f },
+		{ { 4.0f, 5.0f, 6.0f }, { { std::numeric_limits<float>::quiet_NaN(), 0xDEADBEEF, 0xFFFFFFFF } }, 0.5f, 0.5f },
+		{ { 0.0f, -0.0f, 1e-40f }, { { bits(0x7F7FFFFF), 0x01020304, 0x0 } }, 1e30f, -1e-30f },
+		{ { 7.0f, 8.0f, 9.0f }, { { 0.0f, 0x7F800000, 0x7F800000 } }, 0.0f, 0.0f },
+	};
+
+	std::mt19937 rng(42);
+
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		nvertex vertex;
+
+		// Any bit pattern, the conversion must not interpret anything but W
+		uint32_t random[8];
+
+		for (uint32_t &value : random) value = rng();
+
+		memcpy(&vertex, random, sizeof(vertex));
+		ret.push_back(vertex);
+	}
+
+	return ret;
+}
+
+static std::vector<vector3<float>> normalsFor(size_t count)
+{
+	std::vector<vector3<float>> ret(count);
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	for (auto &normal : ret) normal = { dist(rng), dist(rng), dist(rng) };
+
+	return ret;
+}
+
+static void testSemantics()
+{
+	std::vector<nvertex> in = recordedStream();
+	std::vector<Vertex> out(in.size());
+
+	RendererConvertVerticesScalar(out.data(), in.data(), (const vector3<float>*)nullptr, 8);
+
+	CHECK(out[0].x == 12.0f && out[0].y == 240.0f && out[0].z == 0.9990234f && out[0].w == 1.0009775f);
+	CHECK(out[0].bgra == 0x80FFFFFF && out[1].u == 1.0f && out[2].v == 1.0f);
+	CHECK(out[0].nx == 0.0f && out[0].ny == 0.0f && out[0].nz == 0.0f);
+	CHECK(out[3].w == 1.0f);
+	CHECK(out[4].w == 1.0f);
+	CHECK(std::isnan(out[5].w));
+	CHECK(out[6].w == bits(0x7F7FFFFF));
+	// The specular color is not uploaded
+	CHECK(out[4].bgra == 0 && out[7].bgra == 0x7F800000 && out[7].nx == 0.0f);
+}
+
+static void testSse2MatchesScalar()
+{
+	std::vector<nvertex> in = recordedStream();
+	std::vector<vector3<float>> normals = normalsFor(in.size());
+
+	for (const vector3<float> *n : { (const vector3<float>*)nullptr, (const vector3<float>*)normals.data() })
+	{
+		// Every count up to a few vertices, then the whole stream
+		for (size_t count : { size_t(0), size_t(1), size_t(2), size_t(3), size_t(4), size_t(5), size_t(7), size_t(8), in.size() })
+		{
+			// Garbage in the output, every byte must be written
+			std::vector<Vertex> expected(count + 1), actual(count + 1);
+
+			memset(expected.data(), 0xCD, expected.size() * sizeof(Vertex));
+			memset(actual.data(), 0xCD, actual.size() * sizeof(Vertex));
+
+			RendererConvertVerticesScalar(expected.data(), in.data(), n, uint32_t(count));
+			RendererConvertVertices(actual.data(), in.data(), n, uint32_t(count));
+
+			CHECK(memcmp(expected.data(), actual.data(), actual.size() * sizeof(Vertex)) == 0);
+		}
+	}
+}
+
+template<typename Convert>
+static double throughput(Convert convert)
+{
+	std::vector<nvertex> in(100000);
+	std::vector<Vertex> out(in.size());
+	std::vector<nvertex> recorded = recordedStream();
+
+	for (size_t i = 0; i < in.size(); i++) in[i] = recorded[i % 8];
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < 200; i++) convert(out.data(), in.data(), uint32_t(in.size()));
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return double(in.size()) * sizeof(nvertex) * 200 / elapsed.count() / (1024 * 1024);
+}
+
+int main()
+{
+	testSemantics();
+	testSse2MatchesScalar();
+
+#ifdef RENDERER_SSE2
+	printf("SSE2: %.0f MB/s\n", throughput([](Vertex* out, const nvertex* in, uint32_t count) { RendererConvertVertices(out, in, (const vector3<float>*)nullptr, count); }));
+#else
+	printf("SSE2 is not available, only the scalar conversion is checked\n");
+#endif
+	printf("Scalar: %.0f MB/s\n", throughput([](Vertex* out, const nvertex* in, uint32_t count) { RendererConvertVerticesScalar(out, in, (const vector3<float>*)nullptr, count); }));
+
+	return test_result();
+}
@@ -0,0 +1,275 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <bimg/decode.h>
+#include <bx/allocator.h>
+
+#include "texture_encoder.h"
+#include "test.h"
+
+// Taller than a stripe of block rows, so the last one is a partial stripe
+#define WIDTH 96
+#define HEIGHT (TEXTURE_ENCODER_STRIPE_ROWS * 4 + 8)
+
+static bx::DefaultAllocator allocator;
+
+// Smooth color and alpha gradients, like most textures are made of
+static bimg::ImageContainer* makeColorImage()
+{
+	bimg::ImageContainer* img = bimg::imageAlloc(&allocator, bimg::TextureFormat::RGBA8, WIDTH, HEIGHT, 1, 1, false, false);
+	uint8_t* pixels = (uint8_t*)img->m_data;
+
+	for (uint32_t y = 0; y < HEIGHT; y++)
+	{
+		for (uint32_t x = 0; x < WIDTH; x++)
+		{
+			uint8_t* pixel = pixels + (y * WIDTH + x) * 4;
+
+			pixel[0] = uint8_t(x * 255 / (WIDTH - 1));
+			pixel[1] = uint8_t(y * 255 / (HEIGHT - 1));
+			pixel[2] = uint8_t(128 + 100 * sinf(float(x + y) / 16.0f));
+			pixel[3] = uint8_t(255 - y * 128 / (HEIGHT - 1));
+		}
+	}
+
+	return img;
+}
+
+// Unit normals of a bumpy surface, X and Y stored in red and green
+static bimg::ImageContainer* makeNormalImage()
+{
+	bimg::ImageContainer* img = bimg::imageAlloc(&allocator, bimg::TextureFormat::RGBA8, WIDTH, HEIGHT, 1, 1, false, false);
+	uint8_t* pixels = (uint8_t*)img->m_data;
+
+	for (uint32_t y = 0; y < HEIGHT; y++)
+	{
+		for (uint32_t x = 0; x < WIDTH; x++)
+		{
+			uint8_t* pixel = pixels + (y * WIDTH + x) * 4;
+			float nx = 0.5f * sinf(float(x) / 12.0f), ny = 0.5f * cosf(float(y) / 10.0f);
+			float nz = sqrtf(1.0f - nx * nx - ny * ny);
+
+			pixel[0] = uint8_t((nx + 1.0f) * 127.5f);
+			pixel[1] = uint8_t((ny + 1.0f) * 127.5f);
+			pixel[2] = uint8_t((nz + 1.0f) * 127.5f);
+			pixel[3] = 255;
+		}
+	}
+
+	return img;
+}
+
+// Decodes one BC4 block, BC5 is made of two of them: red, then green
+static void decodeBc4Block(const uint8_t* block, uint8_t values[16])
+{
+	uint32_t r0 = block[0], r1 = block[1];
+	uint64_t bits = 0;
+	uint32_t palette[8] = { r0, r1 };
+
+	for (uint32_t i = 0; i < 6; i++) bits |= uint64_t(block[2 + i]) << (8 * i);
+
+	if (r0 > r1)
+	{
+		for (uint32_t i = 2; i < 8; i++) palette[i] = ((8 - i) * r0 + (i - 1) * r1) / 7;
+	}
+	else
+	{
+		for (uint32_t i = 2; i < 6; i++) palette[i] = ((6 - i) * r0 + (i - 1) * r1) / 5;
+
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	for (uint32_t i = 0; i < 16; i++) values[i] = palette[(bits >> (3 * i)) & 7];
+}
+
+static std::vector<uint8_t> decodeBc5(const bimg::ImageContainer& img)
+{
+	std::vector<uint8_t> rgba(img.m_width * img.m_height * 4, 0);
+	const uint8_t* block = (const uint8_t*)img.m_data;
+
+	for (uint32_t blockY = 0; blockY < img.m_height / 4; blockY++)
+	{
+		for (uint32_t blockX = 0; blockX < img.m_width / 4; blockX++, block += 16)
+		{
+			uint8_t red[16], green[16];
+
+			decodeBc4Block(block, red);
+			decodeBc4Block(block + 8, green);
+
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				uint8_t* pixel = &rgba[((blockY * 4 + i / 4) * img.m_width + blockX * 4 + i % 4) * 4];
+
+				pixel[0] = red[i];
+				pixel[1] = green[i];
+			}
+		}
+	}
+
+	return rgba;
+}
+
+// Largest and average difference over the given channels
+static void compare(const uint8_t* expected, const uint8_t* actual, uint32_t channels, uint32_t &maxError, double &averageError)
+{
+	uint64_t total = 0;
+
+	maxError = 0;
+
+	for (uint32_t i = 0; i < WIDTH * HEIGHT; i++)
+	{
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			uint32_t error = abs(int(expected[i * 4 + c]) - int(actual[i * 4 + c]));
+
+			maxError = std::max(maxError, error);
+			total += error;
+		}
+	}
+
+	averageError = double(total) / double(WIDTH * HEIGHT * channels);
+}
+
+// Encodes, goes through a DDS file, and returns what was read back
+static bimg::ImageContainer* roundTrip(const bimg::ImageContainer& source, bimg::TextureFormat::Enum format, std::vector<uint8_t> &file)
+{
+	std::atomic<bool> running = true;
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "ffnx_texture_encoder_test.dds";
+	bimg::ImageContainer* encoded = texture_encode(&allocator, source, format, running);
+
+	CHECK(encoded != nullptr);
+	if (encoded == nullptr) return nullptr;
+
+	CHECK(encoded->m_format == format && encoded->m_width == WIDTH && encoded->m_height == HEIGHT);
+	CHECK(texture_write_dds(*encoded, path.string()));
+	CHECK(!std::filesystem::exists(path.string() + ".tmp"));
+
+	bimg::imageFree(encoded);
+
+	std::ifstream stream(path, std::ios::binary);
+	file.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	stream.close();
+
+	std::filesystem::remove(path);
+
+	bimg::ImageContainer* parsed = bimg::imageParse(&allocator, file.data(), file.size());
+
+	CHECK(parsed != nullptr);
+	if (parsed == nullptr) return nullptr;
+
+	CHECK(parsed->m_format == format && parsed->m_width == WIDTH && parsed->m_height == HEIGHT && parsed->m_numMips == 1 && !parsed->m_cubeMap);
+
+	return parsed;
+}
+
+static void testBc7()
+{
+	bimg::ImageContainer* source = makeColorImage();
+	std::vector<uint8_t> file;
+	bimg::ImageContainer* parsed = roundTrip(*source, bimg::TextureFormat::BC7, file);
+
+	if (parsed != nullptr)
+	{
+		std::vector<uint8_t> decoded(WIDTH * HEIGHT * 4);
+		uint32_t maxError;
+		double averageError;
+
+		bimg::imageDecodeToRgba8(&allocator, decoded.data(), parsed->m_data, WIDTH, HEIGHT, WIDTH * 4, bimg::TextureFormat::BC7);
+		compare((const uint8_t*)source->m_data, decoded.data(), 4, maxError, averageError);
+
+		printf("BC7: max error %u, average error %.2f\n", maxError, averageError);
+
+		CHECK(maxError <= 16);
+		CHECK(averageError < 2.0);
+
+		bimg::imageFree(parsed);
+	}
+
+	bimg::imageFree(source);
+}
+
+static void testBc5()
+{
+	bimg::ImageContainer* source = makeNormalImage();
+	std::vector<uint8_t> file;
+	bimg::ImageContainer* parsed = roundTrip(*source, bimg::TextureFormat::BC5, file);
+
+	if (parsed != nullptr)
+	{
+		std::vector<uint8_t> decoded = decodeBc5(*parsed);
+		uint32_t maxError;
+		double averageError;
+
+		// Only X and Y are stored, Z is rebuilt in the shader
+		compare((const uint8_t*)source->m_data, decoded.data(), 2, maxError, averageError);
+
+		printf("BC5: max error %u, average error %.2f\n", maxError, averageError);
+
+		CHECK(maxError <= 8);
+		CHECK(averageError < 2.0);
+
+		bimg::imageFree(parsed);
+	}
+
+	bimg::imageFree(source);
+}
+
+static void testRejected()
+{
+	std::atomic<bool> running = true;
+	bimg::ImageContainer* source = makeColorImage();
+
+	// Not whole blocks
+	bimg::ImageContainer* odd = bimg::imageAlloc(&allocator, bimg::TextureFormat::RGBA8, WIDTH - 2, HEIGHT, 1, 1, false, false);
+	CHECK(texture_encode(&allocator, *odd, bimg::TextureFormat::BC7, running) == nullptr);
+	bimg::imageFree(odd);
+
+	// Not RGBA8
+	bimg::ImageContainer* bgra = bimg::imageAlloc(&allocator, bimg::TextureFormat::BGRA8, WIDTH, HEIGHT, 1, 1, false, false);
+	CHECK(texture_encode(&allocator, *bgra, bimg::TextureFormat::BC7, running) == nullptr);
+	bimg::imageFree(bgra);
+
+	// Shutting down
+	running = false;
+	CHECK(texture_encode(&allocator, *source, bimg::TextureFormat::BC7, running) == nullptr);
+
+	bimg::imageFree(source);
+}
+
+int main()
+{
+	testBc7();
+	testBc5();
+	testRejected();
+
+	return test_result();
+}
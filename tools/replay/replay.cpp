@@ -0,0 +1,319 @@
+/****************************************************************************/
+//    Copyright (C) 2009 Aali132                                            //
+//    Copyright (C) 2018 quantumpencil                                      //
+//    Copyright (C) 2018 Maxime Bacoux                                      //
+//    Copyright (C) 2020 myst6re                                            //
+//    Copyright (C) 2020 Chris Rizzitello                                   //
+//    Copyright (C) 2020 John Pritchard                                     //
+//    Copyright (C) 2022 Julian Xhokaxhiu                                   //
+//                                                                          //
+//    This file is part of FFNx                                             //
+//                                                                          //
+//    FFNx is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU General Public License as published by  //
+//    the Free Software Foundation, either version 3 of the License         //
+//                                                                          //
+//    FFNx is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+//    GNU General Public License for more details.                          //
+/****************************************************************************/
+
+#include <algorithm>
+#include <filesystem>
+#include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "cfg.h"
+#include "globals.h"
+#include "log.h"
+#include "renderer.h"
+#include "draw_capture_replay.h"
+
+/*
+ * Headless replay of a draw capture made with DrawCapture.
+ *
+ * The captured calls are fed to the Renderer on bgfx's Noop backend, nothing is drawn but the renderer does all of its
+ * CPU work, which is timed per frame. Run it from the game directory, FFNx.toml and the shaders are read from there:
+ *
+ *   FFNxReplay drawcapture_1234.bin [loops]
+ *
+ * The replay goes through the same Renderer calls as gl_draw_indexed_primitive and internal_set_renderstate, keep them in sync.
+ * What the driver decides from the game state is not captured: special cases, deferred draws and lighting.
+ */
+
+// Feeds the replayed calls to the Renderer, keeping the part of the gl_* state which the Renderer does not keep
+struct RendererTarget
+{
+	bool isFF8 = false;
+	bool textureFilter = false;
+	bool shadeMode = false;
+	bool fbTexture = false;
+	uint32_t alphaFunc = 0;
+	uint32_t alphaRef = 0;
+	struct matrix d3dProjection = {};
+	struct matrix d3dViewport = {};
+	// Over the timed frames
+	uint64_t submits = 0;
+	uint64_t mergedDraws = 0;
+
+	uint32_t createTexture(uint32_t captured, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t format)
+	{
+		uint32_t ret = 0;
+
+		// Textures which went to the atlas during the capture go to the atlas again
+		if (TextureAtlas::isAtlasHandle(uint16_t(captured)) && format == RendererTextureType::BGRA)
+			ret = textureAtlas.add((const uint32_t*)pixels, width, height);
+
+		if (!ret) ret = newRenderer.createTexture((uint8_t*)pixels, width, height, 0, RendererTextureType(format));
+
+		return ret;
+	}
+
+	void deleteTexture(uint32_t texture)
+	{
+		newRenderer.deleteTexture(texture);
+	}
+
+	void useTexture(uint32_t texture, bool fbTexture)
+	{
+		newRenderer.useTexture(texture);
+
+		this->fbTexture = fbTexture;
+	}
+
+	void renderState(uint32_t state, uint32_t option)
+	{
+		static const RendererAlphaFunc alphaFuncs[] = {
+			RendererAlphaFunc::NEVER, RendererAlphaFunc::ALWAYS, RendererAlphaFunc::LESS, RendererAlphaFunc::LEQUAL,
+			RendererAlphaFunc::EQUAL, RendererAlphaFunc::GEQUAL, RendererAlphaFunc::GREATER, RendererAlphaFunc::NOTEQUAL
+		};
+
+		switch (state)
+		{
+		case V_WIREFRAME:
+			newRenderer.setWireframeMode(option);
+			break;
+		// The game object can veto filtering, it is not captured
+		case V_LINEARFILTER:
+			textureFilter = option;
+			break;
+		case V_ALPHATEST:
+			newRenderer.doAlphaTest(option);
+			break;
+		case V_CULLFACE:
+			newRenderer.setCullMode(option ? RendererCullMode::FRONT : RendererCullMode::BACK);
+			break;
+		case V_NOCULL:
+			newRenderer.setCullMode(option ? RendererCullMode::DISABLED : RendererCullMode::BACK);
+			break;
+		case V_DEPTHTEST:
+			newRenderer.doDepthTest(option);
+			break;
+		case V_DEPTHMASK:
+			newRenderer.doDepthWrite(option);
+			break;
+		case V_ALPHAFUNC:
+		case V_ALPHAREF:
+			if (state == V_ALPHAFUNC) alphaFunc = option;
+			else alphaRef = option;
+
+			newRenderer.setAlphaRef(alphaFunc < 8 ? alphaFuncs[alphaFunc] : RendererAlphaFunc::LEQUAL, alphaRef / 255.0f);
+			break;
+		case V_SHADEMODE:
+			shadeMode = option;
+			break;
+		default:
+			break;
+		}
+	}
+
+	void blendMode(uint32_t mode)
+	{
+		newRenderer.setBlendMode(RendererBlendMode(mode));
+	}
+
+	void worldViewMatrix(const float* matrix)
+	{
+		struct matrix worldView;
+
+		memcpy(&worldView, matrix, sizeof(worldView));
+		newRenderer.setWorldViewMatrix(&worldView);
+	}
+
+	void d3dProjectionMatrix(const float* matrix)
+	{
+		memcpy(&d3dProjection, matrix, sizeof(d3dProjection));
+	}
+
+	void viewport(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* matrix)
+	{
+		newRenderer.setScissor(x, y, width, height);
+		memcpy(&d3dViewport, matrix, sizeof(d3dViewport));
+	}
+
+	void draw(uint32_t primitiveType, uint32_t vertexType, const uint8_t* vertices, const uint8_t* normals, uint32_t vertexCount, const uint8_t* indices, uint32_t count, uint32_t clip)
+	{
+		// The renderer only reads them
+		struct nvertex* inVertices = (struct nvertex*)vertices;
+		vector3<float>* inNormals = (vector3<float>*)normals;
+		WORD* inIndices = (WORD*)indices;
+
+		if (vertexType > TLVERTEX) return;
+
+		newRenderer.doScissorTest(clip);
+		newRenderer.setInterpolationQualifier(shadeMode ? RendererInterpolationQualifier::SMOOTH : RendererInterpolationQualifier::FLAT);
+		newRenderer.doTextureFiltering(textureFilter);
+
+		if (vertexType != TLVERTEX)
+		{
+			newRenderer.setD3DProjection(&d3dProjection);
+			newRenderer.setD3DViweport(&d3dViewport);
+		}
+
+		newRenderer.isTLVertex(vertexType == TLVERTEX);
+		newRenderer.isFBTexture(fbTexture);
+		newRenderer.doModulateAlpha(!isFF8);
+		newRenderer.setPrimitiveType(RendererPrimitiveType(primitiveType));
+
+		if (enable_draw_batching && vertexType == TLVERTEX && primitiveType == RendererPrimitiveType::PT_TRIANGLES)
+		{
+			newRenderer.drawBatched(inVertices, vertexCount, inIndices, count);
+		}
+		else
+		{
+			newRenderer.bindVertexBuffer(inVertices, inNormals, vertexCount);
+			newRenderer.bindIndexBuffer(inIndices, count);
+			newRenderer.draw();
+		}
+	}
+
+	void show(bool timed)
+	{
+		newRenderer.show();
+
+		if (timed)
+		{
+			submits += newRenderer.getSubmitCount();
+			mergedDraws += newRenderer.getMergedDrawCount();
+		}
+	}
+};
+
+static std::vector<uint8_t> readFile(const char* path)
+{
+	std::vector<uint8_t> ret;
+	FILE* file = fopen(path, "rb");
+
+	if (file == nullptr) return ret;
+
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	ret.resize(fileSize > 0 ? fileSize : 0);
+
+	if (fread(ret.data(), 1, ret.size(), file) != ret.size()) ret.clear();
+
+	fclose(file);
+
+	return ret;
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <draw capture> [loops]\n", argv[0]);
+		return 1;
+	}
+
+	uint32_t loops = argc > 2 ? std::max(1, atoi(argv[2])) : 10;
+	std::vector<uint8_t> buffer = readFile(argv[1]);
+	DrawCaptureStream stream;
+
+	if (!stream.parse(buffer.data(), buffer.size()))
+	{
+		fprintf(stderr, "%s is not a complete draw capture of version %u\n", argv[1], DRAW_CAPTURE_VERSION);
+		return 1;
+	}
+
+	// Frames are timed from the end of the previous one
+	if (stream.frames < 2)
+	{
+		fprintf(stderr, "%s needs at least two frames\n", argv[1]);
+		return 1;
+	}
+
+	strncpy(basedir, std::filesystem::current_path().string().c_str(), BASEDIR_LENGTH - 1);
+	open_applog("FFNxReplay.log");
+
+	ff8 = stream.isFF8;
+
+	read_cfg();
+
+	game_width = 640;
+	game_height = 480;
+
+	if (window_size_x == 0 || window_size_y == 0)
+	{
+		window_size_x = game_width;
+		window_size_y = game_height;
+	}
+
+	renderer_backend = RENDERER_BACKEND_NOOP;
+	// No window to draw the overlay on, and lighting needs the game state
+	enable_devtools = false;
+	enable_lighting = false;
+
+	newRenderer.init();
+
+	uint32_t missingPixels[4 * 4];
+
+	std::fill(std::begin(missingPixels), std::end(missingPixels), 0xFFFF00FF);
+
+	RendererTarget target;
+
+	target.isFF8 = stream.isFF8;
+
+	uint32_t missingTexture = newRenderer.createTexture((uint8_t*)missingPixels, 4, 4);
+	DrawCaptureReplay<RendererTarget> replay(target, stream, missingTexture);
+
+	replay.replay(loops);
+
+	std::vector<double> frameTimes = loops > 1 ? replay.frameTimes : replay.firstLoopTimes;
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+
+	double total = 0.0;
+
+	for (double time : frameTimes) total += time;
+
+	double firstLoopTotal = 0.0;
+
+	for (double time : replay.firstLoopTimes) firstLoopTotal += time;
+
+	uint32_t timedFrames = loops * (stream.frames - 1);
+
+	printf("%s: %s, %u frames and %u draws replayed %u times\n", argv[1], stream.isFF8 ? "FF8" : "FF7", stream.frames - 1, replay.draws, loops);
+	printf("CPU time per frame: mean %.3f ms, median %.3f ms, p95 %.3f ms, max %.3f ms\n", total / frameTimes.size(), percentile(frameTimes, 0.5), percentile(frameTimes, 0.95), frameTimes.back());
+	printf("First loop: mean %.3f ms\n", firstLoopTotal / replay.firstLoopTimes.size());
+	printf("bgfx submits per frame: %.1f, draws merged per frame: %.1f\n", double(target.submits) / timedFrames, double(target.mergedDraws) / timedFrames);
+
+	if (replay.missingTextureBinds) printf("%u binds of textures created before the capture started\n", replay.missingTextureBinds);
+
+	newRenderer.deleteTexture(missingTexture);
+	newRenderer.shutdown();
+
+	close_applog();
+
+	return 0;
+}